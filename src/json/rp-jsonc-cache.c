@@ -0,0 +1,861 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "rp-jsonc-cache.h"
+#include "rp-jsonc.h"
+#include "../misc/sha1.h"
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/**
+ * Magic identifier of cache files
+ */
+static const char magic[8] = "RPJCACHE";
+
+/** version of the format of cache files */
+#define VERSION		1
+
+/** marker of the byte order of the writer */
+#define BYTE_ORDER_MARK	0x01020304
+
+/** extension of cache files */
+#define EXTENSION	".rpjc"
+
+/** maximum length of cache file names */
+#define NAMELEN		40
+
+/**
+ * Delay in seconds after the modification of a file during which its
+ * cache is not written when its content is not hashed: a modification
+ * within the same timestamp granularity would not be detected
+ */
+#define RACY_DELAY	2
+
+/**
+ * Tags of the serialized values
+ */
+#define TAG_NULL	'n'
+#define TAG_FALSE	'f'
+#define TAG_TRUE	't'
+#define TAG_INT		'i'
+#define TAG_DOUBLE	'd'
+#define TAG_STRING	's'
+#define TAG_ARRAY	'a'
+#define TAG_OBJECT	'o'
+
+/**
+ * Header of cache files, in native byte order.
+ *
+ * Serialized values follow the header. Scalar values are the tag
+ * followed by 8 bytes for numbers. Strings are the tag, the 32 bits
+ * length, the bytes and a terminating nul. Arrays and objects are the tag,
+ * the 32 bits count of items, the 32 bits length in bytes of the
+ * items and the items. Items of objects are the key, serialized
+ * like strings but without tag, followed by the value.
+ */
+struct header
+{
+	/** the magic */
+	char magic[8];
+	/** the version */
+	uint32_t version;
+	/** the byte order marker */
+	uint32_t order;
+	/** device of the source file */
+	uint64_t dev;
+	/** inode of the source file */
+	uint64_t ino;
+	/** size of the source file */
+	uint64_t size;
+	/** seconds of the modification time of the source file */
+	int64_t mtsec;
+	/** nanoseconds of the modification time of the source file */
+	uint32_t mtnsec;
+	/** not zero if sha1 is set */
+	uint32_t hashed;
+	/** SHA1 of the content of the source file */
+	uint8_t sha1[SHA1_DIGEST_LENGTH];
+	/** length of the data following the header */
+	uint32_t datalen;
+};
+
+/**
+ * The cache handle
+ */
+struct rp_jsonc_cache
+{
+	/** start of the serialized data */
+	const char *data;
+	/** end of the serialized data */
+	const char *end;
+	/** the mapping or NULL */
+	void *map;
+	/** length of the mapping */
+	size_t maplen;
+	/** the allocated buffer or NULL */
+	char *buffer;
+};
+
+/**
+ * Growable buffer for serializing
+ */
+struct buf
+{
+	/** the data */
+	char *data;
+	/** length of the data */
+	size_t length;
+	/** allocated size */
+	size_t size;
+	/** error status */
+	int error;
+};
+
+/*********************************************************************/
+/* SERIALIZING                                                       */
+/*********************************************************************/
+
+/**
+ * Reserves count bytes at the end of buf
+ *
+ * @param buf the buffer
+ * @param count count of bytes to reserve
+ *
+ * @return the offset of the reserved bytes or (size_t)-1 on error
+ */
+static size_t buf_reserve(struct buf *buf, size_t count)
+{
+	size_t pos, sz;
+	char *data;
+
+	if (buf->error)
+		return (size_t)-1;
+	pos = buf->length;
+	if (count > buf->size - pos) {
+		sz = buf->size ? buf->size : 4096;
+		while (count > sz - pos)
+			sz <<= 1;
+		data = realloc(buf->data, sz);
+		if (data == NULL) {
+			buf->error = -ENOMEM;
+			return (size_t)-1;
+		}
+		buf->data = data;
+		buf->size = sz;
+	}
+	buf->length = pos + count;
+	return pos;
+}
+
+/**
+ * Appends bytes to buf
+ */
+static void buf_put(struct buf *buf, const void *data, size_t length)
+{
+	size_t pos = buf_reserve(buf, length);
+	if (pos != (size_t)-1)
+		memcpy(&buf->data[pos], data, length);
+}
+
+/**
+ * Writes the 32 bits value at position pos of buf
+ */
+static void buf_set32(struct buf *buf, size_t pos, size_t value)
+{
+	uint32_t v = (uint32_t)value;
+	if (value != (size_t)v) {
+		if (!buf->error)
+			buf->error = -E2BIG;
+	}
+	else if (!buf->error)
+		memcpy(&buf->data[pos], &v, sizeof v);
+}
+
+/**
+ * Appends the string of length to buf
+ */
+static void buf_string(struct buf *buf, const char *string, size_t length)
+{
+	size_t pos = buf_reserve(buf, sizeof(uint32_t));
+	if (pos != (size_t)-1) {
+		buf_set32(buf, pos, length);
+		buf_put(buf, string, length);
+		buf_put(buf, "", 1);
+	}
+}
+
+/**
+ * Appends the serialization of object to buf
+ */
+static void serialize(struct buf *buf, struct json_object *object)
+{
+	char tag;
+	int64_t i;
+	double d;
+	size_t pos, count;
+	rp_jsonc_index_t idx, len;
+	struct json_object_iterator it, end;
+	const char *key;
+
+	switch (json_object_get_type(object)) {
+	case json_type_boolean:
+		tag = json_object_get_boolean(object) ? TAG_TRUE : TAG_FALSE;
+		buf_put(buf, &tag, 1);
+		break;
+	case json_type_int:
+		tag = TAG_INT;
+		i = json_object_get_int64(object);
+		buf_put(buf, &tag, 1);
+		buf_put(buf, &i, sizeof i);
+		break;
+	case json_type_double:
+		tag = TAG_DOUBLE;
+		d = json_object_get_double(object);
+		buf_put(buf, &tag, 1);
+		buf_put(buf, &d, sizeof d);
+		break;
+	case json_type_string:
+		tag = TAG_STRING;
+		buf_put(buf, &tag, 1);
+		buf_string(buf, json_object_get_string(object),
+				(size_t)json_object_get_string_len(object));
+		break;
+	case json_type_array:
+		tag = TAG_ARRAY;
+		buf_put(buf, &tag, 1);
+		pos = buf_reserve(buf, 2 * sizeof(uint32_t));
+		len = (rp_jsonc_index_t)json_object_array_length(object);
+		for (idx = 0 ; idx < len ; idx++)
+			serialize(buf, json_object_array_get_idx(object, idx));
+		if (pos != (size_t)-1) {
+			buf_set32(buf, pos, (size_t)len);
+			buf_set32(buf, pos + sizeof(uint32_t), buf->length - pos - 2 * sizeof(uint32_t));
+		}
+		break;
+	case json_type_object:
+		tag = TAG_OBJECT;
+		buf_put(buf, &tag, 1);
+		pos = buf_reserve(buf, 2 * sizeof(uint32_t));
+		count = 0;
+		it = json_object_iter_begin(object);
+		end = json_object_iter_end(object);
+		while (!json_object_iter_equal(&it, &end)) {
+			key = json_object_iter_peek_name(&it);
+			buf_string(buf, key, strlen(key));
+			serialize(buf, json_object_iter_peek_value(&it));
+			json_object_iter_next(&it);
+			count++;
+		}
+		if (pos != (size_t)-1) {
+			buf_set32(buf, pos, count);
+			buf_set32(buf, pos + sizeof(uint32_t), buf->length - pos - 2 * sizeof(uint32_t));
+		}
+		break;
+	case json_type_null:
+	default:
+		tag = TAG_NULL;
+		buf_put(buf, &tag, 1);
+		break;
+	}
+}
+
+/*********************************************************************/
+/* DESERIALIZING                                                     */
+/*********************************************************************/
+
+/**
+ * Reads the 32 bits value at pos
+ */
+static uint32_t get32(const char *pos)
+{
+	uint32_t v;
+	memcpy(&v, pos, sizeof v);
+	return v;
+}
+
+/**
+ * Checks the string at pos, not after end, and returns its length
+ * in *length and the position following it.
+ *
+ * @return the position after the string or NULL if corrupted
+ */
+static const char *get_string(const char *pos, const char *end, size_t *length)
+{
+	size_t len;
+
+	if ((size_t)(end - pos) < sizeof(uint32_t))
+		return NULL;
+	len = get32(pos);
+	pos += sizeof(uint32_t);
+	if ((size_t)(end - pos) <= len || pos[len])
+		return NULL;
+	*length = len;
+	return &pos[len + 1];
+}
+
+/**
+ * Skips the value at pos, not after end
+ *
+ * @return the position after the value or NULL if corrupted
+ */
+static const char *skip(const char *pos, const char *end)
+{
+	size_t len;
+
+	if (pos >= end)
+		return NULL;
+	switch (*pos++) {
+	case TAG_NULL:
+	case TAG_FALSE:
+	case TAG_TRUE:
+		return pos;
+	case TAG_INT:
+	case TAG_DOUBLE:
+		return (size_t)(end - pos) < sizeof(int64_t) ? NULL : &pos[sizeof(int64_t)];
+	case TAG_STRING:
+		return get_string(pos, end, &len);
+	case TAG_ARRAY:
+	case TAG_OBJECT:
+		if ((size_t)(end - pos) < 2 * sizeof(uint32_t))
+			return NULL;
+		len = get32(&pos[sizeof(uint32_t)]);
+		pos += 2 * sizeof(uint32_t);
+		return (size_t)(end - pos) < len ? NULL : &pos[len];
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * Decodes the value at pos, not after end, to *result
+ *
+ * @return the position after the value or NULL on error
+ *         with *rc set to a negative error code
+ */
+static const char *decode(const char *pos, const char *end, struct json_object **result, int *rc)
+{
+	const char *next, *key;
+	struct json_object *object, *item;
+	int64_t i;
+	double d;
+	uint32_t count;
+	size_t len;
+
+	*result = NULL;
+	next = skip(pos, end);
+	if (next == NULL) {
+		*rc = -EBADMSG;
+		return NULL;
+	}
+	switch (*pos++) {
+	case TAG_NULL:
+		return next;
+	case TAG_FALSE:
+		object = json_object_new_boolean(0);
+		break;
+	case TAG_TRUE:
+		object = json_object_new_boolean(1);
+		break;
+	case TAG_INT:
+		memcpy(&i, pos, sizeof i);
+		object = json_object_new_int64(i);
+		break;
+	case TAG_DOUBLE:
+		memcpy(&d, pos, sizeof d);
+		object = json_object_new_double(d);
+		break;
+	case TAG_STRING:
+		object = json_object_new_string_len(&pos[sizeof(uint32_t)], (int)get32(pos));
+		break;
+	case TAG_ARRAY:
+		count = get32(pos);
+		pos += 2 * sizeof(uint32_t);
+		object = json_object_new_array();
+		for ( ; object != NULL && count ; count--) {
+			pos = decode(pos, next, &item, rc);
+			if (pos == NULL) {
+				json_object_put(object);
+				return NULL;
+			}
+			if (json_object_array_add(object, item) < 0) {
+				json_object_put(item);
+				json_object_put(object);
+				object = NULL;
+			}
+		}
+		break;
+	case TAG_OBJECT:
+		count = get32(pos);
+		pos += 2 * sizeof(uint32_t);
+		object = json_object_new_object();
+		for ( ; object != NULL && count ; count--) {
+			key = &pos[sizeof(uint32_t)];
+			pos = get_string(pos, next, &len);
+			if (pos == NULL) {
+				*rc = -EBADMSG;
+				json_object_put(object);
+				return NULL;
+			}
+			pos = decode(pos, next, &item, rc);
+			if (pos == NULL) {
+				json_object_put(object);
+				return NULL;
+			}
+			if (json_object_object_add(object, key, item) < 0) {
+				json_object_put(item);
+				json_object_put(object);
+				object = NULL;
+			}
+		}
+		break;
+	default:
+		object = NULL;
+		break;
+	}
+	if (object == NULL) {
+		*rc = -ENOMEM;
+		return NULL;
+	}
+	*result = object;
+	return next;
+}
+
+/**
+ * Compares the key of length with the escaped token of the pointer
+ * ending at stop
+ *
+ * @return 1 if matching or 0 otherwise
+ */
+static int match_token(const char *key, size_t length, const char *token, const char *stop)
+{
+	while (token != stop) {
+		if (!length--)
+			return 0;
+		if (*token != '~') {
+			if (*key++ != *token++)
+				return 0;
+		}
+		else if (*key++ != (token[1] == '0' ? '~' : '/'))
+			return 0;
+		else
+			token += 2;
+	}
+	return !length;
+}
+
+/**
+ * Locates in the value at pos, not after end, the item of the token
+ * ending at stop
+ *
+ * @return the position of the item or NULL if not found
+ *         with *rc set to a negative error code
+ */
+static const char *locate(const char *pos, const char *end, const char *token, const char *stop, int *rc)
+{
+	const char *next, *key;
+	uint32_t count;
+	size_t len, idx;
+
+	next = skip(pos, end);
+	if (next == NULL) {
+		*rc = -EBADMSG;
+		return NULL;
+	}
+	*rc = -ENOENT;
+	switch (*pos++) {
+	case TAG_ARRAY:
+		if (token == stop || (*token == '0' && stop - token > 1))
+			return NULL;
+		for (idx = 0 ; token != stop ; token++) {
+			if (*token < '0' || *token > '9' || idx > (SIZE_MAX - 9) / 10)
+				return NULL;
+			idx = idx * 10 + (size_t)(*token - '0');
+		}
+		count = get32(pos);
+		if (idx >= count)
+			return NULL;
+		pos += 2 * sizeof(uint32_t);
+		while (idx-- && pos != NULL)
+			pos = skip(pos, next);
+		break;
+	case TAG_OBJECT:
+		count = get32(pos);
+		pos += 2 * sizeof(uint32_t);
+		for ( ; count ; count--) {
+			key = &pos[sizeof(uint32_t)];
+			pos = get_string(pos, next, &len);
+			if (pos == NULL)
+				break;
+			if (match_token(key, len, token, stop))
+				return pos;
+			pos = skip(pos, next);
+			if (pos == NULL)
+				break;
+		}
+		if (count == 0)
+			return NULL;
+		break;
+	default:
+		return NULL;
+	}
+	if (pos == NULL)
+		*rc = -EBADMSG;
+	return pos;
+}
+
+/* see rp-jsonc-cache.h */
+int rp_jsonc_cache_get(rp_jsonc_cache_t *cache, const char *pointer, struct json_object **result)
+{
+	const char *pos, *stop, *iter;
+	int rc;
+
+	*result = NULL;
+	if (*pointer && *pointer != '/')
+		return -EINVAL;
+
+	pos = cache->data;
+	while (*pointer) {
+		stop = ++pointer;
+		while (*stop && *stop != '/')
+			stop++;
+		for (iter = pointer ; iter != stop ; iter++)
+			if (*iter == '~' && iter[1] != '0' && iter[1] != '1')
+				return -EINVAL;
+		pos = locate(pos, cache->end, pointer, stop, &rc);
+		if (pos == NULL)
+			return rc;
+		pointer = stop;
+	}
+	rc = 0;
+	decode(pos, cache->end, result, &rc);
+	return rc;
+}
+
+/*********************************************************************/
+/* CACHE FILES                                                       */
+/*********************************************************************/
+
+/**
+ * Reads the content of the file fd of size, computes its hash in sha1
+ * if not NULL and returns the nul terminated content in *content
+ * if not NULL
+ *
+ * @return 0 on success or a negative error code
+ */
+static int read_file(int fd, size_t size, uint8_t sha1[SHA1_DIGEST_LENGTH], char **content)
+{
+	SHA1_t ctx;
+	char *buffer;
+	ssize_t rc;
+	size_t length;
+
+	buffer = malloc(size + 1);
+	if (buffer == NULL)
+		return -ENOMEM;
+	for (length = 0 ; length < size ; length += (size_t)rc) {
+		rc = pread(fd, &buffer[length], size - length, (off_t)length);
+		if (rc <= 0) {
+			if (rc < 0 && errno == EINTR) {
+				rc = 0;
+				continue;
+			}
+			free(buffer);
+			return rc < 0 ? -errno : -EIO;
+		}
+	}
+	buffer[size] = 0;
+	if (sha1 != NULL) {
+		SHA1_init(&ctx);
+		SHA1_update(&ctx, buffer, size);
+		SHA1_final(&ctx, sha1);
+	}
+	if (content != NULL)
+		*content = buffer;
+	else
+		free(buffer);
+	return 0;
+}
+
+/**
+ * Default parser of JSON text
+ */
+static int parse_json(const char *content, struct json_object **result)
+{
+	enum json_tokener_error jerr;
+
+	*result = json_tokener_parse_verbose(content, &jerr);
+	return jerr == json_tokener_success ? 0 : -EBADMSG;
+}
+
+/**
+ * Checks if the header of the cache file matches the source file
+ */
+static int is_valid(const struct header *head, size_t length, const struct header *ref)
+{
+	return length >= sizeof *head
+	    && !memcmp(head, ref, offsetof(struct header, datalen))
+	    && head->datalen == length - sizeof *head;
+}
+
+/**
+ * Maps the cache file and returns 1 if valid for the header ref
+ * or returns 0 otherwise
+ */
+static int map_cache(rp_jsonc_cache_t *cache, int dfd, const char *name, const struct header *ref)
+{
+	int fd;
+	struct stat st;
+	void *map;
+
+	fd = openat(dfd, name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof *ref) {
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+	if (!is_valid(map, (size_t)st.st_size, ref)) {
+		munmap(map, (size_t)st.st_size);
+		return 0;
+	}
+	cache->map = map;
+	cache->maplen = (size_t)st.st_size;
+	cache->data = (const char*)map + sizeof *ref;
+	cache->end = (const char*)map + cache->maplen;
+	return 1;
+}
+
+/**
+ * Writes atomically the cache file, errors are ignored
+ */
+static void write_cache(int dfd, const char *name, const char *data, size_t length)
+{
+	char tmpname[NAMELEN + 8];
+	unsigned count;
+	ssize_t rc;
+	size_t pos;
+	int fd;
+
+	for (count = 0 ; ; count++) {
+		snprintf(tmpname, sizeof tmpname, "%s.%x%x", name, (unsigned)getpid() & 0xffff, count);
+		fd = openat(dfd, tmpname, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+		if (fd >= 0)
+			break;
+		if (errno != EEXIST || count >= 15)
+			return;
+	}
+	for (pos = 0 ; pos < length ; pos += (size_t)rc) {
+		rc = write(fd, &data[pos], length - pos);
+		if (rc < 0 && errno == EINTR)
+			rc = 0;
+		else if (rc <= 0)
+			break;
+	}
+	if (close(fd) < 0 || pos < length || renameat(dfd, tmpname, dfd, name) < 0)
+		unlinkat(dfd, tmpname, 0);
+}
+
+/**
+ * Checks if the modification time of the header is too recent for
+ * detecting a later modification of the same size
+ */
+static int is_racy(const struct header *head)
+{
+	struct timespec now;
+
+	if (head->hashed)
+		return 0;
+	if (clock_gettime(CLOCK_REALTIME, &now) < 0)
+		return 1;
+	return (int64_t)now.tv_sec - head->mtsec < RACY_DELAY;
+}
+
+/* see rp-jsonc-cache.h */
+int rp_jsonc_cache_open(
+		rp_jsonc_cache_t **result,
+		const char *path,
+		const char *cachedir,
+		unsigned flags,
+		rp_jsonc_cache_parse_cb parse,
+		void *closure
+) {
+	int rc, fd, dfd;
+	struct stat st;
+	struct header head;
+	struct buf buf;
+	char name[NAMELEN], *content;
+	struct json_object *object;
+	rp_jsonc_cache_t *cache;
+
+	*result = NULL;
+	cache = calloc(1, sizeof *cache);
+	if (cache == NULL)
+		return -ENOMEM;
+
+	/* compute the identity of the file */
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		rc = -errno;
+		goto error;
+	}
+	if (fstat(fd, &st) < 0) {
+		rc = -errno;
+		close(fd);
+		goto error;
+	}
+	memset(&head, 0, sizeof head);
+	memcpy(head.magic, magic, sizeof head.magic);
+	head.version = VERSION;
+	head.order = BYTE_ORDER_MARK;
+	head.dev = (uint64_t)st.st_dev;
+	head.ino = (uint64_t)st.st_ino;
+	head.size = (uint64_t)st.st_size;
+	head.mtsec = (int64_t)st.st_mtim.tv_sec;
+	head.mtnsec = (uint32_t)st.st_mtim.tv_nsec;
+	content = NULL;
+	if (flags & RP_JSONC_CACHE_HASH) {
+		head.hashed = 1;
+		rc = read_file(fd, (size_t)st.st_size, head.sha1, parse ? NULL : &content);
+		if (rc < 0) {
+			close(fd);
+			goto error;
+		}
+	}
+
+	/* search a valid cache */
+	snprintf(name, sizeof name, "%llx-%llx" EXTENSION,
+			(unsigned long long)head.dev, (unsigned long long)head.ino);
+	dfd = open(cachedir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dfd >= 0 && map_cache(cache, dfd, name, &head)) {
+		free(content);
+		close(fd);
+		close(dfd);
+		*result = cache;
+		return 0;
+	}
+
+	/* parse the file */
+	if (parse != NULL)
+		rc = parse(closure, path, &object);
+	else {
+		rc = content != NULL ? 0 : read_file(fd, (size_t)st.st_size, NULL, &content);
+		if (rc >= 0)
+			rc = parse_json(content, &object);
+		free(content);
+	}
+	if (rc < 0) {
+		close(fd);
+		if (dfd >= 0)
+			close(dfd);
+		goto error;
+	}
+
+	/* serialize it */
+	memset(&buf, 0, sizeof buf);
+	buf_put(&buf, &head, sizeof head);
+	serialize(&buf, object);
+	json_object_put(object);
+	if (buf.error) {
+		rc = buf.error;
+		free(buf.data);
+		close(fd);
+		if (dfd >= 0)
+			close(dfd);
+		goto error;
+	}
+	buf_set32(&buf, offsetof(struct header, datalen), buf.length - sizeof head);
+
+	/* record it if the file was not modified meanwhile nor too recently */
+	if (dfd >= 0) {
+		if (!buf.error
+		 && !is_racy(&head)
+		 && fstat(fd, &st) == 0
+		 && head.size == (uint64_t)st.st_size
+		 && head.mtsec == (int64_t)st.st_mtim.tv_sec
+		 && head.mtnsec == (uint32_t)st.st_mtim.tv_nsec)
+			write_cache(dfd, name, buf.data, buf.length);
+		close(dfd);
+	}
+	close(fd);
+	if (buf.error) {
+		rc = buf.error;
+		free(buf.data);
+		goto error;
+	}
+	cache->buffer = buf.data;
+	cache->data = &buf.data[sizeof head];
+	cache->end = &buf.data[buf.length];
+	*result = cache;
+	return 0;
+
+error:
+	free(cache);
+	return rc;
+}
+
+/* see rp-jsonc-cache.h */
+void rp_jsonc_cache_close(rp_jsonc_cache_t *cache)
+{
+	if (cache != NULL) {
+		if (cache->map != NULL)
+			munmap(cache->map, cache->maplen);
+		free(cache->buffer);
+		free(cache);
+	}
+}
+
+/* see rp-jsonc-cache.h */
+int rp_jsonc_cache_load(
+		struct json_object **result,
+		const char *path,
+		const char *cachedir,
+		unsigned flags,
+		rp_jsonc_cache_parse_cb parse,
+		void *closure
+) {
+	rp_jsonc_cache_t *cache;
+	int rc;
+
+	*result = NULL;
+	rc = rp_jsonc_cache_open(&cache, path, cachedir, flags, parse, closure);
+	if (rc >= 0) {
+		rc = rp_jsonc_cache_get(cache, "", result);
+		rp_jsonc_cache_close(cache);
+	}
+	return rc;
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <json-c/json.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * Flag for checking the SHA1 of the content of the parsed file
+ * in addition to its identity (device, inode, modification time, size)
+ */
+#define RP_JSONC_CACHE_HASH	1
+
+/**
+ * Handle to a cached parsed file, either mapped from the cache file
+ * or held in memory when the cache file could not be written.
+ */
+typedef struct rp_jsonc_cache rp_jsonc_cache_t;
+
+/**
+ * Callback function for parsing the file when the cache is stale
+ *
+ * @param closure the closure given with the callback
+ * @param path    path of the file to parse
+ * @param result  where to store the parsed result
+ *
+ * @return 0 on success or a negative error code
+ */
+typedef int (*rp_jsonc_cache_parse_cb)(void *closure, const char *path, struct json_object **result);
+
+/**
+ * Opens the cached parsed content of the file of path.
+ *
+ * The cache of the file is searched in the directory cachedir
+ * using the identity of the file (device and inode). It is valid
+ * when it records the same modification time and size as the file,
+ * and the same SHA1 of its content when flags has RP_JSONC_CACHE_HASH.
+ *
+ * When the cache is valid, it is mapped in memory with a single mmap and
+ * nothing else is decoded. Otherwise, the file is parsed using the callback
+ * parse, or as JSON text if parse is NULL, and the cache is written.
+ *
+ * Without RP_JSONC_CACHE_HASH, a modification that keeps the size and
+ * happens within the granularity of the modification time could not be
+ * detected. For this reason, the cache is not written when the file was
+ * modified less than 2 seconds before.
+ *
+ * @param cache    where to store the opened handle
+ * @param path     path of the file
+ * @param cachedir directory of the cache files
+ * @param flags    0 or RP_JSONC_CACHE_HASH
+ * @param parse    the parsing function or NULL for JSON files
+ * @param closure  the closure of the parsing function
+ *
+ * @return 0 on success or a negative error code
+ */
+extern int rp_jsonc_cache_open(
+		rp_jsonc_cache_t **cache,
+		const char *path,
+		const char *cachedir,
+		unsigned flags,
+		rp_jsonc_cache_parse_cb parse,
+		void *closure);
+
+/**
+ * Decodes the object of the cache designated by the JSON pointer.
+ * Only the designated object is decoded, its siblings and parents are
+ * skipped.
+ *
+ * @param cache   the cache handle
+ * @param pointer the RFC 6901 JSON pointer of the object, "" for the root
+ * @param result  where to store the decoded object
+ *
+ * @return 0 on success, -ENOENT if pointer designates nothing,
+ *         -EINVAL if pointer is invalid, -EBADMSG if the cache is corrupted
+ *         or -ENOMEM
+ */
+extern int rp_jsonc_cache_get(rp_jsonc_cache_t *cache, const char *pointer, struct json_object **result);
+
+/**
+ * Closes the cache handle
+ *
+ * @param cache the cache handle to close (can be NULL)
+ */
+extern void rp_jsonc_cache_close(rp_jsonc_cache_t *cache);
+
+/**
+ * Gets the parsed content of the file of path using its cache.
+ * This is the same as calling @see rp_jsonc_cache_open,
+ * @see rp_jsonc_cache_get with pointer "" and @see rp_jsonc_cache_close
+ *
+ * @param result   where to store the parsed content
+ * @param path     path of the file
+ * @param cachedir directory of the cache files
+ * @param flags    0 or RP_JSONC_CACHE_HASH
+ * @param parse    the parsing function or NULL for JSON files
+ * @param closure  the closure of the parsing function
+ *
+ * @return 0 on success or a negative error code
+ */
+extern int rp_jsonc_cache_load(
+		struct json_object **result,
+		const char *path,
+		const char *cachedir,
+		unsigned flags,
+		rp_jsonc_cache_parse_cb parse,
+		void *closure);
+
+#ifdef	__cplusplus
+}
+#endif
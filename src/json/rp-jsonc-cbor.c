@@ -0,0 +1,792 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "rp-jsonc-cbor.h"
+#include "rp-jsonc.h"
+#include "../misc/rp-base64.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <errno.h>
+
+/**
+ * Major types of CBOR
+ */
+#define MAJOR_UINT	0
+#define MAJOR_NINT	1
+#define MAJOR_BYTES	2
+#define MAJOR_TEXT	3
+#define MAJOR_ARRAY	4
+#define MAJOR_MAP	5
+#define MAJOR_TAG	6
+#define MAJOR_SIMPLE	7
+
+/**
+ * Additional informations of CBOR
+ */
+#define INFO_FALSE	20
+#define INFO_TRUE	21
+#define INFO_NULL	22
+#define INFO_SIMPLE	24
+#define INFO_HALF	25
+#define INFO_FLOAT	26
+#define INFO_DOUBLE	27
+#define INFO_INDEFINITE	31
+
+/** the break code */
+#define BREAK		0xff
+
+/** strings longer than this are referenced instead of copied */
+#define REF_THRESHOLD	64
+
+/** maximum depth of nested items when decoding */
+#define MAX_DEPTH	512
+
+/** size of the buffer for short keys */
+#define KEY_BUFSZ	128
+
+/**
+ * Segment of the encoding
+ */
+struct segment
+{
+	/** referenced data or NULL for the encoder's bytes */
+	const char *ref;
+	/** offset in encoder's bytes when ref is NULL */
+	size_t offset;
+	/** length of the segment */
+	size_t length;
+};
+
+/**
+ * The encoder
+ */
+struct rp_jsonc_cbor_encoder
+{
+	/** the encoded bytes */
+	char *bytes;
+	/** length of encoded bytes */
+	size_t length;
+	/** allocated size of bytes */
+	size_t size;
+	/** the segments */
+	struct segment *segments;
+	/** count of segments */
+	int nsegs;
+	/** allocated count of segments */
+	int ssegs;
+	/** the iovec built for the segments */
+	struct iovec *iov;
+	/** allocated count of iov */
+	int siov;
+	/** total length of the encoding */
+	size_t total;
+	/** error status */
+	int error;
+};
+
+/*********************************************************************/
+/* ENCODING                                                          */
+/*********************************************************************/
+
+/**
+ * Adds a new segment to the encoder
+ *
+ * @return the added segment or NULL on memory error
+ */
+static struct segment *add_segment(rp_jsonc_cbor_encoder_t *encoder)
+{
+	struct segment *segs;
+	int sz;
+
+	if (encoder->nsegs == encoder->ssegs) {
+		sz = encoder->ssegs ? 2 * encoder->ssegs : 8;
+		segs = realloc(encoder->segments, (size_t)sz * sizeof *segs);
+		if (segs == NULL) {
+			encoder->error = -ENOMEM;
+			return NULL;
+		}
+		encoder->segments = segs;
+		encoder->ssegs = sz;
+	}
+	return &encoder->segments[encoder->nsegs++];
+}
+
+/**
+ * Appends bytes of data to the encoding
+ */
+static void put(rp_jsonc_cbor_encoder_t *encoder, const void *data, size_t length)
+{
+	struct segment *seg;
+	size_t sz;
+	char *bytes;
+
+	if (encoder->error)
+		return;
+
+	/* ensure room */
+	if (length > encoder->size - encoder->length) {
+		sz = encoder->size ? encoder->size : 1024;
+		while (length > sz - encoder->length)
+			sz <<= 1;
+		bytes = realloc(encoder->bytes, sz);
+		if (bytes == NULL) {
+			encoder->error = -ENOMEM;
+			return;
+		}
+		encoder->bytes = bytes;
+		encoder->size = sz;
+	}
+
+	/* extend the last segment or add one */
+	seg = encoder->nsegs ? &encoder->segments[encoder->nsegs - 1] : NULL;
+	if (seg == NULL || seg->ref != NULL) {
+		seg = add_segment(encoder);
+		if (seg == NULL)
+			return;
+		seg->ref = NULL;
+		seg->offset = encoder->length;
+		seg->length = 0;
+	}
+	memcpy(&encoder->bytes[encoder->length], data, length);
+	encoder->length += length;
+	seg->length += length;
+	encoder->total += length;
+}
+
+/**
+ * Appends a reference to data of length to the encoding
+ */
+static void put_ref(rp_jsonc_cbor_encoder_t *encoder, const char *data, size_t length)
+{
+	struct segment *seg;
+
+	if (length < REF_THRESHOLD)
+		put(encoder, data, length);
+	else if (!encoder->error) {
+		seg = add_segment(encoder);
+		if (seg != NULL) {
+			seg->ref = data;
+			seg->length = length;
+			encoder->total += length;
+		}
+	}
+}
+
+/**
+ * Appends the head of major type and value
+ */
+static void put_head(rp_jsonc_cbor_encoder_t *encoder, unsigned major, uint64_t value)
+{
+	unsigned char head[9];
+	int len, i;
+
+	major <<= 5;
+	if (value < 24) {
+		head[0] = (unsigned char)(major | value);
+		len = 1;
+	}
+	else {
+		if (value <= UINT8_MAX) {
+			head[0] = (unsigned char)(major | 24);
+			len = 2;
+		}
+		else if (value <= UINT16_MAX) {
+			head[0] = (unsigned char)(major | 25);
+			len = 3;
+		}
+		else if (value <= UINT32_MAX) {
+			head[0] = (unsigned char)(major | 26);
+			len = 5;
+		}
+		else {
+			head[0] = (unsigned char)(major | 27);
+			len = 9;
+		}
+		for (i = len ; --i ; value >>= 8)
+			head[i] = (unsigned char)value;
+	}
+	put(encoder, head, (size_t)len);
+}
+
+/**
+ * Appends the simple value of info and its count bytes of value
+ */
+static void put_simple(rp_jsonc_cbor_encoder_t *encoder, unsigned info, uint64_t value, int count)
+{
+	unsigned char head[9];
+	int i;
+
+	head[0] = (unsigned char)(MAJOR_SIMPLE << 5 | info);
+	for (i = count ; i ; value >>= 8)
+		head[i--] = (unsigned char)value;
+	put(encoder, head, (size_t)count + 1);
+}
+
+/**
+ * Appends the double value, as a single precision float if lossless
+ */
+static void put_double(rp_jsonc_cbor_encoder_t *encoder, double value)
+{
+	union { float f; uint32_t u; } f;
+	union { double d; uint64_t u; } d;
+
+	f.f = (float)value;
+	if ((double)f.f == value || isnan(value))
+		put_simple(encoder, INFO_FLOAT, f.u, 4);
+	else {
+		d.d = value;
+		put_simple(encoder, INFO_DOUBLE, d.u, 8);
+	}
+}
+
+/**
+ * Appends the encoding of the object
+ */
+static void encode(rp_jsonc_cbor_encoder_t *encoder, struct json_object *object)
+{
+	struct json_object_iterator it, end;
+	rp_jsonc_index_t idx, len;
+	const char *key;
+	int64_t i;
+
+	switch (json_object_get_type(object)) {
+	case json_type_boolean:
+		put_head(encoder, MAJOR_SIMPLE, json_object_get_boolean(object) ? INFO_TRUE : INFO_FALSE);
+		break;
+	case json_type_int:
+		i = json_object_get_int64(object);
+		if (i >= 0)
+			put_head(encoder, MAJOR_UINT, (uint64_t)i);
+		else
+			put_head(encoder, MAJOR_NINT, ~(uint64_t)i);
+		break;
+	case json_type_double:
+		put_double(encoder, json_object_get_double(object));
+		break;
+	case json_type_string:
+		len = (rp_jsonc_index_t)json_object_get_string_len(object);
+		put_head(encoder, MAJOR_TEXT, (uint64_t)len);
+		put_ref(encoder, json_object_get_string(object), (size_t)len);
+		break;
+	case json_type_array:
+		len = (rp_jsonc_index_t)json_object_array_length(object);
+		put_head(encoder, MAJOR_ARRAY, (uint64_t)len);
+		for (idx = 0 ; idx < len ; idx++)
+			encode(encoder, json_object_array_get_idx(object, idx));
+		break;
+	case json_type_object:
+		put_head(encoder, MAJOR_MAP, (uint64_t)json_object_object_length(object));
+		it = json_object_iter_begin(object);
+		end = json_object_iter_end(object);
+		while (!json_object_iter_equal(&it, &end)) {
+			key = json_object_iter_peek_name(&it);
+			len = (rp_jsonc_index_t)strlen(key);
+			put_head(encoder, MAJOR_TEXT, (uint64_t)len);
+			put_ref(encoder, key, (size_t)len);
+			encode(encoder, json_object_iter_peek_value(&it));
+			json_object_iter_next(&it);
+		}
+		break;
+	case json_type_null:
+	default:
+		put_head(encoder, MAJOR_SIMPLE, INFO_NULL);
+		break;
+	}
+}
+
+/* see rp-jsonc-cbor.h */
+int rp_jsonc_cbor_encoder_create(rp_jsonc_cbor_encoder_t **encoder)
+{
+	*encoder = calloc(1, sizeof **encoder);
+	return *encoder == NULL ? -ENOMEM : 0;
+}
+
+/* see rp-jsonc-cbor.h */
+void rp_jsonc_cbor_encoder_destroy(rp_jsonc_cbor_encoder_t *encoder)
+{
+	if (encoder != NULL) {
+		free(encoder->bytes);
+		free(encoder->segments);
+		free(encoder->iov);
+		free(encoder);
+	}
+}
+
+/* see rp-jsonc-cbor.h */
+void rp_jsonc_cbor_encoder_reset(rp_jsonc_cbor_encoder_t *encoder)
+{
+	encoder->length = 0;
+	encoder->nsegs = 0;
+	encoder->total = 0;
+	encoder->error = 0;
+}
+
+/* see rp-jsonc-cbor.h */
+int rp_jsonc_cbor_encoder_add(rp_jsonc_cbor_encoder_t *encoder, struct json_object *object)
+{
+	encode(encoder, object);
+	return encoder->error;
+}
+
+/* see rp-jsonc-cbor.h */
+int rp_jsonc_cbor_encoder_iovec(rp_jsonc_cbor_encoder_t *encoder, const struct iovec **iov, size_t *length)
+{
+	struct segment *seg;
+	struct iovec *v;
+	int i;
+
+	if (encoder->error || encoder->nsegs == 0) {
+		*iov = NULL;
+		if (length != NULL)
+			*length = 0;
+		return encoder->error;
+	}
+	if (encoder->nsegs > encoder->siov) {
+		v = realloc(encoder->iov, (size_t)encoder->ssegs * sizeof *v);
+		if (v == NULL) {
+			*iov = NULL;
+			return -ENOMEM;
+		}
+		encoder->iov = v;
+		encoder->siov = encoder->ssegs;
+	}
+	v = encoder->iov;
+	for (i = 0 ; i < encoder->nsegs ; i++) {
+		seg = &encoder->segments[i];
+		v[i].iov_base = (void*)(seg->ref != NULL ? seg->ref : &encoder->bytes[seg->offset]);
+		v[i].iov_len = seg->length;
+	}
+	*iov = v;
+	if (length != NULL)
+		*length = encoder->total;
+	return encoder->nsegs;
+}
+
+/* see rp-jsonc-cbor.h */
+int rp_jsonc_cbor_encode(struct json_object *object, void **data, size_t *length)
+{
+	rp_jsonc_cbor_encoder_t encoder;
+	struct segment *seg;
+	char *result, *iter;
+	int i;
+
+	memset(&encoder, 0, sizeof encoder);
+	encode(&encoder, object);
+	result = encoder.error ? NULL : malloc(encoder.total ? encoder.total : 1);
+	if (result != NULL) {
+		for (iter = result, i = 0 ; i < encoder.nsegs ; i++) {
+			seg = &encoder.segments[i];
+			memcpy(iter, seg->ref != NULL ? seg->ref : &encoder.bytes[seg->offset], seg->length);
+			iter += seg->length;
+		}
+	}
+	*data = result;
+	*length = result == NULL ? 0 : encoder.total;
+	free(encoder.bytes);
+	free(encoder.segments);
+	return result == NULL ? -ENOMEM : 0;
+}
+
+/*********************************************************************/
+/* DECODING                                                          */
+/*********************************************************************/
+
+/**
+ * State of decoding
+ */
+struct decoder
+{
+	/** current position */
+	const unsigned char *pos;
+	/** end of data */
+	const unsigned char *end;
+	/** current depth */
+	int depth;
+};
+
+/**
+ * Reads the head of the next item
+ *
+ * @param dec   the decoder
+ * @param major where to store the major type
+ * @param info  where to store the additional information
+ * @param value where to store the value of the head
+ *
+ * @return 0 on success or -EBADMSG
+ */
+static int get_head(struct decoder *dec, unsigned *major, unsigned *info, uint64_t *value)
+{
+	unsigned n;
+	uint64_t v;
+
+	if (dec->pos == dec->end)
+		return -EBADMSG;
+	*major = *dec->pos >> 5;
+	*info = *dec->pos++ & 31;
+	if (*info < 24)
+		v = *info;
+	else if (*info == INFO_INDEFINITE) {
+		if (*major == MAJOR_UINT || *major == MAJOR_NINT || *major == MAJOR_TAG)
+			return -EBADMSG;
+		v = 0;
+	}
+	else if (*info > 27)
+		return -EBADMSG;
+	else {
+		n = 1u << (*info - 24);
+		if ((size_t)(dec->end - dec->pos) < n)
+			return -EBADMSG;
+		for (v = 0 ; n ; n--)
+			v = (v << 8) | *dec->pos++;
+	}
+	*value = v;
+	return 0;
+}
+
+/**
+ * Reads a string of major type, definite or indefinite
+ *
+ * @param dec    the decoder
+ * @param major  the major type of the string
+ * @param info   the additional information of its head
+ * @param value  the value of its head
+ * @param data   where to store the pointer to the string
+ * @param length where to store the length of the string
+ * @param alloc  where to store the allocated buffer holding the string
+ *               if any, this buffer has room for a trailing nul
+ *
+ * @return 0 on success, -EBADMSG or -ENOMEM
+ */
+static int get_string(
+		struct decoder *dec,
+		unsigned major,
+		unsigned info,
+		uint64_t value,
+		const char **data,
+		size_t *length,
+		char **alloc
+) {
+	unsigned m, i;
+	uint64_t v;
+	size_t len;
+	char *buf, *nbuf;
+	int rc;
+
+	*alloc = NULL;
+	if (info != INFO_INDEFINITE) {
+		if (value > (uint64_t)(dec->end - dec->pos))
+			return -EBADMSG;
+		*data = (const char*)dec->pos;
+		*length = (size_t)value;
+		dec->pos += value;
+		return 0;
+	}
+
+	/* concatenate the chunks */
+	buf = NULL;
+	len = 0;
+	for (;;) {
+		if (dec->pos == dec->end) {
+			rc = -EBADMSG;
+			break;
+		}
+		if (*dec->pos == BREAK) {
+			dec->pos++;
+			if (buf == NULL && (buf = malloc(1)) == NULL) {
+				rc = -ENOMEM;
+				break;
+			}
+			*data = *alloc = buf;
+			*length = len;
+			return 0;
+		}
+		rc = get_head(dec, &m, &i, &v);
+		if (rc < 0)
+			break;
+		if (m != major || i == INFO_INDEFINITE || v > (uint64_t)(dec->end - dec->pos)) {
+			rc = -EBADMSG;
+			break;
+		}
+		nbuf = realloc(buf, len + (size_t)v + 1);
+		if (nbuf == NULL) {
+			rc = -ENOMEM;
+			break;
+		}
+		buf = nbuf;
+		memcpy(&buf[len], dec->pos, (size_t)v);
+		len += (size_t)v;
+		dec->pos += v;
+	}
+	free(buf);
+	return rc;
+}
+
+/**
+ * Makes the json-c string for the string of major type
+ */
+static int make_string(unsigned major, const char *data, size_t length, struct json_object **result)
+{
+	char *b64;
+	size_t b64len;
+	int rc;
+
+	if (major == MAJOR_BYTES) {
+		rc = rp_base64_encode((const uint8_t*)data, length, &b64, &b64len, 0, 0, 1);
+		if (rc != rp_base64_ok)
+			return -ENOMEM;
+		*result = b64len > INT_MAX ? NULL : json_object_new_string_len(b64, (int)b64len);
+		free(b64);
+	}
+	else
+		*result = length > INT_MAX ? NULL : json_object_new_string_len(data, (int)length);
+	return *result == NULL ? -ENOMEM : 0;
+}
+
+/**
+ * Decodes a half precision float
+ */
+static double half(unsigned h)
+{
+	union { double d; uint64_t u; } d;
+	unsigned exp = (h >> 10) & 31, mant = h & 1023;
+
+	if (exp == 0)
+		d.d = (double)mant / 16777216.0;
+	else if (exp == 31)
+		d.d = mant ? NAN : INFINITY;
+	else
+		d.u = (uint64_t)(exp + 1008) << 52 | (uint64_t)mant << 42;
+	return h & 0x8000 ? -d.d : d.d;
+}
+
+static int decode(struct decoder *dec, struct json_object **result);
+
+/**
+ * Decodes the items of an array
+ */
+static int decode_array(struct decoder *dec, unsigned info, uint64_t count, struct json_object *array)
+{
+	struct json_object *item;
+	int rc;
+
+	for (;;) {
+		if (info == INFO_INDEFINITE) {
+			if (dec->pos == dec->end)
+				return -EBADMSG;
+			if (*dec->pos == BREAK) {
+				dec->pos++;
+				return 0;
+			}
+		}
+		else if (count-- == 0)
+			return 0;
+		rc = decode(dec, &item);
+		if (rc < 0)
+			return rc;
+		if (json_object_array_add(array, item) < 0) {
+			json_object_put(item);
+			return -ENOMEM;
+		}
+	}
+}
+
+/**
+ * Decodes the entries of a map
+ */
+static int decode_map(struct decoder *dec, unsigned info, uint64_t count, struct json_object *object)
+{
+	struct json_object *item;
+	char keybuf[KEY_BUFSZ], *alloc, *key;
+	const char *data;
+	unsigned m, i;
+	uint64_t v;
+	size_t len;
+	int rc;
+
+	for (;;) {
+		if (info == INFO_INDEFINITE) {
+			if (dec->pos == dec->end)
+				return -EBADMSG;
+			if (*dec->pos == BREAK) {
+				dec->pos++;
+				return 0;
+			}
+		}
+		else if (count-- == 0)
+			return 0;
+
+		/* get the key */
+		rc = get_head(dec, &m, &i, &v);
+		if (rc < 0)
+			return rc;
+		if (m != MAJOR_TEXT)
+			return -EBADMSG;
+		rc = get_string(dec, m, i, v, &data, &len, &alloc);
+		if (rc < 0)
+			return rc;
+		if (alloc != NULL)
+			key = alloc;
+		else if (len < sizeof keybuf)
+			key = keybuf;
+		else if ((key = alloc = malloc(len + 1)) == NULL)
+			return -ENOMEM;
+		if (key != data)
+			memcpy(key, data, len);
+		key[len] = 0;
+
+		/* get the value */
+		rc = decode(dec, &item);
+		if (rc >= 0 && json_object_object_add(object, key, item) < 0) {
+			json_object_put(item);
+			rc = -ENOMEM;
+		}
+		free(alloc);
+		if (rc < 0)
+			return rc;
+	}
+}
+
+/**
+ * Decodes the next item
+ */
+static int decode(struct decoder *dec, struct json_object **result)
+{
+	union { float f; uint32_t u; } f;
+	union { double d; uint64_t u; } d;
+	struct json_object *object;
+	const char *data;
+	char *alloc;
+	unsigned major, info;
+	uint64_t value;
+	size_t len;
+	int rc;
+
+	*result = NULL;
+	rc = get_head(dec, &major, &info, &value);
+	if (rc < 0)
+		return rc;
+	switch (major) {
+	case MAJOR_UINT:
+		object = value <= INT64_MAX
+			? json_object_new_int64((int64_t)value)
+			: json_object_new_double((double)value);
+		break;
+	case MAJOR_NINT:
+		object = value <= INT64_MAX
+			? json_object_new_int64(-1 - (int64_t)value)
+			: json_object_new_double(-1.0 - (double)value);
+		break;
+	case MAJOR_BYTES:
+	case MAJOR_TEXT:
+		rc = get_string(dec, major, info, value, &data, &len, &alloc);
+		if (rc >= 0) {
+			rc = make_string(major, data, len, result);
+			free(alloc);
+		}
+		return rc;
+	case MAJOR_ARRAY:
+	case MAJOR_MAP:
+		if (info != INFO_INDEFINITE && value > (uint64_t)(dec->end - dec->pos))
+			return -EBADMSG;
+		if (dec->depth >= MAX_DEPTH)
+			return -EBADMSG;
+		object = major == MAJOR_ARRAY ? json_object_new_array() : json_object_new_object();
+		if (object == NULL)
+			return -ENOMEM;
+		dec->depth++;
+		rc = major == MAJOR_ARRAY
+			? decode_array(dec, info, value, object)
+			: decode_map(dec, info, value, object);
+		dec->depth--;
+		if (rc < 0) {
+			json_object_put(object);
+			return rc;
+		}
+		*result = object;
+		return 0;
+	case MAJOR_TAG:
+		if (dec->depth >= MAX_DEPTH)
+			return -EBADMSG;
+		dec->depth++;
+		rc = decode(dec, result);
+		dec->depth--;
+		return rc;
+	case MAJOR_SIMPLE:
+	default:
+		switch (info) {
+		case INFO_FALSE:
+		case INFO_TRUE:
+			object = json_object_new_boolean(info == INFO_TRUE);
+			break;
+		case INFO_HALF:
+			object = json_object_new_double(half((unsigned)value));
+			break;
+		case INFO_FLOAT:
+			f.u = (uint32_t)value;
+			object = json_object_new_double((double)f.f);
+			break;
+		case INFO_DOUBLE:
+			d.u = value;
+			object = json_object_new_double(d.d);
+			break;
+		case INFO_INDEFINITE:
+			/* unexpected break */
+			return -EBADMSG;
+		default:
+			/* null, undefined and other simple values */
+			return 0;
+		}
+		break;
+	}
+	if (object == NULL)
+		return -ENOMEM;
+	*result = object;
+	return 0;
+}
+
+/* see rp-jsonc-cbor.h */
+int rp_jsonc_cbor_decode(const void *data, size_t length, struct json_object **result, size_t *consumed)
+{
+	struct decoder dec;
+	int rc;
+
+	dec.pos = data;
+	dec.end = &dec.pos[length];
+	dec.depth = 0;
+	rc = decode(&dec, result);
+	if (rc >= 0) {
+		if (consumed != NULL)
+			*consumed = (size_t)(dec.pos - (const unsigned char*)data);
+		else if (dec.pos != dec.end) {
+			json_object_put(*result);
+			*result = NULL;
+			rc = -EBADMSG;
+		}
+	}
+	return rc;
+}
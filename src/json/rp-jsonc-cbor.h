@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include <json-c/json.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * Encoder of json-c objects to CBOR (RFC 8949)
+ *
+ * The encoding is produced as a vector of buffers suitable for
+ * writev or for websocket binary frames. Long strings are not copied:
+ * the vector points to the memory of the encoded json-c objects, that
+ * must therefore be kept alive until the vector is no more used.
+ */
+typedef struct rp_jsonc_cbor_encoder rp_jsonc_cbor_encoder_t;
+
+/**
+ * Creates an encoder
+ *
+ * @param encoder where to store the created encoder
+ *
+ * @return 0 on success or -ENOMEM
+ */
+extern int rp_jsonc_cbor_encoder_create(rp_jsonc_cbor_encoder_t **encoder);
+
+/**
+ * Destroys the encoder
+ *
+ * @param encoder the encoder to destroy (can be NULL)
+ */
+extern void rp_jsonc_cbor_encoder_destroy(rp_jsonc_cbor_encoder_t *encoder);
+
+/**
+ * Resets the encoder, forgetting any previously encoded object
+ * but keeping its allocated memory for the next encodings
+ *
+ * @param encoder the encoder to reset
+ */
+extern void rp_jsonc_cbor_encoder_reset(rp_jsonc_cbor_encoder_t *encoder);
+
+/**
+ * Appends the CBOR encoding of object to the encoder.
+ * Calling it many times without reset produces a CBOR sequence (RFC 8742).
+ *
+ * @param encoder the encoder
+ * @param object  the object to encode
+ *
+ * @return 0 on success or -ENOMEM
+ */
+extern int rp_jsonc_cbor_encoder_add(rp_jsonc_cbor_encoder_t *encoder, struct json_object *object);
+
+/**
+ * Gets the vector of buffers of the encoding. The returned vector
+ * is valid until the next call to a function of the encoder.
+ *
+ * @param encoder the encoder
+ * @param iov     where to store the pointer to the vector
+ * @param length  if not NULL, where to store the total length in bytes
+ *
+ * @return the count of items in the vector
+ */
+extern int rp_jsonc_cbor_encoder_iovec(rp_jsonc_cbor_encoder_t *encoder, const struct iovec **iov, size_t *length);
+
+/**
+ * Encodes the object in CBOR to a freshly allocated buffer
+ *
+ * @param object the object to encode
+ * @param data   where to store the allocated buffer (to be freed by caller)
+ * @param length where to store the length of the encoding
+ *
+ * @return 0 on success or -ENOMEM
+ */
+extern int rp_jsonc_cbor_encode(struct json_object *object, void **data, size_t *length);
+
+/**
+ * Decodes one CBOR item from data of length.
+ *
+ * Byte strings are decoded as unpadded base64url strings, undefined and
+ * simple values as null, tags are ignored. Keys of maps must be text
+ * strings.
+ *
+ * @param data     the CBOR data
+ * @param length   length of the data
+ * @param result   where to store the decoded object
+ * @param consumed if not NULL, where to store the count of bytes decoded,
+ *                 otherwise data must contain exactly one item
+ *
+ * @return 0 on success, -EBADMSG if data is not valid or -ENOMEM
+ */
+extern int rp_jsonc_cbor_decode(const void *data, size_t length, struct json_object **result, size_t *consumed);
+
+#ifdef	__cplusplus
+}
+#endif
@@ -24,6 +24,97 @@
 
 #include "rp-jsonc-expand.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/**
+ * Record of the expansion of a string that depends on names
+ */
+struct track_rec
+{
+	/** the container of the expanded string (referenced) */
+	struct json_object *container;
+
+	/** key of the string in container or NULL if container is an array */
+	char *key;
+
+	/** index of the string if container is an array */
+	size_t index;
+
+	/** the original string before its expansion (referenced) */
+	struct json_object *source;
+
+	/** the current value in the container (not referenced) */
+	struct json_object *current;
+
+	/** the names it depends on, packed as "name\0name\0..." */
+	char *deps;
+
+	/** length of deps */
+	size_t depslen;
+
+	/** when not zero, it depends on any name */
+	int any;
+};
+
+/**
+ * Structure recording dependencies of expanded strings
+ */
+struct rp_jsonc_expand_track
+{
+	/** closure of expand_string */
+	void *closure;
+
+	/** the function for expanding strings */
+	rp_jsonc_expandcb expand_string;
+
+	/** array of the records */
+	struct track_rec *recs;
+
+	/** count of records */
+	size_t count;
+
+	/** allocated count of records */
+	size_t alloc;
+
+	/** the record in progress */
+	struct track_rec pending;
+
+	/** is recording? */
+	int recording;
+
+	/** count of expansions that could not be recorded */
+	int lost;
+
+	/**
+	 * container shared between workers, it is recorded without taking
+	 * a reference because json-c reference counts are not thread safe,
+	 * the reference is taken by track_merge
+	 */
+	struct json_object *shared;
+};
+
+/**
+ * Context of the expansion
+ */
+struct expctx
+{
+	/** the closure for the expansion functions */
+	void *closure;
+
+	/** the expansion function for objects */
+	rp_jsonc_expandcb expand_object;
+
+	/** the expansion function for strings */
+	rp_jsonc_expandcb expand_string;
+
+	/** the tracking of dependencies or NULL */
+	struct rp_jsonc_expand_track *track;
+};
+
 /**
  * Structure recording the path path of the expansion
  */
@@ -44,6 +135,53 @@ struct rp_jsonc_expand_path
 	/** key of expanded child if object is an object */
 	const char *key;
 
+	/** context of the expansion */
+	struct expctx *ctx;
+};
+
+/**
+ * Job of expanding a top level child in parallel
+ */
+struct job
+{
+	/** key of the child if parent is an object */
+	const char *key;
+
+	/** index of the child if parent is an array */
+	size_t index;
+
+	/** the child to expand */
+	struct json_object *value;
+
+	/** the result of the expansion */
+	struct json_object *result;
+};
+
+/**
+ * Worker of parallel expansion
+ */
+struct worker
+{
+	/** the thread */
+	pthread_t tid;
+
+	/** the expansion context of the worker */
+	struct expctx ctx;
+
+	/** the tracking of the worker */
+	struct rp_jsonc_expand_track track;
+
+	/** the parent of the jobs */
+	struct json_object *object;
+
+	/** the jobs */
+	struct job *jobs;
+
+	/** count of jobs */
+	size_t count;
+
+	/** shared index of the next job to process */
+	size_t *next;
 };
 
 /**
@@ -65,13 +203,227 @@ at(rp_jsonc_expand_path_t path, int index)
 	return path;
 }
 
+/**
+ * Initialize the root path
+ *
+ * @param path the path to initialize
+ * @param ctx  the context of the expansion
+ */
+static void init_root(rp_jsonc_expand_path_t path, struct expctx *ctx)
+{
+	path->depth = -1;
+	path->previous = NULL;
+	path->index = 0;
+	path->key = NULL;
+	path->object = NULL;
+	path->ctx = ctx;
+}
+
+/**
+ * Initialize the path of a child of the object
+ *
+ * @param path the path to initialize
+ * @param previous the path of the parent of object
+ * @param object the object whose child is expanded
+ */
+static void init_child(rp_jsonc_expand_path_t path, rp_jsonc_expand_path_t previous, struct json_object *object)
+{
+	path->depth = previous->depth + 1;
+	path->previous = previous;
+	path->index = 0;
+	path->key = NULL;
+	path->object = object;
+	path->ctx = previous->ctx;
+}
+
+/**
+ * Release the content of the record
+ *
+ * @param rec the record to release
+ */
+static void rec_release(struct track_rec *rec)
+{
+	json_object_put(rec->container);
+	json_object_put(rec->source);
+	free(rec->key);
+	free(rec->deps);
+}
+
+/**
+ * Check if the record depends on name
+ *
+ * @param rec  the record to check
+ * @param name the name to check or NULL for any name
+ * @param len  length of the name
+ *
+ * @return true if the record depends on the name
+ */
+static int rec_depends(struct track_rec *rec, const char *name, size_t len)
+{
+	const char *iter, *end;
+	size_t n;
+
+	if (rec->any || name == NULL)
+		return 1;
+	iter = rec->deps;
+	end = &iter[rec->depslen];
+	while (iter != end) {
+		n = strlen(iter);
+		if (n == len && !memcmp(iter, name, len))
+			return 1;
+		iter += n + 1;
+	}
+	return 0;
+}
+
+/**
+ * Initialize the tracking structure
+ *
+ * @param track the structure to initialize
+ * @param closure closure of the expansion of strings
+ * @param expand_string function for expanding strings
+ */
+static void track_init(struct rp_jsonc_expand_track *track, void *closure, rp_jsonc_expandcb expand_string)
+{
+	memset(track, 0, sizeof *track);
+	track->closure = closure;
+	track->expand_string = expand_string;
+}
+
+/**
+ * Release the content of the tracking structure
+ *
+ * @param track the structure to release
+ */
+static void track_release(struct rp_jsonc_expand_track *track)
+{
+	while (track->count)
+		rec_release(&track->recs[--track->count]);
+	free(track->recs);
+	free(track->pending.deps);
+}
+
+/**
+ * Start recording the dependencies of an expansion
+ *
+ * @param track the tracking structure
+ */
+static void track_start(struct rp_jsonc_expand_track *track)
+{
+	track->pending.deps = NULL;
+	track->pending.depslen = 0;
+	track->pending.any = 0;
+	track->recording = 1;
+}
+
+/**
+ * Stop recording the dependencies of an expansion
+ *
+ * @param track the tracking structure
+ *
+ * @return true if the expansion depends on something
+ */
+static int track_stop(struct rp_jsonc_expand_track *track)
+{
+	track->recording = 0;
+	return track->pending.any || track->pending.depslen;
+}
+
+/**
+ * Add the pending record for the expansion of source
+ * whose result is current and that is child of the
+ * object of path
+ *
+ * @param track the tracking structure
+ * @param path the path of the expanded string
+ * @param source the original string
+ * @param current the result of the expansion
+ */
+static void track_add(
+	struct rp_jsonc_expand_track *track,
+	rp_jsonc_expand_path_t path,
+	struct json_object *source,
+	struct json_object *current
+) {
+	struct track_rec *rec;
+	size_t alloc;
+	char *key = NULL;
+
+	/* grow the array of records if needed */
+	if (track->count == track->alloc) {
+		alloc = track->alloc ? track->alloc << 1 : 16;
+		rec = realloc(track->recs, alloc * sizeof *rec);
+		if (rec == NULL)
+			goto lost;
+		track->recs = rec;
+		track->alloc = alloc;
+	}
+	if (path->key != NULL) {
+		key = strdup(path->key);
+		if (key == NULL)
+			goto lost;
+	}
+
+	/* record it */
+	rec = &track->recs[track->count++];
+	*rec = track->pending;
+	rec->container = path->object == track->shared ? path->object : json_object_get(path->object);
+	rec->key = key;
+	rec->index = path->index;
+	rec->source = json_object_get(source);
+	rec->current = current;
+	track->pending.deps = NULL;
+	return;
+
+lost:
+	free(track->pending.deps);
+	track->pending.deps = NULL;
+	track->lost++;
+}
+
+/**
+ * Merge the records of the tracking structure from into the
+ * tracking structure to. On success, from is emptied.
+ *
+ * @param to the tracking structure receiving the records
+ * @param from the tracking structure giving its records
+ */
+static void track_merge(struct rp_jsonc_expand_track *to, struct rp_jsonc_expand_track *from)
+{
+	struct track_rec *recs;
+	size_t alloc, idx;
+
+	/* take the references of the shared container */
+	if (from->shared != NULL) {
+		for (idx = 0 ; idx < from->count ; idx++)
+			if (from->recs[idx].container == from->shared)
+				json_object_get(from->shared);
+		from->shared = NULL;
+	}
+
+	to->lost += from->lost;
+	if (from->count == 0)
+		return;
+	alloc = to->count + from->count;
+	if (alloc > to->alloc) {
+		recs = realloc(to->recs, alloc * sizeof *recs);
+		if (recs == NULL) {
+			to->lost += (int)from->count;
+			return;
+		}
+		to->recs = recs;
+		to->alloc = alloc;
+	}
+	memcpy(&to->recs[to->count], from->recs, from->count * sizeof *recs);
+	to->count = alloc;
+	from->count = 0;
+}
+
 /**
  * Internal function for expanding json objects
  *
  * @param object the object to be expanded
  * @param previous link to the parent object
- * @param expand_object a function for replacing json objects or NULL
- * @param expand_string a function for replacing json strings or NULL
  *
  * @return either the given object or its replacement
  */
@@ -79,9 +431,77 @@ static
 struct json_object *
 expand(
 	struct json_object *object,
-	void *closure,
-	rp_jsonc_expandcb expand_object,
-	rp_jsonc_expandcb expand_string,
+	rp_jsonc_expand_path_t previous
+);
+
+/**
+ * Expand the given string
+ *
+ * @param object the string to be expanded
+ * @param previous link to the parent object
+ *
+ * @return either the given object or its replacement
+ */
+static
+struct json_object *
+expand_string(
+	struct json_object *object,
+	rp_jsonc_expand_path_t previous
+) {
+	struct json_object *result;
+	struct expctx *ctx = previous->ctx;
+	struct rp_jsonc_expand_track *track = ctx->track;
+
+	/* expansion of strings using given function */
+	if (ctx->expand_string == NULL)
+		result = object;
+	else if (track == NULL || previous->object == NULL)
+		result = ctx->expand_string(ctx->closure, object, previous);
+	else {
+		/* record dependencies of the expansion */
+		track_start(track);
+		result = ctx->expand_string(ctx->closure, object, previous);
+		if (track_stop(track))
+			track_add(track, previous, object, result);
+	}
+	return result;
+}
+
+/**
+ * Expand the given object whose content is already expanded
+ *
+ * @param object the object to be expanded
+ * @param previous link to the parent object
+ *
+ * @return either the given object or its replacement
+ */
+static
+struct json_object *
+expand_object(
+	struct json_object *object,
+	rp_jsonc_expand_path_t previous
+) {
+	struct json_object *nxtval;
+	struct expctx *ctx = previous->ctx;
+
+	/* expand the result using the function */
+	if (ctx->expand_object != NULL) {
+		nxtval = ctx->expand_object(ctx->closure, object, previous);
+		if (nxtval != object) {
+			/* the function returned a new object, try recursive expansion of it */
+			object = expand(nxtval, previous);
+			if (nxtval != object)
+				json_object_put(nxtval);
+		}
+	}
+	return object;
+}
+
+/* internal expansion */
+static
+struct json_object *
+expand(
+	struct json_object *object,
 	rp_jsonc_expand_path_t previous
 ) {
 #if JSON_C_VERSION_NUM >= 0x000d00
@@ -98,51 +518,36 @@ expand(
 	type = json_object_get_type(object);
 	switch (type) {
 	case json_type_object:
-		path.index = 0;
-		path.previous = previous;
-		path.depth = previous->depth + 1;
-		path.object = object;
+		init_child(&path, previous, object);
 		/* first, expand content of the object */
 		it = json_object_iter_begin(object);
 		end = json_object_iter_end(object);
 		while (!json_object_iter_equal(&it, &end)) {
 			curval = json_object_iter_peek_value(&it);
 			path.key = json_object_iter_peek_name(&it);
-			nxtval = expand(curval, closure, expand_object, expand_string, &path);
+			nxtval = expand(curval, &path);
 			if (nxtval != curval)
 				json_object_object_add(object, path.key, nxtval);
 			json_object_iter_next(&it);
 		}
 		/* expand the result using the function */
-		if (expand_object != NULL) {
-			nxtval = expand_object(closure, object, previous);
-			if (nxtval != object) {
-				/* the function returned a new object, try recursive expansion of it */
-				object = expand(nxtval, closure, expand_object, expand_string, previous);
-				if (nxtval != object)
-					json_object_put(nxtval);
-			}
-		}
+		object = expand_object(object, previous);
 		break;
 	case json_type_array:
 		/* arrays are not expanded but their values yes */
-		path.key = 0;
-		path.previous = previous;
-		path.depth = previous->depth + 1;
-		path.object = object;
+		init_child(&path, previous, object);
 		len = json_object_array_length(object);
 		for (idx = 0 ; idx < len ; idx++) {
 			curval = json_object_array_get_idx(object, idx);
 			path.index = (size_t)idx;
-			nxtval = expand(curval, closure, expand_object, expand_string, &path);
+			nxtval = expand(curval, &path);
 			if (nxtval != curval)
 				json_object_array_put_idx(object, idx, nxtval);
 		}
 		break;
 	case json_type_string:
 		/* expansion of strings using given function */
-		if (expand_string != NULL)
-			object = expand_string(closure, object, previous);
+		object = expand_string(object, previous);
 		break;
 	default:
 		/* no expansion on number, bool, null */
@@ -151,6 +556,154 @@ expand(
 	return object;
 }
 
+/**
+ * Process the jobs of the worker until no more job remain
+ *
+ * @param arg the worker
+ *
+ * @return NULL
+ */
+static void *work(void *arg)
+{
+	struct worker *worker = arg;
+	struct rp_jsonc_expand_path root, path;
+	struct job *job;
+	size_t idx;
+
+	init_root(&root, &worker->ctx);
+	init_child(&path, &root, worker->object);
+	for (;;) {
+		idx = __atomic_fetch_add(worker->next, 1, __ATOMIC_RELAXED);
+		if (idx >= worker->count)
+			break;
+		job = &worker->jobs[idx];
+		path.key = job->key;
+		path.index = job->index;
+		job->result = expand(job->value, &path);
+	}
+	return NULL;
+}
+
+/**
+ * Expand the object, distributing the expansion of its top level
+ * children over at most nthreads threads
+ *
+ * @param object the object to expand
+ * @param ctx the context of expansion
+ * @param nthreads the maximum count of threads
+ *
+ * @return the result of the expansion that can be equal to object
+ */
+static
+struct json_object *
+expand_root(
+	struct json_object *object,
+	struct expctx *ctx,
+	int nthreads
+) {
+	size_t idx, count, next;
+	int iw, nw;
+	enum json_type type;
+	struct json_object_iterator it, end;
+	struct rp_jsonc_expand_path root;
+	struct job *jobs, *job;
+	struct worker *workers;
+
+	init_root(&root, ctx);
+
+	/* compute the count of jobs */
+	type = json_object_get_type(object);
+	if (type == json_type_object)
+		count = (size_t)json_object_object_length(object);
+	else if (type == json_type_array)
+		count = (size_t)json_object_array_length(object);
+	else
+		count = 0;
+	if (nthreads <= 0)
+		nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if ((size_t)nthreads > count)
+		nthreads = (int)count;
+	if (nthreads <= 1)
+		return expand(object, &root);
+
+	/* allocates the jobs and the workers */
+	jobs = calloc(count, sizeof *jobs);
+	workers = calloc((size_t)nthreads, sizeof *workers);
+	if (jobs == NULL || workers == NULL) {
+		free(jobs);
+		free(workers);
+		return expand(object, &root);
+	}
+
+	/* prepare the jobs */
+	if (type == json_type_object) {
+		idx = 0;
+		it = json_object_iter_begin(object);
+		end = json_object_iter_end(object);
+		while (!json_object_iter_equal(&it, &end)) {
+			job = &jobs[idx++];
+			job->key = json_object_iter_peek_name(&it);
+			job->value = json_object_iter_peek_value(&it);
+			json_object_iter_next(&it);
+		}
+	}
+	else {
+		for (idx = 0 ; idx < count ; idx++) {
+			job = &jobs[idx];
+			job->index = idx;
+			job->value = json_object_array_get_idx(object, idx);
+		}
+	}
+
+	/* start the workers, the current thread being the first one */
+	next = 0;
+	for (nw = 0 ; nw < nthreads ; nw++) {
+		workers[nw].ctx = *ctx;
+		if (ctx->track != NULL) {
+			track_init(&workers[nw].track, ctx->closure, ctx->expand_string);
+			workers[nw].track.shared = object;
+			workers[nw].ctx.track = &workers[nw].track;
+		}
+		workers[nw].object = object;
+		workers[nw].jobs = jobs;
+		workers[nw].count = count;
+		workers[nw].next = &next;
+		if (nw && pthread_create(&workers[nw].tid, NULL, work, &workers[nw]) != 0)
+			break;
+	}
+	work(&workers[0]);
+
+	/* wait termination of the workers */
+	for (iw = 0 ; iw < nw ; iw++) {
+		if (iw)
+			pthread_join(workers[iw].tid, NULL);
+		if (ctx->track != NULL) {
+			track_merge(ctx->track, &workers[iw].track);
+			track_release(&workers[iw].track);
+		}
+	}
+	if (nw < nthreads && ctx->track != NULL)
+		track_release(&workers[nw].track);
+
+	/* put the results */
+	for (idx = 0 ; idx < count ; idx++) {
+		job = &jobs[idx];
+		if (job->result != job->value) {
+			if (type == json_type_object)
+				json_object_object_add(object, job->key, job->result);
+			else
+				json_object_array_put_idx(object, job->index, job->result);
+		}
+	}
+	free(jobs);
+	free(workers);
+
+	/* expand the result using the function */
+	if (type == json_type_object)
+		object = expand_object(object, &root);
+	return object;
+}
+
 /* expand an object using user functions */
 struct json_object *
 rp_jsonc_expand(
@@ -159,15 +712,135 @@ rp_jsonc_expand(
 	rp_jsonc_expandcb expand_object,
 	rp_jsonc_expandcb expand_string
 ) {
+	struct expctx ctx = { closure, expand_object, expand_string, NULL };
 	struct rp_jsonc_expand_path path;
 
-	path.depth = -1;
-	path.previous = NULL;
-	path.index = 0;
-	path.key = NULL;
-	path.object = NULL;
+	init_root(&path, &ctx);
+	return expand(object, &path);
+}
+
+/* expand an object using user functions and threads */
+struct json_object *
+rp_jsonc_expand_mt(
+	struct json_object *object,
+	void *closure,
+	rp_jsonc_expandcb expand_object,
+	rp_jsonc_expandcb expand_string,
+	int nthreads
+) {
+	struct expctx ctx = { closure, expand_object, expand_string, NULL };
+
+	return expand_root(object, &ctx, nthreads);
+}
+
+/* expand an object using user functions and track dependencies */
+struct json_object *
+rp_jsonc_expand_track(
+	struct json_object *object,
+	void *closure,
+	rp_jsonc_expandcb expand_object,
+	rp_jsonc_expandcb expand_string,
+	int nthreads,
+	rp_jsonc_expand_track_t *track
+) {
+	struct expctx ctx = { closure, expand_object, expand_string, NULL };
+
+	ctx.track = malloc(sizeof *ctx.track);
+	if (ctx.track != NULL)
+		track_init(ctx.track, closure, expand_string);
+	*track = ctx.track;
+	return expand_root(object, &ctx, nthreads);
+}
+
+/* record a dependency of the current expansion */
+void rp_jsonc_expand_path_depends(rp_jsonc_expand_path_t path, const char *name, size_t len)
+{
+	struct rp_jsonc_expand_track *track = path->ctx->track;
+	struct track_rec *rec;
+	char *deps;
+
+	if (track == NULL || !track->recording)
+		return;
+	rec = &track->pending;
+	if (rec->any || rec_depends(rec, name, len))
+		return;
+	deps = realloc(rec->deps, rec->depslen + len + 1);
+	if (deps == NULL)
+		rec->any = 1;
+	else {
+		memcpy(&deps[rec->depslen], name, len);
+		deps[rec->depslen + len] = 0;
+		rec->deps = deps;
+		rec->depslen += len + 1;
+	}
+}
+
+/* update the expansion of strings depending on name */
+int rp_jsonc_expand_track_update(rp_jsonc_expand_track_t track, const char *name)
+{
+	struct expctx ctx = { track->closure, NULL, track->expand_string, track };
+	struct rp_jsonc_expand_path root, path;
+	struct json_object *curval, *nxtval;
+	struct track_rec *rec;
+	size_t idx, len;
+	int count;
+
+	init_root(&root, &ctx);
+	len = name ? strlen(name) : 0;
+	count = 0;
+	for (idx = 0 ; idx < track->count ; idx++) {
+		rec = &track->recs[idx];
+		if (!rec_depends(rec, name, len))
+			continue;
+
+		/* check that the record is still valid */
+		init_child(&path, &root, rec->container);
+		if (rec->key == NULL) {
+			path.index = rec->index;
+			curval = json_object_array_get_idx(rec->container, rec->index);
+		}
+		else {
+			path.key = rec->key;
+			if (!json_object_object_get_ex(rec->container, rec->key, &curval))
+				curval = NULL;
+		}
+		if (curval != rec->current)
+			continue;
+
+		/* expand again */
+		track_start(track);
+		nxtval = track->expand_string(track->closure, rec->source, &path);
+		track_stop(track);
+		if (nxtval == rec->source)
+			json_object_get(nxtval);
+		if (nxtval == curval)
+			json_object_put(nxtval);
+		else {
+			if (rec->key == NULL)
+				json_object_array_put_idx(rec->container, rec->index, nxtval);
+			else
+				json_object_object_add(rec->container, rec->key, nxtval);
+			rec->current = nxtval;
+		}
+
+		/* record the new dependencies */
+		free(rec->deps);
+		rec->deps = track->pending.deps;
+		rec->depslen = track->pending.depslen;
+		rec->any = track->pending.any;
+		track->pending.deps = NULL;
+		count++;
+	}
+	return track->lost ? -ENOMEM : count;
+}
 
-	return expand(object, closure, expand_object, expand_string, &path);
+/* destroy the tracking */
+void rp_jsonc_expand_track_destroy(rp_jsonc_expand_track_t track)
+{
+	if (track != NULL) {
+		track_release(track);
+		free(track);
+	}
 }
 
 /* length of the path */
@@ -73,6 +73,104 @@ extern struct json_object *rp_jsonc_expand(
 	rp_jsonc_expandcb expand_string
 );
 
+/**
+ * Expand the given object using the given expansion functions
+ * and at most nthreads threads.
+ *
+ * The expansion of the top level children of object (the values
+ * of the root dictionary or of the root array) is distributed
+ * over the threads. Consequently, the expansion functions must be
+ * thread safe and the top level children must not share any
+ * json object (as it can happen when YAML aliases are used).
+ *
+ * @param object  the object to expand
+ * @param closure the closure for the expansion functions
+ * @param expand_object the expansion function called on object of type object (dictionaries)
+ * @param expand_string the expansion function called on object of type string
+ * @param nthreads the maximum count of threads to use or 0 for the count of processors
+ *
+ * @return the result of the expansion that can be equal to object
+ */
+extern struct json_object *rp_jsonc_expand_mt(
+	struct json_object *object,
+	void *closure,
+	rp_jsonc_expandcb expand_object,
+	rp_jsonc_expandcb expand_string,
+	int nthreads
+);
+
+/**
+ * The tracking records the names that expanded strings depend on,
+ * allowing to expand again only the strings depending on a name
+ * when its value changes.
+ */
+typedef struct rp_jsonc_expand_track *rp_jsonc_expand_track_t;
+
+/**
+ * Expand the given object using the given expansion functions
+ * like @see rp_jsonc_expand_mt but also create a tracking of
+ * the expanded strings.
+ *
+ * Only the strings for which the function expand_string called
+ * @see rp_jsonc_expand_path_depends are tracked. The tracking
+ * keeps references to the original strings and to their containers.
+ * It must be destroyed using @see rp_jsonc_expand_track_destroy.
+ *
+ * @param object  the object to expand
+ * @param closure the closure for the expansion functions
+ * @param expand_object the expansion function called on object of type object (dictionaries)
+ * @param expand_string the expansion function called on object of type string
+ * @param nthreads the maximum count of threads to use or 0 for the count of processors
+ * @param track where to store the created tracking (set to NULL on memory depletion)
+ *
+ * @return the result of the expansion that can be equal to object
+ */
+extern struct json_object *rp_jsonc_expand_track(
+	struct json_object *object,
+	void *closure,
+	rp_jsonc_expandcb expand_object,
+	rp_jsonc_expandcb expand_string,
+	int nthreads,
+	rp_jsonc_expand_track_t *track
+);
+
+/**
+ * Declares that the string being expanded depends on the given name.
+ * This function is intended to be called by the expand_string
+ * callback, it has no effect when tracking is not active.
+ *
+ * @param path the path received by the expand_string callback
+ * @param name begin of the name (not need to be zero terminated)
+ * @param len length of the name
+ */
+extern void rp_jsonc_expand_path_depends(rp_jsonc_expand_path_t path, const char *name, size_t len);
+
+/**
+ * Expand again the strings that depend on the given name,
+ * using the closure and the expand_string function given
+ * to @see rp_jsonc_expand_track.
+ *
+ * During this update, the path given to expand_string only
+ * has one item: the container of the expanded string.
+ *
+ * Strings whose container was changed in the meantime are
+ * not updated.
+ *
+ * @param track the tracking of the expansion
+ * @param name the name whose value changed or NULL for all names
+ *
+ * @return the count of strings expanded again or -ENOMEM if
+ *         some strings could not be tracked
+ */
+extern int rp_jsonc_expand_track_update(rp_jsonc_expand_track_t track, const char *name);
+
+/**
+ * Destroy the tracking and release its references
+ *
+ * @param track the tracking to destroy (can be NULL)
+ */
+extern void rp_jsonc_expand_track_destroy(rp_jsonc_expand_track_t track);
+
 /**
  * Returns the length of the path
  *
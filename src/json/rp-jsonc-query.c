@@ -0,0 +1,1152 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "rp-jsonc-query.h"
+#include "rp-jsonc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/**
+ * Types of the steps of queries
+ */
+enum step_type
+{
+	/** member of an object (or index of an array if index >= 0) */
+	step_key,
+
+	/** item of an array, negative from end */
+	step_index,
+
+	/** any child */
+	step_wildcard,
+
+	/** self and any descendant */
+	step_descendant,
+
+	/** any child matching a filter */
+	step_filter
+};
+
+/**
+ * Comparison operators of filters
+ */
+enum filter_op
+{
+	/** existence */
+	op_exists,
+	/** == */
+	op_eq,
+	/** != */
+	op_ne,
+	/** < */
+	op_lt,
+	/** <= */
+	op_le,
+	/** > */
+	op_gt,
+	/** >= */
+	op_ge
+};
+
+/**
+ * A step of a query
+ */
+struct step
+{
+	/** type of the step */
+	enum step_type type;
+
+	/** name for keys */
+	const char *name;
+
+	/** index for keys and indexes */
+	long index;
+
+	/** filter for filters */
+	struct filter *filter;
+};
+
+/**
+ * Growable array of steps
+ */
+struct steps
+{
+	/** the steps */
+	struct step *array;
+
+	/** count of steps */
+	unsigned count;
+
+	/** allocated count */
+	unsigned alloc;
+};
+
+/**
+ * Filter of children
+ */
+struct filter
+{
+	/** the operator */
+	enum filter_op op;
+
+	/** type of the value */
+	enum json_type type;
+
+	/** string value */
+	const char *string;
+
+	/** number or boolean value */
+	double number;
+
+	/** the relative path */
+	struct steps rel;
+};
+
+/**
+ * A compiled query
+ */
+struct rp_jsonc_query
+{
+	/** the steps */
+	struct steps steps;
+
+	/** pool of names */
+	char *pool;
+};
+
+/**
+ * State of a query in a batch
+ */
+struct state
+{
+	/** index of the query */
+	unsigned query;
+
+	/** index of the step */
+	unsigned step;
+};
+
+/**
+ * A batch of queries
+ */
+struct rp_jsonc_query_batch
+{
+	/** the queries */
+	const rp_jsonc_query_t * const *queries;
+
+	/** count of queries */
+	unsigned count;
+
+	/** is a query using descendants? */
+	int descendants;
+
+	/** stack of states */
+	struct state *stack;
+
+	/** allocated size of the stack */
+	size_t alloc;
+
+	/** callback receiving results */
+	int (*callback)(void*,unsigned,struct json_object*);
+
+	/** closure of the callback */
+	void *closure;
+};
+
+/**
+ * Parser of queries
+ */
+struct parser
+{
+	/** current position */
+	const char *pos;
+
+	/** next free position in pool */
+	char *pool;
+};
+
+/******************************************************************************/
+/*** COMPILING                                                              ***/
+/******************************************************************************/
+
+/**
+ * Release memory used by steps
+ *
+ * @param steps the steps to release
+ */
+static void steps_release(struct steps *steps)
+{
+	unsigned idx;
+	struct filter *filter;
+
+	for (idx = 0 ; idx < steps->count ; idx++) {
+		filter = steps->array[idx].filter;
+		if (filter != NULL) {
+			steps_release(&filter->rel);
+			free(filter);
+		}
+	}
+	free(steps->array);
+}
+
+/**
+ * Add a step
+ *
+ * @param steps the steps to grow
+ * @param type type of the added step
+ * @param name name of the step or NULL
+ * @param index index of the step
+ *
+ * @return the added step or NULL on memory depletion
+ */
+static struct step *steps_add(struct steps *steps, enum step_type type, const char *name, long index)
+{
+	struct step *step;
+	unsigned alloc;
+
+	if (steps->count == steps->alloc) {
+		alloc = steps->alloc ? steps->alloc << 1 : 4;
+		step = realloc(steps->array, alloc * sizeof *step);
+		if (step == NULL)
+			return NULL;
+		steps->array = step;
+		steps->alloc = alloc;
+	}
+	step = &steps->array[steps->count++];
+	step->type = type;
+	step->name = name;
+	step->index = index;
+	step->filter = NULL;
+	return step;
+}
+
+/**
+ * Add a key step, computing its index if it is a canonical integer
+ *
+ * @param steps the steps to grow
+ * @param name name of the step
+ *
+ * @return 0 on success or -ENOMEM
+ */
+static int add_key(struct steps *steps, const char *name)
+{
+	const char *iter = name;
+	long index = 0;
+
+	if (*iter == '0')
+		iter++;
+	else
+		while (*iter >= '0' && *iter <= '9' && index <= 99999999)
+			index = 10 * index + (long)(*iter++ - '0');
+	if (*iter || iter == name)
+		index = -1;
+	return steps_add(steps, step_key, name, index) ? 0 : -ENOMEM;
+}
+
+/**
+ * Skip spaces
+ *
+ * @param parser the parser
+ */
+static void skip_spaces(struct parser *parser)
+{
+	while (*parser->pos == ' ' || *parser->pos == '\t')
+		parser->pos++;
+}
+
+/**
+ * Parse an unquoted name terminated by one of the characters of stops
+ *
+ * @param parser the parser
+ * @param stops  the characters stopping the name
+ *
+ * @return the parsed name or NULL if empty
+ */
+static const char *parse_name(struct parser *parser, const char *stops)
+{
+	const char *name = parser->pool;
+	char c;
+
+	while ((c = *parser->pos) && !strchr(stops, c)) {
+		*parser->pool++ = c;
+		parser->pos++;
+	}
+	if (name == parser->pool)
+		return NULL;
+	*parser->pool++ = 0;
+	return name;
+}
+
+/**
+ * Parse a quoted string
+ *
+ * @param parser the parser
+ *
+ * @return the parsed string or NULL if not terminated
+ */
+static const char *parse_quoted(struct parser *parser)
+{
+	const char *name = parser->pool;
+	char c, q = *parser->pos++;
+
+	while ((c = *parser->pos++) != q) {
+		if (c == '\\' && *parser->pos)
+			c = *parser->pos++;
+		else if (c == 0)
+			return NULL;
+		*parser->pool++ = c;
+	}
+	*parser->pool++ = 0;
+	return name;
+}
+
+/**
+ * Parse an integer
+ *
+ * @param parser the parser
+ * @param value where to store the value
+ *
+ * @return 0 on success or -EINVAL
+ */
+static int parse_integer(struct parser *parser, long *value)
+{
+	char *end;
+
+	*value = strtol(parser->pos, &end, 10);
+	if (end == parser->pos)
+		return -EINVAL;
+	parser->pos = end;
+	return 0;
+}
+
+/**
+ * Parse a bracketed member of relative path, after the bracket
+ *
+ * @param parser the parser
+ * @param steps the steps to grow
+ *
+ * @return 0 on success or -EINVAL or -ENOMEM
+ */
+static int parse_bracket_member(struct parser *parser, struct steps *steps)
+{
+	const char *name;
+	long index;
+	int rc;
+
+	skip_spaces(parser);
+	if (*parser->pos == '\'' || *parser->pos == '"') {
+		name = parse_quoted(parser);
+		if (name == NULL)
+			return -EINVAL;
+		rc = steps_add(steps, step_key, name, -1) ? 0 : -ENOMEM;
+	}
+	else {
+		rc = parse_integer(parser, &index);
+		if (rc == 0)
+			rc = steps_add(steps, step_index, NULL, index) ? 0 : -ENOMEM;
+	}
+	skip_spaces(parser);
+	if (rc == 0 && *parser->pos++ != ']')
+		rc = -EINVAL;
+	return rc;
+}
+
+/**
+ * Parse a filter, after the ?
+ *
+ * @param parser the parser
+ * @param steps the steps to grow
+ *
+ * @return 0 on success or -EINVAL or -ENOMEM
+ */
+static int parse_filter(struct parser *parser, struct steps *steps)
+{
+	struct filter *filter;
+	const char *name;
+	char *end;
+	int rc;
+
+	if (*parser->pos++ != '(')
+		return -EINVAL;
+	skip_spaces(parser);
+	if (*parser->pos++ != '@')
+		return -EINVAL;
+
+	filter = calloc(1, sizeof *filter);
+	if (filter == NULL)
+		return -ENOMEM;
+	if (steps_add(steps, step_filter, NULL, -1) == NULL) {
+		free(filter);
+		return -ENOMEM;
+	}
+	steps->array[steps->count - 1].filter = filter;
+
+	/* relative path */
+	for (rc = 0 ; rc == 0 ; ) {
+		if (*parser->pos == '.') {
+			parser->pos++;
+			name = parse_name(parser, ".[]()=!<> \t");
+			rc = name == NULL ? -EINVAL : add_key(&filter->rel, name);
+		}
+		else if (*parser->pos == '[') {
+			parser->pos++;
+			rc = parse_bracket_member(parser, &filter->rel);
+		}
+		else
+			break;
+	}
+	if (rc < 0)
+		return rc;
+
+	/* operator */
+	skip_spaces(parser);
+	switch (*parser->pos) {
+	case ')': filter->op = op_exists; break;
+	case '=': filter->op = op_eq; break;
+	case '!': filter->op = op_ne; break;
+	case '<': filter->op = parser->pos[1] == '=' ? op_le : op_lt; break;
+	case '>': filter->op = parser->pos[1] == '=' ? op_ge : op_gt; break;
+	default: return -EINVAL;
+	}
+	if (filter->op != op_exists) {
+		if (filter->op == op_eq || filter->op == op_ne) {
+			if (parser->pos[1] != '=')
+				return -EINVAL;
+			parser->pos++;
+		}
+		else if (filter->op == op_le || filter->op == op_ge)
+			parser->pos++;
+		parser->pos++;
+
+		/* value */
+		skip_spaces(parser);
+		if (*parser->pos == '\'' || *parser->pos == '"') {
+			filter->type = json_type_string;
+			filter->string = parse_quoted(parser);
+			if (filter->string == NULL)
+				return -EINVAL;
+		}
+		else if (!strncmp(parser->pos, "true", 4)) {
+			filter->type = json_type_boolean;
+			filter->number = 1;
+			parser->pos += 4;
+		}
+		else if (!strncmp(parser->pos, "false", 5)) {
+			filter->type = json_type_boolean;
+			filter->number = 0;
+			parser->pos += 5;
+		}
+		else if (!strncmp(parser->pos, "null", 4)) {
+			filter->type = json_type_null;
+			parser->pos += 4;
+		}
+		else {
+			filter->type = json_type_double;
+			filter->number = strtod(parser->pos, &end);
+			if (end == parser->pos)
+				return -EINVAL;
+			parser->pos = end;
+		}
+		skip_spaces(parser);
+	}
+	if (*parser->pos++ != ')')
+		return -EINVAL;
+	return 0;
+}
+
+/**
+ * Parse a JSONPath expression
+ *
+ * @param parser the parser
+ * @param steps the steps to grow
+ *
+ * @return 0 on success or -EINVAL or -ENOMEM
+ */
+static int parse_path(struct parser *parser, struct steps *steps)
+{
+	const char *name;
+	int rc = 0;
+
+	if (*parser->pos++ != '$')
+		return -EINVAL;
+	while (rc == 0 && *parser->pos) {
+		if (*parser->pos == '.') {
+			/* dotted member */
+			if (*++parser->pos == '.') {
+				parser->pos++;
+				if (steps_add(steps, step_descendant, NULL, -1) == NULL)
+					return -ENOMEM;
+				if (*parser->pos == '[')
+					continue;
+			}
+			if (*parser->pos == '*') {
+				parser->pos++;
+				rc = steps_add(steps, step_wildcard, NULL, -1) ? 0 : -ENOMEM;
+			}
+			else {
+				name = parse_name(parser, ".[");
+				rc = name == NULL ? -EINVAL : add_key(steps, name);
+			}
+		}
+		else if (*parser->pos == '[') {
+			/* bracketed member */
+			parser->pos++;
+			skip_spaces(parser);
+			if (*parser->pos == '*') {
+				parser->pos++;
+				skip_spaces(parser);
+				rc = *parser->pos++ != ']' ? -EINVAL
+					: steps_add(steps, step_wildcard, NULL, -1) ? 0 : -ENOMEM;
+			}
+			else if (*parser->pos == '?') {
+				parser->pos++;
+				rc = parse_filter(parser, steps);
+				skip_spaces(parser);
+				if (rc == 0 && *parser->pos++ != ']')
+					rc = -EINVAL;
+			}
+			else
+				rc = parse_bracket_member(parser, steps);
+		}
+		else
+			rc = -EINVAL;
+	}
+	/* a trailing descendant is not valid */
+	if (rc == 0 && steps->count && steps->array[steps->count - 1].type == step_descendant)
+		rc = -EINVAL;
+	return rc;
+}
+
+/**
+ * Parse a JSON pointer
+ *
+ * @param parser the parser
+ * @param steps the steps to grow
+ *
+ * @return 0 on success or -EINVAL or -ENOMEM
+ */
+static int parse_pointer(struct parser *parser, struct steps *steps)
+{
+	const char *name;
+	char c;
+	int rc = 0;
+
+	while (rc == 0 && *parser->pos) {
+		if (*parser->pos++ != '/')
+			return -EINVAL;
+		name = parser->pool;
+		while ((c = *parser->pos) && c != '/') {
+			parser->pos++;
+			if (c == '~') {
+				c = *parser->pos++;
+				if (c == '0')
+					c = '~';
+				else if (c == '1')
+					c = '/';
+				else
+					return -EINVAL;
+			}
+			*parser->pool++ = c;
+		}
+		*parser->pool++ = 0;
+		rc = add_key(steps, name);
+	}
+	return rc;
+}
+
+/**
+ * Compile a query
+ *
+ * @param query where to store the query
+ * @param text the text of the query
+ * @param parse the parsing function
+ *
+ * @return 0 on success or -EINVAL or -ENOMEM
+ */
+static int compile(
+	rp_jsonc_query_t **query,
+	const char *text,
+	int (*parse)(struct parser*, struct steps*)
+) {
+	rp_jsonc_query_t *result;
+	struct parser parser;
+	int rc;
+
+	*query = NULL;
+	result = calloc(1, sizeof *result);
+	if (result == NULL)
+		return -ENOMEM;
+
+	/* names decoded in the pool are never longer than the text */
+	result->pool = malloc(strlen(text) + 1);
+	if (result->pool == NULL) {
+		free(result);
+		return -ENOMEM;
+	}
+	parser.pos = text;
+	parser.pool = result->pool;
+	rc = parse(&parser, &result->steps);
+	if (rc < 0)
+		rp_jsonc_query_destroy(result);
+	else
+		*query = result;
+	return rc;
+}
+
+/* compile a JSON pointer */
+int rp_jsonc_query_pointer(rp_jsonc_query_t **query, const char *pointer)
+{
+	return compile(query, pointer, parse_pointer);
+}
+
+/* compile a JSONPath */
+int rp_jsonc_query_path(rp_jsonc_query_t **query, const char *path)
+{
+	return compile(query, path, parse_path);
+}
+
+/* destroy the query */
+void rp_jsonc_query_destroy(rp_jsonc_query_t *query)
+{
+	if (query != NULL) {
+		steps_release(&query->steps);
+		free(query->pool);
+		free(query);
+	}
+}
+
+/******************************************************************************/
+/*** EVALUATING                                                             ***/
+/******************************************************************************/
+
+/**
+ * Get the index in an array of the given length designated by the step
+ *
+ * @param step the step or NULL
+ * @param length the length of the array
+ *
+ * @return the index or -1 if the step doesn't designate an existing item
+ */
+static long array_index(const struct step *step, size_t length)
+{
+	long index;
+
+	if (step == NULL || (step->type != step_key && step->type != step_index))
+		return -1;
+	index = step->index;
+	if (index < 0 && step->type == step_index)
+		index += (long)length;
+	return index < (long)length ? index : -1;
+}
+
+/**
+ * Get the child of node designated by the key or index step
+ *
+ * @param node the node whose child is queried
+ * @param step the key or index step
+ * @param child where to store the child
+ *
+ * @return 1 if the child exists or 0 otherwise
+ */
+static int get_child(struct json_object *node, const struct step *step, struct json_object **child)
+{
+	long index;
+
+	if (json_object_is_type(node, json_type_object))
+		return step->type == step_key
+			&& json_object_object_get_ex(node, step->name, child);
+	if (!json_object_is_type(node, json_type_array))
+		return 0;
+	index = array_index(step, json_object_array_length(node));
+	if (index < 0)
+		return 0;
+	*child = json_object_array_get_idx(node, (rp_jsonc_index_t)index);
+	return 1;
+}
+
+/**
+ * Compare the node with the value of the filter
+ *
+ * @param node the node to compare
+ * @param filter the filter
+ *
+ * @return 1 if the comparison is true or 0 otherwise
+ */
+static int compare(struct json_object *node, const struct filter *filter)
+{
+	int cmp;
+	double number;
+
+	switch (json_object_get_type(node)) {
+	case json_type_int:
+	case json_type_double:
+		if (filter->type != json_type_double)
+			return filter->op == op_ne;
+		number = json_object_get_double(node);
+		cmp = (number > filter->number) - (number < filter->number);
+		break;
+	case json_type_string:
+		if (filter->type != json_type_string)
+			return filter->op == op_ne;
+		cmp = strcmp(json_object_get_string(node), filter->string);
+		break;
+	case json_type_boolean:
+		if (filter->type != json_type_boolean)
+			return filter->op == op_ne;
+		cmp = !json_object_get_boolean(node) != !filter->number;
+		if (filter->op != op_eq && filter->op != op_ne)
+			return 0;
+		break;
+	case json_type_null:
+		if (filter->type != json_type_null)
+			return filter->op == op_ne;
+		cmp = 0;
+		if (filter->op != op_eq && filter->op != op_ne)
+			return 0;
+		break;
+	default:
+		return filter->op == op_ne;
+	}
+	switch (filter->op) {
+	case op_eq: return cmp == 0;
+	case op_ne: return cmp != 0;
+	case op_lt: return cmp < 0;
+	case op_le: return cmp <= 0;
+	case op_gt: return cmp > 0;
+	case op_ge: return cmp >= 0;
+	default: return 1;
+	}
+}
+
+/**
+ * Test if node matches the filter
+ *
+ * @param node the node to test
+ * @param filter the filter
+ *
+ * @return 1 if node matches or 0 otherwise
+ */
+static int test(struct json_object *node, const struct filter *filter)
+{
+	const struct step *step = filter->rel.array;
+	const struct step *end = &step[filter->rel.count];
+
+	for ( ; step != end ; step++)
+		if (!get_child(node, step, &node))
+			return filter->op == op_ne;
+	return filter->op == op_exists || compare(node, filter);
+}
+
+/**
+ * Evaluate the steps from step to end on node
+ *
+ * @param step the first step to evaluate
+ * @param end the end of the steps
+ * @param node the node
+ * @param callback the callback receiving matching nodes
+ * @param closure the closure of the callback
+ *
+ * @return the last value returned by the callback or 0
+ */
+static int eval(
+	const struct step *step,
+	const struct step *end,
+	struct json_object *node,
+	int (*callback)(void*,struct json_object*),
+	void *closure
+) {
+	struct json_object_iterator it, iend;
+	struct json_object *child;
+	rp_jsonc_index_t idx, len;
+	int rc;
+
+	for ( ; step != end ; step++) {
+		switch (step->type) {
+		case step_key:
+		case step_index:
+			if (!get_child(node, step, &node))
+				return 0;
+			break;
+		case step_descendant:
+			rc = eval(step + 1, end, node, callback, closure);
+			if (rc)
+				return rc;
+			/*@fallthrough@*/
+		default:
+			/* iterate over the children */
+			if (json_object_is_type(node, json_type_object)) {
+				it = json_object_iter_begin(node);
+				iend = json_object_iter_end(node);
+				for ( ; !json_object_iter_equal(&it, &iend) ; json_object_iter_next(&it)) {
+					child = json_object_iter_peek_value(&it);
+					if (step->type == step_filter && !test(child, step->filter))
+						continue;
+					rc = eval(step + (step->type != step_descendant), end, child, callback, closure);
+					if (rc)
+						return rc;
+				}
+			}
+			else if (json_object_is_type(node, json_type_array)) {
+				len = json_object_array_length(node);
+				for (idx = 0 ; idx < len ; idx++) {
+					child = json_object_array_get_idx(node, idx);
+					if (step->type == step_filter && !test(child, step->filter))
+						continue;
+					rc = eval(step + (step->type != step_descendant), end, child, callback, closure);
+					if (rc)
+						return rc;
+				}
+			}
+			return 0;
+		}
+	}
+	return callback(closure, node);
+}
+
+/**
+ * Callback recording the first found object
+ */
+static int getcb(void *closure, struct json_object *object)
+{
+	*(struct json_object**)closure = object;
+	return 1;
+}
+
+/* get first matching object */
+int rp_jsonc_query_get(const rp_jsonc_query_t *query, struct json_object *root, struct json_object **result)
+{
+	struct json_object *found = NULL;
+	const struct step *step = query->steps.array;
+	int rc = eval(step, &step[query->steps.count], root, getcb, &found);
+	if (result != NULL)
+		*result = found;
+	return rc;
+}
+
+/* apply callback until it returns not null */
+int rp_jsonc_query_until(
+	const rp_jsonc_query_t *query,
+	struct json_object *root,
+	int (*callback)(void*,struct json_object*),
+	void *closure
+) {
+	const struct step *step = query->steps.array;
+	return eval(step, &step[query->steps.count], root, callback, closure);
+}
+
+/**
+ * Adaptor of callbacks for calling rp_jsonc_query_until
+ */
+struct forall
+{
+	/** the callback */
+	void (*callback)(void*,struct json_object*);
+
+	/** its closure */
+	void *closure;
+};
+
+/**
+ * Callback adaptor for rp_jsonc_query_for_all
+ */
+static int forallcb(void *closure, struct json_object *object)
+{
+	struct forall *fa = closure;
+	fa->callback(fa->closure, object);
+	return 0;
+}
+
+/* apply callback to all matching objects */
+void rp_jsonc_query_for_all(
+	const rp_jsonc_query_t *query,
+	struct json_object *root,
+	void (*callback)(void*,struct json_object*),
+	void *closure
+) {
+	struct forall fa = { callback, closure };
+	rp_jsonc_query_until(query, root, forallcb, &fa);
+}
+
+/******************************************************************************/
+/*** BATCHING                                                               ***/
+/******************************************************************************/
+
+/* create a batch */
+int rp_jsonc_query_batch_create(
+	rp_jsonc_query_batch_t **batch,
+	const rp_jsonc_query_t * const *queries,
+	unsigned count
+) {
+	rp_jsonc_query_batch_t *result;
+	unsigned iq, is;
+
+	*batch = result = calloc(1, sizeof *result);
+	if (result == NULL)
+		return -ENOMEM;
+	result->queries = queries;
+	result->count = count;
+	for (iq = 0 ; iq < count ; iq++)
+		for (is = 0 ; is < queries[iq]->steps.count ; is++)
+			if (queries[iq]->steps.array[is].type == step_descendant)
+				result->descendants = 1;
+	return 0;
+}
+
+/* destroy a batch */
+void rp_jsonc_query_batch_destroy(rp_jsonc_query_batch_t *batch)
+{
+	if (batch != NULL) {
+		free(batch->stack);
+		free(batch);
+	}
+}
+
+/**
+ * Get the step of the state
+ *
+ * @param batch the batch
+ * @param state the state
+ *
+ * @return the step of the state or NULL if the query is complete
+ */
+static inline const struct step *state_step(rp_jsonc_query_batch_t *batch, struct state state)
+{
+	const struct steps *steps = &batch->queries[state.query]->steps;
+	return state.step < steps->count ? &steps->array[state.step] : NULL;
+}
+
+/**
+ * Push a state on the stack of states, avoiding duplicates
+ * when descendants are used
+ *
+ * @param batch the batch
+ * @param base  the base index of the current level of states
+ * @param top   pointer to the top index of the current level of states
+ * @param query index of the query
+ * @param step  index of the step
+ *
+ * @return 0 on success or -ENOMEM
+ */
+static int push(rp_jsonc_query_batch_t *batch, size_t base, size_t *top, unsigned query, unsigned step)
+{
+	struct state *stack;
+	size_t idx, alloc;
+
+	if (batch->descendants)
+		for (idx = base ; idx < *top ; idx++)
+			if (batch->stack[idx].query == query && batch->stack[idx].step == step)
+				return 0;
+	if (*top == batch->alloc) {
+		alloc = batch->alloc ? batch->alloc << 1 : 64;
+		stack = realloc(batch->stack, alloc * sizeof *stack);
+		if (stack == NULL)
+			return -ENOMEM;
+		batch->stack = stack;
+		batch->alloc = alloc;
+	}
+	batch->stack[*top].query = query;
+	batch->stack[(*top)++].step = step;
+	return 0;
+}
+
+/**
+ * Check if the step matches the child of given key or index
+ *
+ * @param step the step
+ * @param child the child
+ * @param key the key of the child if in an object or NULL
+ * @param index the index of the child if in an array
+ * @param length the length of the array
+ *
+ * @return 1 if matching or 0 otherwise
+ */
+static int step_match(const struct step *step, struct json_object *child, const char *key, size_t index, size_t length)
+{
+	switch (step->type) {
+	case step_key:
+		return key ? !strcmp(key, step->name) : array_index(step, length) == (long)index;
+	case step_index:
+		return !key && array_index(step, length) == (long)index;
+	case step_filter:
+		return test(child, step->filter);
+	default:
+		return 1;
+	}
+}
+
+/**
+ * Visit the node with the states of stack from base to top
+ *
+ * @param batch the batch
+ * @param node the node to visit
+ * @param base base index of the states
+ * @param top top index of the states
+ *
+ * @return the last value returned by the callback, 0 or -ENOMEM
+ */
+static int visit(rp_jsonc_query_batch_t *batch, struct json_object *node, size_t base, size_t top);
+
+/**
+ * Visit the child of node with the states of stack from base to top
+ *
+ * @param batch the batch
+ * @param child the child node to visit
+ * @param key the key of the child if in an object or NULL
+ * @param index the index of the child if in an array
+ * @param length the length of the array
+ * @param base base index of the states of the parent
+ * @param top top index of the states of the parent
+ *
+ * @return the last value returned by the callback, 0 or -ENOMEM
+ */
+static int visit_child(
+	rp_jsonc_query_batch_t *batch,
+	struct json_object *child,
+	const char *key,
+	size_t index,
+	size_t length,
+	size_t base,
+	size_t top
+) {
+	const struct step *step;
+	struct state state;
+	size_t idx, ntop = top;
+	int rc = 0;
+
+	for (idx = base ; rc == 0 && idx < top ; idx++) {
+		state = batch->stack[idx];
+		step = state_step(batch, state);
+		if (step == NULL)
+			continue;
+		if (step->type == step_descendant)
+			rc = push(batch, top, &ntop, state.query, state.step);
+		else if (step_match(step, child, key, index, length))
+			rc = push(batch, top, &ntop, state.query, state.step + 1);
+	}
+	if (rc == 0 && ntop != top)
+		rc = visit(batch, child, top, ntop);
+	return rc;
+}
+
+/* visit a node */
+static int visit(rp_jsonc_query_batch_t *batch, struct json_object *node, size_t base, size_t top)
+{
+	struct json_object_iterator it, iend;
+	const struct step *step, *other;
+	struct json_object *child;
+	struct state state;
+	size_t idx, jdx, length;
+	long index;
+	int rc, all;
+
+	/* self part of descendants */
+	for (idx = base, rc = 0 ; rc == 0 && idx < top ; idx++) {
+		state = batch->stack[idx];
+		step = state_step(batch, state);
+		if (step != NULL && step->type == step_descendant)
+			rc = push(batch, base, &top, state.query, state.step + 1);
+	}
+
+	/* emit the results and check if iteration is needed */
+	all = 0;
+	for (idx = base ; rc == 0 && idx < top ; idx++) {
+		state = batch->stack[idx];
+		step = state_step(batch, state);
+		if (step == NULL)
+			rc = batch->callback(batch->closure, state.query, node);
+		else if (step->type != step_key && step->type != step_index)
+			all = 1;
+	}
+	if (rc != 0)
+		return rc;
+
+	/* visit the children */
+	if (json_object_is_type(node, json_type_object)) {
+		if (all) {
+			it = json_object_iter_begin(node);
+			iend = json_object_iter_end(node);
+			for ( ; rc == 0 && !json_object_iter_equal(&it, &iend) ; json_object_iter_next(&it))
+				rc = visit_child(batch, json_object_iter_peek_value(&it),
+						json_object_iter_peek_name(&it), 0, 0, base, top);
+		}
+		else {
+			/* direct access to the children, each visited once */
+			for (idx = base ; rc == 0 && idx < top ; idx++) {
+				step = state_step(batch, batch->stack[idx]);
+				if (step == NULL || step->type != step_key)
+					continue;
+				for (jdx = base ; jdx < idx ; jdx++) {
+					other = state_step(batch, batch->stack[jdx]);
+					if (other != NULL && other->type == step_key && !strcmp(other->name, step->name))
+						break;
+				}
+				if (jdx == idx && json_object_object_get_ex(node, step->name, &child))
+					rc = visit_child(batch, child, step->name, 0, 0, idx, top);
+			}
+		}
+	}
+	else if (json_object_is_type(node, json_type_array)) {
+		length = json_object_array_length(node);
+		if (all) {
+			for (idx = 0 ; rc == 0 && idx < length ; idx++)
+				rc = visit_child(batch, json_object_array_get_idx(node, (rp_jsonc_index_t)idx),
+						NULL, idx, length, base, top);
+		}
+		else {
+			/* direct access to the children, each visited once */
+			for (idx = base ; rc == 0 && idx < top ; idx++) {
+				index = array_index(state_step(batch, batch->stack[idx]), length);
+				if (index < 0)
+					continue;
+				for (jdx = base ; jdx < idx ; jdx++)
+					if (array_index(state_step(batch, batch->stack[jdx]), length) == index)
+						break;
+				if (jdx == idx)
+					rc = visit_child(batch, json_object_array_get_idx(node, (rp_jsonc_index_t)index),
+							NULL, (size_t)index, length, idx, top);
+			}
+		}
+	}
+	return rc;
+}
+
+/* evaluate the batch */
+int rp_jsonc_query_batch_until(
+	rp_jsonc_query_batch_t *batch,
+	struct json_object *root,
+	int (*callback)(void*,unsigned,struct json_object*),
+	void *closure
+) {
+	size_t top = 0;
+	unsigned iq;
+	int rc;
+
+	batch->callback = callback;
+	batch->closure = closure;
+	for (iq = 0, rc = 0 ; rc == 0 && iq < batch->count ; iq++)
+		rc = push(batch, 0, &top, iq, 0);
+	return rc ? rc : visit(batch, root, 0, top);
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <json-c/json.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * A query is a precompiled search of json objects in a tree
+ * of json-c objects.
+ *
+ * Queries are either RFC 6901 JSON pointers or expressions
+ * of the below subset of JSONPath:
+ *
+ *   - `$` the root (must be the first character)
+ *   - `.name` or `['name']` or `["name"]` the member of an object
+ *   - `[N]` the item of index N of an array, negative N count from the end
+ *   - `.*` or `[*]` all the children of an object or of an array
+ *   - `..` the descendants, as in `$..name` or `$..*` or `$..[0]`
+ *   - `[?(@REL)]` the children for which the relative path REL exists
+ *   - `[?(@REL OP VALUE)]` the children for which the value at the relative
+ *     path REL compares to VALUE using OP in `==`, `!=`, `<`, `<=`, `>`, `>=`
+ *     and VALUE is a number, a quoted string, `true`, `false` or `null`
+ *
+ * Relative paths REL are made of `.name`, `['name']` and `[N]` items.
+ * Names given after a dot also match the index of arrays when they are
+ * integers, as do the reference tokens of JSON pointers.
+ *
+ * Evaluation of single queries by rp_jsonc_query_get, rp_jsonc_query_until
+ * and rp_jsonc_query_for_all doesn't allocate memory. The evaluation of
+ * batches by rp_jsonc_query_batch_until grows the working area of the
+ * batch when needed and can fail with -ENOMEM.
+ *
+ * Note that json-c represents the json null value by NULL.
+ * So the callbacks can receive NULL.
+ */
+typedef struct rp_jsonc_query rp_jsonc_query_t;
+
+/**
+ * A batch is a set of queries evaluated together on a single traversal
+ */
+typedef struct rp_jsonc_query_batch rp_jsonc_query_batch_t;
+
+/**
+ * Compiles the RFC 6901 JSON pointer
+ *
+ * @param query   where to store the compiled query
+ * @param pointer the JSON pointer to compile
+ *
+ * @return 0 on success or -EINVAL if pointer is invalid or -ENOMEM
+ */
+extern int rp_jsonc_query_pointer(rp_jsonc_query_t **query, const char *pointer);
+
+/**
+ * Compiles the JSONPath expression
+ *
+ * @param query   where to store the compiled query
+ * @param path    the JSONPath expression to compile
+ *
+ * @return 0 on success or -EINVAL if path is invalid or -ENOMEM
+ */
+extern int rp_jsonc_query_path(rp_jsonc_query_t **query, const char *path);
+
+/**
+ * Destroys the query
+ *
+ * @param query the query to destroy (can be NULL)
+ */
+extern void rp_jsonc_query_destroy(rp_jsonc_query_t *query);
+
+/**
+ * Gets the first object of root matching the query
+ *
+ * @param query  the query
+ * @param root   the root object to query
+ * @param result where to store the found object (can be NULL)
+ *
+ * @return 1 if found or 0 otherwise
+ */
+extern int rp_jsonc_query_get(const rp_jsonc_query_t *query, struct json_object *root, struct json_object **result);
+
+/**
+ * Calls the callback for the objects of root matching the query
+ * until the callback returns a not null value.
+ *
+ * @param query    the query
+ * @param root     the root object to query
+ * @param callback the callback function receiving the closure and the object
+ * @param closure  the closure for the callback
+ *
+ * @return the last value returned by the callback or 0
+ */
+extern int rp_jsonc_query_until(
+		const rp_jsonc_query_t *query,
+		struct json_object *root,
+		int (*callback)(void*,struct json_object*),
+		void *closure);
+
+/**
+ * Calls the callback for all the objects of root matching the query.
+ *
+ * @param query    the query
+ * @param root     the root object to query
+ * @param callback the callback function receiving the closure and the object
+ * @param closure  the closure for the callback
+ */
+extern void rp_jsonc_query_for_all(
+		const rp_jsonc_query_t *query,
+		struct json_object *root,
+		void (*callback)(void*,struct json_object*),
+		void *closure);
+
+/**
+ * Creates a batch of queries. The batch refers to the given queries
+ * that must remain valid until the batch is destroyed.
+ *
+ * @param batch   where to store the created batch
+ * @param queries array of the queries of the batch
+ * @param count   count of queries in the array
+ *
+ * @return 0 on success or -ENOMEM
+ */
+extern int rp_jsonc_query_batch_create(
+		rp_jsonc_query_batch_t **batch,
+		const rp_jsonc_query_t * const *queries,
+		unsigned count);
+
+/**
+ * Destroys the batch of queries but not the queries
+ *
+ * @param batch the batch to destroy (can be NULL)
+ */
+extern void rp_jsonc_query_batch_destroy(rp_jsonc_query_batch_t *batch);
+
+/**
+ * Evaluates all the queries of the batch during one traversal of root.
+ * The callback receives the index of the matching query in the array
+ * given at creation of the batch and the matching object. The evaluation
+ * stops when the callback returns a not null value.
+ *
+ * A batch should not be evaluated by two threads at the same time
+ * because it holds a working area whose size adapts to the evaluations.
+ *
+ * @param batch    the batch of queries
+ * @param root     the root object to query
+ * @param callback the callback function receiving the closure, the index
+ *                 of the query and the object
+ * @param closure  the closure for the callback
+ *
+ * @return the last value returned by the callback, 0 or -ENOMEM
+ */
+extern int rp_jsonc_query_batch_until(
+		rp_jsonc_query_batch_t *batch,
+		struct json_object *root,
+		int (*callback)(void*,unsigned,struct json_object*),
+		void *closure);
+
+#ifdef	__cplusplus
+}
+#endif
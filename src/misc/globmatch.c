@@ -23,64 +23,152 @@
  */
 
 #include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "globmatch.h"
 
 #define TOLOWER(ch)        (tolower((int)(unsigned char)(ch)))
-#define EQ(flags,cha,chb)  ((flags & FNM_CASEFOLD) ? \
-				(TOLOWER(cha) == TOLOWER(chb)) : (cha == chb))
+#define EQ(flags,cha,chb)  ((cha) == (chb) || ((flags & FNM_CASEFOLD) && \
+				TOLOWER(cha) == TOLOWER(chb)))
 
 /**
- * Matches whether the string 'str' matches the pattern 'pat'
- * and returns its matching score.
+ * Computes the matching score of the pattern 'pat', that is
+ * the count of its literal characters plus one.
+ * The character following a glob is always literal.
  *
  * @param pat the glob pattern
- * @param str the string to match
- * @return 0 if no match or number representing the matching score
+ * @return the score of the pattern when it matches
  */
-static unsigned match(const char *pat, const char *str, int flags)
+static unsigned score(const char *pat)
 {
-	unsigned r, rs, rr;
-	char c, x;
+	unsigned r;
+	char c;
 
-	/* scan the prefix without glob */
 	r = 1;
-	while ((c = *pat++) != GLOB) {
-		x = *str++;
-		if (!EQ(flags,c,x))
-			return 0; /* no match */
-		if (!c)
-			return r; /* match up to end */
-		r++;
+	while ((c = *pat++)) {
+		if (c != GLOB)
+			r++;
+		else if (*pat) {
+			pat++;
+			r++;
+		}
 	}
+	return r;
+}
+
+/**
+ * Checks whether the string 'str' matches the pattern 'pat'
+ * when globs can match any character.
+ *
+ * Uses the greedy technique: on mismatch, only the last glob
+ * is extended by one character, giving O(len(pat) x len(str)).
+ *
+ * @param pat the glob pattern
+ * @param str the string to match
+ * @param flags the flags (only FNM_CASEFOLD is used)
+ * @return 1 if matching or 0 otherwise
+ */
+static int match_any(const char *pat, const char *str, int flags)
+{
+	const char *bpat, *bstr;
+	int lit;
+	char c;
 
-	/* glob found */
-	c = *pat++;
-	if (!c) {
-		/* not followed by pattern */
-		if (flags & FNM_PATHNAME) {
-			while(*str)
-				if (*str++ == '/')
-					return 0;
+	bpat = bstr = NULL;
+	lit = 0; /* is the character at pat literal? */
+	for (;;) {
+		c = *pat;
+		if (c == GLOB && !lit) {
+			/* glob found, remember where to restart */
+			bpat = ++pat;
+			if (!*pat)
+				return 1; /* not followed by pattern */
+			bstr = str;
+			lit = 1;
+		}
+		else if (!c) {
+			if (!*str)
+				return 1; /* match up to end */
+			if (!bpat)
+				return 0;
+			pat = bpat;
+			str = ++bstr;
+			lit = 1;
+		}
+		else if (*str && EQ(flags, c, *str)) {
+			pat++;
+			str++;
+			lit = 0;
+		}
+		else {
+			/* no match, extend the last glob if any */
+			if (!bpat || !*bstr)
+				return 0;
+			pat = bpat;
+			str = ++bstr;
+			lit = 1;
 		}
-		return r;
 	}
+}
+
+/**
+ * Checks whether the string 'str' matches the pattern 'pat'
+ * when globs can't match the character /.
+ *
+ * Uses dynamic programming: the row tells for each position of
+ * the string if the pattern processed so far matches up to it,
+ * giving O(len(pat) x len(str)).
+ *
+ * @param pat the glob pattern
+ * @param str the string to match
+ * @param flags the flags (only FNM_CASEFOLD is used)
+ * @return 1 if matching or 0 otherwise
+ */
+static int match_path(const char *pat, const char *str, int flags)
+{
+	size_t len, j;
+	char *row, c, any;
 
-	/* evaluate the best score for following pattern */
-	rs = 0;
-	while (*str) {
-		x = *str++;
-		if (EQ(flags,c,x)) {
-			/* first char matches, check remaining string */
-			rr = match(pat, str, flags);
-			if (rr > rs)
-				rs = rr;
-		} else if ((flags & FNM_PATHNAME) && x == '/')
+	len = strlen(str);
+	row = alloca(len + 1);
+	memset(row, 0, len + 1);
+	row[0] = 1;
+	while ((c = *pat++)) {
+		if (c == GLOB) {
+			/* glob followed by the literal c */
+			c = *pat;
+			for (j = 1 ; j <= len ; j++)
+				if (!row[j] && row[j - 1] && str[j - 1] != '/')
+					row[j] = 1;
+			if (!c)
+				break;
+			pat++;
+		}
+		/* literal c */
+		for (j = len, any = 0 ; j ; j--) {
+			row[j] = row[j - 1] && EQ(flags, c, str[j - 1]);
+			any |= row[j];
+		}
+		row[0] = 0;
+		if (!any)
 			return 0;
 	}
+	return row[len];
+}
 
-	/* best score or not match if rs == 0 */
-	return rs ? rs + r : 0;
+/**
+ * Matches whether the string 'str' matches the pattern 'pat'
+ * and returns its matching score.
+ *
+ * @param pat the glob pattern
+ * @param str the string to match
+ * @return 0 if no match or number representing the matching score
+ */
+static unsigned match(const char *pat, const char *str, int flags)
+{
+	int ok = (flags & FNM_PATHNAME) ? match_path(pat, str, flags) : match_any(pat, str, flags);
+	return ok ? score(pat) : 0;
 }
 
 /**
@@ -29,6 +29,7 @@
 #include "globset.h"
 #include "globmatch.h"
 #include "../sys/x-errno.h"
+#include "../sys/x-mutex.h"
 
 /*************************************************************************
  * internal types
@@ -39,164 +40,1028 @@
  */
 struct pathndl
 {
-	/* link to the next handler of the list */
-	struct pathndl *next;
+	/* score of the pattern when matching (see globmatch) */
+	unsigned score;
 
-	/* the hash value for the pattern */
-	size_t hash;
+	/* not zero for exact patterns, i.e. patterns without glob */
+	unsigned exact;
+
+	/* sequence number of addition of the pattern */
+	unsigned long seqno;
 
 	/* the handler */
 	struct globset_handler handler;
 };
 
+/**
+ * Edge of the automaton
+ */
+struct edge
+{
+	/* the character of the edge */
+	char c;
+
+	/* the node reached */
+	struct node *node;
+};
+
+/**
+ * Edges of a node, never modified once published
+ */
+struct edges
+{
+	/* count of edges */
+	unsigned count;
+
+	/* edges sorted by character */
+	struct edge items[];
+};
+
+/**
+ * Node of the automaton compiling patterns
+ *
+ * The automaton is a trie of the patterns in which a glob
+ * is an edge (star) to a node that loops on any character.
+ * As in globmatch, the character following a glob is always literal.
+ *
+ * Readers access nodes without locking (RCU like): writers publish
+ * new data with atomic stores and retire the replaced data until
+ * readers that could see it are gone.
+ */
+struct node
+{
+	/* the node following a glob or NULL */
+	struct node *star;
+
+	/* the pattern ending at this node or NULL */
+	struct pathndl *ph;
+
+	/* the edges or NULL */
+	struct edges *edges;
+};
+
+/**
+ * List of retired memory blocks
+ */
+struct retired
+{
+	/* the blocks */
+	void **items;
+
+	/* count of blocks */
+	unsigned count;
+
+	/* allocated count of blocks */
+	unsigned size;
+};
+
 /**
  * Structure that handles a set of global pattern handlers
  */
 struct globset
 {
-	/** linked list of global patterns */
-	struct pathndl *globs;
+	/** root of the automaton of patterns */
+	struct node root;
 
-	/** hash dictionary of exact matches */
-	struct pathndl **exacts;
+	/** sequence number of the next added pattern */
+	unsigned long seqno;
 
-	/** mask used for accessing dictionary of exact matches */
-	unsigned gmask;
+	/** current reading epoch (0 or 1) */
+	unsigned epoch;
 
-	/** count of handlers stored in the dictionary of exact matches */
+	/** count of readers per epoch */
+	unsigned readers[2];
+
+	/** memory retired during each epoch */
+	struct retired retired[2];
+
+	/** mutual exclusion of writers */
+	x_mutex_t mutex;
+};
+
+/**
+ * count of items of vectors before allocation
+ */
+#define LOCAL_COUNT	16
+
+/**
+ * Vector of nodes or of handlers
+ */
+struct vec
+{
+	/* the items */
+	void **items;
+
+	/* count of items */
 	unsigned count;
+
+	/* allocated count of items */
+	unsigned size;
+
+	/* local storage avoiding allocation */
+	void *local[LOCAL_COUNT];
+};
+
+/**
+ * Slot of the hash set of active looping nodes
+ */
+struct slot
+{
+	/* the node */
+	struct node *node;
+
+	/* its index in the vector of stars */
+	unsigned index;
+};
+
+/**
+ * Active nodes after consuming some characters of a text
+ */
+struct level
+{
+	/* first active node in the vector of lits */
+	unsigned begin;
+
+	/* end of active nodes in the vector of lits */
+	unsigned end;
+
+	/* count of active looping nodes */
+	unsigned nstars;
+};
+
+/**
+ * State of the automaton when matching
+ */
+struct run
+{
+	/* stack of the active nodes of all levels */
+	struct vec lits;
+
+	/* stack of active looping nodes, they remain active once reached */
+	struct vec stars;
+
+	/* levels */
+	struct level *levels;
+
+	/* allocated count of levels */
+	unsigned nlevels;
+
+	/* count of computed levels */
+	unsigned top;
+
+	/* hash set of stars */
+	struct slot *slots;
+
+	/* mask of the hash set */
+	unsigned mask;
+
+	/* count of used slots */
+	unsigned used;
+
+	/* error status */
+	int error;
+
+	/* local storage of the levels */
+	struct level llevels[4 * LOCAL_COUNT];
+
+	/* local storage of the hash set */
+	struct slot lslots[2 * LOCAL_COUNT];
+};
+
+/**
+ * Text of a batch
+ */
+struct batch
+{
+	/* the text */
+	const char *text;
+
+	/* its index in the batch */
+	unsigned index;
 };
 
+/*************************************************************************
+ * patterns and texts
+ ************************************************************************/
+
 /**
- * Normalize the string 'from' to the string 'to' and computes the hash code.
+ * Normalize the string 'from' to the string 'to'.
  * The normalization translates upper characters to lower characters.
- * The returned hash code is greater than zero for exact patterns or zero
- * for global patterns.
  *
  * @param from string to normalize
  * @param to where to store the normalization
- * @return 0 if 'from' is a glob pattern or the hash code for exacts patterns
+ * @return 0 if 'from' is a glob pattern or 1 for exacts patterns
  */
-static unsigned normhash(const char *from, char *to)
+static int normalize(const char *from, char *to)
 {
-	unsigned i, hash;
-	int isglob;
+	int exact;
 	char c;
 
-	isglob = 0; /* is glob? */
-	i = hash = 0; /* index and hash code */
-
-	/* copy the normalized string and compute isglob and hash */
-	while ((c = from[i])) {
-		if (c == GLOB) {
-			/* it is a glob pattern */
-			isglob = 1;
-			hash = 0;
-		} else {
-			/* normalize to lower */
-			if (c >= 'A' && c <= 'Z')
-				c = (char)(c + 'a' - 'A');
-			/* compute hash if not glob */
-			if (!isglob) {
-				hash += (unsigned)(unsigned char)c;
-				hash += hash << 10;
-				hash ^= hash >> 6;
+	exact = 1;
+	while ((c = *from++)) {
+		if (c == GLOB)
+			exact = 0;
+		else if (c >= 'A' && c <= 'Z')
+			c = (char)(c + 'a' - 'A');
+		*to++ = c;
+	}
+	*to = c;
+	return exact;
+}
+
+/**
+ * Compare the two texts without regard to case
+ */
+static int textcmp(const char *a, const char *b)
+{
+	char ca, cb;
+
+	do {
+		ca = *a++;
+		cb = *b++;
+		if (ca >= 'A' && ca <= 'Z')
+			ca = (char)(ca + 'a' - 'A');
+		if (cb >= 'A' && cb <= 'Z')
+			cb = (char)(cb + 'a' - 'A');
+	} while (ca && ca == cb);
+	return (int)(unsigned char)ca - (int)(unsigned char)cb;
+}
+
+/**
+ * Compute the length of the common prefix of the texts without regard to case
+ */
+static unsigned textprefix(const char *a, const char *b)
+{
+	unsigned n;
+	char ca, cb;
+
+	for (n = 0 ; ; n++) {
+		ca = a[n];
+		cb = b[n];
+		if (ca >= 'A' && ca <= 'Z')
+			ca = (char)(ca + 'a' - 'A');
+		if (cb >= 'A' && cb <= 'Z')
+			cb = (char)(cb + 'a' - 'A');
+		if (!ca || ca != cb)
+			return n;
+	}
+}
+
+/**
+ * Compare texts of batch for sorting them
+ */
+static int batchcmp(const void *a, const void *b)
+{
+	const struct batch *ba = a, *bb = b;
+	int r = textcmp(ba->text, bb->text);
+	return r ? r : (int)ba->index - (int)bb->index;
+}
+
+/**
+ * Tells whether the handler a is better than the handler b
+ * with same rules as globmatch but exact patterns first.
+ */
+static int better(const struct pathndl *a, const struct pathndl *b)
+{
+	if (!b || a->score > b->score)
+		return 1;
+	if (a->score < b->score)
+		return 0;
+	if (a->exact != b->exact)
+		return a->exact;
+	return a->seqno < b->seqno;
+}
+
+/**
+ * Compare handlers for sorting them from best to worst
+ */
+static int phcmp(const void *a, const void *b)
+{
+	const struct pathndl *pa = *(void * const *)a;
+	const struct pathndl *pb = *(void * const *)b;
+	return pa == pb ? 0 : better(pa, pb) ? -1 : 1;
+}
+
+/*************************************************************************
+ * read-copy-update
+ ************************************************************************/
+
+/**
+ * Atomic reading of pointers published by writers
+ */
+#define LOAD(ptr)		__atomic_load_n(&(ptr), __ATOMIC_ACQUIRE)
+
+/**
+ * Atomic publication of pointers by writers
+ */
+#define PUBLISH(ptr,val)	__atomic_store_n(&(ptr), (val), __ATOMIC_RELEASE)
+
+/**
+ * Enter a reading section. The memory accessed through the
+ * automaton remains valid until the section is left.
+ *
+ * @param set the set
+ * @return the epoch to give to read_unlock
+ */
+static unsigned read_lock(struct globset *set)
+{
+	unsigned epoch;
+
+	for (;;) {
+		epoch = __atomic_load_n(&set->epoch, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&set->readers[epoch], 1, __ATOMIC_SEQ_CST);
+		if (epoch == __atomic_load_n(&set->epoch, __ATOMIC_SEQ_CST))
+			return epoch;
+		__atomic_sub_fetch(&set->readers[epoch], 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+/**
+ * Leave a reading section
+ *
+ * @param set the set
+ * @param epoch the value returned by read_lock
+ */
+static void read_unlock(struct globset *set, unsigned epoch)
+{
+	__atomic_sub_fetch(&set->readers[epoch], 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Release the retired memory blocks of the list
+ */
+static void release(struct retired *list)
+{
+	while (list->count)
+		free(list->items[--list->count]);
+}
+
+/**
+ * Release the memory retired that can no more be read
+ * and switch the epoch if possible.
+ * Must be called by writers.
+ *
+ * @param set the set
+ */
+static void reclaim(struct globset *set)
+{
+	unsigned previous = set->epoch ^ 1;
+
+	if (!__atomic_load_n(&set->readers[previous], __ATOMIC_SEQ_CST)) {
+		release(&set->retired[previous]);
+		__atomic_store_n(&set->epoch, previous, __ATOMIC_SEQ_CST);
+	}
+}
+
+/**
+ * Retire the memory block, it will be released when no reader
+ * can access it. Must be called by writers.
+ *
+ * @param set the set
+ * @param ptr the block to retire
+ */
+static void retire(struct globset *set, void *ptr)
+{
+	struct retired *list;
+	unsigned size;
+	void **items;
+
+	list = &set->retired[set->epoch];
+	if (list->count == list->size) {
+		size = list->size ? list->size << 1 : 16;
+		items = realloc(list->items, size * sizeof *items);
+		if (!items) {
+			/* out of memory, wait until no reader can access ptr */
+			for (size = 0 ; size < 2 ; size++) {
+				while (__atomic_load_n(&set->readers[set->epoch ^ 1], __ATOMIC_SEQ_CST))
+					;
+				reclaim(set);
 			}
+			free(ptr);
+			return;
 		}
-		to[i++] = c;
-	}
-	to[i] = c;
-	if (!isglob) {
-		/* finalize hash if not glob */
-		hash += i;
-		hash += hash << 3;
-		hash ^= hash >> 11;
-		hash += hash << 15;
-		if (hash == 0)
-			hash = 1 + i;
+		list->items = items;
+		list->size = size;
 	}
-	return hash;
+	list->items[list->count++] = ptr;
 }
 
+/*************************************************************************
+ * automaton
+ ************************************************************************/
+
 /**
- * Ensure that there is enough place to store one more exact pattern
- * in the dictionary.
+ * Search the edge of character c in the edges
  *
- * @param set the set that has to grow if needed
- * @return 0 in case of success or -1 on case of error
+ * @param edges the edges (can be NULL)
+ * @param c the character
+ * @param index where to store the index of the edge or of its insertion
+ * @return the node reached by the edge or NULL if none
  */
-static int grow(struct globset *set)
+static struct node *edge_search(const struct edges *edges, char c, unsigned *index)
 {
-	unsigned old_gmask, new_gmask, i;
-	struct pathndl **new_exacts, **old_exacts, *ph, *next_ph;
+	unsigned lo, hi, mid;
 
-	/* test if grow is needed */
-	old_gmask = set->gmask;
-	if (old_gmask - (old_gmask >> 2) > set->count + 1)
-		return 0;
+	lo = 0;
+	hi = edges ? edges->count : 0;
+	while (lo < hi) {
+		mid = (lo + hi) >> 1;
+		if (edges->items[mid].c == c) {
+			if (index)
+				*index = mid;
+			return edges->items[mid].node;
+		}
+		if ((unsigned char)edges->items[mid].c < (unsigned char)c)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (index)
+		*index = lo;
+	return NULL;
+}
 
-	/* compute the new mask */
-	new_gmask = (old_gmask << 1) | 15;
-	if (new_gmask + 1 <= new_gmask)
-		return X_EOVERFLOW;
+/**
+ * Get the node following 'node' for the character c
+ */
+static struct node *next_node(struct node *node, char c)
+{
+	return edge_search(LOAD(node->edges), c, NULL);
+}
 
-	/* allocates the new array */
-	new_exacts = calloc(1 + (size_t)new_gmask, sizeof *new_exacts);
-	if (!new_exacts)
-		return X_ENOMEM;
+/**
+ * Release the node, its descendants and their handlers.
+ * Must be called only when no reader can access it.
+ *
+ * @param node the node to release
+ */
+static void node_clear(struct node *node)
+{
+	unsigned i;
+
+	if (node->edges) {
+		for (i = 0 ; i < node->edges->count ; i++) {
+			node_clear(node->edges->items[i].node);
+			free(node->edges->items[i].node);
+		}
+		free(node->edges);
+	}
+	if (node->star) {
+		node_clear(node->star);
+		free(node->star);
+	}
+	free(node->ph);
+}
+
+/**
+ * Create the private chain of nodes for the end of a normalized pattern
+ *
+ * @param pat the end of the normalized pattern
+ * @param afterglob tells if pat follows a glob
+ * @param ph the handler of the pattern
+ * @return the head of the chain or NULL when out of memory
+ */
+static struct node *chain(const char *pat, int afterglob, struct pathndl *ph)
+{
+	struct node *head, *node, *next;
+	struct edges *edges;
+	char c;
 
-	/* copy values */
-	old_exacts = set->exacts;
-	set->exacts = new_exacts;
-	set->gmask = new_gmask;
-	if (old_gmask) {
-		for(i = 0 ; i <= old_gmask ; i++) {
-			ph = old_exacts[i];
-			while (ph) {
-				next_ph = ph->next;
-				ph->next = new_exacts[ph->hash & new_gmask];
-				new_exacts[ph->hash & new_gmask] = ph;
-				ph = next_ph;
+	head = node = calloc(1, sizeof *node);
+	while (node && (c = *pat++)) {
+		next = calloc(1, sizeof *next);
+		if (!next)
+			node = NULL;
+		else if (c == GLOB && !afterglob) {
+			node->star = next;
+			node = next;
+			afterglob = 1;
+		}
+		else {
+			edges = malloc(sizeof *edges + sizeof *edges->items);
+			if (!edges) {
+				free(next);
+				node = NULL;
+			}
+			else {
+				edges->count = 1;
+				edges->items[0].c = c;
+				edges->items[0].node = next;
+				node->edges = edges;
+				node = next;
+				afterglob = 0;
 			}
 		}
-		free(old_exacts);
 	}
+	if (!node) {
+		if (head) {
+			node_clear(head);
+			free(head);
+		}
+		return NULL;
+	}
+	node->ph = ph;
+	return head;
+}
+
+/**
+ * Search the handler of the normalized pattern in the automaton
+ *
+ * @param set the set
+ * @param pat the normalized pattern
+ * @return the handler found or NULL
+ */
+static struct pathndl *auto_find(struct globset *set, const char *pat)
+{
+	struct node *node;
+	int afterglob;
+	char c;
+
+	node = &set->root;
+	afterglob = 0;
+	while (node && (c = *pat++)) {
+		if (c == GLOB && !afterglob) {
+			node = LOAD(node->star);
+			afterglob = 1;
+		}
+		else {
+			node = next_node(node, c);
+			afterglob = 0;
+		}
+	}
+	return node ? LOAD(node->ph) : NULL;
+}
 
-	/* release the previous values */
+/**
+ * Add the normalized pattern of the handler to the automaton.
+ * The pattern must not be already in the automaton.
+ *
+ * @param set the set
+ * @param ph the handler of the pattern
+ * @return 0 in case of success or X_ENOMEM
+ */
+static int auto_add(struct globset *set, struct pathndl *ph)
+{
+	struct node *node, *next;
+	struct edges *edges, *nedges;
+	const char *pat;
+	unsigned score, idx, count;
+	int afterglob;
+	char c;
+
+	/* compute the score */
+	score = 1;
+	afterglob = 0;
+	for (pat = ph->handler.pattern ; (c = *pat) ; pat++) {
+		if (c != GLOB || afterglob)
+			score++;
+		afterglob = c == GLOB && !afterglob;
+	}
+	ph->score = score;
+	ph->seqno = set->seqno++;
+
+	/* follow the existing nodes */
+	node = &set->root;
+	afterglob = 0;
+	pat = ph->handler.pattern;
+	while ((c = *pat++)) {
+		if (c == GLOB && !afterglob) {
+			next = node->star;
+			if (!next) {
+				/* publish a new looping node */
+				next = chain(pat, 1, ph);
+				if (!next)
+					return X_ENOMEM;
+				PUBLISH(node->star, next);
+				return 0;
+			}
+			afterglob = 1;
+		}
+		else {
+			edges = node->edges;
+			next = edge_search(edges, c, &idx);
+			if (!next) {
+				/* publish new edges */
+				count = edges ? edges->count : 0;
+				nedges = malloc(sizeof *nedges + (count + 1) * sizeof *nedges->items);
+				next = nedges ? chain(pat, 0, ph) : NULL;
+				if (!next) {
+					free(nedges);
+					return X_ENOMEM;
+				}
+				nedges->count = count + 1;
+				if (count) {
+					memcpy(nedges->items, edges->items, idx * sizeof *edges->items);
+					memcpy(&nedges->items[idx + 1], &edges->items[idx],
+							(count - idx) * sizeof *edges->items);
+				}
+				nedges->items[idx].c = c;
+				nedges->items[idx].node = next;
+				PUBLISH(node->edges, nedges);
+				if (edges)
+					retire(set, edges);
+				return 0;
+			}
+			afterglob = 0;
+		}
+		node = next;
+	}
+	PUBLISH(node->ph, ph);
 	return 0;
 }
 
 /**
- * Search in set the handler for the normalized pattern 'normal' of 'has' code.
+ * Remove the normalized pattern 'pat' from the automaton
+ * starting at node, pruning the nodes becoming empty
  *
- * @param set the set to search
- * @param normal the normalized pattern
- * @param hash hash code of the normalized pattern
- * @param pprev pointer where to store the pointer pointing to the returned result
- * @return the handler found, can be NULL
+ * @param set the set
+ * @param node the node where pat starts
+ * @param pat the pattern to remove
+ * @param afterglob tells if pat follows a glob
+ * @return 1 if the node became empty or 0 otherwise
  */
-static struct pathndl *search(
-		struct globset *set,
-		const char *normal,
-		unsigned hash,
-		struct pathndl ***pprev)
+static int auto_del(struct globset *set, struct node *node, const char *pat, int afterglob)
 {
-	struct pathndl *ph, **pph;
+	struct node *next;
+	struct edges *edges, *nedges;
+	unsigned idx, count;
 
-	if (!hash)
-		pph = &set->globs;
-	else if (set->exacts)
-		pph = &set->exacts[hash & set->gmask];
+	if (!*pat) {
+		retire(set, node->ph);
+		PUBLISH(node->ph, NULL);
+	}
+	else if (*pat == GLOB && !afterglob) {
+		next = node->star;
+		if (next && auto_del(set, next, pat + 1, 1)) {
+			PUBLISH(node->star, NULL);
+			retire(set, next);
+		}
+	}
 	else {
-		*pprev = NULL;
-		return NULL;
+		edges = node->edges;
+		next = edge_search(edges, *pat, &idx);
+		if (next && auto_del(set, next, pat + 1, 0)) {
+			/* publish the edges without the removed one */
+			count = edges->count - 1;
+			if (!count)
+				nedges = NULL;
+			else {
+				nedges = malloc(sizeof *nedges + count * sizeof *nedges->items);
+				if (!nedges)
+					/* keep the empty node */
+					return 0;
+				nedges->count = count;
+				memcpy(nedges->items, edges->items, idx * sizeof *edges->items);
+				memcpy(&nedges->items[idx], &edges->items[idx + 1],
+						(count - idx) * sizeof *edges->items);
+			}
+			PUBLISH(node->edges, nedges);
+			retire(set, edges);
+			retire(set, next);
+		}
+	}
+	return !node->ph && !node->star && !node->edges;
+}
+
+/*************************************************************************
+ * running the automaton
+ ************************************************************************/
+
+/**
+ * Initialize the vector
+ */
+static void vec_init(struct vec *vec)
+{
+	vec->items = vec->local;
+	vec->count = 0;
+	vec->size = LOCAL_COUNT;
+}
+
+/**
+ * Release the memory of the vector
+ */
+static void vec_release(struct vec *vec)
+{
+	if (vec->items != vec->local)
+		free(vec->items);
+}
+
+/**
+ * Append the item to the vector
+ *
+ * @return 0 in case of success or X_ENOMEM
+ */
+static int vec_push(struct vec *vec, void *item)
+{
+	void **items;
+
+	if (vec->count == vec->size) {
+		items = malloc(2 * vec->size * sizeof *items);
+		if (!items)
+			return X_ENOMEM;
+		memcpy(items, vec->items, vec->count * sizeof *items);
+		vec_release(vec);
+		vec->items = items;
+		vec->size <<= 1;
+	}
+	vec->items[vec->count++] = item;
+	return 0;
+}
+
+/**
+ * Search the slot of the node in the hash set of stars.
+ * Slots whose index is no more valid are considered as free.
+ *
+ * @param run the running state
+ * @param node the node to search
+ * @param found where to store if the node is active
+ * @return the found slot or the first free slot
+ */
+static struct slot *star_slot(struct run *run, struct node *node, int *found)
+{
+	struct slot *slot, *avail;
+	unsigned h;
+
+	avail = NULL;
+	h = (unsigned)(((size_t)node >> 4) * 2654435761u);
+	for (;; h++) {
+		slot = &run->slots[h & run->mask];
+		if (!slot->node)
+			break;
+		if (slot->index < run->stars.count && run->stars.items[slot->index] == slot->node) {
+			if (slot->node == node) {
+				*found = 1;
+				return slot;
+			}
+		}
+		else if (!avail)
+			avail = slot;
+	}
+	*found = 0;
+	return avail ? avail : slot;
+}
+
+/**
+ * Activate the looping node if not already active
+ */
+static void activate_star(struct run *run, struct node *node)
+{
+	struct slot *slot, *slots;
+	unsigned i, mask;
+	int found;
+
+	slot = star_slot(run, node, &found);
+	if (found)
+		return;
+
+	if (vec_push(&run->stars, node)) {
+		run->error = X_ENOMEM;
+		return;
+	}
+	if (!slot->node)
+		run->used++;
+	slot->node = node;
+	slot->index = run->stars.count - 1;
+	if (run->used <= (run->mask >> 1))
+		return;
+
+	/* grow the hash set, dropping the invalid slots */
+	mask = run->stars.count <= (run->mask >> 2) ? run->mask : (run->mask << 1) | 1;
+	slots = calloc(1 + (size_t)mask, sizeof *slots);
+	if (!slots) {
+		run->error = X_ENOMEM;
+		return;
+	}
+	if (run->slots != run->lslots)
+		free(run->slots);
+	run->slots = slots;
+	run->mask = mask;
+	run->used = run->stars.count;
+	for (i = 0 ; i < run->stars.count ; i++) {
+		slot = star_slot(run, run->stars.items[i], &found);
+		slot->node = run->stars.items[i];
+		slot->index = i;
+	}
+}
+
+/**
+ * Activate the node and the looping node following it
+ */
+static void activate(struct run *run, struct node *node)
+{
+	struct node *star;
+
+	if (vec_push(&run->lits, node))
+		run->error = X_ENOMEM;
+	star = LOAD(node->star);
+	if (star)
+		activate_star(run, star);
+}
+
+/**
+ * Initialize the running state with the active nodes of level 0
+ */
+static void run_init(struct run *run, struct globset *set)
+{
+	vec_init(&run->lits);
+	vec_init(&run->stars);
+	memset(run->lslots, 0, sizeof run->lslots);
+	run->slots = run->lslots;
+	run->mask = 2 * LOCAL_COUNT - 1;
+	run->used = 0;
+	run->levels = run->llevels;
+	run->nlevels = 4 * LOCAL_COUNT;
+	run->error = 0;
+
+	activate(run, &set->root);
+	run->levels[0].begin = 0;
+	run->levels[0].end = run->lits.count;
+	run->levels[0].nstars = run->stars.count;
+	run->top = 0;
+}
+
+/**
+ * Release the memory of the running state
+ */
+static void run_release(struct run *run)
+{
+	vec_release(&run->lits);
+	vec_release(&run->stars);
+	if (run->slots != run->lslots)
+		free(run->slots);
+	if (run->levels != run->llevels)
+		free(run->levels);
+}
+
+/**
+ * Run the automaton for the text whose 'prefix' first characters
+ * are the same as the previous text.
+ *
+ * @param run the running state
+ * @param text the text
+ * @param prefix length of the prefix common with the previous text
+ * @return the level of the end of the text or NULL if no pattern can match
+ */
+static struct level *run_text(struct run *run, const char *text, unsigned prefix)
+{
+	struct level *level, *levels;
+	struct node *node;
+	unsigned depth, i;
+	char c;
+
+	/* restore the common level */
+	depth = prefix < run->top ? prefix : run->top;
+	level = &run->levels[depth];
+	run->lits.count = level->end;
+	run->stars.count = level->nstars;
+
+	/* one pass over the remaining text */
+	while ((c = text[depth]) && (level->begin != level->end || level->nstars) && !run->error) {
+		if (c >= 'A' && c <= 'Z')
+			c = (char)(c + 'a' - 'A');
+		if (depth + 1 == run->nlevels) {
+			levels = malloc(2 * run->nlevels * sizeof *levels);
+			if (!levels) {
+				run->error = X_ENOMEM;
+				break;
+			}
+			memcpy(levels, run->levels, run->nlevels * sizeof *levels);
+			if (run->levels != run->llevels)
+				free(run->levels);
+			run->levels = levels;
+			run->nlevels <<= 1;
+		}
+		level = &run->levels[depth];
+		for (i = level->begin ; i < level->end ; i++) {
+			node = next_node(run->lits.items[i], c);
+			if (node)
+				activate(run, node);
+		}
+		for (i = 0 ; i < level->nstars ; i++) {
+			node = next_node(run->stars.items[i], c);
+			if (node)
+				activate(run, node);
+		}
+		level[1].begin = level->end;
+		level[1].end = run->lits.count;
+		level[1].nstars = run->stars.count;
+		level++;
+		depth++;
+	}
+	run->top = depth;
+	return c || run->error ? NULL : level;
+}
+
+/**
+ * Get the best handler of the level
+ */
+static struct pathndl *level_best(struct run *run, struct level *level)
+{
+	struct pathndl *ph, *best;
+	struct node *node;
+	unsigned i;
+
+	best = NULL;
+	for (i = level->begin ; i < level->end ; i++) {
+		node = run->lits.items[i];
+		ph = LOAD(node->ph);
+		if (ph && better(ph, best))
+			best = ph;
+	}
+	for (i = 0 ; i < level->nstars ; i++) {
+		node = run->stars.items[i];
+		ph = LOAD(node->ph);
+		if (ph && better(ph, best))
+			best = ph;
+	}
+	return best;
+}
+
+/**
+ * Get all the handlers of the level sorted from best to worst
+ *
+ * @param run the running state
+ * @param level the level
+ * @param result vector receiving the handlers
+ * @return 0 on success or X_ENOMEM
+ */
+static int level_all(struct run *run, struct level *level, struct vec *result)
+{
+	struct pathndl *ph;
+	struct node *node;
+	unsigned i;
+
+	result->count = 0;
+	for (i = level->begin ; i < level->end ; i++) {
+		node = run->lits.items[i];
+		ph = LOAD(node->ph);
+		if (ph && vec_push(result, ph))
+			return X_ENOMEM;
+	}
+	for (i = 0 ; i < level->nstars ; i++) {
+		node = run->stars.items[i];
+		ph = LOAD(node->ph);
+		if (ph && vec_push(result, ph))
+			return X_ENOMEM;
+	}
+	qsort(result->items, result->count, sizeof *result->items, phcmp);
+	return 0;
+}
+
+/**
+ * Scan the patterns of the node and its descendants for the best
+ * match of the normalized text
+ *
+ * @param node the node to scan
+ * @param txt the normalized text to match
+ * @param best where is stored the best handler found
+ */
+static void scan(struct node *node, const char *txt, struct pathndl **best)
+{
+	struct pathndl *ph;
+	struct edges *edges;
+	struct node *star;
+	unsigned i;
+
+	ph = LOAD(node->ph);
+	if (ph && (ph->exact ? !strcmp(ph->handler.pattern, txt) : globmatch(ph->handler.pattern, txt))
+	 && better(ph, *best))
+		*best = ph;
+	edges = LOAD(node->edges);
+	for (i = 0 ; edges && i < edges->count ; i++)
+		scan(edges->items[i].node, txt, best);
+	star = LOAD(node->star);
+	if (star)
+		scan(star, txt, best);
+}
+
+/**
+ * Sort the texts of the batch
+ *
+ * @param texts the texts
+ * @param count count of texts
+ * @return the sorted batch or NULL when out of memory
+ */
+static struct batch *sort_batch(const char * const texts[], unsigned count)
+{
+	struct batch *batch;
+	unsigned i;
+
+	batch = malloc((count ? count : 1) * sizeof *batch);
+	if (batch) {
+		for (i = 0 ; i < count ; i++) {
+			batch[i].text = texts[i];
+			batch[i].index = i;
+		}
+		qsort(batch, count, sizeof *batch, batchcmp);
 	}
-	while ((ph = *pph) && strcmp(normal, ph->handler.pattern))
-		pph = &ph->next;
-	*pprev = pph;
-	return ph;
+	return batch;
 }
 
+/*************************************************************************
+ * public functions
+ ************************************************************************/
+
 /**
  * Allocates a new set of handlers
  *
@@ -204,7 +1069,12 @@ static struct pathndl *search(
  */
 struct globset *globset_create()
 {
-	return calloc(1, sizeof(struct globset));
+	struct globset *set;
+
+	set = calloc(1, sizeof *set);
+	if (set)
+		x_mutex_init(&set->mutex);
+	return set;
 }
 
 /**
@@ -213,31 +1083,17 @@ struct globset *globset_create()
  */
 void globset_destroy(struct globset *set)
 {
-	unsigned i;
-	struct pathndl *ph, *next_ph;
-
-	/* free exact pattern handlers */
-	if (set->gmask) {
-		for(i = 0 ; i <= set->gmask ; i++) {
-			ph = set->exacts[i];
-			while (ph) {
-				next_ph = ph->next;
-				free(ph);
-				ph = next_ph;
-			}
-		}
-		free(set->exacts);
-	}
+	/* free retired memory */
+	release(&set->retired[0]);
+	release(&set->retired[1]);
+	free(set->retired[0].items);
+	free(set->retired[1].items);
 
-	/* free global pattern handlers */
-	ph = set->globs;
-	while (ph) {
-		next_ph = ph->next;
-		free(ph);
-		ph = next_ph;
-	}
+	/* free pattern handlers */
+	node_clear(&set->root);
 
 	/* free the set */
+	x_mutex_destroy(&set->mutex);
 	free(set);
 }
 
@@ -255,41 +1111,32 @@ int globset_add(
 		void *callback,
 		void *closure)
 {
-	struct pathndl *ph, **pph;
-	unsigned hash;
+	struct pathndl *ph;
 	size_t len;
-	char *pat;
+	int rc;
 
-	/* normalize */
+	/* create the handler */
 	len = strlen(pattern);
-	pat = alloca(1 + len);
-	hash = normhash(pattern, pat);
-
-	/* grows if needed */
-	if (hash && grow(set))
-		return -1;
-
-	/* search */
-	ph = search(set, pat, hash, &pph);
-	if (ph)
-		/* found */
-		return X_EEXIST;
-
-	/* not found, create it */
 	ph = malloc(1 + len + sizeof *ph);
 	if (!ph)
 		return X_ENOMEM;
 
 	/* initialize it */
-	ph->next = NULL;
-	ph->hash = hash;
+	ph->exact = (unsigned)normalize(pattern, ph->handler.pattern);
 	ph->handler.callback = callback;
 	ph->handler.closure = closure;
-	strcpy(ph->handler.pattern, pat);
-	*pph = ph;
-	if (hash)
-		set->count++;
-	return 0;
+
+	/* add it if not existing */
+	x_mutex_lock(&set->mutex);
+	if (auto_find(set, ph->handler.pattern))
+		rc = X_EEXIST;
+	else
+		rc = auto_add(set, ph);
+	reclaim(set);
+	x_mutex_unlock(&set->mutex);
+	if (rc)
+		free(ph);
+	return rc;
 }
 
 /**
@@ -304,32 +1151,31 @@ int globset_del(
 			const char *pattern,
 			void **closure)
 {
-	struct pathndl *ph, **pph;
-	unsigned hash;
+	struct pathndl *ph;
 	char *pat;
+	int rc;
 
 	/* normalize */
 	pat = alloca(1 + strlen(pattern));
-	hash = normhash(pattern, pat);
+	normalize(pattern, pat);
 
-	/* search */
-	ph = search(set, pat, hash, &pph);
+	/* search and remove */
+	x_mutex_lock(&set->mutex);
+	ph = auto_find(set, pat);
 	if (!ph)
 		/* not found */
-		return X_ENOENT;
-
-	/* found, remove it */
-	if (hash)
-		set->count--;
-	*pph = ph->next;
-
-	/* store the closure back */
-	if (closure)
-		*closure = ph->handler.closure;
-
-	/* free the memory */
-	free(ph);
-	return 0;
+		rc = X_ENOENT;
+	else {
+		/* store the closure back */
+		if (closure)
+			*closure = ph->handler.closure;
+		/* remove it, its memory is retired */
+		auto_del(set, &set->root, pat, 0);
+		rc = 0;
+	}
+	reclaim(set);
+	x_mutex_unlock(&set->mutex);
+	return rc;
 }
 
 /**
@@ -342,21 +1188,24 @@ struct globset_handler *globset_search(
 			struct globset *set,
 			const char *pattern)
 {
-	struct pathndl *ph, **pph;
-	unsigned hash;
+	struct pathndl *ph;
+	unsigned epoch;
 	char *pat;
 
 	/* local normalization */
 	pat = alloca(1 + strlen(pattern));
-	hash = normhash(pattern, pat);
+	normalize(pattern, pat);
 
 	/* search */
-	ph = search(set, pat, hash, &pph);
+	epoch = read_lock(set);
+	ph = auto_find(set, pat);
+	read_unlock(set, epoch);
 	return ph ? &ph->handler : NULL;
 }
 
 /**
  * Search a handler for the string 'text'
+ * The handler found remains valid until it is deleted
  * @param set the set
  * @param text the text to match
  * @return the handler found or NULL
@@ -365,36 +1214,145 @@ const struct globset_handler *globset_match(
 			struct globset *set,
 			const char *text)
 {
-	struct pathndl *ph, *iph;
-	unsigned hash, g, s;
+	struct run run;
+	struct level *level;
+	struct pathndl *ph;
+	unsigned epoch;
 	char *txt;
 
-	/* local normalization */
-	txt = alloca(1 + strlen(text));
-	hash = normhash(text, txt);
-
-	/* first, look in dictionary of exact matches */
-	ph = NULL;
-	if (hash && set->exacts) {
-		ph = set->exacts[hash & set->gmask];
-		while(ph && (ph->hash != hash || strcmp(txt, ph->handler.pattern)))
-			ph = ph->next;
+	epoch = read_lock(set);
+	run_init(&run, set);
+	level = run_text(&run, text, 0);
+	ph = level ? level_best(&run, level) : NULL;
+	if (run.error) {
+		/* out of memory, fallback to scanning */
+		txt = alloca(1 + strlen(text));
+		normalize(text, txt);
+		scan(&set->root, txt, &ph);
 	}
+	run_release(&run);
+	read_unlock(set, epoch);
+	return ph ? &ph->handler : NULL;
+}
 
-	/* then if not found */
-	if (ph == NULL) {
-		/* look in glob patterns for the best match */
-		s = 0;
-		iph = set->globs;
-		while(iph) {
-			g = globmatch(iph->handler.pattern, txt);
-			if (g > s) {
-				s = g;
-				ph = iph;
-			}
-			iph = iph->next;
-		}
+/**
+ * Search all the handlers matching the string 'text'
+ * @param set the set
+ * @param text the text to match
+ * @param callback the function called for each handler from best to worst
+ * @param closure the closure of the callback
+ * @return the count of matching handlers or X_ENOMEM
+ */
+int globset_match_all(
+			struct globset *set,
+			const char *text,
+			void (*callback)(void *closure, const struct globset_handler *handler),
+			void *closure)
+{
+	struct run run;
+	struct level *level;
+	struct vec result;
+	unsigned epoch, i;
+	int rc;
+
+	epoch = read_lock(set);
+	vec_init(&result);
+	run_init(&run, set);
+	level = run_text(&run, text, 0);
+	rc = run.error ? run.error : level ? level_all(&run, level, &result) : 0;
+	for (i = 0 ; !rc && i < result.count ; i++)
+		callback(closure, &((struct pathndl*)result.items[i])->handler);
+	run_release(&run);
+	vec_release(&result);
+	read_unlock(set, epoch);
+	return rc ? rc : (int)i;
+}
+
+/**
+ * Search the best handlers matching the strings of 'texts'.
+ * The texts are matched in sorted order so that their common
+ * prefixes are processed only once.
+ * @param set the set
+ * @param texts the texts to match
+ * @param count the count of texts
+ * @param results where to store the handlers found or NULL
+ * @return 0 in case of success or X_ENOMEM
+ */
+int globset_match_batch(
+			struct globset *set,
+			const char * const texts[],
+			unsigned count,
+			const struct globset_handler *results[])
+{
+	struct batch *batch;
+	struct run run;
+	struct level *level;
+	struct pathndl *ph;
+	unsigned epoch, i, prefix;
+	int rc;
+
+	batch = sort_batch(texts, count);
+	if (!batch)
+		return X_ENOMEM;
+
+	epoch = read_lock(set);
+	run_init(&run, set);
+	for (i = 0 ; i < count && !run.error ; i++) {
+		prefix = i ? textprefix(batch[i - 1].text, batch[i].text) : 0;
+		level = run_text(&run, batch[i].text, prefix);
+		ph = level ? level_best(&run, level) : NULL;
+		results[batch[i].index] = ph ? &ph->handler : NULL;
 	}
-	return ph ? &ph->handler : NULL;
+	rc = run.error;
+	run_release(&run);
+	read_unlock(set, epoch);
+	free(batch);
+	return rc;
 }
 
+/**
+ * Search all the handlers matching the strings of 'texts'.
+ * The texts are matched in sorted order so that their common
+ * prefixes are processed only once.
+ * @param set the set
+ * @param texts the texts to match
+ * @param count the count of texts
+ * @param callback the function called for each matching handler, with the
+ *                 index of the text, from best to worst for each text
+ * @param closure the closure of the callback
+ * @return the count of matches or X_ENOMEM
+ */
+int globset_match_all_batch(
+			struct globset *set,
+			const char * const texts[],
+			unsigned count,
+			void (*callback)(void *closure, unsigned index, const struct globset_handler *handler),
+			void *closure)
+{
+	struct batch *batch;
+	struct run run;
+	struct level *level;
+	struct vec result;
+	unsigned epoch, i, j, prefix;
+	int rc, n;
+
+	batch = sort_batch(texts, count);
+	if (!batch)
+		return X_ENOMEM;
+
+	epoch = read_lock(set);
+	vec_init(&result);
+	run_init(&run, set);
+	for (rc = n = 0, i = 0 ; i < count && !rc ; i++) {
+		prefix = i ? textprefix(batch[i - 1].text, batch[i].text) : 0;
+		level = run_text(&run, batch[i].text, prefix);
+		rc = run.error ? run.error : level ? level_all(&run, level, &result) : 0;
+		for (j = 0 ; !rc && level && j < result.count ; j++, n++)
+			callback(closure, batch[i].index, &((struct pathndl*)result.items[j])->handler);
+	}
+	run_release(&run);
+	vec_release(&result);
+	read_unlock(set, epoch);
+	free(batch);
+	return rc ? rc : n;
+}
@@ -53,6 +53,15 @@ extern int globset_del(
 			const char *pattern,
 			void **closure);
 
+/**
+ * Matching is lock free and can run concurrently with globset_add and
+ * globset_del. But a handler returned by globset_search, globset_match
+ * or globset_match_batch is released when it is deleted. So it remains
+ * valid only while no writer deletes it: when the set can be modified
+ * concurrently, use globset_match_all or globset_match_all_batch whose
+ * callbacks receive the handlers while they are protected.
+ */
+
 extern struct globset_handler *globset_search(
 			struct globset *set,
 			const char *pattern);
@@ -61,3 +70,38 @@ extern const struct globset_handler *globset_match(
 			struct globset *set,
 			const char *text);
 
+/**
+ * Calls 'callback' with 'closure' for each handler matching 'text', from
+ * the best match to the worst. Returns the count of matching handlers or
+ * -ENOMEM. The handler given to the callback is valid during the call.
+ */
+extern int globset_match_all(
+			struct globset *set,
+			const char *text,
+			void (*callback)(void *closure, const struct globset_handler *handler),
+			void *closure);
+
+/**
+ * Stores in 'results[i]' the best handler matching 'texts[i]', or NULL,
+ * for the 'count' texts. Texts sharing prefixes are matched faster.
+ * Returns 0 on success or -ENOMEM.
+ */
+extern int globset_match_batch(
+			struct globset *set,
+			const char * const texts[],
+			unsigned count,
+			const struct globset_handler *results[]);
+
+/**
+ * Calls 'callback' with 'closure', the index of the text and the handler
+ * for each handler matching each of the 'count' 'texts', from the best
+ * match to the worst for each text. Returns the count of matches or
+ * -ENOMEM. The handler given to the callback is valid during the call.
+ */
+extern int globset_match_all_batch(
+			struct globset *set,
+			const char * const texts[],
+			unsigned count,
+			void (*callback)(void *closure, unsigned index, const struct globset_handler *handler),
+			void *closure);
+
@@ -0,0 +1,343 @@
+/*
+ Copyright (C) 2015-2026 IoT.bzh Company
+
+ Author: José Bollo <jose.bollo@iot.bzh>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is furnished
+ to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice (including the next
+ paragraph) shall be included in all copies or substantial portions of the
+ Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "locale-root.h"
+#include "locale-file.h"
+#include "../sys/x-errno.h"
+#include "../sys/x-mutex.h"
+
+#if !defined(WITH_SENDFILE)
+#  if defined(__linux__)
+#    define WITH_SENDFILE 1
+#  else
+#    define WITH_SENDFILE 0
+#  endif
+#endif
+#if WITH_SENDFILE
+#  include <sys/sendfile.h>
+#endif
+
+#define COPY_BUFFER_SIZE  16384
+
+/*
+ * Memory mapping of a small file, shared by the cache and by the
+ * files opened through it.
+ */
+struct locale_file_map {
+	unsigned refcount;
+	dev_t dev;
+	ino_t ino;
+	size_t size;
+	struct timespec mtime;
+	void *data;
+	char etag[56];
+};
+
+/*
+ * Cache of mappings of small files, indexed by device and inode.
+ * Each slot holds at most one mapping, the newest replacing the oldest.
+ */
+struct locale_file_cache {
+	x_mutex_t mutex;
+	size_t maxsize;
+	uint32_t mask;
+	struct locale_file_map *maps[];
+};
+
+/***************************************************************/
+
+/*
+ * Computes in 'etag' the entity tag of the file of status 'st'.
+ * The tag changes when the file is replaced or modified.
+ */
+static void make_etag(char etag[56], const struct stat *st)
+{
+	unsigned long long mtime;
+
+	mtime = (unsigned long long)st->st_mtim.tv_sec * 1000000000ULL
+		+ (unsigned long long)st->st_mtim.tv_nsec;
+	snprintf(etag, 56, "\"%llx-%llx-%llx\"",
+		(unsigned long long)st->st_ino,
+		(unsigned long long)st->st_size,
+		mtime);
+}
+
+static inline int same_file(const struct locale_file_map *map, const struct stat *st)
+{
+	return map->ino == st->st_ino
+	    && map->dev == st->st_dev
+	    && map->size == (size_t)st->st_size
+	    && map->mtime.tv_sec == st->st_mtim.tv_sec
+	    && map->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void map_unref(struct locale_file_map *map)
+{
+	if (map != NULL && !__atomic_sub_fetch(&map->refcount, 1, __ATOMIC_ACQ_REL)) {
+		munmap(map->data, map->size);
+		free(map);
+	}
+}
+
+/*
+ * Creates a cache of at most 'count' (rounded to a power of 2)
+ * mappings of files whose size is not greater than 'maxsize'.
+ * Memory used by the mappings is then bounded by 'count' times 'maxsize'.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int locale_file_cache_create(struct locale_file_cache **cache, int count, size_t maxsize)
+{
+	struct locale_file_cache *result;
+	uint32_t size;
+
+	if (count <= 0) {
+		*cache = NULL;
+		return X_EINVAL;
+	}
+	for (size = 1 ; size < (uint32_t)count && size < 0x10000 ; size <<= 1);
+	result = calloc(1, sizeof *result + size * sizeof *result->maps);
+	*cache = result;
+	if (result == NULL)
+		return X_ENOMEM;
+	x_mutex_init(&result->mutex);
+	result->maxsize = maxsize;
+	result->mask = size - 1;
+	return 0;
+}
+
+/*
+ * Destroys the 'cache'. Files opened through it remain valid.
+ */
+void locale_file_cache_destroy(struct locale_file_cache *cache)
+{
+	uint32_t idx;
+
+	if (cache != NULL) {
+		for (idx = 0 ; idx <= cache->mask ; idx++)
+			map_unref(cache->maps[idx]);
+		x_mutex_destroy(&cache->mutex);
+		free(cache);
+	}
+}
+
+/*
+ * Get from the 'cache' the mapping of the file 'fd' of status 'st',
+ * mapping it when not already in the cache.
+ *
+ * Returns a new reference to the mapping or NULL if it can't be mapped.
+ */
+static struct locale_file_map *cache_get(struct locale_file_cache *cache, int fd, const struct stat *st)
+{
+	struct locale_file_map *map, *old;
+	uint64_t hash;
+	uint32_t idx;
+
+	hash = ((uint64_t)st->st_ino ^ ((uint64_t)st->st_dev << 32)) * 0x9e3779b97f4a7c15ULL;
+	idx = (uint32_t)(hash >> 32) & cache->mask;
+
+	/* search a valid mapping */
+	x_mutex_lock(&cache->mutex);
+	map = cache->maps[idx];
+	if (map != NULL && same_file(map, st))
+		__atomic_add_fetch(&map->refcount, 1, __ATOMIC_RELAXED);
+	else
+		map = NULL;
+	x_mutex_unlock(&cache->mutex);
+	if (map != NULL)
+		return map;
+
+	/* create the mapping */
+	map = malloc(sizeof *map);
+	if (map == NULL)
+		return NULL;
+	map->data = mmap(NULL, (size_t)st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map->data == MAP_FAILED) {
+		free(map);
+		return NULL;
+	}
+	map->refcount = 2;
+	map->dev = st->st_dev;
+	map->ino = st->st_ino;
+	map->size = (size_t)st->st_size;
+	map->mtime = st->st_mtim;
+	make_etag(map->etag, st);
+
+	/* record it */
+	x_mutex_lock(&cache->mutex);
+	old = cache->maps[idx];
+	cache->maps[idx] = map;
+	x_mutex_unlock(&cache->mutex);
+	map_unref(old);
+	return map;
+}
+
+/***************************************************************/
+
+/*
+ * Setup 'file' for the opened file descriptor 'fd'.
+ * Files of the 'cache' size limit are served from memory.
+ */
+static int setup(struct locale_file *file, int fd, struct locale_file_cache *cache)
+{
+	struct locale_file_map *map;
+	struct stat st;
+	int rc;
+
+	file->fd = -1;
+	file->data = NULL;
+	file->map = NULL;
+	if (fd < 0)
+		return fd == -1 ? -errno : fd;
+	if (fstat(fd, &st) < 0) {
+		rc = -errno;
+		close(fd);
+		return rc;
+	}
+	if (!S_ISREG(st.st_mode)) {
+		close(fd);
+		return X_EINVAL;
+	}
+
+	file->size = (size_t)st.st_size;
+	file->mtime = st.st_mtim;
+	if (cache != NULL && st.st_size > 0 && (size_t)st.st_size <= cache->maxsize) {
+		map = cache_get(cache, fd, &st);
+		if (map != NULL) {
+			close(fd);
+			file->map = map;
+			file->data = map->data;
+			memcpy(file->etag, map->etag, sizeof file->etag);
+			return 0;
+		}
+	}
+	file->fd = fd;
+	make_etag(file->etag, &st);
+	return 0;
+}
+
+/*
+ * Opens in 'file' the 'filename' of 'root' for the 'locale'
+ * (see locale_root_open), with its size, its modification time and
+ * its entity tag. When 'cache' isn't NULL, small files are served
+ * from the memory mappings it shares.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int locale_file_open(struct locale_file *file, struct locale_root *root, const char *filename, const char *locale, struct locale_file_cache *cache)
+{
+	return setup(file, locale_root_open(root, filename, O_RDONLY|O_CLOEXEC, locale), cache);
+}
+
+/*
+ * Same as locale_file_open but for the given 'search'.
+ */
+int locale_file_open_search(struct locale_file *file, struct locale_search *search, const char *filename, struct locale_file_cache *cache)
+{
+	return setup(file, locale_search_open(search, filename, O_RDONLY|O_CLOEXEC), cache);
+}
+
+/*
+ * Closes the 'file'.
+ */
+void locale_file_close(struct locale_file *file)
+{
+	if (file->fd >= 0)
+		close(file->fd);
+	map_unref(file->map);
+	file->fd = -1;
+	file->data = NULL;
+	file->map = NULL;
+}
+
+/***************************************************************/
+
+/*
+ * Sends to 'sockfd' at most 'count' bytes of 'file' starting at
+ * '*offset', without copying them in user space when possible.
+ * On success, '*offset' is advanced of the count of bytes sent.
+ * Fewer bytes than requested can be sent, mainly on non
+ * blocking sockets: the function has then to be called again.
+ *
+ * Returns the count of bytes sent, 0 at end of the file,
+ * or a negative error code (X_EAGAIN when 'sockfd' is full).
+ */
+ssize_t locale_file_send(struct locale_file *file, int sockfd, off_t *offset, size_t count)
+{
+	char buffer[COPY_BUFFER_SIZE];
+	ssize_t rc;
+	size_t len;
+
+	/* compute the count to send */
+	if (*offset < 0)
+		return X_EINVAL;
+	if ((size_t)*offset >= file->size)
+		return 0;
+	len = file->size - (size_t)*offset;
+	if (count > len)
+		count = len;
+
+	/* send from memory */
+	if (file->data != NULL) {
+		do { rc = write(sockfd, (const char*)file->data + *offset, count); } while (rc < 0 && errno == EINTR);
+		if (rc < 0)
+			return -errno;
+		*offset += (off_t)rc;
+		return rc;
+	}
+
+#if WITH_SENDFILE
+	/* send from the file */
+	do { rc = sendfile(sockfd, file->fd, offset, count); } while (rc < 0 && errno == EINTR);
+	if (rc >= 0)
+		return rc;
+	if (errno != EINVAL && errno != ENOSYS)
+		return -errno;
+#endif
+
+	/* fallback to copy */
+	if (count > sizeof buffer)
+		count = sizeof buffer;
+	do { rc = pread(file->fd, buffer, count, *offset); } while (rc < 0 && errno == EINTR);
+	if (rc <= 0)
+		return rc < 0 ? -errno : 0;
+	do { rc = write(sockfd, buffer, (size_t)rc); } while (rc < 0 && errno == EINTR);
+	if (rc < 0)
+		return -errno;
+	*offset += (off_t)rc;
+	return rc;
+}
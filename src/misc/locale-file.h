@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+struct locale_root;
+struct locale_search;
+struct locale_file_map;
+struct locale_file_cache;
+
+/*
+ * A file opened from a locale root for being served.
+ * When 'data' isn't NULL, the content is mapped in memory
+ * and 'fd' is -1.
+ */
+struct locale_file {
+	int fd;
+	size_t size;
+	struct timespec mtime;
+	const void *data;
+	char etag[56];
+	struct locale_file_map *map;
+};
+
+extern int locale_file_cache_create(struct locale_file_cache **cache, int count, size_t maxsize);
+extern void locale_file_cache_destroy(struct locale_file_cache *cache);
+
+extern int locale_file_open(struct locale_file *file, struct locale_root *root, const char *filename, const char *locale, struct locale_file_cache *cache);
+extern int locale_file_open_search(struct locale_file *file, struct locale_search *search, const char *filename, struct locale_file_cache *cache);
+extern void locale_file_close(struct locale_file *file);
+
+extern ssize_t locale_file_send(struct locale_file *file, int sockfd, off_t *offset, size_t count);
@@ -32,12 +32,27 @@
 #include <limits.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include "locale-root.h"
+#include "rp-pearson.h"
 #include "../sys/subpath.h"
 #include "../sys/x-errno.h"
+#include "../sys/x-mutex.h"
+
+#if !defined(WITH_INOTIFY)
+#  if defined(__linux__)
+#    define WITH_INOTIFY 1
+#  else
+#    define WITH_INOTIFY 0
+#  endif
+#endif
+#if WITH_INOTIFY
+#  include <sys/inotify.h>
+#endif
 
 /*
  * Implementation of folder based localisation as described here:
@@ -48,6 +63,7 @@
 #define LRU_COUNT         3
 #define DEFAULT_IMMEDIATE 0
 #define LIST_LENGTH       200
+#define CACHE_PROBES      4
 
 static const char _locales_[] = "locales/";
 
@@ -60,11 +76,35 @@ struct locale_search {
 	char list[];
 };
 
+/*
+ * Entry of the resolution cache: the key is the search list followed
+ * by the filename, the value is the path of the first existing candidate
+ * or nothing (negative entry) when pathlen < 0
+ */
+struct cache_entry {
+	uint32_t hash;
+	uint32_t generation;
+	uint32_t stamp;
+	int keylen;
+	int pathlen;
+	char *data;
+};
+
+struct cache {
+	x_mutex_t mutex;
+	uint32_t mask;
+	uint32_t stamp;
+	int notifyfd;
+	struct cache_entry entries[];
+};
+
 struct locale_root {
 #if LRU_COUNT
 	struct locale_search *lru[LRU_COUNT];
 #endif
 	struct locale_search *default_search;
+	struct cache *cache;
+	uint32_t generation;
 	int refcount;
 	int intcount;
 #if WITH_OPENAT
@@ -186,6 +226,7 @@ struct locale_root *locale_root_addref(struct locale_root *root)
 static void internal_unref(struct locale_root *root)
 {
 	if (!__atomic_sub_fetch(&root->intcount, 1, __ATOMIC_RELAXED)) {
+		locale_root_set_cache(root, 0, 0);
 #if WITH_OPENAT
 		close(root->rootfd);
 #endif
@@ -207,6 +248,7 @@ void locale_root_unref(struct locale_root *root)
 		for (i = 0 ; i < LRU_COUNT ; i++)
 			locale_search_unref(root->lru[i]);
 #endif
+		locale_search_unref(root->default_search);
 		/* finalize if needed */
 		internal_unref(root);
 	}
@@ -470,6 +512,103 @@ void locale_root_set_default_search(struct locale_root *root, struct locale_sear
 	older = root->default_search;
 	root->default_search = search ? locale_search_addref(search) : NULL;
 	locale_search_unref(older);
+	locale_root_invalidate(root);
+}
+
+/***************************************************************/
+
+/*
+ * Set the resolution cache of 'root' to hold at most 'count' entries
+ * (rounded to a power of 2), or removes it when 'count' is zero.
+ * When 'flags' has LOCALE_ROOT_CACHE_NOTIFY, the directories where
+ * files are searched are watched using inotify (see
+ * locale_root_cache_notify_fd).
+ * It must not be called while searches are in progress.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int locale_root_set_cache(struct locale_root *root, int count, int flags)
+{
+	struct cache *cache;
+	uint32_t size, idx;
+
+	/* allocate the new cache */
+	if (count <= 0)
+		cache = NULL;
+	else {
+		for (size = 1 ; size < (uint32_t)count && size < 0x10000 ; size <<= 1);
+		cache = calloc(1, sizeof *cache + size * sizeof *cache->entries);
+		if (cache == NULL)
+			return X_ENOMEM;
+		x_mutex_init(&cache->mutex);
+		cache->mask = size - 1;
+		cache->notifyfd = -1;
+#if WITH_INOTIFY
+		if (flags & LOCALE_ROOT_CACHE_NOTIFY) {
+			cache->notifyfd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+			if (cache->notifyfd < 0) {
+				x_mutex_destroy(&cache->mutex);
+				free(cache);
+				return -errno;
+			}
+		}
+#else
+		if (flags & LOCALE_ROOT_CACHE_NOTIFY) {
+			x_mutex_destroy(&cache->mutex);
+			free(cache);
+			return X_ENOTSUP;
+		}
+#endif
+	}
+
+	/* replace the old one */
+	cache = __atomic_exchange_n(&root->cache, cache, __ATOMIC_ACQ_REL);
+	if (cache != NULL) {
+		for (idx = 0 ; idx <= cache->mask ; idx++)
+			free(cache->entries[idx].data);
+		if (cache->notifyfd >= 0)
+			close(cache->notifyfd);
+		x_mutex_destroy(&cache->mutex);
+		free(cache);
+	}
+	return 0;
+}
+
+/*
+ * Invalidates all the entries of the resolution cache of 'root'.
+ * Must be called when the files of 'root' are changed.
+ */
+void locale_root_invalidate(struct locale_root *root)
+{
+	__atomic_add_fetch(&root->generation, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Get the file descriptor watching changes of 'root' or -1 if none.
+ * When it becomes readable, locale_root_cache_notify_process must be called.
+ */
+int locale_root_cache_notify_fd(struct locale_root *root)
+{
+	return root->cache == NULL ? -1 : root->cache->notifyfd;
+}
+
+/*
+ * Process the changes notified for 'root', invalidating its
+ * resolution cache if needed.
+ */
+void locale_root_cache_notify_process(struct locale_root *root)
+{
+#if WITH_INOTIFY
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	int changed = 0;
+
+	if (root->cache != NULL && root->cache->notifyfd >= 0) {
+		while (read(root->cache->notifyfd, buffer, sizeof buffer) > 0)
+			changed = 1;
+		if (changed)
+			locale_root_invalidate(root);
+	}
+#endif
 }
 
 /***************************************************************/
@@ -483,13 +622,28 @@ struct iter
 	struct locale_root *root;
 	const char *filename;
 	const char *list;
+	const char *klist;
 	int state;
 	int llen;
+	int kllen;
 	int offset;
 	int flen;
 	char path[PATH_MAX];
 };
 
+/*
+ * State of a search in the resolution cache
+ */
+struct probe
+{
+	struct cache *cache;
+	uint32_t hash;
+	uint32_t generation;
+	int keylen;
+	char key[LIST_LENGTH + PATH_MAX + 2];
+	char path[PATH_MAX];
+};
+
 static int iter_init(struct iter *iter, const char *filename, struct locale_root *root)
 {
 	int offset;
@@ -584,6 +738,8 @@ static int iter_next(struct iter *iter)
 static int iter_list_init(struct iter *iter, const char *filename, struct locale_root *root, const char *list, int llen)
 {
 	int rc = iter_init(iter, filename, root);
+	iter->klist = list;
+	iter->kllen = llen;
 	iter_list_set(iter, list, llen);
 	if (iter->llen == 0)
 		rc = iter_next(iter) ? 0 : X_EINVAL;
@@ -593,6 +749,8 @@ static int iter_list_init(struct iter *iter, const char *filename, struct locale
 static int iter_search_init(struct iter *iter, const char *filename, struct locale_root *root, struct locale_search *search)
 {
 	int rc = iter_init(iter, filename, root);
+	iter->klist = search ? search->list : NULL;
+	iter->kllen = search ? search->llen : 0;
 	if (search)
 		iter_list_set(iter, search->list, search->llen);
 	if (iter->llen == 0)
@@ -602,23 +760,202 @@ static int iter_search_init(struct iter *iter, const char *filename, struct loca
 
 /***************************************************************/
 
+/*
+ * Search the resolution of the iteration in the cache.
+ * Returns 1 if found with its path in probe->path, 0 if found
+ * as not existing or -1 if not found or if there is no cache.
+ */
+static int cache_get(struct iter *iter, struct probe *probe)
+{
+	struct cache *cache;
+	struct cache_entry *entry;
+	uint32_t idx, n;
+	int rc;
+
+	cache = iter->root->cache;
+	if (cache == NULL || iter->kllen + iter->flen + 2 > (int)sizeof probe->key) {
+		probe->cache = NULL;
+		return -1;
+	}
+	probe->cache = cache;
+
+	/* compute the key: length of the list, the list, the filename */
+	probe->key[0] = (char)(iter->kllen & 255);
+	probe->key[1] = (char)(iter->kllen >> 8);
+	if (iter->kllen)
+		memcpy(&probe->key[2], iter->klist, (size_t)iter->kllen);
+	memcpy(&probe->key[2 + iter->kllen], iter->filename, (size_t)iter->flen);
+	probe->keylen = 2 + iter->kllen + iter->flen;
+	probe->hash = rp_pearson32_len(probe->key, (size_t)probe->keylen);
+	probe->generation = __atomic_load_n(&iter->root->generation, __ATOMIC_ACQUIRE);
+
+	/* search */
+	rc = -1;
+	x_mutex_lock(&cache->mutex);
+	for (n = 0, idx = probe->hash ; n < CACHE_PROBES ; n++, idx++) {
+		entry = &cache->entries[idx & cache->mask];
+		if (entry->data != NULL
+		 && entry->hash == probe->hash
+		 && entry->generation == probe->generation
+		 && entry->keylen == probe->keylen
+		 && !memcmp(entry->data, probe->key, (size_t)probe->keylen)) {
+			entry->stamp = ++cache->stamp;
+			if (entry->pathlen < 0)
+				rc = 0;
+			else {
+				memcpy(probe->path, &entry->data[entry->keylen], (size_t)entry->pathlen + 1);
+				rc = 1;
+			}
+			break;
+		}
+	}
+	x_mutex_unlock(&cache->mutex);
+	return rc;
+}
+
+/*
+ * Record in the cache the resolution of the probe to path
+ * or to nothing if path is NULL
+ */
+static void cache_put(struct probe *probe, const char *path)
+{
+	struct cache *cache = probe->cache;
+	struct cache_entry *entry, *victim;
+	uint32_t idx, n;
+	int pathlen;
+	char *data;
+
+	if (cache == NULL)
+		return;
+
+	pathlen = path ? (int)strlen(path) : -1;
+	data = malloc((size_t)probe->keylen + (size_t)pathlen + 1);
+	if (data == NULL)
+		return;
+	memcpy(data, probe->key, (size_t)probe->keylen);
+	if (path)
+		memcpy(&data[probe->keylen], path, (size_t)pathlen + 1);
+
+	/* replace the same key or the least recently used entry */
+	x_mutex_lock(&cache->mutex);
+	victim = NULL;
+	for (n = 0, idx = probe->hash ; n < CACHE_PROBES ; n++, idx++) {
+		entry = &cache->entries[idx & cache->mask];
+		if (entry->data == NULL
+		 || (entry->hash == probe->hash
+		  && entry->keylen == probe->keylen
+		  && !memcmp(entry->data, probe->key, (size_t)probe->keylen))) {
+			victim = entry;
+			break;
+		}
+		if (victim == NULL || (int32_t)(entry->stamp - victim->stamp) < 0)
+			victim = entry;
+	}
+	free(victim->data);
+	victim->hash = probe->hash;
+	victim->generation = probe->generation;
+	victim->stamp = ++cache->stamp;
+	victim->keylen = probe->keylen;
+	victim->pathlen = pathlen;
+	victim->data = data;
+	x_mutex_unlock(&cache->mutex);
+}
+
+/*
+ * Watch the nearest existing directory of the candidate path
+ */
+static void cache_watch(struct iter *iter, struct probe *probe)
+{
+#if WITH_INOTIFY
+	struct cache *cache = probe->cache;
+	char *path, *end;
+	size_t off;
+	int errnosav;
+
+	if (cache == NULL || cache->notifyfd < 0)
+		return;
+
+	/* compute the absolute path */
+	path = probe->path;
+#if WITH_OPENAT
+	off = strlen(iter->root->path);
+	if (off + strlen(iter->path) >= sizeof probe->path)
+		return;
+	memcpy(path, iter->root->path, off);
+	strcpy(&path[off], iter->path);
+#else
+	off = strlen(iter->root->path);
+	strcpy(path, iter->path);
+#endif
+
+	/* watch the nearest existing directory */
+	errnosav = errno;
+	for (;;) {
+		end = strrchr(path, '/');
+		if (end == NULL || end < &path[off - 1])
+			break;
+		*end = 0;
+		if (inotify_add_watch(cache->notifyfd, end == path ? "/" : path,
+				IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO
+				|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR) >= 0
+		 || (errno != ENOENT && errno != ENOTDIR))
+			break;
+	}
+	errno = errnosav;
+#endif
+}
+
 /*
  */
 static int iter_open(struct iter *iter, int flags)
 {
-	int fd;
+	struct probe probe;
+	int fd, cacheable;
+
+	/* search in cache */
+	switch (cache_get(iter, &probe)) {
+	case 0:
+		errno = ENOENT;
+		return -1;
+	case 1:
+#if WITH_OPENAT
+		fd = openat(iter->root->rootfd, probe.path, flags);
+#else
+		fd = open(probe.path, flags);
+#endif
+		if (fd >= 0)
+			return fd;
+		/* stale entry, search again */
+		break;
+	default:
+		break;
+	}
 
+	/* search the candidates, the result is cacheable if the candidates
+	 * before the found one don't exist */
+	cacheable = 1;
 	do {
 		if (iter_set(iter)) {
+			/* watch before probing, so no creation is missed */
+			cache_watch(iter, &probe);
 #if WITH_OPENAT
 			fd = openat(iter->root->rootfd, iter->path, flags);
 #else
 			fd = open(iter->path, flags);
 #endif
-			if (fd >= 0)
+			if (fd < 0 && errno != ENOENT)
+				cacheable = 0;
+			if (fd >= 0) {
+				if (cacheable)
+					cache_put(&probe, iter->path);
 				return fd;
+			}
 		}
 	} while(iter_next(iter));
+	if (cacheable) {
+		cache_put(&probe, NULL);
+		errno = ENOENT;
+	}
 	return -1;
 }
 
@@ -691,18 +1028,41 @@ int locale_root_open(struct locale_root *root, const char *filename, int flags,
  */
 static char *iter_resolve(struct iter *iter)
 {
-	int rc;
+	struct probe probe;
+	int rc, cacheable;
+
+	/* search in cache */
+	switch (cache_get(iter, &probe)) {
+	case 0:
+		return NULL;
+	case 1:
+		return strdup(probe.path);
+	default:
+		break;
+	}
+
+	/* search the candidates */
+	cacheable = 1;
 	do {
 		if (iter_set(iter)) {
+			/* watch before probing, so no creation is missed */
+			cache_watch(iter, &probe);
 #if WITH_OPENAT
 			rc = faccessat(iter->root->rootfd, iter->path, F_OK, 0);
 #else
 			rc = access(iter->path, F_OK);
 #endif
-			if (rc == 0)
+			if (rc < 0 && errno != ENOENT)
+				cacheable = 0;
+			if (rc == 0) {
+				if (cacheable)
+					cache_put(&probe, iter->path);
 				return strdup(iter->path);
+			}
 		}
 	} while(iter_next(iter));
+	if (cacheable)
+		cache_put(&probe, NULL);
 	return NULL;
 }
 
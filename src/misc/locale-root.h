@@ -42,6 +42,13 @@ extern void locale_search_unref(struct locale_search *search);
 
 extern void locale_root_set_default_search(struct locale_root *root, struct locale_search *search);
 
+#define LOCALE_ROOT_CACHE_NOTIFY  1
+
+extern int locale_root_set_cache(struct locale_root *root, int count, int flags);
+extern void locale_root_invalidate(struct locale_root *root);
+extern int locale_root_cache_notify_fd(struct locale_root *root);
+extern void locale_root_cache_notify_process(struct locale_root *root);
+
 #if WITH_OPENAT
 extern int locale_root_get_dirfd(struct locale_root *root);
 #endif
@@ -22,174 +22,379 @@
  * SOFTWARE.
  */
 
-
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "lockany.h"
+
 #include "../sys/x-errno.h"
 #include "../sys/x-mutex.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#else
 #include "../sys/x-cond.h"
+#endif
 
 /*****************************************************************************/
 /* LOCKING                                                                   */
 /*****************************************************************************/
 
+/*
+ * Lockers are spread over LOCKANY_BUCKETS buckets indexed by a hash
+ * of the address of the locked item.
+ *
+ * The state of the lock of an item is a single 64 bits word of its
+ * locker. Uncontended locking and unlocking are a single compare and
+ * swap of that word. Under contention, threads wait on the event
+ * counters 'seqr' or 'seqw' of the locker using futexes on Linux.
+ *
+ * The lockers of a bucket are linked in a list that is only growing
+ * and that is read without lock. The bucket mutex only serializes
+ * attribution of lockers to items. A locker whose state is idle can
+ * be attributed to another item. Because the generation of the state
+ * is then incremented, threads that found the locker for the previous
+ * item fail to change its state and search again.
+ */
+#define LOCKANY_BUCKETS_LOG2 6
+#define LOCKANY_BUCKETS (1 << LOCKANY_BUCKETS_LOG2)
+
+/* layout of the state word */
+#define R_ONE     UINT64_C(1)                  /* count of readers */
+#define R_MASK    (R_ONE * 0xfffff)
+#define W_BIT     (UINT64_C(1) << 20)          /* locked for writing */
+#define FREE_BIT  (UINT64_C(1) << 21)          /* being attributed */
+#define RW_ONE    (UINT64_C(1) << 22)          /* count of waiting readers */
+#define RW_MASK   (RW_ONE * 0xfff)
+#define WW_ONE    (UINT64_C(1) << 34)          /* count of waiting writers */
+#define WW_MASK   (WW_ONE * 0xfff)
+#define GEN_ONE   (UINT64_C(1) << 46)          /* generation */
+#define GEN_MASK  (~(GEN_ONE - 1))
+
+#define USED_MASK (R_MASK | W_BIT | RW_MASK | WW_MASK)
+
 struct locker {
 	struct locker *next;
 	const void *item;
-	uint32_t lockw: 1;
-	uint32_t lockr: 1;
-	uint32_t cntw: 15;
-	uint32_t cntr: 15;
+	uint64_t state;
+	uint32_t seqr;       /* where readers wait */
+	uint32_t seqw;       /* where writers wait */
+};
+
+struct bucket {
+	x_mutex_t mutex;
+	struct locker *lockers;
+#if !defined(__linux__)
 	x_cond_t cond;
+#endif
 };
 
-static struct locker *lockers;
-static x_mutex_t mutlock = X_MUTEX_INITIALIZER;
+#if defined(__linux__)
+#define BUCKET_INIT  { X_MUTEX_INITIALIZER, 0 }
+#else
+#define BUCKET_INIT  { X_MUTEX_INITIALIZER, 0, X_COND_INITIALIZER }
+#endif
+#define BUCKET_INIT4  BUCKET_INIT, BUCKET_INIT, BUCKET_INIT, BUCKET_INIT
+#define BUCKET_INIT16 BUCKET_INIT4, BUCKET_INIT4, BUCKET_INIT4, BUCKET_INIT4
+#define BUCKET_INIT64 BUCKET_INIT16, BUCKET_INIT16, BUCKET_INIT16, BUCKET_INIT16
+
+/* the 64 buckets */
+static struct bucket buckets[LOCKANY_BUCKETS] = { BUCKET_INIT64 };
+
+/* is writer preferred? */
+static int prefer_writers = 0;
+
+#define LOAD(x)        __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define STORE(x,v)     __atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+#define CAS(x,pe,v)    __atomic_compare_exchange_n(&(x), (pe), (v), 0, \
+				__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
 
-static struct locker *locker_get(const void *item)
+/* get the bucket of the item, Fibonacci hashing of its address */
+static struct bucket *bucket_of(const void *item)
 {
-	struct locker *lock, *unused;
+	uint64_t h = (uint64_t)(uintptr_t)item * UINT64_C(0x9E3779B97F4A7C15);
+	return &buckets[h >> (64 - LOCKANY_BUCKETS_LOG2)];
+}
 
-	/* lock all */
-	x_mutex_lock(&mutlock);
+/* wait until *seq changes from value */
+static void wait_on(struct bucket *bucket, uint32_t *seq, uint32_t value)
+{
+#if defined(__linux__)
+	(void)bucket;
+	syscall(SYS_futex, seq, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+#else
+	x_mutex_lock(&bucket->mutex);
+	if (LOAD(*seq) == value)
+		x_cond_wait(&bucket->cond, &bucket->mutex);
+	x_mutex_unlock(&bucket->mutex);
+#endif
+}
 
-	/* search a lock for the item and records first frelock */
-	unused = 0;
-	lock = lockers;
-	while (lock && lock->item != item && lock->item)
-		lock = lock->next;
-	if (lock && lock->item != item) {
-		unused = lock;
+/* change *seq and wake up count threads waiting on it */
+static void wake_up(struct bucket *bucket, uint32_t *seq, int count)
+{
+	__atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+#if defined(__linux__)
+	(void)bucket;
+	syscall(SYS_futex, seq, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+#else
+	x_mutex_lock(&bucket->mutex);
+	x_cond_broadcast(&bucket->cond);
+	x_mutex_unlock(&bucket->mutex);
+#endif
+}
+
+/* search without lock the locker of item, set its state in *state */
+static struct locker *locker_search(struct bucket *bucket, const void *item, uint64_t *state)
+{
+	struct locker *lock = LOAD(bucket->lockers);
+	uint64_t s;
+
+	while (lock) {
+		s = LOAD(lock->state);
+		if (!(s & FREE_BIT) && LOAD(lock->item) == item) {
+			*state = s;
+			break;
+		}
 		lock = lock->next;
-		while (lock && lock->item != item)
-			lock = lock->next;
 	}
+	return lock;
+}
+
+/* get the locker of item, creating it if needed, set its state in *state */
+static struct locker *locker_get(struct bucket *bucket, const void *item, uint64_t *state)
+{
+	struct locker *lock;
+	uint64_t s;
 
-	/* treat the case where lock isn't found */
+	/* fast path */
+	lock = locker_search(bucket, item, state);
+	if (lock)
+		return lock;
+
+	/* slow path, attribute a locker to item */
+	x_mutex_lock(&bucket->mutex);
+	lock = locker_search(bucket, item, state);
 	if (!lock) {
-		if (unused) {
-			/* an unused locker exists, predate it */
-			unused->item = item;
-			lock = unused;
+		/* search an idle locker */
+		lock = LOAD(bucket->lockers);
+		while (lock) {
+			s = LOAD(lock->state);
+			if (!(s & USED_MASK)
+			 && CAS(lock->state, &s, (s & GEN_MASK) + GEN_ONE + FREE_BIT)) {
+				STORE(lock->item, item);
+				s = (s & GEN_MASK) + GEN_ONE;
+				STORE(lock->state, s);
+				*state = s;
+				break;
+			}
+			lock = lock->next;
 		}
-		else {
-			/* not locker exists, create it */
+		if (!lock) {
+			/* no idle locker exists, create it */
 			lock = malloc(sizeof *lock);
 			if (lock) {
-				lock->next = lockers;
-				lockers = lock;
 				lock->item = item;
-				lock->lockw = 0;
-				lock->lockr = 0;
-				lock->cntw = 0;
-				lock->cntr = 0;
-				x_cond_init(&lock->cond);
+				lock->state = 0;
+				lock->seqr = 0;
+				lock->seqw = 0;
+				lock->next = bucket->lockers;
+				STORE(bucket->lockers, lock);
+				*state = 0;
 			}
 		}
 	}
+	x_mutex_unlock(&bucket->mutex);
 	return lock;
 }
 
-static int locker_used(struct locker *lock)
+/* is the state changed by an attribution to an other item? */
+static int reattributed(uint64_t before, uint64_t after)
 {
-	return lock->cntw != 0 || lock->cntr != 0;
+	return ((before ^ after) & GEN_MASK) || (after & FREE_BIT);
 }
 
-static void locker_release(struct locker *lock)
+/* are readers blocked in state? */
+static int readers_blocked(uint64_t state)
 {
-	if (!locker_used(lock))
-		lock->item = 0;
-	x_mutex_unlock(&mutlock);
+	return (state & W_BIT) || (prefer_writers && (state & WW_MASK));
 }
 
-static void locker_wait(struct locker *lock)
+/* are writers blocked in state? */
+static int writers_blocked(uint64_t state)
 {
-	x_cond_wait(&lock->cond, &mutlock);
+	return (state & (W_BIT | R_MASK)) != 0;
 }
 
-static void locker_signal(struct locker *lock)
+/* see lockany.h */
+void lockany_prefer_writers(int enable)
 {
-	x_cond_broadcast(&lock->cond);
+	STORE(prefer_writers, !!enable);
 }
 
+/* see lockany.h */
 void lockany_lock_read(const void *item)
 {
-	struct locker *lock = locker_get(item);
-	if (lock) {
-		lock->cntr++;
-		while (lock->lockw)
-			locker_wait(lock);
-		lock->lockr = 1;
-		locker_release(lock);
+	struct bucket *bucket = bucket_of(item);
+	struct locker *lock;
+	uint64_t s, s0;
+	uint32_t seq;
+
+	/* get the lock or register as waiting */
+	lock = locker_get(bucket, item, &s0);
+	if (!lock)
+		return;
+	s = s0;
+	for (;;) {
+		if (!readers_blocked(s)) {
+			if (CAS(lock->state, &s, s + R_ONE))
+				return;
+		}
+		else {
+			if (CAS(lock->state, &s, s + RW_ONE))
+				break;
+		}
+		if (reattributed(s0, s)) {
+			lock = locker_get(bucket, item, &s0);
+			if (!lock)
+				return;
+			s = s0;
+		}
+	}
+
+	/* wait */
+	for (;;) {
+		seq = LOAD(lock->seqr);
+		s = LOAD(lock->state);
+		if (readers_blocked(s))
+			wait_on(bucket, &lock->seqr, seq);
+		else if (CAS(lock->state, &s, s - RW_ONE + R_ONE))
+			return;
 	}
 }
 
+/* see lockany.h */
 int lockany_try_lock_read(const void *item)
 {
-	int rc = 0;
-	struct locker *lock = locker_get(item);
-	if (lock) {
-		if (lock->lockw)
-			rc = X_EAGAIN;
-		else {
-			lock->cntr++;
-			lock->lockr = 1;
+	struct bucket *bucket = bucket_of(item);
+	struct locker *lock;
+	uint64_t s, s0;
+
+	lock = locker_get(bucket, item, &s0);
+	s = s0;
+	while (lock) {
+		if (readers_blocked(s))
+			return X_EAGAIN;
+		if (CAS(lock->state, &s, s + R_ONE))
+			break;
+		if (reattributed(s0, s)) {
+			lock = locker_get(bucket, item, &s0);
+			s = s0;
 		}
-		locker_release(lock);
 	}
-	return rc;
+	return 0;
 }
 
+/* see lockany.h */
 void lockany_lock_write(const void *item)
 {
-	struct locker *lock = locker_get(item);
-	if (lock) {
-		lock->cntw++;
-		while (lock->lockw || lock->lockr)
-			locker_wait(lock);
-		lock->lockw = 1;
-		locker_release(lock);
+	struct bucket *bucket = bucket_of(item);
+	struct locker *lock;
+	uint64_t s, s0;
+	uint32_t seq;
+
+	/* get the lock or register as waiting */
+	lock = locker_get(bucket, item, &s0);
+	if (!lock)
+		return;
+	s = s0;
+	for (;;) {
+		if (!writers_blocked(s)) {
+			if (CAS(lock->state, &s, s | W_BIT))
+				return;
+		}
+		else {
+			if (CAS(lock->state, &s, s + WW_ONE))
+				break;
+		}
+		if (reattributed(s0, s)) {
+			lock = locker_get(bucket, item, &s0);
+			if (!lock)
+				return;
+			s = s0;
+		}
+	}
+
+	/* wait */
+	for (;;) {
+		seq = LOAD(lock->seqw);
+		s = LOAD(lock->state);
+		if (writers_blocked(s))
+			wait_on(bucket, &lock->seqw, seq);
+		else if (CAS(lock->state, &s, (s - WW_ONE) | W_BIT))
+			return;
 	}
 }
 
+/* see lockany.h */
 int lockany_try_lock_write(const void *item)
 {
-	int rc = 0;
-	struct locker *lock = locker_get(item);
-	if (lock) {
-		if (lock->lockw && lock->lockr)
-			rc = X_EAGAIN;
-		else {
-			lock->cntw++;
-			lock->lockw = 1;
+	struct bucket *bucket = bucket_of(item);
+	struct locker *lock;
+	uint64_t s, s0;
+
+	lock = locker_get(bucket, item, &s0);
+	s = s0;
+	while (lock) {
+		if (writers_blocked(s))
+			return X_EAGAIN;
+		if (CAS(lock->state, &s, s | W_BIT))
+			break;
+		if (reattributed(s0, s)) {
+			lock = locker_get(bucket, item, &s0);
+			s = s0;
 		}
-		locker_release(lock);
 	}
-	return rc;
+	return 0;
 }
 
+/* see lockany.h */
 int lockany_unlock(const void *item)
 {
-	int rc = 0, sig = 0;
-	struct locker *lock = locker_get(item);
-	if (lock) {
-		if (lock->lockw) {
-			lock->lockw = 0;
-			lock->cntw--;
-			sig = 1;
-		}
-		else if (lock->lockr) {
-			if (!--lock->cntr) {
-				sig = 1;
-				lock->lockr = 0;
-			}
-		}
-		rc = locker_used(lock);
-		if (rc && sig)
-			locker_signal(lock);
-		locker_release(lock);
+	struct bucket *bucket = bucket_of(item);
+	struct locker *lock;
+	uint64_t s, s0, n;
+
+	lock = locker_search(bucket, item, &s0);
+	if (!lock)
+		return 0;
+	s = s0;
+	do {
+		if (reattributed(s0, s))
+			return 0;
+		if (s & W_BIT)
+			n = s & ~W_BIT;
+		else if (s & R_MASK)
+			n = s - R_ONE;
+		else
+			return (s & USED_MASK) != 0;
+	} while (!CAS(lock->state, &s, n));
+
+	/* wake up waiters */
+	if (s & W_BIT) {
+		/* all readers or else one writer, as preferred */
+		if ((n & RW_MASK) && !(prefer_writers && (n & WW_MASK)))
+			wake_up(bucket, &lock->seqr, INT32_MAX);
+		else if (n & WW_MASK)
+			wake_up(bucket, &lock->seqw, 1);
+		else if (n & RW_MASK)
+			wake_up(bucket, &lock->seqr, INT32_MAX);
+	}
+	else if (!(n & R_MASK) && (n & WW_MASK)) {
+		/* last reader wakes up one writer */
+		wake_up(bucket, &lock->seqw, 1);
 	}
-	return rc;
+	return (n & USED_MASK) != 0;
 }
-
@@ -29,3 +29,15 @@ extern int lockany_try_lock_read(const void *item);
 extern void lockany_lock_write(const void *item);
 extern int lockany_try_lock_write(const void *item);
 extern int lockany_unlock(const void *item);
+
+/**
+ * Set whether waiting writers block new readers.
+ *
+ * By default, readers can lock an item as long as it is not locked
+ * for writing, even when writers are waiting. Enabling writer preference
+ * avoids starvation of writers. But then, a thread already holding a read
+ * lock must not lock the same item for reading again.
+ *
+ * @param enable not zero for preferring writers
+ */
+extern void lockany_prefer_writers(int enable);
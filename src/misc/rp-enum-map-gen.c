@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Generator of indexed rp_enum_map_t arrays
+ *
+ * usage: rp-enum-map-gen NAME INPUT OUTPUT
+ *
+ * Each line of INPUT is either empty, or a comment starting with #,
+ * or a label followed by an integer value (C syntax, decimal, octal
+ * or hexadecimal). OUTPUT is a C file defining the array
+ *
+ *     const rp_enum_map_t NAME[];
+ *
+ * and its index, as computed by rp_enum_index_create,
+ *
+ *     const rp_enum_index_t NAME_index;
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "rp-enum-map.h"
+
+static const char *prog;
+
+static void fail(const char *message, const char *arg)
+{
+	fprintf(stderr, "%s: %s%s%s\n", prog, message, arg ? ": " : "", arg ? arg : "");
+	exit(1);
+}
+
+/* read the pairs of label and value from file */
+static rp_enum_map_t *read_input(const char *file)
+{
+	FILE *in;
+	char line[1024], *label, *value, *end;
+	rp_enum_map_t *array = NULL;
+	size_t count = 0, lino = 0;
+	long v;
+
+	in = fopen(file, "r");
+	if (in == NULL)
+		fail(strerror(errno), file);
+	while (fgets(line, (int)sizeof line, in)) {
+		lino++;
+		label = strtok(line, " \t\r\n");
+		if (label == NULL || *label == '#')
+			continue;
+		value = strtok(NULL, " \t\r\n");
+		if (value == NULL || strtok(NULL, " \t\r\n") != NULL)
+			fail("bad line, expected LABEL VALUE", label);
+		errno = 0;
+		v = strtol(value, &end, 0);
+		if (*end || errno || v != (int)v)
+			fail("bad value", value);
+		array = realloc(array, (count + 2) * sizeof *array);
+		if (array == NULL)
+			fail("out of memory", NULL);
+		/* the value is const, initialize through memcpy */
+		memcpy(&array[count], &(rp_enum_map_t){ strdup(label), (int)v }, sizeof *array);
+		if (array[count].label == NULL)
+			fail("out of memory", NULL);
+		count++;
+	}
+	fclose(in);
+	array = realloc(array, (count + 1) * sizeof *array);
+	if (array == NULL)
+		fail("out of memory", NULL);
+	memcpy(&array[count], &(rp_enum_map_t){ NULL, 0 }, sizeof *array);
+	return array;
+}
+
+/* print the C string of text */
+static void put_string(FILE *out, const char *text)
+{
+	unsigned char c;
+
+	putc('"', out);
+	while ((c = (unsigned char)*text++)) {
+		if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if (isprint(c) && c != '?')
+			putc(c, out);
+		else
+			fprintf(out, "\\%03o", c);
+	}
+	putc('"', out);
+}
+
+/* print the table of uint16_t */
+static void put_table(FILE *out, const char *name, const char *suffix, const uint16_t *table, unsigned count)
+{
+	unsigned i;
+
+	fprintf(out, "\nstatic const uint16_t %s_%s[] = {", name, suffix);
+	for (i = 0 ; i < count ; i++)
+		fprintf(out, "%s%u,", i % 16 ? " " : "\n\t", table[i]);
+	fprintf(out, "%s};\n", count ? "\n" : " 0 ");
+}
+
+int main(int ac, char **av)
+{
+	const char *name;
+	rp_enum_map_t *array;
+	rp_enum_index_t *index;
+	FILE *out;
+	unsigned i;
+	int rc;
+
+	prog = av[0];
+	if (ac != 4)
+		fail("usage", "rp-enum-map-gen NAME INPUT OUTPUT");
+	name = av[1];
+	array = read_input(av[2]);
+	rc = rp_enum_index_create(array, &index);
+	if (rc < 0)
+		fail("can't index", strerror(-rc));
+
+	out = fopen(av[3], "w");
+	if (out == NULL)
+		fail(strerror(errno), av[3]);
+	fprintf(out, "/* generated by rp-enum-map-gen from %s, don't edit */\n\n", av[2]);
+	fprintf(out, "#include <stddef.h>\n#include <rp-utils/rp-enum-map.h>\n");
+
+	fprintf(out, "\nconst rp_enum_map_t %s[] = {\n", name);
+	for (i = 0 ; array[i].label != NULL ; i++) {
+		fprintf(out, "\t{ ");
+		put_string(out, array[i].label);
+		fprintf(out, ", %d },\n", array[i].value);
+	}
+	fprintf(out, "\t{ NULL, 0 }\n};\n");
+
+	put_table(out, name, "displacements", index->displacements, index->nbuckets);
+	put_table(out, name, "labels", index->labels, index->nlabels);
+	put_table(out, name, "values", index->values, index->nvalues);
+
+	fprintf(out, "\nconst rp_enum_index_t %s_index = {\n", name);
+	fprintf(out, "\t.keyvals = %s,\n", name);
+	fprintf(out, "\t.seed = %u,\n", (unsigned)index->seed);
+	fprintf(out, "\t.nlabels = %u,\n", (unsigned)index->nlabels);
+	fprintf(out, "\t.nbuckets = %u,\n", (unsigned)index->nbuckets);
+	fprintf(out, "\t.displacements = %s_displacements,\n", name);
+	fprintf(out, "\t.labels = %s_labels,\n", name);
+	fprintf(out, "\t.vmin = %d,\n", index->vmin);
+	fprintf(out, "\t.nvalues = %u,\n", (unsigned)index->nvalues);
+	fprintf(out, "\t.vdirect = %u,\n", (unsigned)index->vdirect);
+	fprintf(out, "\t.values = %s_values\n", name);
+	fprintf(out, "};\n");
+
+	if (fclose(out))
+		fail(strerror(errno), av[3]);
+	rp_enum_index_destroy(index);
+	return 0;
+}
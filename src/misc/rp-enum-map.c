@@ -25,9 +25,13 @@
 #include "rp-enum-map.h"
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include "rp-verbose.h"
+#include "../sys/x-errno.h"
+#include "../sys/x-mutex.h"
 
 static const rp_enum_map_t *search_label(const rp_enum_map_t *keyvals, const char *label)
 {
@@ -74,7 +78,7 @@ bool rp_enum_map_check_label(const rp_enum_map_t *keyvals, const char *label, co
 bool rp_enum_map_value (const rp_enum_map_t *keyvals, const char *label, int *result)
 {
   keyvals = search_label(keyvals, label);
-  if (keyvals != NULL)
+  if (keyvals == NULL)
   	return false;
   *result = keyvals->value;
   return true;
@@ -83,7 +87,7 @@ bool rp_enum_map_value (const rp_enum_map_t *keyvals, const char *label, int *re
 bool rp_enum_map_label (const rp_enum_map_t *keyvals, int value, const char **result)
 {
   keyvals = search_value(keyvals, value);
-  if (keyvals != NULL)
+  if (keyvals == NULL)
   	return false;
   *result = keyvals->label;
   return true;
@@ -101,3 +105,393 @@ const char *rp_enum_map_label_def (const rp_enum_map_t *keyvals, int value, cons
 	return def;
 }
 
+
+/******************************************************************************/
+/* INDEXED SEARCH                                                             */
+/******************************************************************************/
+
+/*
+ * The labels are indexed by a minimal perfect hash built using the
+ * "hash and displace" method: the hash of a label selects a bucket
+ * and the displacement of the bucket, combined with the hash, selects
+ * the slot of the label. Displacements are chosen, biggest buckets
+ * first, so that each label has its own slot.
+ */
+
+/* count of seeds tried before giving up */
+#define MAX_SEEDS 64
+
+/* greatest displacement */
+#define MAX_DISPLACEMENT 0xffff
+
+/* case insensitive FNV-1a hash of the label */
+static uint32_t hash_label(const char *label, uint32_t seed)
+{
+	uint32_t h = seed ^ UINT32_C(2166136261);
+	unsigned char c;
+
+	while ((c = (unsigned char)*label++)) {
+		if (c >= 'A' && c <= 'Z')
+			c = (unsigned char)(c + 'a' - 'A');
+		h = (h ^ c) * UINT32_C(16777619);
+	}
+	return h;
+}
+
+/* mix the hash with the displacement */
+static uint32_t hash_slot(uint32_t h, uint32_t displacement)
+{
+	h ^= displacement * UINT32_C(0x9E3779B9);
+	h ^= h >> 16;
+	h *= UINT32_C(0x85EBCA6B);
+	h ^= h >> 13;
+	h *= UINT32_C(0xC2B2AE35);
+	h ^= h >> 16;
+	return h;
+}
+
+/* item of label being indexed */
+struct key {
+	const char *label;
+	uint32_t hash;
+	uint16_t index;
+	uint16_t bucket;
+};
+
+/* compare keys by hash, label and index so that duplicates are consecutive */
+static int cmp_keys(const void *a, const void *b)
+{
+	const struct key *ka = a, *kb = b;
+	int r;
+
+	if (ka->hash != kb->hash)
+		return ka->hash < kb->hash ? -1 : 1;
+	r = strcasecmp(ka->label, kb->label);
+	if (r == 0)
+		r = (int)ka->index - (int)kb->index;
+	return r;
+}
+
+/* item of value being indexed */
+struct val {
+	int value;
+	uint16_t index;
+};
+
+/* compare values by value and index */
+static int cmp_values(const void *a, const void *b)
+{
+	const struct val *va = a, *vb = b;
+
+	if (va->value != vb->value)
+		return va->value < vb->value ? -1 : 1;
+	return (int)va->index - (int)vb->index;
+}
+
+/* compute displacements and slots of the nkeys keys, returns 0 or -1 */
+static int place_labels(struct key *keys, uint16_t nkeys, uint16_t nbuckets,
+		uint16_t *displacements, uint16_t *labels, uint16_t *work)
+{
+	uint16_t *taken = work, *first = &work[nkeys], *order = &first[nbuckets + 1];
+	uint32_t d, slot, i, j, b, size, maxsize;
+
+	/* group keys by bucket: first[b] is the position of the first key of b */
+	memset(first, 0, (nbuckets + 1) * sizeof *first);
+	for (i = 0 ; i < nkeys ; i++)
+		first[keys[i].bucket + 1]++;
+	maxsize = 0;
+	for (b = 0 ; b < nbuckets ; b++) {
+		if (first[b + 1] > maxsize)
+			maxsize = first[b + 1];
+		first[b + 1] = (uint16_t)(first[b + 1] + first[b]);
+	}
+	for (i = 0 ; i < nkeys ; i++)
+		taken[i] = first[keys[i].bucket]++;
+	for (i = 0 ; i < nkeys ; i++)
+		order[taken[i]] = (uint16_t)i;
+	for (b = nbuckets ; b > 0 ; b--)
+		first[b] = first[b - 1];
+	first[0] = 0;
+
+	/* place the buckets, biggest first */
+	memset(taken, 0, nkeys * sizeof *taken);
+	memset(displacements, 0, nbuckets * sizeof *displacements);
+	for (size = maxsize ; size > 0 ; size--) {
+		for (b = 0 ; b < nbuckets ; b++) {
+			if ((uint32_t)(first[b + 1] - first[b]) != size)
+				continue;
+			for (d = 0 ; ; d++) {
+				if (d > MAX_DISPLACEMENT)
+					return -1;
+				/* try the displacement d */
+				for (i = first[b] ; i < first[b + 1] ; i++) {
+					slot = hash_slot(keys[order[i]].hash, d) % nkeys;
+					if (taken[slot])
+						break;
+					taken[slot] = 1;
+				}
+				if (i == first[b + 1])
+					break;
+				/* failed, release the slots */
+				for (j = first[b] ; j < i ; j++)
+					taken[hash_slot(keys[order[j]].hash, d) % nkeys] = 0;
+			}
+			displacements[b] = (uint16_t)d;
+			for (i = first[b] ; i < first[b + 1] ; i++) {
+				slot = hash_slot(keys[order[i]].hash, d) % nkeys;
+				labels[slot] = keys[order[i]].index;
+			}
+		}
+	}
+	return 0;
+}
+
+/* see rp-enum-map.h */
+int rp_enum_index_create(const rp_enum_map_t *keyvals, rp_enum_index_t **result)
+{
+	rp_enum_index_t *index = NULL;
+	struct key *keys = NULL;
+	struct val *vals = NULL;
+	uint16_t *tables, *work = NULL, *displacements, *labels, *values;
+	uint32_t i, n, nkeys, nbuckets, nvalues, seed;
+	int64_t vmin, vmax, span;
+	int rc, direct;
+
+	/* count items */
+	for (n = 0 ; keyvals[n].label != NULL ; n++)
+		if (n >= 0xfffe) {
+			rc = X_E2BIG;
+			goto end;
+		}
+
+	/* compute size of values */
+	vmin = vmax = 0;
+	for (i = 0 ; i < n ; i++) {
+		if (i == 0 || keyvals[i].value < vmin)
+			vmin = keyvals[i].value;
+		if (i == 0 || keyvals[i].value > vmax)
+			vmax = keyvals[i].value;
+	}
+	span = n ? vmax - vmin + 1 : 0;
+	direct = span <= 2 * (int64_t)n + 64 && span <= 0xffff;
+	nvalues = direct ? (uint32_t)span : n;
+
+	/* allocate */
+	rc = X_ENOMEM;
+	keys = malloc((n + 1) * sizeof *keys);
+	work = malloc((2 * n + n / 4 + 2) * sizeof *work);
+	nbuckets = n / 4 + 1;
+	index = malloc(sizeof *index + (nbuckets + n + nvalues) * sizeof *tables);
+	if (!direct)
+		vals = malloc(n * sizeof *vals);
+	if (!keys || !work || !index || (!direct && !vals))
+		goto error;
+	tables = (uint16_t*)(index + 1);
+	displacements = tables;
+	labels = &displacements[nbuckets];
+	values = &labels[n];
+
+	/* sort labels, removing duplicates */
+	for (i = 0 ; i < n ; i++) {
+		keys[i].label = keyvals[i].label;
+		keys[i].hash = hash_label(keyvals[i].label, 0);
+		keys[i].index = (uint16_t)i;
+	}
+	qsort(keys, n, sizeof *keys, cmp_keys);
+	for (nkeys = i = 0 ; i < n ; i++)
+		if (i == 0 || keys[i].hash != keys[nkeys - 1].hash
+		 || strcasecmp(keys[i].label, keys[nkeys - 1].label))
+			keys[nkeys++] = keys[i];
+	nbuckets = nkeys / 4 + 1;
+
+	/* build the perfect hash of labels */
+	for (seed = 0 ; ; seed++) {
+		if (seed == MAX_SEEDS) {
+			rc = X_EINVAL;
+			goto error;
+		}
+		for (i = 0 ; i < nkeys ; i++) {
+			keys[i].hash = hash_label(keys[i].label, seed);
+			keys[i].bucket = (uint16_t)(keys[i].hash % nbuckets);
+		}
+		if (place_labels(keys, (uint16_t)nkeys, (uint16_t)nbuckets, displacements, labels, work) == 0)
+			break;
+	}
+
+	/* build the table of values */
+	if (direct) {
+		/* direct table */
+		memset(values, 0, nvalues * sizeof *values);
+		for (i = n ; i > 0 ; i--)
+			values[keyvals[i - 1].value - vmin] = (uint16_t)i;
+	}
+	else {
+		/* sorted table, removing duplicates */
+		for (i = 0 ; i < n ; i++) {
+			vals[i].value = keyvals[i].value;
+			vals[i].index = (uint16_t)i;
+		}
+		qsort(vals, n, sizeof *vals, cmp_values);
+		for (nvalues = i = 0 ; i < n ; i++)
+			if (i == 0 || vals[i].value != vals[i - 1].value)
+				values[nvalues++] = vals[i].index;
+	}
+	index->vdirect = (uint16_t)direct;
+
+	index->keyvals = keyvals;
+	index->seed = seed;
+	index->nlabels = (uint16_t)nkeys;
+	index->nbuckets = (uint16_t)nbuckets;
+	index->displacements = displacements;
+	index->labels = labels;
+	index->vmin = (int)vmin;
+	index->nvalues = (uint16_t)nvalues;
+	index->values = values;
+	rc = 0;
+	goto end;
+
+error:
+	free(index);
+	index = NULL;
+end:
+	free(keys);
+	free(vals);
+	free(work);
+	*result = index;
+	return rc;
+}
+
+/* see rp-enum-map.h */
+void rp_enum_index_destroy(rp_enum_index_t *index)
+{
+	free(index);
+}
+
+static const rp_enum_map_t *index_search_label(const rp_enum_index_t *index, const char *label)
+{
+	const rp_enum_map_t *keyval;
+	uint32_t h, d;
+
+	if (index->nlabels == 0)
+		return NULL;
+	h = hash_label(label, index->seed);
+	d = index->displacements[h % index->nbuckets];
+	keyval = &index->keyvals[index->labels[hash_slot(h, d) % index->nlabels]];
+	return strcasecmp(keyval->label, label) ? NULL : keyval;
+}
+
+static const rp_enum_map_t *index_search_value(const rp_enum_index_t *index, int value)
+{
+	const uint16_t *values = index->values;
+	int64_t offset = (int64_t)value - index->vmin;
+	unsigned low, high, mid;
+	int v;
+
+	if (index->vdirect) {
+		if (offset < 0 || offset >= index->nvalues || !values[offset])
+			return NULL;
+		return &index->keyvals[values[offset] - 1];
+	}
+	low = 0;
+	high = index->nvalues;
+	while (low < high) {
+		mid = (low + high) >> 1;
+		v = index->keyvals[values[mid]].value;
+		if (v == value)
+			return &index->keyvals[values[mid]];
+		if (v < value)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return NULL;
+}
+
+/* see rp-enum-map.h */
+bool rp_enum_index_value(const rp_enum_index_t *index, const char *label, int *result)
+{
+	const rp_enum_map_t *keyval = index_search_label(index, label);
+	if (keyval == NULL)
+		return false;
+	*result = keyval->value;
+	return true;
+}
+
+/* see rp-enum-map.h */
+bool rp_enum_index_label(const rp_enum_index_t *index, int value, const char **result)
+{
+	const rp_enum_map_t *keyval = index_search_value(index, value);
+	if (keyval == NULL)
+		return false;
+	*result = keyval->label;
+	return true;
+}
+
+/* see rp-enum-map.h */
+int rp_enum_index_value_def(const rp_enum_index_t *index, const char *label, int def)
+{
+	rp_enum_index_value(index, label, &def);
+	return def;
+}
+
+/* see rp-enum-map.h */
+const char *rp_enum_index_label_def(const rp_enum_index_t *index, int value, const char *def)
+{
+	rp_enum_index_label(index, value, &def);
+	return def;
+}
+
+/* indexes created by rp_enum_map_index */
+struct cached_index {
+	struct cached_index *next;
+	rp_enum_index_t *index;
+};
+
+static struct cached_index *cached_indexes;
+static x_mutex_t cached_mutex = X_MUTEX_INITIALIZER;
+
+/* see rp-enum-map.h */
+int rp_enum_map_index(const rp_enum_map_t *keyvals, const rp_enum_index_t **index)
+{
+	struct cached_index *iter;
+	rp_enum_index_t *created;
+	int rc = 0;
+
+	x_mutex_lock(&cached_mutex);
+	for (iter = cached_indexes ; iter && iter->index->keyvals != keyvals ; iter = iter->next);
+	if (iter)
+		*index = iter->index;
+	else {
+		rc = rp_enum_index_create(keyvals, &created);
+		if (rc == 0) {
+			iter = malloc(sizeof *iter);
+			if (iter == NULL) {
+				rp_enum_index_destroy(created);
+				rc = X_ENOMEM;
+			}
+			else {
+				iter->index = created;
+				iter->next = cached_indexes;
+				cached_indexes = iter;
+				*index = created;
+			}
+		}
+	}
+	x_mutex_unlock(&cached_mutex);
+	return rc;
+}
+
+/* see rp-enum-map.h */
+void rp_enum_map_unindex(const rp_enum_map_t *keyvals)
+{
+	struct cached_index *iter, **prv;
+
+	x_mutex_lock(&cached_mutex);
+	for (prv = &cached_indexes ; (iter = *prv) && iter->index->keyvals != keyvals ; prv = &iter->next);
+	if (iter) {
+		*prv = iter->next;
+		rp_enum_index_destroy(iter->index);
+		free(iter);
+	}
+	x_mutex_unlock(&cached_mutex);
+}
@@ -0,0 +1,52 @@
+###########################################################################
+# Copyright (C) 2015-2026 IoT.bzh Company
+#
+# Author: José Bollo <jose.bollo@iot.bzh>
+#
+# $RP_BEGIN_LICENSE$
+# Commercial License Usage
+#  Licensees holding valid commercial IoT.bzh licenses may use this file in
+#  accordance with the commercial license agreement provided with the
+#  Software or, alternatively, in accordance with the terms contained in
+#  a written agreement between you and The IoT.bzh Company. For licensing terms
+#  and conditions see https://www.iot.bzh/terms-conditions. For further
+#  information use the contact form at https://www.iot.bzh/contact.
+# 
+# GNU General Public License Usage
+#  Alternatively, this file may be used under the terms of the GNU General
+#  Public license version 3. This license is as published by the Free Software
+#  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+#  of this file. Please review the following information to ensure the GNU
+#  General Public License requirements will be met
+#  https://www.gnu.org/licenses/gpl-3.0.html.
+# $RP_END_LICENSE$
+###########################################################################
+
+# rp_enum_map_generate(NAME INPUT OUTPUT)
+#
+# Generates the C file OUTPUT defining the array of rp_enum_map_t NAME
+# and its index NAME_index from the pairs "label value" of INPUT.
+# Declare them in C using:
+#
+#    extern const rp_enum_map_t NAME[];
+#    extern const rp_enum_index_t NAME_index;
+#
+# The generator rp-enum-map-gen is either the target of that name
+# or the installed program.
+function(rp_enum_map_generate name input output)
+	get_filename_component(input ${input} ABSOLUTE)
+	if(TARGET rp-enum-map-gen)
+		set(generator rp-enum-map-gen)
+	else()
+		find_program(RP_ENUM_MAP_GEN rp-enum-map-gen)
+		if(NOT RP_ENUM_MAP_GEN)
+			message(FATAL_ERROR "rp-enum-map-gen not found")
+		endif()
+		set(generator ${RP_ENUM_MAP_GEN})
+	endif()
+	add_custom_command(
+		OUTPUT ${output}
+		COMMAND ${generator} ${name} ${input} ${output}
+		DEPENDS ${input} ${generator}
+		COMMENT "Generating enum map ${name}")
+endfunction(rp_enum_map_generate)
@@ -23,6 +23,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -80,6 +81,83 @@ extern int rp_enum_map_value_def(const rp_enum_map_t *keyvals, const char *label
 */
 extern const char *rp_enum_map_label_def(const rp_enum_map_t *keyvals, int value, const char *def);
 
+/******************************************************************************/
+/* INDEXED SEARCH                                                             */
+/******************************************************************************/
+
+/**
+ * Index of a label=NULL terminated array of rp_enum_map_t.
+ *
+ * Labels are searched using a minimal perfect hash and values
+ * using a direct table or a sorted table. The result is the same as the
+ * one of the linear functions: labels are compared without case and the
+ * first item of the array matching a label or a value is returned.
+ *
+ * Indexes are created at runtime with 'rp_enum_index_create' or
+ * 'rp_enum_map_index' or generated at build time by the tool
+ * rp-enum-map-gen (see the CMake function 'rp_enum_map_generate').
+ */
+typedef struct rp_enum_index rp_enum_index_t;
+
+struct rp_enum_index
+{
+    const rp_enum_map_t *keyvals;  /**< the indexed array */
+    uint32_t seed;                 /**< seed of the hash of labels */
+    uint16_t nlabels;              /**< count of distinct labels */
+    uint16_t nbuckets;             /**< count of displacements */
+    const uint16_t *displacements; /**< displacement of each bucket of labels */
+    const uint16_t *labels;        /**< index in keyvals of each slot of labels */
+    int vmin;                      /**< lowest value */
+    uint16_t nvalues;              /**< count of items in values */
+    uint16_t vdirect;              /**< is values a direct table? */
+    const uint16_t *values;        /**< if vdirect, 1 + index in keyvals of value - vmin (0 if none)
+                                        else indexes in keyvals sorted by value */
+};
+
+/** create in 'index' the index of the label=NULL terminated array 'keyvals'
+* the array must not change while the index is used
+* returns 0 on success, -ENOMEM on memory depletion, -E2BIG if the array
+* has more than 65534 items or -EINVAL if no perfect hash of its labels
+* was found
+*/
+extern int rp_enum_index_create(const rp_enum_map_t *keyvals, rp_enum_index_t **index);
+
+/** destroy the 'index' created by 'rp_enum_index_create'
+*/
+extern void rp_enum_index_destroy(rp_enum_index_t *index);
+
+/** get in 'index' the index of the label=NULL terminated array 'keyvals'
+* the index is created on first call and then kept until 'rp_enum_map_unindex'
+* is called for 'keyvals'. Callers of hot paths should keep the returned index.
+* returns 0 on success or a negative value as 'rp_enum_index_create'
+*/
+extern int rp_enum_map_index(const rp_enum_map_t *keyvals, const rp_enum_index_t **index);
+
+/** forget the index created by 'rp_enum_map_index' for 'keyvals'
+* must be called before releasing or changing 'keyvals'
+*/
+extern void rp_enum_map_unindex(const rp_enum_map_t *keyvals);
+
+/** search the 'label' using 'index'
+* if found, returns true and store the value in 'result' else return false
+*/
+extern bool rp_enum_index_value(const rp_enum_index_t *index, const char *label, int *result);
+
+/** search the 'value' using 'index'
+* if found, returns true and store the label in 'result' else return false
+*/
+extern bool rp_enum_index_label(const rp_enum_index_t *index, int value, const char **result);
+
+/** search the 'label' using 'index'
+* if found, returns its value, otherwise if not found, returns the default value 'def'
+*/
+extern int rp_enum_index_value_def(const rp_enum_index_t *index, const char *label, int def);
+
+/** search the 'value' using 'index'
+* if found, returns its label, otherwise if not found, returns the default label 'def'
+*/
+extern const char *rp_enum_index_label_def(const rp_enum_index_t *index, int value, const char *def);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -28,11 +28,16 @@
 
 #include "rp-expand-vars.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <ctype.h>
 
+#include "rp-pearson.h"
+#include "rp-strmap.h"
+#include "../sys/x-errno.h"
+
 #if !defined(RP_EXPAND_VARS_LIMIT)
 #    define  RP_EXPAND_VARS_LIMIT           16384
 #endif
@@ -70,161 +75,362 @@
 extern char **environ;
 
 /**
- * Internal expansion of the variables of the given value
- * using values returned by function.
+ * Initial allocation grain of the result
+ */
+#define RP_EXPAND_VARS_GRAIN            64
+
+/**
+ * Result of the search of a variable, cached during one expansion
+ */
+struct lookup
+{
+	/** the name of the variable */
+	const char *name;
+
+	/** length of the name */
+	size_t namelen;
+
+	/** hash of the name */
+	uint32_t hash;
+
+	/** was it found? */
+	int found;
+
+	/** expansion of the variable in the result if expanded != 0 */
+	int expanded;
+	size_t offset;
+	size_t length;
+
+	/** the value found */
+	rp_expand_vars_result_t result;
+};
+
+/**
+ * State of an expansion
+ */
+struct expansion
+{
+	/** function for getting values */
+	rp_expand_vars_fun_t function;
+
+	/** closure of the function */
+	void *closure;
+
+	/** the result being built */
+	char *buffer;
+	size_t length;
+	size_t capacity;
+
+	/** count of variables */
+	size_t count;
+
+	/** cached lookups */
+	struct lookup *lookups;
+	size_t nlookups;
+
+	/** hashed index of lookups, 1 + index of the lookup or 0 if empty */
+	uint32_t *index;
+	uint32_t mask;
+};
+
+/**
+ * Ensure that the result can receive @p length more characters
  *
- * @param value the value whose variables are to be expanded
- * @param function the name resolution function
- * @param closure the closure to give to the function
+ * @return 0 on success or -1 on error or if the limit is reached
+ */
+static int reserve(struct expansion *exp, size_t length)
+{
+	size_t capa;
+	char *buffer;
+
+	length += exp->length;
+	if (length >= RP_EXPAND_VARS_LIMIT)
+		return -1;
+	if (length >= exp->capacity) {
+		capa = exp->capacity ? exp->capacity : RP_EXPAND_VARS_GRAIN;
+		while (capa <= length)
+			capa <<= 1;
+		buffer = realloc(exp->buffer, capa);
+		if (buffer == NULL)
+			return -1;
+		exp->buffer = buffer;
+		exp->capacity = capa;
+	}
+	return 0;
+}
+
+/**
+ * Append the @p length characters of @p text to the result
  *
- * @return NULL if no variable expansion was performed or if
- * memory allocation failed or if maximum recusion was reached
+ * @return 0 on success or -1 on error
  */
-static char *expand(const char *value, rp_expand_vars_fun_t function, void *closure)
+static int append(struct expansion *exp, const char *text, size_t length)
+{
+	if (reserve(exp, length) < 0)
+		return -1;
+	memcpy(&exp->buffer[exp->length], text, length);
+	exp->length += length;
+	return 0;
+}
+
+/**
+ * Get the value of the variable of @p name from the cache or
+ * from the function
+ *
+ * @return the cached lookup or NULL on memory error
+ */
+static struct lookup *lookup(struct expansion *exp, const char *name, size_t namelen)
 {
-	char *result, *write, *previous, c, oc, cdef;
-	const char *begin, *end, *def;
-	int drop, again, depth, found;
-	size_t remove, add, i, len, lendef;
-	rp_expand_vars_result_t expval;
-
-	depth = 0;
-	write = result = previous = NULL;
-	begin = value;
-	while (begin) {
-		drop = again = 0;
-		remove = add = 0;
-		/* scan/expand the input */
-		while ((c = *begin++)) {
-			if (c == RP_EXPAND_VARS_ESC) {
-				/* escaping a key or escape */
-				oc = *begin;
-				if (oc == RP_EXPAND_VARS_ESC || oc == RP_EXPAND_VARS_CHAR) {
-					c = oc;
-					begin++;
+	struct lookup *lo;
+	uint32_t hash, idx, *index, mask;
+	size_t i;
+
+	/* search in cache */
+	hash = rp_pearson32_len(name, namelen);
+	if (exp->index) {
+		for (idx = hash & exp->mask ; exp->index[idx] ; idx = (idx + 1) & exp->mask) {
+			lo = &exp->lookups[exp->index[idx] - 1];
+			if (lo->hash == hash && lo->namelen == namelen && !memcmp(lo->name, name, namelen))
+				return lo;
+		}
+	}
+
+	/* grow the cache, keeping it at most half full */
+	if (2 * (exp->nlookups + 1) > (size_t)exp->mask + 1 || !exp->index) {
+		mask = exp->index ? 2 * exp->mask + 1 : 15;
+		lo = realloc(exp->lookups, ((mask + 1) >> 1) * sizeof *lo);
+		if (lo == NULL)
+			return NULL;
+		exp->lookups = lo;
+		index = calloc((size_t)mask + 1, sizeof *index);
+		if (index == NULL)
+			return NULL;
+		free(exp->index);
+		exp->index = index;
+		exp->mask = mask;
+		for (i = 0 ; i < exp->nlookups ; i++) {
+			for (idx = exp->lookups[i].hash & mask ; index[idx] ; idx = (idx + 1) & mask);
+			index[idx] = (uint32_t)(i + 1);
+		}
+	}
+
+	/* query the function */
+	lo = &exp->lookups[exp->nlookups];
+	lo->name = name;
+	lo->namelen = namelen;
+	lo->hash = hash;
+	lo->expanded = 0;
+	lo->result.value = 0;
+	lo->result.length = 0;
+	lo->result.dispose.function = 0;
+	lo->result.dispose.closure = 0;
+	lo->found = exp->function(exp->closure, name, namelen, &lo->result);
+	if (lo->result.value && !lo->result.length)
+		lo->result.length = strlen(lo->result.value);
+	for (idx = hash & exp->mask ; exp->index[idx] ; idx = (idx + 1) & exp->mask);
+	exp->index[idx] = (uint32_t)(++exp->nlookups);
+	return lo;
+}
+
+/**
+ * Expand the variables of the text from @p begin to @p stop
+ * at the end of the result
+ *
+ * @param exp the expansion
+ * @param begin begin of the text to expand
+ * @param stop end of the text to expand
+ * @param depth depth of recursion
+ *
+ * @return 0 on success or -1 on error, including maximum recursion
+ */
+static int expand_text(struct expansion *exp, const char *begin, const char *stop, int depth)
+{
+	const char *end, *def, *value;
+	char c, oc, cdef, open;
+	size_t len, lendef, length, offset;
+	struct lookup *lo;
+	int drop, found, nest;
+
+#define AT(ptr) ((ptr) < stop ? *(ptr) : 0)
+
+	if (depth >= RP_EXPAND_VARS_DEPTH_MAX)
+		return -1;
+
+	while (begin < stop) {
+		/* copy the plain characters */
+		for (end = begin ; end < stop && *end != RP_EXPAND_VARS_CHAR && *end != RP_EXPAND_VARS_ESC ; end++);
+		if (end != begin) {
+			if (append(exp, begin, (size_t)(end - begin)) < 0)
+				return -1;
+			begin = end;
+			continue;
+		}
+		c = *begin++;
+		if (c == RP_EXPAND_VARS_ESC) {
+			/* escaping a key or escape */
+			oc = AT(begin);
+			if (oc == RP_EXPAND_VARS_ESC || oc == RP_EXPAND_VARS_CHAR) {
+				c = oc;
+				begin++;
+			}
+			if (append(exp, &c, 1) < 0)
+				return -1;
+			continue;
+		}
+
+		/* a variable to expand */
+		exp->count++;
+		drop = 0;
+		cdef = 0;
+		def = NULL;
+		lendef = 0;
+		/* search name of the variable to expand */
+		open = AT(begin);
+		switch(open) {
+			case '(': c = ')'; break;
+			case '{': c = '}'; break;
+			default: c = 0; break;
+		}
+		if (c == 0) {
+			for (end = begin ; end < stop && (isalnum(*end) || *end == '_') ; end++);
+			len = (size_t)(end - begin);
+		}
+		else {
+			/* nested brackets of defaults are skipped */
+			for (nest = 0, end = ++begin ; (oc = AT(end)) && (oc != c || nest) ; end++)
+				if (oc == open)
+					nest++;
+				else if (oc == c)
+					nest--;
+				else if (cdef == 0 && (oc == RP_EXPAND_VARS_DEFA
+				   || (oc == RP_EXPAND_VARS_DEFX && AT(end + 1) == RP_EXPAND_VARS_DEFA))) {
+					cdef = oc;
+					def = end;
 				}
-				if (write)
-					*write++ = c;
+			if (cdef == 0)
+				len = (size_t)(end - begin);
+			else {
+				len = (size_t)(def - begin);
+				def += 1 + (cdef == RP_EXPAND_VARS_DEFX);
+				lendef = (size_t)(end - def);
 			}
-			else if (c != RP_EXPAND_VARS_CHAR) {
-				/* not a variable to expand */
-				if (write)
-					*write++ = c;
+			if (oc)
+				/* correct termination */
+				end++;
+			else
+				/* bad termination, ignore */
+				drop = 1;
+		}
+		if (!drop) {
+			/* search the value of the variable */
+			lo = lookup(exp, begin, len);
+			if (lo == NULL)
+				return -1;
+			found = lo->found;
+			value = lo->result.value;
+			length = lo->result.length;
+			if ((cdef && !found)
+			 || (cdef == RP_EXPAND_VARS_DEFX && !(value && length))) {
+				/* use the default */
+				lo = NULL;
+				value = def;
+				length = lendef;
+				found = 1;
 			}
-			else {
-				/* no default */
-				cdef = 0;
-				def = NULL;
-				lendef = 0;
-				/* search name of the variable to expand */
-				switch(*begin) {
-					case '(': c = ')'; break;
-					case '{': c = '}'; break;
-					default: c = 0; break;
-				}
-				if (c == 0) {
-					for (end = begin ; isalnum(*end) || *end == '_' ; end++);
-					len = (size_t)(end - begin);
-					remove += 1 + len; /* length to remove */
-				}
-				else {
-					for (end = ++begin ; (oc = *end) && oc != c ; end++)
-						if (cdef == 0 && (oc == RP_EXPAND_VARS_DEFA
-						   || (oc == RP_EXPAND_VARS_DEFX && end[1] == RP_EXPAND_VARS_DEFA))) {
-							cdef = oc;
-							def = end;
-						}
-					if (cdef == 0)
-						len = (size_t)(end - begin);
-					else {
-						len = (size_t)(def - begin);
-						def += 1 + (cdef == RP_EXPAND_VARS_DEFX);
-						lendef = (size_t)(end - def);
-					}
-					if (oc) {
-						/* correct termination */
-						end++;
-						remove += 3 + (size_t)(end - begin); /* length to remove */
-					}
-					else {
-						/* bad termination, ignore */
-						remove += 2 + (size_t)(end - begin); /* length to remove */
-						drop = 1;
-					}
+			if (found && value) {
+				/* expand value of found variable */
+				if (lo && lo->expanded) {
+					/* already expanded */
+					if (reserve(exp, lo->length) < 0)
+						return -1;
+					memcpy(&exp->buffer[exp->length], &exp->buffer[lo->offset], lo->length);
+					exp->length += lo->length;
 				}
-				/* search the value of the variable in vars and env */
-				if (drop) {
-					drop = 0;
+				else if (memchr(value, RP_EXPAND_VARS_CHAR, length) == NULL) {
+					/* nothing to expand */
+					if (append(exp, value, length) < 0)
+						return -1;
 				}
 				else {
-					expval.value = 0;
-					expval.length = 0;
-					expval.dispose.function = 0;
-					expval.dispose.closure = 0;
-					found = function(closure, begin, len, &expval);
-					if ((cdef && !found)
-					 || (cdef == RP_EXPAND_VARS_DEFX && !(expval.value && *expval.value))) {
-						expval.length = lendef;
-						/*
-						 * because strlen is used when length is zero
-						 * it is needed to set a value pointing an empty string
-						 * the fastest and simplest way is to point the length == 0
-						 */
-						expval.value = lendef ? def : (char*)&expval.length;
-						found = 1;
-					}
-					if (found && expval.value) {
-						/* expand value of found variable */
-						if (!expval.length)
-							expval.length = strlen(expval.value);
-						if (write) {
-							memcpy(write, expval.value, expval.length);
-							write += expval.length;
-							again += NULL != memchr(expval.value, RP_EXPAND_VARS_CHAR, expval.length);
-						}
-						add += expval.length;
+					/* recursive expansion */
+					offset = exp->length;
+					if (expand_text(exp, value, value + length, depth + 1) < 0)
+						return -1;
+					if (lo) {
+						lo = lookup(exp, begin, len);
+						lo->expanded = 1;
+						lo->offset = offset;
+						lo->length = exp->length - offset;
 					}
-					if (expval.dispose.function)
-						expval.dispose.function(expval.dispose.closure);
 				}
-				begin = end;
-			}
-		}
-		/* scan/expand done */
-		if (again) {
-			/* expansion done but must iterate */
-			free(previous);
-			begin = value = previous = result;
-			*write = 0;
-			result = write = NULL;
-			if (++depth >= RP_EXPAND_VARS_DEPTH_MAX) {
-				/* limit recursivity effect */
-				begin = NULL;
-			}
-		}
-		else if (write) {
-			/* expansion done */
-			*write = 0;
-			begin = NULL;
-		}
-		else if (!remove) {
-			/* no expansion to do after first scan */
-			begin = NULL;
-		}
-		else {
-			/* prepare expansion after scan */
-			i = (size_t)(begin - value) + add - remove;
-			if (i >= RP_EXPAND_VARS_LIMIT) {
-				/* limit expansion size */
-				begin = NULL;
-			}
-			else {
-				result = write = malloc(i + 1);
-				begin = write ? value : NULL;
 			}
 		}
+		begin = end;
 	}
-	free(previous);
+	return 0;
+
+#undef AT
+}
+
+/**
+ * Internal expansion of the variables of the given value
+ * using values returned by function.
+ *
+ * The result is built in one pass, the values containing variables
+ * being expanded recursively in place. The values of the variables
+ * are searched once and cached during the expansion, as are the
+ * recursive expansions of their values.
+ *
+ * @param value the value whose variables are to be expanded
+ * @param function the name resolution function
+ * @param closure the closure to give to the function
+ *
+ * @return NULL if no variable expansion was performed or if
+ * memory allocation failed or if maximum recusion was reached
+ */
+static char *expand(const char *value, rp_expand_vars_fun_t function, void *closure)
+{
+	struct expansion exp;
+	char *result;
+	size_t length, i;
+	int rc;
+
+	/* fast check of presence of variables */
+	if (value == NULL || strchr(value, RP_EXPAND_VARS_CHAR) == NULL)
+		return NULL;
+
+	/* expand */
+	length = strlen(value);
+	exp.function = function;
+	exp.closure = closure;
+	exp.buffer = NULL;
+	exp.length = 0;
+	exp.capacity = 0;
+	exp.count = 0;
+	exp.lookups = NULL;
+	exp.nlookups = 0;
+	exp.index = NULL;
+	exp.mask = 0;
+	rc = reserve(&exp, length);
+	if (rc == 0)
+		rc = expand_text(&exp, value, value + length, 0);
+	if (rc == 0)
+		rc = reserve(&exp, 1);
+
+	/* dispose the values */
+	for (i = 0 ; i < exp.nlookups ; i++)
+		if (exp.lookups[i].result.dispose.function)
+			exp.lookups[i].result.dispose.function(exp.lookups[i].result.dispose.closure);
+	free(exp.lookups);
+	free(exp.index);
+
+	/* terminate */
+	if (rc < 0 || exp.count == 0) {
+		free(exp.buffer);
+		return NULL;
+	}
+	result = exp.buffer;
+	result[exp.length] = 0;
 	return result;
 }
 
@@ -266,7 +472,7 @@ const char *rp_expand_vars_search(char **vars, const char *name, size_t len)
 	char *var;
 
 	for (var = *vars ; var ; var = *++vars) {
-		if (!memcmp(var, name, len) && var[len] == '=')
+		if (!strncmp(var, name, len) && var[len] == '=')
 			return &var[len + 1];
 	}
 	return NULL;
@@ -333,3 +539,178 @@ char *rp_expand_vars_last(const char *value, int copy, char **vars)
 	char **array[] = { environ, vars, 0 };
 	return rp_expand_vars_array(value, copy, array);
 }
+
+/**
+ * Source of definitions of a dictionary
+ */
+struct source
+{
+	/** the array of definitions */
+	char **vars;
+
+	/** is it the environment? */
+	int env;
+};
+
+/**
+ * Dictionary of variables
+ */
+struct rp_expand_vars_dict
+{
+	/** map of names to values */
+	rp_strmap_t *map;
+
+	/** copy of the definitions when snapshot */
+	char *snapshot;
+
+	/** flags of creation */
+	int flags;
+
+	/** count of sources */
+	unsigned count;
+
+	/** the sources in priority order */
+	struct source sources[];
+};
+
+/**
+ * Internal routine used to get variables from dictionaries
+ */
+static int getdict(void *closure, const char *name, size_t len, rp_expand_vars_result_t *result)
+{
+	result->value = rp_expand_vars_dict_search(closure, name, len);
+	return result->value != NULL;
+}
+
+/**
+ * Builds the map and the snapshot of the dictionary from its sources
+ */
+static int dict_build(rp_expand_vars_dict_t *dict, rp_strmap_t **pmap, char **psnapshot)
+{
+	rp_strmap_t *map;
+	char **vars, *var, *snapshot, *eq;
+	unsigned isrc, count;
+	size_t size, len;
+	int rc;
+
+	/* count the definitions and their size */
+	count = 0;
+	size = 0;
+	for (isrc = 0 ; isrc < dict->count ; isrc++) {
+		vars = dict->sources[isrc].env ? environ : dict->sources[isrc].vars;
+		for ( ; vars && (var = *vars) ; vars++) {
+			count++;
+			size += strlen(var) + 1;
+		}
+	}
+
+	/* allocate */
+	snapshot = NULL;
+	if ((dict->flags & RP_EXPAND_VARS_DICT_SNAPSHOT) && size) {
+		snapshot = malloc(size);
+		if (snapshot == NULL)
+			return X_ENOMEM;
+	}
+	rc = rp_strmap_create(&map, count, 0);
+	if (rc < 0) {
+		free(snapshot);
+		return rc;
+	}
+
+	/* fill, the first definition wins */
+	size = 0;
+	for (isrc = 0 ; isrc < dict->count ; isrc++) {
+		vars = dict->sources[isrc].env ? environ : dict->sources[isrc].vars;
+		for ( ; vars && (var = *vars) ; vars++) {
+			if (snapshot) {
+				len = strlen(var) + 1;
+				var = memcpy(&snapshot[size], var, len);
+				size += len;
+			}
+			eq = strchr(var, '=');
+			if (eq != NULL) {
+				rc = rp_strmap_add_len(map, var, (size_t)(eq - var), eq + 1);
+				if (rc < 0 && rc != X_EEXIST) {
+					rp_strmap_destroy(map);
+					free(snapshot);
+					return rc;
+				}
+			}
+		}
+	}
+	*pmap = map;
+	*psnapshot = snapshot;
+	return 0;
+}
+
+/* see rp-expand-vars.h */
+int rp_expand_vars_dict_create(rp_expand_vars_dict_t **pdict, char ***varsarray, int flags)
+{
+	rp_expand_vars_dict_t *dict;
+	unsigned count;
+	int rc;
+
+	for (count = 0 ; varsarray && varsarray[count] ; count++);
+	*pdict = dict = malloc(sizeof *dict + count * sizeof *dict->sources);
+	if (dict == NULL)
+		return X_ENOMEM;
+	dict->flags = flags;
+	dict->count = count;
+	for (count = 0 ; count < dict->count ; count++) {
+		dict->sources[count].vars = varsarray[count];
+		dict->sources[count].env = varsarray[count] == environ;
+	}
+	rc = dict_build(dict, &dict->map, &dict->snapshot);
+	if (rc < 0) {
+		free(dict);
+		*pdict = NULL;
+	}
+	return rc;
+}
+
+/* see rp-expand-vars.h */
+int rp_expand_vars_dict_create_env(rp_expand_vars_dict_t **dict, char **before, char **after, int flags)
+{
+	char **array[] = { before, environ, after, 0 };
+	return rp_expand_vars_dict_create(dict, &array[!before], flags);
+}
+
+/* see rp-expand-vars.h */
+int rp_expand_vars_dict_refresh(rp_expand_vars_dict_t *dict)
+{
+	rp_strmap_t *map;
+	char *snapshot;
+	int rc;
+
+	rc = dict_build(dict, &map, &snapshot);
+	if (rc == 0) {
+		rp_strmap_destroy(dict->map);
+		free(dict->snapshot);
+		dict->map = map;
+		dict->snapshot = snapshot;
+	}
+	return rc;
+}
+
+/* see rp-expand-vars.h */
+void rp_expand_vars_dict_destroy(rp_expand_vars_dict_t *dict)
+{
+	if (dict) {
+		rp_strmap_destroy(dict->map);
+		free(dict->snapshot);
+		free(dict);
+	}
+}
+
+/* see rp-expand-vars.h */
+const char *rp_expand_vars_dict_search(rp_expand_vars_dict_t *dict, const char *name, size_t len)
+{
+	void *value;
+	return rp_strmap_get_len(dict->map, name, len, &value) < 0 ? NULL : value;
+}
+
+/* see rp-expand-vars.h */
+char *rp_expand_vars_dict(const char *value, int copy, rp_expand_vars_dict_t *dict)
+{
+	return rp_expand_vars_function(value, copy, getdict, dict);
+}
@@ -61,6 +61,11 @@ typedef struct {
  * characters and a length. Based on that the function returns the value
  * associated to the name in result.
  *
+ * During one expansion, the function is called only once per distinct name,
+ * its result is cached and reused for next occurences of the name. For that
+ * reason, the value returned must remain valid until the expansion ends:
+ * the dispose functions are all called at the end of the expansion.
+ *
  * @param closure the closure of the function
  * @param name    start pointer for the name
  * @param len     the length in chars of the name
@@ -255,6 +260,100 @@ extern char *rp_expand_vars_first(const char *value, int copy, char **vars);
  */
 extern char *rp_expand_vars_last(const char *value, int copy, char **vars);
 
+/**
+ * Dictionary of variables prebuilt from arrays of definitions
+ * and from the environment, for searching variables in constant time
+ */
+typedef struct rp_expand_vars_dict rp_expand_vars_dict_t;
+
+/**
+ * Flag for creating dictionaries that copy the definitions
+ *
+ * Without that flag, the dictionary refers to the definitions of the arrays
+ * and must be refreshed when the arrays or the environment change.
+ * With that flag, the dictionary keeps the values it had at its creation
+ * or at its last refresh.
+ */
+#define RP_EXPAND_VARS_DICT_SNAPSHOT   1
+
+/**
+ * Creates a dictionary of the variables defined in the null terminated
+ * array of null terminated arrays of definitions "NAME=VALUE...".
+ * When a variable is defined many times, the first definition is used,
+ * as for @see rp_expand_vars_array.
+ *
+ * When an array of @p varsarray is the environment (environ), the
+ * dictionary records it and uses the current environment on refresh.
+ *
+ * @param dict      where to store the created dictionary
+ * @param varsarray the arrays of definitions
+ * @param flags     either 0 or RP_EXPAND_VARS_DICT_SNAPSHOT
+ *
+ * @return 0 on success or -ENOMEM if allocation failed
+ */
+extern int rp_expand_vars_dict_create(rp_expand_vars_dict_t **dict, char ***varsarray, int flags);
+
+/**
+ * Creates a dictionary of the variables searched
+ *   1. in the null terminated array 'before'
+ *   2. in the environment
+ *   3. in the null terminated array 'after'
+ * as for @see rp_expand_vars
+ *
+ * @param dict   where to store the created dictionary
+ * @param before null terminated array of definitions "NAME=VALUE..." or NULL
+ * @param after  null terminated array of definitions "NAME=VALUE..." or NULL
+ * @param flags  either 0 or RP_EXPAND_VARS_DICT_SNAPSHOT
+ *
+ * @return 0 on success or -ENOMEM if allocation failed
+ */
+extern int rp_expand_vars_dict_create_env(rp_expand_vars_dict_t **dict, char **before, char **after, int flags);
+
+/**
+ * Rebuilds the dictionary from the current content of its arrays
+ * and of the environment. On error, the dictionary is unchanged.
+ *
+ * @param dict the dictionary to refresh
+ *
+ * @return 0 on success or -ENOMEM if allocation failed
+ */
+extern int rp_expand_vars_dict_refresh(rp_expand_vars_dict_t *dict);
+
+/**
+ * Destroys the dictionary
+ *
+ * @param dict the dictionary to destroy, can be NULL
+ */
+extern void rp_expand_vars_dict_destroy(rp_expand_vars_dict_t *dict);
+
+/**
+ * Search for the variable in the dictionary
+ *
+ * @param dict the dictionary
+ * @param name begin of the name of the searched variable
+ * @param len  length of the searched variable
+ *
+ * @return a pointer to the value or NULL if the variable is not found
+ */
+extern const char *rp_expand_vars_dict_search(rp_expand_vars_dict_t *dict, const char *name, size_t len);
+
+/**
+ * Return the result of expanding variables of 'value'.
+ * When 'value' does not contains variables, returns either NULL (when 'copy' == 0)
+ * or a copy of value (when 'copy' != 0).
+ *
+ * The variables can appear in one of the form ${...} or $(...) or $ALPHA_NUM
+ *
+ * The resolution of the variables if done by searching in the dictionary
+ *
+ * @param value  the string to expand
+ * @param copy   behavior in lack of variable (0 return NULL, not zero return copy)
+ * @param dict   the dictionary of the variables
+ *
+ * @return The result of expanding variables of value or NULL if lake of variables and copy == 0
+ */
+extern char *rp_expand_vars_dict(const char *value, int copy, rp_expand_vars_dict_t *dict);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -27,12 +27,17 @@
 #include "rp-file.h"
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include <errno.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 
+#define DEFAULT_BLOCK_SIZE 65536
+
 int rp_file_get(const char *file, char **content, size_t *size)
 {
 	return rp_file_get_at(AT_FDCWD, file, content, size);
@@ -91,6 +96,194 @@ int rp_file_get_at(int dfd, const char *file, char **content, size_t *size)
 	return rc;
 }
 
+int rp_file_map(const char *file, rp_file_map_t *map, unsigned flags)
+{
+	return rp_file_map_at(AT_FDCWD, file, map, flags);
+}
+
+int rp_file_map_at(int dfd, const char *file, rp_file_map_t *map, unsigned flags)
+{
+	int rc, f, mflags, advice;
+	struct stat s;
+	void *addr;
+
+	map->data = "";
+	map->size = 0;
+	rc = openat(dfd, file, O_RDONLY|O_CLOEXEC);
+	if (rc < 0)
+		rc = -errno;
+	else {
+		f = rc;
+		rc = fstat(f, &s);
+		if (rc != 0) {
+			rc = -errno;
+		} else if (!S_ISREG(s.st_mode)) {
+			rc = -EBADF;
+		} else if (s.st_size > 0) {
+			mflags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+			if (flags & RP_FILE_MAP_POPULATE)
+				mflags |= MAP_POPULATE;
+#endif
+			addr = mmap(NULL, (size_t)s.st_size, PROT_READ, mflags, f, 0);
+			if (addr == MAP_FAILED)
+				rc = -errno;
+			else {
+				map->data = addr;
+				map->size = (size_t)s.st_size;
+				advice = (flags & RP_FILE_MAP_SEQUENTIAL) ? MADV_SEQUENTIAL
+				       : (flags & RP_FILE_MAP_RANDOM) ? MADV_RANDOM
+				       : MADV_NORMAL;
+				if (advice != MADV_NORMAL)
+					madvise(addr, map->size, advice);
+				if (flags & RP_FILE_MAP_WILLNEED)
+					madvise(addr, map->size, MADV_WILLNEED);
+			}
+		}
+		close(f);
+	}
+	return rc;
+}
+
+void rp_file_map_release(rp_file_map_t *map)
+{
+	if (map->size > 0)
+		munmap((void*)map->data, map->size);
+	map->data = "";
+	map->size = 0;
+}
+
+int rp_file_read_blocks(const char *file, size_t blocksize, rp_file_block_cb_t callback, void *closure)
+{
+	return rp_file_read_blocks_at(AT_FDCWD, file, blocksize, callback, closure);
+}
+
+int rp_file_read_blocks_at(int dfd, const char *file, size_t blocksize, rp_file_block_cb_t callback, void *closure)
+{
+	int rc, f;
+	struct stat s;
+	char *buffer;
+	ssize_t rsz;
+	size_t sz;
+
+	rc = openat(dfd, file, O_RDONLY|O_CLOEXEC);
+	if (rc < 0)
+		rc = -errno;
+	else {
+		f = rc;
+		rc = fstat(f, &s);
+		if (rc != 0) {
+			rc = -errno;
+		} else if (!S_ISREG(s.st_mode)) {
+			rc = -EBADF;
+		} else {
+			if (blocksize == 0)
+				blocksize = DEFAULT_BLOCK_SIZE;
+			buffer = malloc(blocksize);
+			if (!buffer) {
+				rc = -ENOMEM;
+			} else {
+				posix_fadvise(f, 0, 0, POSIX_FADV_SEQUENTIAL);
+				sz = 0;
+				while (rc == 0) {
+					rsz = read(f, buffer + sz, blocksize - sz);
+					if (rsz > 0) {
+						sz += (size_t)rsz;
+						if (sz == blocksize) {
+							rc = callback(closure, buffer, sz);
+							sz = 0;
+						}
+					}
+					else if (rsz == 0) {
+						if (sz > 0)
+							rc = callback(closure, buffer, sz);
+						break;
+					}
+					else if (errno != EINTR && errno != EAGAIN)
+						rc = -errno;
+				}
+				free(buffer);
+			}
+		}
+		close(f);
+	}
+	return rc;
+}
+
+static int write_all(int f, const void *content, size_t size)
+{
+	ssize_t wsz;
+	size_t i;
+
+	i = 0;
+	while (i < size) {
+		wsz = write(f, content + i, size - i);
+		if (wsz >= 0)
+			i += (size_t)wsz;
+		else if (errno != EINTR && errno != EAGAIN)
+			return -errno;
+	}
+	return 0;
+}
+
+/*
+ * creates a fresh temporary file for 'file' and returns its name in 'tmp'
+ * the temporary file gets the mode of 'file' when it exists
+ */
+static int create_temp(int dfd, const char *file, char *tmp, size_t tmpsz)
+{
+	static unsigned counter;
+	unsigned trial, value;
+	struct stat st;
+	int rc, err;
+
+	for (trial = 0 ; trial < 100 ; trial++) {
+		value = __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+		rc = snprintf(tmp, tmpsz, "%s.%x-%x.tmp", file, (unsigned)getpid(), value);
+		if (rc < 0 || (size_t)rc >= tmpsz)
+			return -ENAMETOOLONG;
+		rc = openat(dfd, tmp, O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC, 0666);
+		if (rc >= 0) {
+			if (fstatat(dfd, file, &st, 0) == 0 && fchmod(rc, st.st_mode & 07777) < 0) {
+				err = -errno;
+				close(rc);
+				unlinkat(dfd, tmp, 0);
+				return err;
+			}
+			return rc;
+		}
+		if (errno != EEXIST)
+			return -errno;
+	}
+	return -EEXIST;
+}
+
+/* synchronizes the directory containing 'file' */
+static int sync_dir_of(int dfd, const char *file)
+{
+	char dir[PATH_MAX];
+	const char *slash;
+	size_t len;
+	int rc, d;
+
+	slash = strrchr(file, '/');
+	if (slash == NULL)
+		d = openat(dfd, ".", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	else {
+		len = slash == file ? 1 : (size_t)(slash - file);
+		if (len >= sizeof dir)
+			return -ENAMETOOLONG;
+		memcpy(dir, file, len);
+		dir[len] = 0;
+		d = openat(dfd, dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	}
+	if (d < 0)
+		return -errno;
+	rc = fsync(d) < 0 ? -errno : 0;
+	close(d);
+	return rc;
+}
+
 int rp_file_put(const char *file, const void *content, size_t size)
 {
 	return rp_file_put_at(AT_FDCWD, file, content, size);
@@ -98,30 +291,195 @@ int rp_file_put(const char *file, const void *content, size_t size)
 
 int rp_file_put_at(int dfd, const char *file, const void *content, size_t size)
 {
+	return rp_file_put_flags_at(dfd, file, content, size, 0);
+}
+
+int rp_file_put_flags(const char *file, const void *content, size_t size, unsigned flags)
+{
+	return rp_file_put_flags_at(AT_FDCWD, file, content, size, flags);
+}
+
+int rp_file_put_flags_at(int dfd, const char *file, const void *content, size_t size, unsigned flags)
+{
+	char tmp[PATH_MAX];
+	const char *name;
 	int rc, f;
-	ssize_t wsz;
-	size_t i;
 
-	rc = openat(dfd, file, O_WRONLY|O_CREAT|O_TRUNC, 0666);
-	if (rc < 0)
-		rc = -errno;
+	if (flags & RP_FILE_PUT_ATOMIC) {
+		rc = create_temp(dfd, file, tmp, sizeof tmp);
+		name = tmp;
+	}
 	else {
+		rc = openat(dfd, file, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0666);
+		if (rc < 0)
+			rc = -errno;
+		name = file;
+	}
+	if (rc >= 0) {
 		if (size == (size_t)(ssize_t)-1)
 			size = strlen(content);
 		f = rc;
-		i = 0;
-		rc = 0;
-		while (rc == 0 && i < size) {
-			wsz = write(f, content + i, size - i);
-			if (wsz >= 0)
-				i += (size_t)wsz;
-			else if (errno != EINTR && errno != EAGAIN) {
-				unlinkat(dfd, file, 0);
-				rc = -errno;
-			}
-		}
+		rc = write_all(f, content, size);
+		if (rc == 0 && (flags & RP_FILE_PUT_SYNC) && fdatasync(f) < 0)
+			rc = -errno;
 		close(f);
+		if (rc == 0 && name != file && renameat(dfd, name, dfd, file) < 0)
+			rc = -errno;
+		if (rc < 0)
+			unlinkat(dfd, name, 0);
+		else if ((flags & (RP_FILE_PUT_ATOMIC|RP_FILE_PUT_SYNC)) == (RP_FILE_PUT_ATOMIC|RP_FILE_PUT_SYNC))
+			rc = sync_dir_of(dfd, file);
+	}
+	return rc;
+}
+
+/******************************************************************************/
+
+struct batch_entry
+{
+	/* final name, followed by the temporary name */
+	char *name;
+	char *tmp;
+};
+
+struct rp_file_batch_s
+{
+	int dirfd;
+	unsigned flags;
+	unsigned count;
+	unsigned alloc;
+	struct batch_entry *entries;
+};
+
+int rp_file_batch_create(rp_file_batch_t **batch, int dfd, const char *dir, unsigned flags)
+{
+	rp_file_batch_t *b;
+
+	*batch = b = malloc(sizeof *b);
+	if (b == NULL)
+		return -ENOMEM;
+	b->dirfd = openat(dfd, dir ? dir : ".", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	if (b->dirfd < 0) {
+		free(b);
+		*batch = NULL;
+		return -errno;
+	}
+	b->flags = flags;
+	b->count = b->alloc = 0;
+	b->entries = NULL;
+	return 0;
+}
+
+int rp_file_batch_put(rp_file_batch_t *batch, const char *file, const void *content, size_t size)
+{
+	char tmp[PATH_MAX];
+	struct batch_entry *entries;
+	size_t nlen, tlen;
+	char *names;
+	int rc, f;
+
+	if (strchr(file, '/') != NULL)
+		return -EINVAL;
+
+	/* ensure room for the entry */
+	if (batch->count == batch->alloc) {
+		entries = realloc(batch->entries, (batch->alloc + 32) * sizeof *entries);
+		if (entries == NULL)
+			return -ENOMEM;
+		batch->entries = entries;
+		batch->alloc += 32;
+	}
+
+	/* write the temporary file */
+	rc = create_temp(batch->dirfd, file, tmp, sizeof tmp);
+	if (rc < 0)
+		return rc;
+	f = rc;
+	if (size == (size_t)(ssize_t)-1)
+		size = strlen(content);
+	rc = write_all(f, content, size);
+#ifdef SYNC_FILE_RANGE_WRITE
+	/* start the write back now, it is waited at commit */
+	if (rc == 0 && (batch->flags & RP_FILE_PUT_SYNC))
+		sync_file_range(f, 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+	close(f);
+
+	/* record it */
+	if (rc == 0) {
+		nlen = strlen(file) + 1;
+		tlen = strlen(tmp) + 1;
+		names = malloc(nlen + tlen);
+		if (names == NULL)
+			rc = -ENOMEM;
+		else {
+			entries = &batch->entries[batch->count++];
+			entries->name = memcpy(names, file, nlen);
+			entries->tmp = memcpy(names + nlen, tmp, tlen);
+		}
 	}
+	if (rc < 0)
+		unlinkat(batch->dirfd, tmp, 0);
 	return rc;
 }
 
+/* discards the entries of 'batch' from 'index' */
+static void batch_discard(rp_file_batch_t *batch, unsigned index)
+{
+	struct batch_entry *entry;
+
+	for ( ; index < batch->count ; index++) {
+		entry = &batch->entries[index];
+		unlinkat(batch->dirfd, entry->tmp, 0);
+		free(entry->name);
+	}
+	batch->count = 0;
+}
+
+int rp_file_batch_commit(rp_file_batch_t *batch)
+{
+	struct batch_entry *entry;
+	unsigned index;
+	int rc, f;
+
+	/* synchronize the data of the files */
+	if (batch->flags & RP_FILE_PUT_SYNC) {
+		for (index = 0 ; index < batch->count ; index++) {
+			f = openat(batch->dirfd, batch->entries[index].tmp, O_RDONLY|O_CLOEXEC);
+			rc = f < 0 || fdatasync(f) < 0 ? -errno : 0;
+			if (f >= 0)
+				close(f);
+			if (rc < 0) {
+				batch_discard(batch, 0);
+				return rc;
+			}
+		}
+	}
+
+	/* rename the files */
+	for (index = 0 ; index < batch->count ; index++) {
+		entry = &batch->entries[index];
+		if (renameat(batch->dirfd, entry->tmp, batch->dirfd, entry->name) < 0) {
+			rc = -errno;
+			batch_discard(batch, index);
+			return rc;
+		}
+		free(entry->name);
+	}
+	batch->count = 0;
+
+	/* synchronize the directory once */
+	if ((batch->flags & RP_FILE_PUT_SYNC) && fsync(batch->dirfd) < 0)
+		return -errno;
+	return 0;
+}
+
+void rp_file_batch_destroy(rp_file_batch_t *batch)
+{
+	if (batch != NULL) {
+		batch_discard(batch, 0);
+		close(batch->dirfd);
+		free(batch->entries);
+		free(batch);
+	}
+}
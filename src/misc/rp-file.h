@@ -86,6 +86,207 @@ extern int rp_file_put_at(int dfd, const char *file, const void *content, size_t
  */
 extern int rp_file_put(const char *file, const void *content, size_t size);
 
+/**
+ * Flags for rp_file_put_flags_at and rp_file_batch_create
+ */
+/** replace the file atomically: readers see the old or the new content */
+#define RP_FILE_PUT_ATOMIC      1
+/** wait for the content to be on the storage before returning */
+#define RP_FILE_PUT_SYNC        2
+
+/**
+ * Writes the 'file' relative to 'dfd' (see openat) with the 'content' of 'size'
+ * as specified by 'flags'.
+ *
+ * With RP_FILE_PUT_ATOMIC, the content is written in a temporary file
+ * of the same directory that is then renamed to 'file'. A crash never
+ * leaves a truncated 'file' but can leave a temporary file.
+ *
+ * With RP_FILE_PUT_SYNC, the data are synchronized to the storage
+ * (and also the directory when RP_FILE_PUT_ATOMIC is set).
+ *
+ * @param dfd the directory file descriptor number
+ * @param file filename to be written
+ * @param content the content to write
+ * @param size the length of the content
+ * @param flags a combination of RP_FILE_PUT_... flags
+ *
+ * @return 0 in case of success or else -errno
+ */
+extern int rp_file_put_flags_at(int dfd, const char *file, const void *content, size_t size, unsigned flags);
+
+/**
+ * Writes the 'file' with the 'content' of 'size' as specified by 'flags'.
+ *
+ * alias for rp_file_put_flags_at(AT_FDCWD, file, content, size, flags)
+ *
+ * @param file filename to be written
+ * @param content the content to write
+ * @param size the length of the content
+ * @param flags a combination of RP_FILE_PUT_... flags
+ *
+ * @return 0 in case of success or else -errno
+ */
+extern int rp_file_put_flags(const char *file, const void *content, size_t size, unsigned flags);
+
+/**
+ * Batch of files atomically written in one directory
+ */
+typedef struct rp_file_batch_s rp_file_batch_t;
+
+/**
+ * Creates a batch for writing files in the directory 'dir' relative
+ * to 'dfd' (see openat). When 'dir' is NULL, the directory is 'dfd'.
+ *
+ * Files put in the batch are written in temporary files that are
+ * renamed to their final name by rp_file_batch_commit.
+ * With RP_FILE_PUT_SYNC, the commit synchronizes the data of all
+ * files and then the directory only once.
+ *
+ * @param batch where to store the created batch
+ * @param dfd the directory file descriptor number
+ * @param dir the directory of the files or NULL
+ * @param flags a combination of RP_FILE_PUT_... flags
+ *
+ * @return 0 in case of success or else -errno
+ */
+extern int rp_file_batch_create(rp_file_batch_t **batch, int dfd, const char *dir, unsigned flags);
+
+/**
+ * Writes in the 'batch' the 'file' with the 'content' of 'size'.
+ * The file is visible only after rp_file_batch_commit.
+ *
+ * @param batch the batch
+ * @param file filename to be written, in the directory of the batch
+ * @param content the content to write
+ * @param size the length of the content
+ *
+ * @return 0 in case of success or else -errno
+ */
+extern int rp_file_batch_put(rp_file_batch_t *batch, const char *file, const void *content, size_t size);
+
+/**
+ * Commits the files put in the 'batch' and empties it.
+ * On error, the files not yet renamed are discarded.
+ *
+ * @param batch the batch
+ *
+ * @return 0 in case of success or else -errno
+ */
+extern int rp_file_batch_commit(rp_file_batch_t *batch);
+
+/**
+ * Destroys the 'batch', discarding the files not committed.
+ *
+ * @param batch the batch
+ */
+extern void rp_file_batch_destroy(rp_file_batch_t *batch);
+
+/**
+ * Flags for rp_file_map_at and rp_file_map
+ */
+/** prefault the pages of the file at mapping time */
+#define RP_FILE_MAP_POPULATE    1
+/** hint that the content will be read sequentially */
+#define RP_FILE_MAP_SEQUENTIAL  2
+/** hint that the content will be read randomly */
+#define RP_FILE_MAP_RANDOM      4
+/** hint that the content will be read soon */
+#define RP_FILE_MAP_WILLNEED    8
+
+/**
+ * Read only memory mapping of a file
+ */
+typedef struct {
+	/** the content of the file, not null terminated */
+	const char *data;
+	/** the size of the content */
+	size_t size;
+} rp_file_map_t;
+
+/**
+ * Maps the 'file' relative to 'dfd' (see openat) read only in memory.
+ * Unlike rp_file_get_at, the content is not copied and it is not
+ * terminated by a null. The mapping must be released using
+ * rp_file_map_release.
+ *
+ * The file should not be modified in place while mapped: accessing
+ * a part of the mapping that was truncated raises SIGBUS.
+ *
+ * @param dfd the directory file descriptor number
+ * @param file filename to be mapped (absolute or relative to dfd)
+ * @param map where to store the mapping
+ * @param flags a combination of RP_FILE_MAP_... flags
+ *
+ * @return 0 in case of success or else -errno
+ */
+extern int rp_file_map_at(int dfd, const char *file, rp_file_map_t *map, unsigned flags);
+
+/**
+ * Maps the 'file' read only in memory.
+ *
+ * alias for rp_file_map_at(AT_FDCWD, file, map, flags)
+ *
+ * @param file filename to be mapped
+ * @param map where to store the mapping
+ * @param flags a combination of RP_FILE_MAP_... flags
+ *
+ * @return 0 in case of success or else -errno
+ */
+extern int rp_file_map(const char *file, rp_file_map_t *map, unsigned flags);
+
+/**
+ * Releases the 'map' got using rp_file_map_at or rp_file_map.
+ *
+ * @param map the mapping to release
+ */
+extern void rp_file_map_release(rp_file_map_t *map);
+
+/**
+ * Callback receiving the blocks read by rp_file_read_blocks_at.
+ *
+ * @param closure the closure given to rp_file_read_blocks_at
+ * @param data the data of the block
+ * @param size the size of the block
+ *
+ * @return 0 for continuing the reading or else a value that stops
+ * the reading and is returned by rp_file_read_blocks_at
+ */
+typedef int (*rp_file_block_cb_t)(void *closure, const char *data, size_t size);
+
+/**
+ * Reads the 'file' relative to 'dfd' (see openat) by blocks of at
+ * most 'blocksize' bytes, and calls the 'callback' for each block.
+ * Only one buffer of 'blocksize' is allocated, whatever the size
+ * of the file is.
+ *
+ * @param dfd the directory file descriptor number
+ * @param file filename to be read (absolute or relative to dfd)
+ * @param blocksize size of the blocks or 0 for a default size
+ * @param callback the function receiving the blocks
+ * @param closure the closure of the callback
+ *
+ * @return 0 in case of success, the non zero value returned
+ * by the callback or else -errno
+ */
+extern int rp_file_read_blocks_at(int dfd, const char *file, size_t blocksize, rp_file_block_cb_t callback, void *closure);
+
+/**
+ * Reads the 'file' by blocks of at most 'blocksize' bytes,
+ * and calls the 'callback' for each block.
+ *
+ * alias for rp_file_read_blocks_at(AT_FDCWD, file, blocksize, callback, closure)
+ *
+ * @param file filename to be read
+ * @param blocksize size of the blocks or 0 for a default size
+ * @param callback the function receiving the blocks
+ * @param closure the closure of the callback
+ *
+ * @return 0 in case of success, the non zero value returned
+ * by the callback or else -errno
+ */
+extern int rp_file_read_blocks(const char *file, size_t blocksize, rp_file_block_cb_t callback, void *closure);
+
 #ifdef	__cplusplus
 }
 #endif
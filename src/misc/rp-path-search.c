@@ -27,6 +27,7 @@
 
 #include "rp-path-search.h"
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
@@ -317,6 +318,10 @@ int rp_path_search_filter(rp_path_search_t *paths, int flags,
 int rp_path_search(rp_path_search_t *paths, int flags,
 		rp_path_search_item_cb callback, void *closure)
 	__attribute__((alias("zero")));
+int rp_path_search_filter_mt(rp_path_search_t *paths, int flags,
+		rp_path_search_item_cb callback, void *closure, rp_path_search_filter_cb filter, void *filter_closure,
+		int nthreads)
+	__attribute__((alias("zero")));
 int rp_path_search_get_path(rp_path_search_t *paths, char **path,
 		int rec, const char *name, const char *extension)
 	__attribute__((alias("zero")));
@@ -324,23 +329,135 @@ int rp_path_search_get_content(rp_path_search_t *paths, char **content,
 		int rec, const char *name, const char *extension)
 	__attribute__((alias("zero")));
 
+static int enotsup() { return X_ENOTSUP; }
+static void nothing() {}
+int rp_path_search_index_create(rp_path_search_index_t **index, rp_path_search_t *paths, int flags, int check)
+{
+	(void)paths;
+	(void)flags;
+	(void)check;
+	*index = NULL;
+	return X_ENOTSUP;
+}
+void rp_path_search_index_destroy(rp_path_search_index_t *index)
+	__attribute__((alias("nothing")));
+int rp_path_search_index_refresh(rp_path_search_index_t *index, int force)
+	__attribute__((alias("enotsup")));
+int rp_path_search_index_get_path(rp_path_search_index_t *index, const char **path, const char *name, const char *extension)
+	__attribute__((alias("enotsup")));
+int rp_path_search_index_match(rp_path_search_index_t *index, const char *name, const char *extension, rp_path_search_item_cb callback, void *closure)
+	__attribute__((alias("enotsup")));
+
 #else
 
 #include <dirent.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/stat.h>
 
+#include "rp-strmap.h"
+
+#if !defined(WITH_INOTIFY)
+#  if defined(__linux__)
+#    define WITH_INOTIFY 1
+#  else
+#    define WITH_INOTIFY 0
+#  endif
+#endif
+#if WITH_INOTIFY
+#  include <sys/inotify.h>
+#endif
+
+#if !defined(WITH_GETDENTS64)
+#  if defined(__linux__)
+#    define WITH_GETDENTS64 1
+#  else
+#    define WITH_GETDENTS64 0
+#  endif
+#endif
+#if WITH_GETDENTS64
+#  include <sys/syscall.h>
+#endif
+
+/**
+ * directory entry, layout of the records of getdents64
+ */
+struct dent {
+	/** inode number */
+	uint64_t ino;
+	/** offset of next record */
+	int64_t off;
+	/** length of this record */
+	unsigned short reclen;
+	/** type of the entry (DT_xxx) */
+	unsigned char type;
+	/** name of the entry */
+	char name[];
+};
+
+/**
+ * listing of a directory
+ */
+struct listing {
+	/** file descriptor of the directory */
+	int fd;
+	/** records of the entries, NULL when not read */
+	char *data;
+	/** length of the records */
+	size_t length;
+};
+
 /**
  * back link to detect loops
  */
 struct direntlist {
-	/** the directory entry */
-	struct dirent *ent;
+	/** inode of the directory entry */
+	uint64_t ino;
 	/** the previous entry in the list */
 	struct direntlist *previous;
 };
 
+/**
+ * read ahead of the listing of a subdirectory by a worker thread
+ */
+struct prefetch {
+	/** next in the queue of the workers */
+	struct prefetch *next;
+	/** name of the subdirectory */
+	const char *name;
+	/** file descriptor of the parent directory */
+	int parentfd;
+	/** state of the read ahead */
+	enum { prefetch_queued, prefetch_running, prefetch_done, prefetch_taken } state;
+	/** the read listing */
+	struct listing listing;
+};
+
+/**
+ * pool of threads reading listings ahead
+ */
+struct pool {
+	/** mutual exclusion of the pool */
+	pthread_mutex_t mutex;
+	/** signaling new jobs or end of jobs */
+	pthread_cond_t cond;
+	/** head of the queue */
+	struct prefetch *head;
+	/** tail of the queue */
+	struct prefetch **tail;
+	/** count of read ahead per directory */
+	int window;
+	/** stop indicator */
+	int stop;
+	/** count of threads */
+	int count;
+	/** the threads */
+	pthread_t tids[];
+};
+
 /**
  * search data
  */
@@ -363,6 +480,9 @@ struct search {
 	/** Closure of the filter */
 	void *filter_closure;
 
+	/** Pool of threads if any */
+	struct pool *pool;
+
 	/** Item passed to the callback */
 	rp_path_search_entry_t entry;
 
@@ -370,20 +490,272 @@ struct search {
 	char path[PATH_MAX];
 };
 
+/* minimal free space in listing buffers */
+#define LISTING_ROOM     4096
+/* initial size of listing buffers */
+#define LISTING_INITIAL  32768
+
+/**
+ * read all the entries of the directory of the listing
+ *
+ * @param listing the listing whose fd is set
+ *
+ * @return 0 on success or a negative error code
+ */
+static int listing_read(struct listing *listing)
+{
+	size_t capa = 0;
+	char *data;
+#if WITH_GETDENTS64
+	long rc;
+#else
+	DIR *dir;
+	struct dirent *ent;
+	struct dent *dent;
+	size_t len;
+	int fd;
+#endif
+
+	listing->data = NULL;
+	listing->length = 0;
+#if WITH_GETDENTS64
+	for (;;) {
+		if (capa - listing->length < LISTING_ROOM) {
+			capa = capa ? capa << 1 : LISTING_INITIAL;
+			data = realloc(listing->data, capa);
+			if (data == NULL)
+				break;
+			listing->data = data;
+		}
+		rc = syscall(SYS_getdents64, listing->fd, &listing->data[listing->length], capa - listing->length);
+		if (rc <= 0) {
+			if (rc == 0)
+				return 0;
+			break;
+		}
+		listing->length += (size_t)rc;
+	}
+#else
+	fd = dup(listing->fd);
+	dir = fd < 0 ? NULL : fdopendir(fd);
+	if (dir == NULL) {
+		if (fd >= 0)
+			close(fd);
+	}
+	else {
+		while ((ent = readdir(dir)) != NULL) {
+			len = (offsetof(struct dent, name) + strlen(ent->d_name) + 8) & ~(size_t)7;
+			if (capa - listing->length < len) {
+				capa = capa ? capa << 1 : LISTING_INITIAL;
+				data = realloc(listing->data, capa);
+				if (data == NULL)
+					break;
+				listing->data = data;
+			}
+			dent = (struct dent*)&listing->data[listing->length];
+			dent->ino = (uint64_t)ent->d_ino;
+			dent->off = 0;
+			dent->reclen = (unsigned short)len;
+			dent->type = ent->d_type;
+			strcpy(dent->name, ent->d_name);
+			listing->length += len;
+		}
+		closedir(dir);
+		if (ent == NULL)
+			return 0;
+	}
+#endif
+	free(listing->data);
+	listing->data = NULL;
+	listing->length = 0;
+	return X_ENOMEM;
+}
+
+/**
+ * open and read the directory of name relative to parentfd
+ *
+ * @return 0 on success or a negative error code
+ */
+static int listing_open(struct listing *listing, int parentfd, const char *name)
+{
+	listing->fd = openat(parentfd, name, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	listing->data = NULL;
+	listing->length = 0;
+	return listing->fd < 0 ? X_ENOENT : 0;
+}
+
+/**
+ * release the listing
+ */
+static void listing_release(struct listing *listing)
+{
+	if (listing->fd >= 0)
+		close(listing->fd);
+	free(listing->data);
+}
+
+/**
+ * read the listing of the prefetch
+ */
+static void prefetch_run(struct prefetch *prefetch)
+{
+	if (listing_open(&prefetch->listing, prefetch->parentfd, prefetch->name) == 0)
+		listing_read(&prefetch->listing);
+}
+
+/**
+ * routine of the threads of the pool
+ */
+static void *pool_work(void *arg)
+{
+	struct pool *pool = arg;
+	struct prefetch *prefetch;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (!pool->stop) {
+		prefetch = pool->head;
+		if (prefetch == NULL)
+			pthread_cond_wait(&pool->cond, &pool->mutex);
+		else {
+			pool->head = prefetch->next;
+			if (pool->head == NULL)
+				pool->tail = &pool->head;
+			prefetch->state = prefetch_running;
+			pthread_mutex_unlock(&pool->mutex);
+			prefetch_run(prefetch);
+			pthread_mutex_lock(&pool->mutex);
+			prefetch->state = prefetch_done;
+			pthread_cond_broadcast(&pool->cond);
+		}
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+/**
+ * start a pool of nthreads threads, the current one being counted
+ *
+ * @return the pool or NULL if not possible
+ */
+static struct pool *pool_start(int nthreads)
+{
+	struct pool *pool;
+
+	if (nthreads <= 0)
+		nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 1)
+		return NULL;
+	pool = malloc(sizeof *pool + (size_t)(nthreads - 1) * sizeof *pool->tids);
+	if (pool == NULL)
+		return NULL;
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	pool->head = NULL;
+	pool->tail = &pool->head;
+	pool->window = 2 * nthreads;
+	pool->stop = 0;
+	for (pool->count = 0 ; pool->count < nthreads - 1 ; pool->count++)
+		if (pthread_create(&pool->tids[pool->count], NULL, pool_work, pool) != 0)
+			break;
+	return pool;
+}
+
+/**
+ * stop the pool and release its memory
+ */
+static void pool_stop(struct pool *pool)
+{
+	int idx;
+
+	if (pool != NULL) {
+		pthread_mutex_lock(&pool->mutex);
+		pool->stop = 1;
+		pthread_cond_broadcast(&pool->cond);
+		pthread_mutex_unlock(&pool->mutex);
+		for (idx = 0 ; idx < pool->count ; idx++)
+			pthread_join(pool->tids[idx], NULL);
+		pthread_cond_destroy(&pool->cond);
+		pthread_mutex_destroy(&pool->mutex);
+		free(pool);
+	}
+}
+
+/**
+ * queue the prefetch for the threads
+ */
+static void pool_queue(struct pool *pool, struct prefetch *prefetch)
+{
+	pthread_mutex_lock(&pool->mutex);
+	prefetch->next = NULL;
+	prefetch->state = prefetch_queued;
+	*pool->tail = prefetch;
+	pool->tail = &prefetch->next;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * get the result of the prefetch, running it if not already started
+ * and if @p want isn't zero
+ *
+ * @return 1 if the listing is available or 0 otherwise
+ */
+static int pool_take(struct pool *pool, struct prefetch *prefetch, int want)
+{
+	struct prefetch **prv;
+
+	pthread_mutex_lock(&pool->mutex);
+	if (prefetch->state == prefetch_queued) {
+		/* not started, remove it from the queue */
+		for (prv = &pool->head ; *prv != prefetch ; prv = &(*prv)->next);
+		*prv = prefetch->next;
+		if (*prv == NULL)
+			pool->tail = prv;
+		prefetch->state = prefetch_taken;
+		pthread_mutex_unlock(&pool->mutex);
+		if (want)
+			prefetch_run(prefetch);
+		return want;
+	}
+	while (prefetch->state == prefetch_running)
+		pthread_cond_wait(&pool->cond, &pool->mutex);
+	prefetch->state = prefetch_taken;
+	pthread_mutex_unlock(&pool->mutex);
+	if (!want)
+		listing_release(&prefetch->listing);
+	return want;
+}
+
+/**
+ * is the entry a directory to scan?
+ */
+static inline int is_subdir(const struct dent *dent)
+{
+	return dent->type == DT_DIR
+		&& (dent->name[0] != '.'
+		    || (dent->name[1] != 0 && (dent->name[1] != '.' || dent->name[2] != 0)));
+}
+
 /**
  * recursive search
  *
  * @param search the search structure
+ * @param listing listing of the directory, its fd being opened
+ * @param previous chain of parent directories
+ * @param flags the flags for the directory
  */
-static int search_in_dir(struct search *search, DIR *dir, struct direntlist *previous, int flags)
+static int search_in_dir(struct search *search, struct listing *listing, struct direntlist *previous, int flags)
 {
 	struct direntlist dl, *idl;
 	struct stat st;
+	struct dent *dent;
+	struct prefetch *prefetchs;
+	struct listing sublisting;
+	size_t off;
 	short pos, len;
 	short oplen, onlen;
-	int stop, type;
+	int stop, type, nsub, isub, nqueued;
 	char *name;
-	DIR *subdir;
 
 	/* manage recursive search */
 	if (flags >= RP_PATH_SEARCH_DEPTH_BASE) {
@@ -413,6 +785,35 @@ static int search_in_dir(struct search *search, DIR *dir, struct direntlist *pre
 		onlen = search->entry.namelen;
 		oplen = search->entry.pathlen;
 
+		/* read the entries if not already done */
+		if (listing->data == NULL)
+			listing_read(listing);
+
+		/* prepare read ahead of subdirectories */
+		nsub = isub = nqueued = 0;
+		prefetchs = NULL;
+		if (search->pool != NULL && (flags & RP_PATH_SEARCH_RECURSIVE)) {
+			for (off = 0 ; off < listing->length ; off += dent->reclen) {
+				dent = (struct dent*)&listing->data[off];
+				nsub += is_subdir(dent);
+			}
+			prefetchs = nsub ? malloc((size_t)nsub * sizeof *prefetchs) : NULL;
+			if (prefetchs == NULL)
+				nsub = 0;
+			for (off = 0 ; isub < nsub ; off += dent->reclen) {
+				dent = (struct dent*)&listing->data[off];
+				if (is_subdir(dent)) {
+					prefetchs[isub].name = dent->name;
+					prefetchs[isub].parentfd = listing->fd;
+					if (isub < search->pool->window)
+						pool_queue(search->pool, &prefetchs[isub]);
+					isub++;
+				}
+			}
+			nqueued = nsub < search->pool->window ? nsub : search->pool->window;
+			isub = 0;
+		}
+
 		/* prepare to name files in path */
 		dl.previous = previous;
 		pos = search->entry.pathlen;
@@ -421,24 +822,39 @@ static int search_in_dir(struct search *search, DIR *dir, struct direntlist *pre
 		name = &search->path[pos];
 
 		/* loop on each entry */
-		while (!stop && (dl.ent = readdir(dir))) {
+		for (off = 0 ; !stop && off < listing->length ; off += dent->reclen) {
+			dent = (struct dent*)&listing->data[off];
+			dl.ino = dent->ino;
+			type = dent->type;
+
+			/* get the read ahead listing of subdirectories */
+			sublisting.fd = -1;
+			if (isub < nsub && is_subdir(dent)) {
+				if (nqueued < nsub)
+					pool_queue(search->pool, &prefetchs[nqueued++]);
+				for (idl = previous ; idl != NULL && idl->ino != dent->ino ; idl = idl->previous);
+				if (pool_take(search->pool, &prefetchs[isub], idl == NULL))
+					sublisting = prefetchs[isub].listing;
+				isub++;
+			}
 
 			/* detection of loops */
-			for (idl = previous ; idl != NULL && idl->ent->d_ino != dl.ent->d_ino ; idl = idl->previous);
+			for (idl = previous ; idl != NULL && idl->ino != dl.ino ; idl = idl->previous);
 			if (idl)
 				continue;
 
 			/* copy name if no overflow */
-			len = (short)strlen(dl.ent->d_name);
+			len = (short)strlen(dent->name);
 			if (len + pos >= (int)sizeof(search->path)) {
 				/* overflow detected */
+				if (sublisting.fd >= 0)
+					listing_release(&sublisting);
 				continue;
 			}
-			memcpy(name, dl.ent->d_name, 1 + (size_t)len);
+			memcpy(name, dent->name, 1 + (size_t)len);
 
-			/* get type after dereferencing if link */
-			type = dl.ent->d_type;
-			if (type == DT_LNK && stat(search->path, &st) == 0) {
+			/* get type after dereferencing if link or unknown */
+			if ((type == DT_LNK || type == DT_UNKNOWN) && fstatat(listing->fd, dent->name, &st, 0) == 0) {
 				switch (st.st_mode & S_IFMT) {
 				case S_IFREG:
 					type = DT_REG;
@@ -468,13 +884,17 @@ static int search_in_dir(struct search *search, DIR *dir, struct direntlist *pre
 				}
 			}
 			else if (type == DT_DIR && (name[0] != '.' || (len > 1 && (name[1] != '.' || len > 2)))) {
-				subdir = opendir(search->path);
-				if (subdir != NULL)
-					stop = search_in_dir(search, subdir, &dl, flags);
+				if (sublisting.fd >= 0 || listing_open(&sublisting, listing->fd, dent->name) == 0)
+					stop = search_in_dir(search, &sublisting, &dl, flags);
 			}
 		}
 		search->entry.namelen = onlen;
 		search->entry.pathlen = oplen;
+
+		/* cancel pending read ahead */
+		while (isub < nqueued)
+			pool_take(search->pool, &prefetchs[isub++], 0);
+		free(prefetchs);
 	}
 
 	search->entry.action = rp_path_search_directory_after;
@@ -485,7 +905,7 @@ static int search_in_dir(struct search *search, DIR *dir, struct direntlist *pre
 		stop = search->callback(search->callback_closure, &search->entry);
 	}
 
-	closedir(dir);
+	listing_release(listing);
 	return stop;
 }
 
@@ -493,8 +913,9 @@ static int searchcb(void *closure, const char *path, size_t length)
 {
 	struct search *search = closure;
 	int stop;
-	DIR *dir;
+	struct listing listing;
 	struct stat st;
+	const char *name;
 
 	search->entry.pathlen = (short)length;
 	memcpy(search->path, path, 1 + length);
@@ -502,16 +923,22 @@ static int searchcb(void *closure, const char *path, size_t length)
 
 	/* init and open directory */
 	stop = 0;
-	dir = opendir(search->path);
-	if (dir)
-		stop = search_in_dir(search, dir, NULL, search->flags);
+	listing.fd = open(search->path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	listing.data = NULL;
+	listing.length = 0;
+	if (listing.fd >= 0)
+		stop = search_in_dir(search, &listing, NULL, search->flags);
 	else if ((search->flags & (RP_PATH_SEARCH_FLEXIBLE|RP_PATH_SEARCH_FILE)) == (RP_PATH_SEARCH_FLEXIBLE|RP_PATH_SEARCH_FILE)
 	      && stat(search->path, &st) == 0
 	      && (st.st_mode & S_IFMT) == S_IFREG) {
 		/* flexible and regular file, use the callback */
+		name = strrchr(search->path, DIRECTORY_SEPARATOR_CHARACTER);
+		search->entry.name = name == NULL ? search->path : name + 1;
+		search->entry.namelen = (short)(length - (size_t)(search->entry.name - search->path));
 		search->entry.isDir = 0;
 		search->entry.action = rp_path_search_file;
-		stop = search->callback(search->callback_closure, &search->entry);
+		if (!search->filter || search->filter(search->filter_closure, &search->entry))
+			stop = search->callback(search->callback_closure, &search->entry);
 	}
 
 	return stop;
@@ -522,14 +949,16 @@ int rp_path_search_can_list_entries()
 	return 1;
 }
 
-int rp_path_search_filter(
+int rp_path_search_filter_mt(
 	rp_path_search_t *paths,
 	int flags,
 	rp_path_search_item_cb callback,
 	void *callback_closure,
 	rp_path_search_filter_cb filter,
-	void *filter_closure
+	void *filter_closure,
+	int nthreads
 ) {
+	int rc;
 	struct search search = {
 		.paths = paths,
 		.flags = flags & (RP_PATH_SEARCH_FILE|RP_PATH_SEARCH_DIRECTORY) ? flags : flags|RP_PATH_SEARCH_FILE,
@@ -537,11 +966,27 @@ int rp_path_search_filter(
 		.callback_closure = callback_closure,
 		.filter = filter,
 		.filter_closure = filter_closure,
+		.pool = NULL,
 		.entry.pathlen = 0,
 		.entry.path = search.path
 	};
 
-	return rp_path_search_list(paths, searchcb, &search);
+	if (nthreads != 1 && (flags & RP_PATH_SEARCH_RECURSIVE))
+		search.pool = pool_start(nthreads);
+	rc = rp_path_search_list(paths, searchcb, &search);
+	pool_stop(search.pool);
+	return rc;
+}
+
+int rp_path_search_filter(
+	rp_path_search_t *paths,
+	int flags,
+	rp_path_search_item_cb callback,
+	void *callback_closure,
+	rp_path_search_filter_cb filter,
+	void *filter_closure
+) {
+	return rp_path_search_filter_mt(paths, flags, callback, callback_closure, filter, filter_closure, 1);
 }
 
 int rp_path_search(rp_path_search_t *paths, int flags, rp_path_search_item_cb callback, void *closure)
@@ -591,4 +1036,452 @@ int rp_path_search_match(rp_path_search_t *paths, int flags, const char *name, c
 	return rp_path_search_filter(paths, flags, callback, closure, matchnamecb, &mn);
 }
 
+/**
+ * file recorded in an index
+ */
+struct indexed_file {
+	/** offset of the path in the pool */
+	size_t path;
+	/** length of the path */
+	short pathlen;
+	/** length of the name */
+	short namelen;
+	/** index of the next file of same name or -1 */
+	int next;
+};
+
+/**
+ * Delay in seconds after the modification of a directory during which
+ * its modification time can't be trusted: a change within the same
+ * timestamp granularity would not be detected
+ */
+#define RACY_DELAY	2
+
+/**
+ * directory recorded in an index for checking its validity
+ */
+struct indexed_dir {
+	/** offset of the path in the pool */
+	size_t path;
+	/** does the directory exist? */
+	int exists;
+	/** device and inode */
+	dev_t dev;
+	ino_t ino;
+	/** modification time */
+	struct timespec mtime;
+	/** is it watched? */
+	int watched;
+};
+
+/**
+ * content of an index
+ */
+struct index_content {
+	/** pool of paths */
+	char *pool;
+	size_t poolsize;
+	size_t poolcapa;
+	/** indexed files in search order */
+	struct indexed_file *files;
+	int nfiles;
+	int capafiles;
+	/** recorded directories */
+	struct indexed_dir *dirs;
+	int ndirs;
+	int capadirs;
+	/** map of names to 1 + index of the first file of that name */
+	rp_strmap_t *map;
+	/** inotify file descriptor or -1 */
+	int notifyfd;
+	/** time of the build */
+	time_t built;
+	/** status of the build */
+	int rc;
+};
+
+/**
+ * index of a path's list
+ */
+struct rp_path_search_index {
+	/** the indexed path's list */
+	rp_path_search_t *paths;
+	/** flags of search */
+	int flags;
+	/** mode of check */
+	int check;
+	/** the content */
+	struct index_content content;
+};
+
+/* add a path to the pool, returns its offset or -1 */
+static size_t index_add_path(struct index_content *content, const char *path, size_t length)
+{
+	size_t capa, offset;
+	char *pool;
+
+	if (content->poolsize + length + 1 > content->poolcapa) {
+		capa = content->poolcapa ? content->poolcapa : 4096;
+		while (capa < content->poolsize + length + 1)
+			capa <<= 1;
+		pool = realloc(content->pool, capa);
+		if (pool == NULL) {
+			content->rc = X_ENOMEM;
+			return (size_t)-1;
+		}
+		content->pool = pool;
+		content->poolcapa = capa;
+	}
+	offset = content->poolsize;
+	memcpy(&content->pool[offset], path, length);
+	content->pool[offset + length] = 0;
+	content->poolsize = offset + length + 1;
+	return offset;
+}
+
+/* record a directory */
+static int index_add_dir(struct index_content *content, const char *path, size_t length)
+{
+	struct indexed_dir *dirs;
+	struct stat st;
+	size_t offset;
+	int capa;
+
+	if (content->ndirs == content->capadirs) {
+		capa = content->capadirs ? 2 * content->capadirs : 16;
+		dirs = realloc(content->dirs, (size_t)capa * sizeof *dirs);
+		if (dirs == NULL) {
+			content->rc = X_ENOMEM;
+			return X_ENOMEM;
+		}
+		content->dirs = dirs;
+		content->capadirs = capa;
+	}
+	offset = index_add_path(content, path, length);
+	if (offset == (size_t)-1)
+		return X_ENOMEM;
+	dirs = &content->dirs[content->ndirs++];
+	dirs->path = offset;
+	dirs->watched = 0;
+#if WITH_INOTIFY
+	/* watch before the entries are read, so no change is missed */
+	if (content->notifyfd >= 0) {
+		if (inotify_add_watch(content->notifyfd, path,
+				IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF
+				|IN_ONLYDIR) >= 0)
+			dirs->watched = 1;
+		else if (errno != ENOENT && errno != ENOTDIR) {
+			/* can't watch all, fallback to modification time */
+			close(content->notifyfd);
+			content->notifyfd = -1;
+		}
+	}
+#endif
+	dirs->exists = stat(path, &st) == 0;
+	dirs->dev = dirs->exists ? st.st_dev : 0;
+	dirs->ino = dirs->exists ? st.st_ino : 0;
+	dirs->mtime.tv_sec = dirs->exists ? st.st_mtim.tv_sec : 0;
+	dirs->mtime.tv_nsec = dirs->exists ? st.st_mtim.tv_nsec : 0;
+	return 0;
+}
+
+/* record the items of the path's list that aren't directories */
+static int index_root_cb(void *closure, const char *path, size_t length)
+{
+	struct stat st;
+
+	if (stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+		return 0;
+	return index_add_dir(closure, path, length);
+}
+
+/* record the directories of the search */
+static int index_filter_cb(void *closure, const rp_path_search_entry_t *entry)
+{
+	switch (entry->action) {
+	case rp_path_search_directory_before:
+		index_add_dir(closure, entry->path, (size_t)entry->pathlen);
+		return 0;
+	case rp_path_search_directory_after:
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+/* record the files of the search */
+static int index_file_cb(void *closure, const rp_path_search_entry_t *entry)
+{
+	struct index_content *content = closure;
+	struct indexed_file *files;
+	size_t offset;
+	int capa;
+
+	if (content->nfiles == content->capafiles) {
+		capa = content->capafiles ? 2 * content->capafiles : 64;
+		files = realloc(content->files, (size_t)capa * sizeof *files);
+		if (files == NULL) {
+			content->rc = X_ENOMEM;
+			return 1;
+		}
+		content->files = files;
+		content->capafiles = capa;
+	}
+	offset = index_add_path(content, entry->path, (size_t)entry->pathlen);
+	if (offset == (size_t)-1)
+		return 1;
+	files = &content->files[content->nfiles++];
+	files->path = offset;
+	files->pathlen = entry->pathlen;
+	files->namelen = entry->namelen;
+	files->next = -1;
+	return 0;
+}
+
+/* release the content */
+static void index_content_release(struct index_content *content)
+{
+	rp_strmap_destroy(content->map);
+	free(content->pool);
+	free(content->files);
+	free(content->dirs);
+#if WITH_INOTIFY
+	if (content->notifyfd >= 0)
+		close(content->notifyfd);
+#endif
+}
+
+/* build the content of the index */
+static int index_build(rp_path_search_index_t *index, struct index_content *content)
+{
+	struct indexed_file *file;
+	void *value;
+	int idx, rc;
+
+	memset(content, 0, sizeof *content);
+	content->notifyfd = -1;
+	content->built = time(NULL);
+#if WITH_INOTIFY
+	if (index->check == RP_PATH_SEARCH_INDEX_NOTIFY)
+		content->notifyfd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+#endif
+
+	/* enumerate */
+	rp_path_search_list(index->paths, index_root_cb, content);
+	if (content->rc == 0)
+		rp_path_search_filter(index->paths,
+			(index->flags & ~RP_PATH_SEARCH_DIRECTORY) | RP_PATH_SEARCH_FILE | RP_PATH_SEARCH_DIRECTORY,
+			index_file_cb, content, index_filter_cb, content);
+
+	/* map the names, last to first for chaining files of same name */
+	rc = content->rc;
+	if (rc == 0)
+		rc = rp_strmap_create(&content->map, (unsigned)content->nfiles, 0);
+	for (idx = content->nfiles ; rc == 0 && idx ; ) {
+		file = &content->files[--idx];
+		if (rp_strmap_get(content->map,
+				&content->pool[file->path + (size_t)(file->pathlen - file->namelen)],
+				&value) == 0)
+			file->next = (int)(intptr_t)value - 1;
+		rc = rp_strmap_set(content->map,
+				&content->pool[file->path + (size_t)(file->pathlen - file->namelen)],
+				(void*)(intptr_t)(idx + 1));
+	}
+	if (rc < 0)
+		index_content_release(content);
+	return rc;
+}
+
+/* check if the index is still valid */
+static int index_is_valid(struct index_content *content)
+{
+	struct indexed_dir *dir;
+	struct stat st;
+	char buffer[4096];
+	int idx, exists, valid;
+
+	valid = 1;
+#if WITH_INOTIFY
+	if (content->notifyfd >= 0) {
+		while (read(content->notifyfd, buffer, sizeof buffer) > 0)
+			valid = 0;
+		if (!valid)
+			return 0;
+	}
+#else
+	(void)buffer;
+#endif
+	for (idx = 0 ; valid && idx < content->ndirs ; idx++) {
+		dir = &content->dirs[idx];
+		if (content->notifyfd < 0 || !dir->watched) {
+			/* a directory modified too close to the build is rescanned */
+			exists = stat(&content->pool[dir->path], &st) == 0;
+			valid = exists == dir->exists
+				&& (!exists
+				   || (st.st_dev == dir->dev
+				    && st.st_ino == dir->ino
+				    && st.st_mtim.tv_sec == dir->mtime.tv_sec
+				    && st.st_mtim.tv_nsec == dir->mtime.tv_nsec
+				    && dir->mtime.tv_sec + RACY_DELAY <= content->built));
+		}
+	}
+	return valid;
+}
+
+/* create an index */
+int rp_path_search_index_create(rp_path_search_index_t **pindex, rp_path_search_t *paths, int flags, int check)
+{
+	rp_path_search_index_t *index;
+	int rc;
+
+	*pindex = index = malloc(sizeof *index);
+	if (index == NULL)
+		return X_ENOMEM;
+	index->paths = rp_path_search_addref(paths);
+	index->flags = flags;
+	index->check = check;
+	rc = index_build(index, &index->content);
+	if (rc < 0) {
+		rp_path_search_unref(index->paths);
+		free(index);
+		*pindex = NULL;
+	}
+	return rc;
+}
+
+/* destroy an index */
+void rp_path_search_index_destroy(rp_path_search_index_t *index)
+{
+	if (index != NULL) {
+		index_content_release(&index->content);
+		rp_path_search_unref(index->paths);
+		free(index);
+	}
+}
+
+/* refresh an index */
+int rp_path_search_index_refresh(rp_path_search_index_t *index, int force)
+{
+	struct index_content content;
+	int rc;
+
+	if (!force && index_is_valid(&index->content))
+		return 0;
+	rc = index_build(index, &content);
+	if (rc < 0)
+		return rc;
+	index_content_release(&index->content);
+	index->content = content;
+	return 1;
+}
+
+/* get the first file of name from the index or -1 */
+static int index_first(struct index_content *content, const char *name, size_t length)
+{
+	void *value;
+	return rp_strmap_get_len(content->map, name, length, &value) < 0 ? -1 : (int)(intptr_t)value - 1;
+}
+
+/* search the index */
+static int index_match(rp_path_search_index_t *index, const char *name, const char *extension, rp_path_search_item_cb callback, void *closure)
+{
+	struct index_content *content;
+	struct indexed_file *file;
+	rp_path_search_entry_t entry;
+	char key[NAME_MAX + 1];
+	size_t lname, lext;
+	int rc, idx, alt, swap;
+	struct matchname mn = {
+		extension == NULL ? 0 : strlen(extension),
+		extension,
+		name == NULL ? 0 : strlen(name),
+		name
+	};
+
+	/* check validity */
+	if (index->check != RP_PATH_SEARCH_INDEX_MANUAL) {
+		rc = rp_path_search_index_refresh(index, 0);
+		if (rc < 0)
+			return rc;
+	}
+	content = &index->content;
+
+	/* first candidates of names */
+	lname = mn.len_filename;
+	lext = mn.len_extension;
+	if (lname == 0) {
+		/* no name, scan all files */
+		idx = content->nfiles ? 0 : -1;
+		alt = -1;
+	}
+	else if (lname + lext + 1 > sizeof key)
+		return 0;
+	else {
+		/* files named name + extension or name + '.' + extension */
+		memcpy(key, name, lname);
+		alt = -1;
+		if (lext == 0)
+			idx = index_first(content, key, lname);
+		else {
+			memcpy(&key[lname], extension, lext);
+			idx = index_first(content, key, lname + lext);
+		}
+		if (lext && extension[0] != '.') {
+			key[lname] = '.';
+			memcpy(&key[lname + 1], extension, lext);
+			alt = index_first(content, key, lname + lext + 1);
+		}
+	}
+
+	/* enumerate in search order */
+	entry.isDir = 0;
+	entry.action = rp_path_search_file;
+	for (rc = 0 ; rc == 0 && (idx >= 0 || alt >= 0) ; ) {
+		if (idx < 0 || (alt >= 0 && alt < idx)) {
+			/* exchange for getting the first */
+			swap = idx;
+			idx = alt;
+			alt = swap;
+		}
+		file = &content->files[idx];
+		entry.path = &content->pool[file->path];
+		entry.pathlen = file->pathlen;
+		entry.name = &entry.path[file->pathlen - file->namelen];
+		entry.namelen = file->namelen;
+		if (lname == 0) {
+			idx = idx + 1 < content->nfiles ? idx + 1 : -1;
+			if (matchnamecb(&mn, &entry))
+				rc = callback(closure, &entry);
+		}
+		else {
+			idx = file->next;
+			rc = callback(closure, &entry);
+		}
+	}
+	return rc;
+}
+
+/* callback of rp_path_search_index_get_path */
+static int index_get_path_cb(void *closure, const rp_path_search_entry_t *entry)
+{
+	*(const char**)closure = entry->path;
+	return 1;
+}
+
+/* get path of first file */
+int rp_path_search_index_get_path(rp_path_search_index_t *index, const char **path, const char *name, const char *extension)
+{
+	int rc;
+
+	*path = NULL;
+	rc = index_match(index, name, extension, index_get_path_cb, path);
+	return rc < 0 ? rc : rc == 1 ? 0 : X_ENOENT;
+}
+
+/* enumerate matching files */
+int rp_path_search_index_match(rp_path_search_index_t *index, const char *name, const char *extension, rp_path_search_item_cb callback, void *closure)
+{
+	return index_match(index, name, extension, callback, closure);
+}
+
 #endif
@@ -305,6 +305,37 @@ int rp_path_search_filter(
 	void *filter_closure
 );
 
+/**
+* CAUTION only effective if rp_path_search_can_list_entries() returns non zero value.
+*
+* Same as rp_path_search_filter but when the search is recursive, the
+* directories are read ahead by at most @p nthreads threads.
+*
+* The filter and the callback are always called by the calling thread
+* and in the same order than rp_path_search_filter would do.
+*
+* @param paths     the path's list
+* @param flags     flags of search (see above)
+* @param callback  callback to call for each filtered in entry
+* @param callback_closure   the closure for the callback
+* @param filter    if not NULL a callback filtering calls to callback
+* @param filter_closure   the closure for the filter
+* @param nthreads  count of threads including the calling one,
+*                  the count of processors if zero or negative
+*
+* @return the last non zero value returned by a callback or zero
+*/
+extern
+int rp_path_search_filter_mt(
+	rp_path_search_t *paths,
+	int flags,
+	rp_path_search_item_cb callback,
+	void *callback_closure,
+	rp_path_search_filter_cb filter,
+	void *filter_closure,
+	int nthreads
+);
+
 /**
 */
 extern int rp_path_search(rp_path_search_t *paths, int flags, rp_path_search_item_cb callback, void *closure);
@@ -316,6 +347,101 @@ extern int rp_path_search(rp_path_search_t *paths, int flags, rp_path_search_ite
 */
 extern int rp_path_search_match(rp_path_search_t *paths, int flags, const char *name, const char *extension, rp_path_search_item_cb callback, void *closure);
 
+/**
+* structure for indexing the files of a path's list
+*/
+typedef struct rp_path_search_index rp_path_search_index_t;
+
+/**
+* The index is only refreshed on explicit calls to rp_path_search_index_refresh
+*/
+#define RP_PATH_SEARCH_INDEX_MANUAL   0
+/**
+* The index checks the modification time of its directories before use.
+* This costs a call to stat for each indexed directory at each search.
+* Because a change within the granularity of the modification time
+* could be missed, the index is rebuilt at each search while one of its
+* directories was modified less than 2 seconds before its build.
+*/
+#define RP_PATH_SEARCH_INDEX_MTIME    1
+/**
+* The index watches its directories using inotify when available
+* and checks the modification time otherwise
+*/
+#define RP_PATH_SEARCH_INDEX_NOTIFY   2
+
+/**
+* CAUTION only effective if rp_path_search_can_list_entries() returns non zero value.
+*
+* Creates an index of the files of the path's list. The files are
+* enumerated once, as rp_path_search would do with the given flags, and
+* their names are recorded in a hash table so that later searches don't
+* access the file system except for checking the validity of the index.
+*
+* The index is not thread safe.
+*
+* @param index  address receiving the created index
+* @param paths  the path's list to index
+* @param flags  flags of search (RP_PATH_SEARCH_FLEXIBLE, RP_PATH_SEARCH_RECURSIVE
+*               or RP_PATH_SEARCH_DEPTH(x)), directories are not indexed
+* @param check  how the validity is checked: RP_PATH_SEARCH_INDEX_MANUAL,
+*               RP_PATH_SEARCH_INDEX_MTIME or RP_PATH_SEARCH_INDEX_NOTIFY
+*
+* @return 0 in case of success and in that case, index receives the result
+*         or a negative number in case of error
+*/
+extern int rp_path_search_index_create(rp_path_search_index_t **index, rp_path_search_t *paths, int flags, int check);
+
+/**
+* Destroys the index
+*
+* @param index the index to destroy, can be NULL
+*/
+extern void rp_path_search_index_destroy(rp_path_search_index_t *index);
+
+/**
+* Refreshes the index if it is no more valid or if @p force is not zero
+*
+* @param index the index to refresh
+* @param force if not zero, refresh even if the index seems valid
+*
+* @return 1 if the index was rebuilt, 0 if it was valid
+*         or a negative number in case of error
+*/
+extern int rp_path_search_index_refresh(rp_path_search_index_t *index, int force);
+
+/**
+* Get the path of the first file matching the name and/or the extension,
+* as rp_path_search_match would find it.
+*
+* The returned path remains valid until the next call using the index,
+* because searches can refresh it, or until its destruction.
+*
+* @param index     the index
+* @param path      address receiving the found path
+* @param name      the name to match or NULL
+* @param extension the extension to match or NULL
+*
+* @return 0 in case of success, -ENOENT if not found
+*         or a negative number in case of error
+*/
+extern int rp_path_search_index_get_path(rp_path_search_index_t *index, const char **path, const char *name, const char *extension);
+
+/**
+* Enumerate the files matching the name and/or the extension
+* in the order of the path's list, as rp_path_search_match does
+*
+* @param index     the index
+* @param name      the name to match or NULL
+* @param extension the extension to match or NULL
+* @param callback  callback to call for each matching file
+* @param closure   the closure for the callback
+*
+* @return the last non zero value returned by the callback or zero
+*         or a negative number in case of error
+*/
+extern int rp_path_search_index_match(rp_path_search_index_t *index, const char *name, const char *extension, rp_path_search_item_cb callback, void *closure);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -24,6 +24,8 @@
 
 #include "rp-pearson.h"
 
+#include <string.h>
+
 static uint8_t TP4[16] = {
 	4,  6,  1,  10,  9, 14, 11,  5,
 	3,  2, 12, 15, 0,  7,  8, 13
@@ -69,3 +71,146 @@ uint8_t rp_pearson8_len(const char *text, size_t length)
 	}
 	return ((ru << 4) | rl) ^ ((uint8_t)length);
 }
+
+/*
+ * Wider hashes of the pearson family
+ *
+ * The text is read by words of 8 bytes (little endian order). Each
+ * word is mixed in the state by a multiplication, then the upper byte
+ * of the state, the best mixed, selects in the substitution table TP64
+ * a value that is mixed back to all the bits of the state. The final
+ * state is avalanched by the finalizer of murmur3.
+ */
+
+static const uint64_t TP64[256] = {
+	UINT64_C(0x9d05b5a9aa174b0d), UINT64_C(0x1fe56e487ce03f33), UINT64_C(0x1de0e4e4c1ca2369), UINT64_C(0x9a6cba6a877a872d),
+	UINT64_C(0xc900df341b3da611), UINT64_C(0x16ae6d5562cd0a54), UINT64_C(0x130d28cbb866395f), UINT64_C(0xd75e0273ec582b13),
+	UINT64_C(0xee3ab29abf6f354b), UINT64_C(0xcd5387dc638016a2), UINT64_C(0x427af39b3da5b56a), UINT64_C(0xa2df041b26e78168),
+	UINT64_C(0x89e63e6b9b0f2179), UINT64_C(0xe29001947e69d583), UINT64_C(0x81b096cae3f6df97), UINT64_C(0xd9061ea2e0469bb0),
+	UINT64_C(0x787f8b3cc634019d), UINT64_C(0xebba383ee6ba2799), UINT64_C(0x6ded3bc0c84ab8eb), UINT64_C(0x4bf7741c5eda33b4),
+	UINT64_C(0xba5028f991fc4f29), UINT64_C(0x8befa3a4e0cfe8ce), UINT64_C(0x50a3051b7e7d0c1e), UINT64_C(0xaa5eef0338e0d830),
+	UINT64_C(0x5657609956fcd951), UINT64_C(0x4f6500aed1980973), UINT64_C(0xa414bff355e10eec), UINT64_C(0xd1bfd6bc0cf4870d),
+	UINT64_C(0x2623c7af9edacc40), UINT64_C(0x7c0114320dc3b321), UINT64_C(0x2a779243f2d8bbb8), UINT64_C(0xd34a510271ceaa13),
+	UINT64_C(0x4756aeef22d34202), UINT64_C(0x7b2f8f62cfafd4a6), UINT64_C(0x392b59ccd68b66f3), UINT64_C(0xead6fa4c8500c8dc),
+	UINT64_C(0xf3a2f6e04dc96c8c), UINT64_C(0xccda7252a901a6c4), UINT64_C(0x8eb83ab521ad55fa), UINT64_C(0x6c0b82088ffedbe4),
+	UINT64_C(0x1b27e62177e0bd75), UINT64_C(0x6def08316d510c0f), UINT64_C(0xea3c4583bc3dd47e), UINT64_C(0xd6397e7ea2ed7e66),
+	UINT64_C(0xda3c13fdac0f76d7), UINT64_C(0x3ece9302e3257a34), UINT64_C(0x8d6782e6c20279a2), UINT64_C(0xba440dd0eb70b40c),
+	UINT64_C(0x110e3d0ee08b9d4b), UINT64_C(0x4ec62a8f04175eca), UINT64_C(0x8ff23f428cc73586), UINT64_C(0x01dc4000fa04c16e),
+	UINT64_C(0x3245705666a60f0e), UINT64_C(0x5b6470f7ec3edf9b), UINT64_C(0xb225f5106ebc6225), UINT64_C(0x8d2bf7f997fc9875),
+	UINT64_C(0xe692c9603bf8ef0c), UINT64_C(0xde19c135fa440a74), UINT64_C(0xf7622b328f45cbb4), UINT64_C(0x94fc73b47cb3a2c2),
+	UINT64_C(0x8521bb10fed9fa2f), UINT64_C(0x6e1777220fc63936), UINT64_C(0x1373539980b143dc), UINT64_C(0x89963af0699c02b9),
+	UINT64_C(0x3fbaf44574d7ed8b), UINT64_C(0x1d3f3fba2dc81023), UINT64_C(0xf2495d32a5f8a4bf), UINT64_C(0x1e88e4d763249b59),
+	UINT64_C(0x45addf783f84567e), UINT64_C(0xf393e68acad8038c), UINT64_C(0x019cd94789ec4d20), UINT64_C(0x6f2020df890f890d),
+	UINT64_C(0x93192616bb4230bb), UINT64_C(0xeefcc9524c0efab5), UINT64_C(0xec3e86fe5b9375c8), UINT64_C(0x2a6efa2f848d4ecd),
+	UINT64_C(0xb407408b7577c42f), UINT64_C(0xb77d56ad9f08cf06), UINT64_C(0x22879a0fa849afac), UINT64_C(0xf975b89449e9e993),
+	UINT64_C(0x637ad70873bba365), UINT64_C(0x9145707d16e0519e), UINT64_C(0x061f5f34cd7fd488), UINT64_C(0x83d4d2e02fb0975d),
+	UINT64_C(0x57ad5073938b52f7), UINT64_C(0x0c35db172e9e6a7c), UINT64_C(0x509478a7614033e3), UINT64_C(0x56c04fe19f9cebb6),
+	UINT64_C(0x2247693259f9feca), UINT64_C(0xad2f738c55815302), UINT64_C(0x3f5ed0e4901e7f6c), UINT64_C(0x5c16a32eb2e53001),
+	UINT64_C(0x5ce7b349a4dd4f27), UINT64_C(0x809c2ee06ab90a97), UINT64_C(0x51d0c6ab87df5aaf), UINT64_C(0xb093e73740e71a6a),
+	UINT64_C(0x21428ad452a6ba51), UINT64_C(0x23cfd56713618a5f), UINT64_C(0xee6862e861d738f9), UINT64_C(0x43b9e509d8bcdbfe),
+	UINT64_C(0xae30448b4bbb07fa), UINT64_C(0x93f71461bd8b56ea), UINT64_C(0x5ca66dd5163934f9), UINT64_C(0x623b9b0c3fc456dc),
+	UINT64_C(0x5728c743aae41b5c), UINT64_C(0x7e73dd8d7d9dc903), UINT64_C(0xb2a2c05a226d745f), UINT64_C(0x023b78643c6094aa),
+	UINT64_C(0xd2004fa7ac5b6cb5), UINT64_C(0x44a4be0021fbd11e), UINT64_C(0xd3d040cb84adee5d), UINT64_C(0xb608fb750aeb7aeb),
+	UINT64_C(0xcfa4885486b41312), UINT64_C(0x94bdf14a780c36b9), UINT64_C(0x4fa8736f44d82328), UINT64_C(0xfd73dbdda2e795f3),
+	UINT64_C(0x4769fd16e282e090), UINT64_C(0x39a23d420e0583c5), UINT64_C(0x722f5b3e7e99c3b8), UINT64_C(0x1cdfbd0bf504eca7),
+	UINT64_C(0x192d929015f69ad4), UINT64_C(0xb58f5aaca9fe25e3), UINT64_C(0x70d9e782f37bb29f), UINT64_C(0x2b84907911f57ee7),
+	UINT64_C(0x8043357ca5109ae9), UINT64_C(0xc8e11d0e6cd6e32e), UINT64_C(0xb563f51f3ebd1890), UINT64_C(0x55b7b0a38f00e020),
+	UINT64_C(0xd2821e478a8a82f2), UINT64_C(0x346f55a3ea3b57c7), UINT64_C(0x822be50d06ba20ee), UINT64_C(0x7b10316b022690ec),
+	UINT64_C(0xfde08b059c07a5f2), UINT64_C(0xd56a214e5a05c5bb), UINT64_C(0x83d21f7696d4b142), UINT64_C(0x1ffe5aea7aa953d0),
+	UINT64_C(0x26b43c753f073231), UINT64_C(0xadc35730243c3c49), UINT64_C(0xce4983ee145bc5d4), UINT64_C(0x35a2d9b7746faf4a),
+	UINT64_C(0x48bc1eeca3694867), UINT64_C(0xf2e983ed5abb6500), UINT64_C(0x6fad219e917465a8), UINT64_C(0x36e0e4ff14fa6a50),
+	UINT64_C(0x2f453e57e49d8956), UINT64_C(0x3c23e2254ba77156), UINT64_C(0xe27793067bdaf966), UINT64_C(0xd391ae44c30a02cd),
+	UINT64_C(0xc380012e522728ec), UINT64_C(0x9021aae6c40e277e), UINT64_C(0x43d80362132d0c35), UINT64_C(0x797be1e9a2db399f),
+	UINT64_C(0x0f2ca44f3c2894dd), UINT64_C(0x632a089b099c1427), UINT64_C(0x0cdddc699f5c3aba), UINT64_C(0x802361114dd0498e),
+	UINT64_C(0x164797ced6e19797), UINT64_C(0xcf3ac7964a8f5a8c), UINT64_C(0x4d64d6343171c2f6), UINT64_C(0xaa2cf37813a724fc),
+	UINT64_C(0xaa2a9f14c7ada9a3), UINT64_C(0xd46104acefa4a991), UINT64_C(0xf210cde6a435beb4), UINT64_C(0xd0e8b08fbbf10a74),
+	UINT64_C(0x1e635136abf6ec3d), UINT64_C(0x4f68a8d0c5bf7349), UINT64_C(0xd8347969b841819d), UINT64_C(0x71495ef8178372b8),
+	UINT64_C(0xb200c0ca4e2fa955), UINT64_C(0xb502648fdea32dab), UINT64_C(0x562d5868b6838b51), UINT64_C(0xf6100568151f412f),
+	UINT64_C(0x4e8e411e70ebac1b), UINT64_C(0xc63500a366f4d49e), UINT64_C(0xe3e53d1c9301644f), UINT64_C(0x206a7ca7edf571b4),
+	UINT64_C(0x5405becb787ecad0), UINT64_C(0xe92afa9f7ad51ca6), UINT64_C(0x07031296e1c1e909), UINT64_C(0x46297ebc90504be6),
+	UINT64_C(0x02f4f7d6f22e5676), UINT64_C(0xa92020fc1f388d82), UINT64_C(0x3aa70ba256f11f08), UINT64_C(0x73ea68c4c10a6d0f),
+	UINT64_C(0xf122af1f5dc0b527), UINT64_C(0xab3b3b22d921ed35), UINT64_C(0xec5944abcdc4c6d9), UINT64_C(0x25ea1985e109f45a),
+	UINT64_C(0xf26b3833cfef791a), UINT64_C(0x6eac4e7d1f691993), UINT64_C(0x3436584c71a3a3ee), UINT64_C(0x661f976a199a5e36),
+	UINT64_C(0x1e3a867718579f28), UINT64_C(0xdde4e01179728579), UINT64_C(0xffa30a0513545e93), UINT64_C(0x521f2a02a2fc3f16),
+	UINT64_C(0x046d4c1d76a95464), UINT64_C(0x612eb1293bfd91ad), UINT64_C(0xbfbe81e68f9197da), UINT64_C(0x1c1eda72ad914f98),
+	UINT64_C(0x55f4821934f60e82), UINT64_C(0x4111896eca9d75de), UINT64_C(0x1f70074b54825d9d), UINT64_C(0x7c55976d892f3f3d),
+	UINT64_C(0x93f0e20e81f3cbcb), UINT64_C(0x5ae3cd3d8530f2e0), UINT64_C(0x3f02c5a2cd9415e1), UINT64_C(0x7664adedbdc026ca),
+	UINT64_C(0x6672acd32a5c8085), UINT64_C(0x002dab8b725871e1), UINT64_C(0xa20a4b7f4ca0fe1b), UINT64_C(0x45d915e94a848844),
+	UINT64_C(0xa51ebb8b133e6671), UINT64_C(0xa73b347d7ca0b67a), UINT64_C(0x04b308d09ed5631b), UINT64_C(0xb34686e31184bf17),
+	UINT64_C(0x4b52cb9447558929), UINT64_C(0xaef52082e52353d0), UINT64_C(0x68f319a20dadfc18), UINT64_C(0x4c353653941b664f),
+	UINT64_C(0x27a36bc41e845296), UINT64_C(0xd0b447cc2594ee55), UINT64_C(0x92f2d9e4d9c9d293), UINT64_C(0xae435159df5f8aaf),
+	UINT64_C(0xb26c72b910e51b5f), UINT64_C(0x7517c24b072634b0), UINT64_C(0xad4b1a7064593012), UINT64_C(0x2934d6cf9ee4c990),
+	UINT64_C(0x4290df575d07f980), UINT64_C(0x4435ee26e8214ff3), UINT64_C(0xd961c75e908fbf4a), UINT64_C(0x626494876184cd82),
+	UINT64_C(0xa57ac56786502ea6), UINT64_C(0xb4e8629ddd78470a), UINT64_C(0xbb03d423fd644680), UINT64_C(0x26105ae279c9f567),
+	UINT64_C(0xcfeb724bb9671bdb), UINT64_C(0x80e59a2221de522a), UINT64_C(0x5ea0543421be1e3d), UINT64_C(0x66ca8418906e3513),
+	UINT64_C(0x87e3219b51d59882), UINT64_C(0x85d80adc551518fb), UINT64_C(0x64580271d6e9fe35), UINT64_C(0x1f7b14f2acb773a9),
+	UINT64_C(0x713ae3146af97282), UINT64_C(0x4017b8e27dce7cbb), UINT64_C(0xc806941ee7f299cc), UINT64_C(0x0618b09d1103ee0d),
+	UINT64_C(0x0949dbf40a46e416), UINT64_C(0xbce8d4ac6b08f994), UINT64_C(0xabb1d9ad3f38e2be), UINT64_C(0xdf3f45aee6ae0406),
+	UINT64_C(0x0e635e06cc730ecc), UINT64_C(0xc034d4d8cc7349a5), UINT64_C(0xf0a874628ce87a7c), UINT64_C(0x310dd5756209a011),
+};
+
+#define MUL64 UINT64_C(0x9E3779B97F4A7C15)
+
+/* get the 64 bits word of the n bytes at p, little endian order */
+static inline uint64_t word64(const unsigned char *p, size_t n)
+{
+	uint64_t w = 0;
+
+	switch (n) {
+	default:
+	case 8: w |= (uint64_t)p[7] << 56; /*@fallthrough@*/
+	case 7: w |= (uint64_t)p[6] << 48; /*@fallthrough@*/
+	case 6: w |= (uint64_t)p[5] << 40; /*@fallthrough@*/
+	case 5: w |= (uint64_t)p[4] << 32; /*@fallthrough@*/
+	case 4: w |= (uint64_t)p[3] << 24; /*@fallthrough@*/
+	case 3: w |= (uint64_t)p[2] << 16; /*@fallthrough@*/
+	case 2: w |= (uint64_t)p[1] << 8;  /*@fallthrough@*/
+	case 1: w |= (uint64_t)p[0];       /*@fallthrough@*/
+	case 0: break;
+	}
+	return w;
+}
+
+/* mix the word w in the state h */
+static inline uint64_t step64(uint64_t h, uint64_t w)
+{
+	h = (h ^ w) * MUL64;
+	return h ^ TP64[h >> 56];
+}
+
+/*
+ * Returns a 64 bits hash value for the 'text' of 'length'.
+ *
+ * @param text the text to hash
+ * @param length length of the text to hash
+ * @return a 64 bits hash value
+ */
+uint64_t rp_pearson64_len(const char *text, size_t length)
+{
+	const unsigned char *p = (const unsigned char*)text;
+	uint64_t h = TP64[length & 255] ^ length;
+
+	for ( ; length >= 8 ; length -= 8, p += 8)
+		h = step64(h, word64(p, 8));
+	if (length)
+		h = step64(h, word64(p, length));
+
+	/* final avalanche */
+	h ^= h >> 33;
+	h *= UINT64_C(0xff51afd7ed558ccd);
+	h ^= h >> 33;
+	h *= UINT64_C(0xc4ceb9fe1a85ec53);
+	h ^= h >> 33;
+	return h;
+}
+
+/*
+ * Returns a 64 bits hash value for the 'text'.
+ *
+ * @param text the text to hash
+ * @return a 64 bits hash value
+ */
+uint64_t rp_pearson64(const char *text)
+{
+	return rp_pearson64_len(text, strlen(text));
+}
@@ -177,6 +177,79 @@ _DEF_RP_PEARSON_(7)
 static inline uint8_t rp_pearson7_len(const char *text, size_t length)
 _DEF_RP_PEARSON_LEN_(7)
 
+/*
+ * Returns a 64 bits hash value for the 'text'.
+ *
+ * Wider hash of the pearson family, reading 8 bytes per step.
+ * The value doesn't depend on the endianness of the machine.
+ *
+ * @param text the text to hash
+ * @return a 64 bits hash value
+ */
+extern uint64_t rp_pearson64(const char *text);
+
+/*
+ * Returns a 64 bits hash value for the 'text' of 'length'.
+ *
+ * Wider hash of the pearson family, reading 8 bytes per step.
+ * The value doesn't depend on the endianness of the machine.
+ *
+ * @param text the text to hash
+ * @param length length of the text to hash
+ * @return a 64 bits hash value
+ */
+extern uint64_t rp_pearson64_len(const char *text, size_t length);
+
+/*
+ * Returns a 32 bits hash value for the 'text'.
+ *
+ * @param text the text to hash
+ * @return a 32 bits hash value
+ */
+static inline uint32_t rp_pearson32(const char *text)
+{
+	uint64_t h = rp_pearson64(text);
+	return (uint32_t)(h ^ (h >> 32));
+}
+
+/*
+ * Returns a 32 bits hash value for the 'text' of 'length'.
+ *
+ * @param text the text to hash
+ * @param length length of the text to hash
+ * @return a 32 bits hash value
+ */
+static inline uint32_t rp_pearson32_len(const char *text, size_t length)
+{
+	uint64_t h = rp_pearson64_len(text, length);
+	return (uint32_t)(h ^ (h >> 32));
+}
+
+/*
+ * Returns a 16 bits hash value for the 'text'.
+ *
+ * @param text the text to hash
+ * @return a 16 bits hash value
+ */
+static inline uint16_t rp_pearson16(const char *text)
+{
+	uint32_t h = rp_pearson32(text);
+	return (uint16_t)(h ^ (h >> 16));
+}
+
+/*
+ * Returns a 16 bits hash value for the 'text' of 'length'.
+ *
+ * @param text the text to hash
+ * @param length length of the text to hash
+ * @return a 16 bits hash value
+ */
+static inline uint16_t rp_pearson16_len(const char *text, size_t length)
+{
+	uint32_t h = rp_pearson32_len(text, length);
+	return (uint16_t)(h ^ (h >> 16));
+}
+
 #ifdef	__cplusplus
 }
 #endif
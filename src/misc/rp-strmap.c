@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rp-strmap.h"
+#include "rp-pearson.h"
+#include "../sys/x-errno.h"
+
+/* smallest count of slots */
+#define MIN_SLOTS 8
+
+/* the table is grown when the count exceeds 3/4 of the slots */
+#define MAX_LOAD(nslots) (((nslots) >> 1) + ((nslots) >> 2))
+
+struct entry {
+	/** the key, NULL when the slot is free */
+	const char *key;
+	/** the value */
+	void *value;
+	/** the hash of the key */
+	uint32_t hash;
+	/** the length of the key */
+	uint32_t length;
+};
+
+struct rp_strmap {
+	/** the slots, a power of 2 */
+	struct entry *entries;
+	/** mask of slot indexes, count of slots minus 1 */
+	uint32_t mask;
+	/** count of used slots */
+	uint32_t count;
+	/** flags of creation */
+	int flags;
+};
+
+/* hash of the key */
+static inline uint32_t hash_key(const char *key, size_t length)
+{
+	return rp_pearson32_len(key, length);
+}
+
+/* search the slot of the key or of the free slot where it would be */
+static struct entry *search(rp_strmap_t *map, const char *key, size_t length, uint32_t hash)
+{
+	struct entry *entry;
+	uint32_t index = hash & map->mask;
+
+	for (;;) {
+		entry = &map->entries[index];
+		if (entry->key == NULL
+		 || (entry->hash == hash && entry->length == length
+		  && memcmp(entry->key, key, length) == 0))
+			return entry;
+		index = (index + 1) & map->mask;
+	}
+}
+
+/* resize the table to nslots, a power of 2 */
+static int resize(rp_strmap_t *map, uint32_t nslots)
+{
+	struct entry *entries = map->entries, *entry;
+	uint32_t index, omask = map->mask;
+
+	map->entries = calloc(nslots, sizeof *entry);
+	if (map->entries == NULL) {
+		map->entries = entries;
+		return X_ENOMEM;
+	}
+	map->mask = nslots - 1;
+	if (entries) {
+		for (index = 0 ; index <= omask ; index++) {
+			if (entries[index].key) {
+				entry = &map->entries[entries[index].hash & map->mask];
+				while (entry->key)
+					entry = entry == &map->entries[map->mask] ? map->entries : entry + 1;
+				*entry = entries[index];
+			}
+		}
+		free(entries);
+	}
+	return 0;
+}
+
+/* see rp-strmap.h */
+int rp_strmap_create(rp_strmap_t **pmap, unsigned capacity, int flags)
+{
+	rp_strmap_t *map;
+	uint32_t nslots;
+
+	nslots = MIN_SLOTS;
+	while (MAX_LOAD(nslots) < capacity && nslots < UINT32_C(0x80000000))
+		nslots <<= 1;
+	*pmap = map = malloc(sizeof *map);
+	if (map == NULL)
+		return X_ENOMEM;
+	map->entries = NULL;
+	map->mask = 0;
+	map->count = 0;
+	map->flags = flags;
+	if (resize(map, nslots) < 0) {
+		free(map);
+		*pmap = NULL;
+		return X_ENOMEM;
+	}
+	return 0;
+}
+
+/* see rp-strmap.h */
+void rp_strmap_clear(rp_strmap_t *map)
+{
+	uint32_t index;
+
+	if (map->flags & RP_STRMAP_COPY_KEYS)
+		for (index = 0 ; index <= map->mask ; index++)
+			free((void*)map->entries[index].key);
+	memset(map->entries, 0, (map->mask + 1) * sizeof *map->entries);
+	map->count = 0;
+}
+
+/* see rp-strmap.h */
+void rp_strmap_destroy(rp_strmap_t *map)
+{
+	if (map) {
+		rp_strmap_clear(map);
+		free(map->entries);
+		free(map);
+	}
+}
+
+/* see rp-strmap.h */
+unsigned rp_strmap_count(rp_strmap_t *map)
+{
+	return map->count;
+}
+
+/* add or set */
+static int put(rp_strmap_t *map, const char *key, size_t length, void *value, int replace)
+{
+	struct entry *entry;
+	char *copy;
+	uint32_t hash;
+	int rc;
+
+	if (length > UINT32_MAX)
+		return X_E2BIG;
+	hash = hash_key(key, length);
+	entry = search(map, key, length, hash);
+	if (entry->key) {
+		if (!replace)
+			return X_EEXIST;
+		entry->value = value;
+		return 0;
+	}
+	if (map->count >= MAX_LOAD(map->mask + 1)) {
+		rc = resize(map, (map->mask + 1) << 1);
+		if (rc < 0)
+			return rc;
+		entry = search(map, key, length, hash);
+	}
+	if (map->flags & RP_STRMAP_COPY_KEYS) {
+		copy = malloc(length + 1);
+		if (copy == NULL)
+			return X_ENOMEM;
+		memcpy(copy, key, length);
+		copy[length] = 0;
+		key = copy;
+	}
+	entry->key = key;
+	entry->value = value;
+	entry->hash = hash;
+	entry->length = (uint32_t)length;
+	map->count++;
+	return 0;
+}
+
+/* see rp-strmap.h */
+int rp_strmap_add(rp_strmap_t *map, const char *key, void *value)
+{
+	return put(map, key, strlen(key), value, 0);
+}
+
+/* see rp-strmap.h */
+int rp_strmap_add_len(rp_strmap_t *map, const char *key, size_t length, void *value)
+{
+	return put(map, key, length, value, 0);
+}
+
+/* see rp-strmap.h */
+int rp_strmap_set(rp_strmap_t *map, const char *key, void *value)
+{
+	return put(map, key, strlen(key), value, 1);
+}
+
+/* see rp-strmap.h */
+int rp_strmap_get_len(rp_strmap_t *map, const char *key, size_t length, void **value)
+{
+	struct entry *entry = search(map, key, length, hash_key(key, length));
+
+	if (entry->key == NULL)
+		return X_ENOENT;
+	if (value)
+		*value = entry->value;
+	return 0;
+}
+
+/* see rp-strmap.h */
+int rp_strmap_get(rp_strmap_t *map, const char *key, void **value)
+{
+	return rp_strmap_get_len(map, key, strlen(key), value);
+}
+
+/* see rp-strmap.h */
+int rp_strmap_drop(rp_strmap_t *map, const char *key, void **value)
+{
+	size_t length = strlen(key);
+	struct entry *entry = search(map, key, length, hash_key(key, length));
+	uint32_t hole, index, home;
+
+	if (entry->key == NULL)
+		return X_ENOENT;
+	if (value)
+		*value = entry->value;
+	if (map->flags & RP_STRMAP_COPY_KEYS)
+		free((void*)entry->key);
+	map->count--;
+
+	/* shift back the following entries that can fill the hole */
+	hole = (uint32_t)(entry - map->entries);
+	index = hole;
+	for (;;) {
+		index = (index + 1) & map->mask;
+		entry = &map->entries[index];
+		if (entry->key == NULL)
+			break;
+		home = entry->hash & map->mask;
+		/* move it if its home isn't cyclically in ]hole, index] */
+		if (((index - home) & map->mask) >= ((index - hole) & map->mask)) {
+			map->entries[hole] = *entry;
+			hole = index;
+		}
+	}
+	map->entries[hole].key = NULL;
+	return 0;
+}
+
+/* see rp-strmap.h */
+void rp_strmap_forall(
+		rp_strmap_t *map,
+		void (*callback)(void *closure, const char *key, void *value),
+		void *closure)
+{
+	uint32_t index;
+
+	for (index = 0 ; index <= map->mask ; index++)
+		if (map->entries[index].key)
+			callback(closure, map->entries[index].key, map->entries[index].value);
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Map of strings to pointers
+ *
+ * The map is an open addressing hash table using linear probing
+ * and the hash rp_pearson64. Removed entries are reclaimed by
+ * shifting back the entries following them, so searches never
+ * have to skip tombstones.
+ */
+typedef struct rp_strmap rp_strmap_t;
+
+/** flag telling that the map makes and owns copies of the keys */
+#define RP_STRMAP_COPY_KEYS 1
+
+/**
+ * Creates in @p map an empty map
+ *
+ * @param map pointer to the created map
+ * @param capacity count of entries expected, can be zero
+ * @param flags either 0 or RP_STRMAP_COPY_KEYS
+ *
+ * @return 0 in case of success or -ENOMEM if allocation failed
+ */
+extern int rp_strmap_create(rp_strmap_t **map, unsigned capacity, int flags);
+
+/**
+ * Destroys the map
+ *
+ * @param map the map to destroy
+ */
+extern void rp_strmap_destroy(rp_strmap_t *map);
+
+/**
+ * Removes all the entries of the map
+ *
+ * @param map the map to clear
+ */
+extern void rp_strmap_clear(rp_strmap_t *map);
+
+/**
+ * Count of entries of the map
+ *
+ * @param map the map
+ *
+ * @return the count of entries
+ */
+extern unsigned rp_strmap_count(rp_strmap_t *map);
+
+/**
+ * Adds the @p key with the @p value in the @p map
+ *
+ * When RP_STRMAP_COPY_KEYS isn't set, the key must remain valid
+ * until its removal.
+ *
+ * @param map the map
+ * @param key the key to add
+ * @param value the value associated to the key
+ *
+ * @return 0 in case of success, -EEXIST if the key is already in the map
+ *         or -ENOMEM if allocation failed
+ */
+extern int rp_strmap_add(rp_strmap_t *map, const char *key, void *value);
+
+/**
+ * Adds the @p key of @p length with the @p value in the @p map
+ *
+ * When RP_STRMAP_COPY_KEYS is set, the copied key is zero terminated.
+ * Otherwise, the key must remain valid until its removal and is given
+ * as is, possibly not zero terminated, to the callback of rp_strmap_forall.
+ *
+ * @param map the map
+ * @param key the key to add, not needing a terminating zero
+ * @param length length of the key
+ * @param value the value associated to the key
+ *
+ * @return 0 in case of success, -EEXIST if the key is already in the map
+ *         or -ENOMEM if allocation failed
+ */
+extern int rp_strmap_add_len(rp_strmap_t *map, const char *key, size_t length, void *value);
+
+/**
+ * Adds the @p key with the @p value in the @p map or replaces
+ * its value if the key already exists
+ *
+ * @param map the map
+ * @param key the key to set
+ * @param value the value associated to the key
+ *
+ * @return 0 in case of success or -ENOMEM if allocation failed
+ */
+extern int rp_strmap_set(rp_strmap_t *map, const char *key, void *value);
+
+/**
+ * Gets in @p value the value of the @p key
+ *
+ * @param map the map
+ * @param key the key to search
+ * @param value where to store the found value, can be NULL
+ *
+ * @return 0 if found or -ENOENT if the key isn't in the map
+ */
+extern int rp_strmap_get(rp_strmap_t *map, const char *key, void **value);
+
+/**
+ * Gets in @p value the value of the @p key of @p length
+ *
+ * @param map the map
+ * @param key the key to search, not needing a terminating zero
+ * @param length length of the key
+ * @param value where to store the found value, can be NULL
+ *
+ * @return 0 if found or -ENOENT if the key isn't in the map
+ */
+extern int rp_strmap_get_len(rp_strmap_t *map, const char *key, size_t length, void **value);
+
+/**
+ * Removes the @p key from the @p map and gets in @p value its value
+ *
+ * @param map the map
+ * @param key the key to remove
+ * @param value where to store the value of the removed key, can be NULL
+ *
+ * @return 0 if removed or -ENOENT if the key isn't in the map
+ */
+extern int rp_strmap_drop(rp_strmap_t *map, const char *key, void **value);
+
+/**
+ * Calls the @p callback for all the entries of the @p map, in no
+ * particular order. The map must not be changed by the callback.
+ *
+ * @param map the map
+ * @param callback the function to call with the @p closure, the key and the value
+ * @param closure the closure of the callback
+ */
+extern void rp_strmap_forall(
+		rp_strmap_t *map,
+		void (*callback)(void *closure, const char *key, void *value),
+		void *closure);
+
+#ifdef	__cplusplus
+}
+#endif
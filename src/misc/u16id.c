@@ -24,6 +24,7 @@
 
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <malloc.h>
 
 #include "u16id.h"
@@ -40,8 +41,34 @@
 #  error "Unsupported pointer size"
 #endif
 
-/* grain of allocation */
+/* vector instructions for searching ids, VECTOR_IDS is the count of ids compared at once */
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#  define VECTOR_IDS 16
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#  define VECTOR_IDS 8
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#  define VECTOR_IDS 8
+#else
+#  define VECTOR_IDS 1
+#endif
+
+/* grain of allocation, the array of ids is padded to a multiple of VECTOR_IDS */
+#if VECTOR_IDS > 4
+#define N VECTOR_IDS
+#else
 #define N 4
+#endif
+
+/* count of ids above which an index is used for searching */
+#if !defined(U16ID_INDEX_THRESHOLD)
+#define U16ID_INDEX_THRESHOLD 64
+#endif
+
+/* count of ids below which the index is released */
+#define U16ID_INDEX_RELEASE (U16ID_INDEX_THRESHOLD / 2)
 
 /*
  * The u16id maps are made of a single block of memory structured
@@ -53,19 +80,55 @@
  * The first item of the array of uint16_t is used to record the
  * upper index of valid uint16_t ids.
  *
- * +-----+-----+-----+-----+ - - - - - - - - +-----+-----+-----+-----+ - - - - - - - -
- * |upper| id1 | id2 | id3 |                 |         ptr1          |
- * +-----+-----+-----+-----+ - - - - - - - - +-----+-----+-----+-----+ - - - - - - - -
+ * When vector instructions are available, N is the count of ids that
+ * they compare at once so that the search reads whole vectors without
+ * leaving the array of uint16_t.
+ *
+ * +-----+-----+-----+-----+ - - - - - - - - +-----+-----+-----+-----+ - - - - +-----+-----+-----+-----+
+ * |upper| id1 | id2 | id3 |                 |         ptr1          |         |         index         |
+ * +-----+-----+-----+-----+ - - - - - - - - +-----+-----+-----+-----+ - - - - +-----+-----+-----+-----+
+ *
+ * The array of void* is followed by a pointer to an optional index.
+ * When the count of ids exceeds U16ID_INDEX_THRESHOLD, the index is
+ * created. It is a directory of pages giving directly the position
+ * of each id in the arrays. The index is released when the count
+ * of ids falls below U16ID_INDEX_RELEASE. The index doesn't change
+ * the order of items in the arrays, only the way ids are searched.
+ *
+ * Above U16ID_INDEX_THRESHOLD, the capacity grows by powers of 2
+ * instead of multiples of N.
+ */
+
+/** bit count of the id part selecting a page of the index */
+#define PAGE_BITS 8
+#define PAGE_SIZE (1 << PAGE_BITS)
+#define PAGE_COUNT (65536 >> PAGE_BITS)
+
+/**
+ * index of positions by id
  */
+struct index {
+	/** count of ids of each page */
+	uint16_t counts[PAGE_COUNT];
+
+	/** pages of positions, 0 when the id is absent */
+	uint16_t *pages[PAGE_COUNT];
+};
 
 static inline uint16_t get_capacity(uint16_t upper)
 {
+	uint16_t capa;
+
 	/* capacity is the smallest kN-1 such that kN-1 >= upper) */
 #if N == 2 || N == 4 || N == 8 || N == 16
-	return upper | (N - 1);
+	capa = upper | (N - 1);
 #else
 #	error "not supported"
 #endif
+	/* above the threshold, it is the smallest 2^k-1 such that 2^k-1 >= kN-1 */
+	while (capa > U16ID_INDEX_THRESHOLD && (capa & (capa + 1)))
+		capa |= (uint16_t)(capa >> 1);
+	return capa;
 }
 
 /**
@@ -83,8 +146,19 @@ typedef struct {
 
 	/** pointer to pointers */
 	void **ptrs;
+
+	/** the index if any */
+	struct index *index;
 } flat_t;
 
+/**
+ * get the address where the pointer to the index is stored
+ */
+static inline struct index **index_slot(flat_t *flat)
+{
+	return (struct index**)&flat->ptrs[flat->capacity + 1];
+}
+
 /**
  * set fields of @p flat accordingly to the @p base pointer
  * of upper value being @p up
@@ -111,14 +185,17 @@ static void flatofup(flat_t *flat, void *base, uint16_t up)
  */
 static void flatof(flat_t *flat, void *base)
 {
-	if (base)
+	if (base) {
 		/* not empty */
 		flatofup(flat, base, *(uint16_t*)base);
+		flat->index = *index_slot(flat);
+	}
 	else {
 		/* empty */
 		flat->upper = flat->capacity = 0;
 		flat->ids = NULL;
 		flat->ptrs = NULL;
+		flat->index = NULL;
 	}
 }
 
@@ -128,8 +205,116 @@ static void flatof(flat_t *flat, void *base)
 static inline size_t size(uint16_t capacity)
 {
 	return sizeof(uint16_t) * (capacity + 1)
-		+ sizeof(void*) * capacity;
+		+ sizeof(void*) * capacity
+		+ sizeof(struct index*);
+}
+
+/**
+ * release the index of flat
+ */
+static void index_release(flat_t *flat)
+{
+	struct index *index = flat->index;
+	int i;
+
+	if (index) {
+		for (i = 0 ; i < PAGE_COUNT ; i++)
+			free(index->pages[i]);
+		free(index);
+		flat->index = NULL;
+		*index_slot(flat) = NULL;
+	}
+}
+
+/**
+ * record in the index of flat that id is at position
+ *
+ * @return 0 on success or -1 if allocation failed
+ */
+static int index_set(flat_t *flat, uint16_t id, uint16_t position)
+{
+	struct index *index = flat->index;
+	uint16_t *page, np = (uint16_t)(id >> PAGE_BITS);
+
+	page = index->pages[np];
+	if (!page) {
+		page = calloc(PAGE_SIZE, sizeof *page);
+		if (!page)
+			return -1;
+		index->pages[np] = page;
+	}
+	if (!page[id & (PAGE_SIZE - 1)])
+		index->counts[np]++;
+	page[id & (PAGE_SIZE - 1)] = position;
+	return 0;
+}
+
+/**
+ * remove id from the index of flat
+ */
+static void index_clear(flat_t *flat, uint16_t id)
+{
+	struct index *index = flat->index;
+	uint16_t np = (uint16_t)(id >> PAGE_BITS);
+
+	index->pages[np][id & (PAGE_SIZE - 1)] = 0;
+	if (!--index->counts[np]) {
+		free(index->pages[np]);
+		index->pages[np] = NULL;
+	}
+}
+
+/**
+ * create the index of flat for its upper first ids
+ * if allocation fails, flat stays without index
+ */
+static void index_create(flat_t *flat, uint16_t upper)
+{
+	uint16_t pos;
+
+	flat->index = calloc(1, sizeof *flat->index);
+	if (flat->index) {
+		*index_slot(flat) = flat->index;
+		for (pos = 1 ; pos <= upper ; pos++) {
+			if (index_set(flat, flat->ids[pos], pos) < 0) {
+				index_release(flat);
+				break;
+			}
+		}
+	}
+}
+
+#if VECTOR_IDS > 1
+/**
+ * compare the VECTOR_IDS ids at @p ids with @p id
+ *
+ * @return a mask having the BITS_PER_ID bits of each equal id set
+ */
+#if defined(__AVX2__)
+#define BITS_PER_ID 2
+static inline uint64_t compare(const uint16_t *ids, uint16_t id)
+{
+	__m256i v = _mm256_loadu_si256((const __m256i*)ids);
+	__m256i k = _mm256_set1_epi16((short)id);
+	return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(v, k));
+}
+#elif defined(__SSE2__)
+#define BITS_PER_ID 2
+static inline uint64_t compare(const uint16_t *ids, uint16_t id)
+{
+	__m128i v = _mm_loadu_si128((const __m128i*)ids);
+	__m128i k = _mm_set1_epi16((short)id);
+	return (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi16(v, k));
 }
+#else
+#define BITS_PER_ID 8
+static inline uint64_t compare(const uint16_t *ids, uint16_t id)
+{
+	uint16x8_t eq = vceqq_u16(vld1q_u16(ids), vdupq_n_u16(id));
+	return vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(eq)), 0);
+}
+#endif
+#endif
 
 /**
  * search the @p id and returns its not null index if
@@ -142,12 +327,45 @@ static inline size_t size(uint16_t capacity)
  */
 static inline uint16_t search(flat_t *flat, uint16_t id)
 {
-	uint16_t *ids = flat->ids;
-	uint16_t *end = &ids[flat->upper];
+	uint16_t *ids, *page;
+#if VECTOR_IDS > 1
+	uint64_t mask;
+	unsigned base, index;
+
+	if (flat->index) {
+		page = flat->index->pages[id >> PAGE_BITS];
+		return page ? page[id & (PAGE_SIZE - 1)] : 0;
+	}
+	ids = flat->ids;
+	if (!flat->upper)
+		return 0;
+
+	/* the first vector includes the upper index that must be ignored */
+	mask = compare(ids, id) & ~(uint64_t)((1 << BITS_PER_ID) - 1);
+	base = 0;
+	while (!mask) {
+		base += VECTOR_IDS;
+		if (base > flat->upper)
+			return 0;
+		mask = compare(&ids[base], id);
+	}
+	/* ids after the upper index are not valid */
+	index = base + (unsigned)__builtin_ctzll(mask) / BITS_PER_ID;
+	return index <= flat->upper ? (uint16_t)index : 0;
+#else
+	uint16_t *end;
+
+	if (flat->index) {
+		page = flat->index->pages[id >> PAGE_BITS];
+		return page ? page[id & (PAGE_SIZE - 1)] : 0;
+	}
+	ids = flat->ids;
+	end = &ids[flat->upper];
 	while(ids != end)
 		if (id == *++ids)
 			return (uint16_t)(ids - flat->ids);
 	return 0;
+#endif
 }
 
 /**
@@ -157,12 +375,14 @@ static void *add(flat_t *flat, uint16_t id, void *ptr)
 {
 	void *grown, *result;
 	flat_t oflat;
+	struct index *index;
 	uint16_t nupper, oupper;
 
 	oupper = flat->upper;
 	nupper = (uint16_t)(oupper + 1);
 	result = flat->ids;
 	if (nupper > flat->capacity) {
+		index = flat->index;
 		grown = realloc(result, size(get_capacity(nupper)));
 		if (grown == NULL)
 			return NULL;
@@ -175,11 +395,21 @@ static void *add(flat_t *flat, uint16_t id, void *ptr)
 				oupper--;
 			}
 		}
+		flat->index = index;
+		*index_slot(flat) = index;
 	}
 	/* flat->upper = nupper; NOT DONE BECAUSE NOT NEEDED */
 	flat->ids[0] = nupper;
 	flat->ids[nupper] = id;
 	flat->ptrs[nupper] = ptr;
+
+	/* update the index */
+	if (flat->index) {
+		if (index_set(flat, id, nupper) < 0)
+			index_release(flat);
+	}
+	else if (nupper > U16ID_INDEX_THRESHOLD)
+		index_create(flat, nupper);
 	return result;
 }
 
@@ -189,15 +419,22 @@ static void *add(flat_t *flat, uint16_t id, void *ptr)
 static void *drop(flat_t *flat, uint16_t index)
 {
 	void **ptrs, *result;
+	struct index *idx2pos;
 	uint16_t upper, idx, capa;
 
 	/* remove the upper element */
 	upper = flat->upper;
+	if (flat->index)
+		index_clear(flat, flat->ids[index]);
 	if (index != upper) {
 		flat->ids[index] = flat->ids[upper];
 		flat->ptrs[index] = flat->ptrs[upper];
+		if (flat->index)
+			index_set(flat, flat->ids[index], index);
 	}
 	flat->ids[0] = --upper;
+	if (upper < U16ID_INDEX_RELEASE)
+		index_release(flat);
 
 	/* shrink capacity */
 	capa = get_capacity(upper);
@@ -205,12 +442,15 @@ static void *drop(flat_t *flat, uint16_t index)
 	if (capa != flat->capacity) {
 		/* shrink pointers */
 		ptrs = flat->ptrs;
+		idx2pos = flat->index;
 		flatofup(flat, result, upper);
 		idx = 1;
 		while(idx <= upper) {
 			flat->ptrs[idx] = ptrs[idx];
 			idx++;
 		}
+		flat->index = idx2pos;
+		*index_slot(flat) = idx2pos;
 #if U16ID_ALWAYS_SHRINK
 		/* reallocating if shrink */
 		result = realloc(flat->ids, size(capa));
@@ -227,10 +467,16 @@ static void *drop(flat_t *flat, uint16_t index)
 static void dropall(void **pbase)
 {
 	void *base;
+	flat_t flat;
 
 	base = *pbase;
-	if (base)
+	if (base) {
+		flatof(&flat, base);
+		index_release(&flat);
+		flatofup(&flat, base, 0);
+		*index_slot(&flat) = NULL;
 		*(uint16_t*)base = 0;
+	}
 }
 
 /**
@@ -239,9 +485,12 @@ static void dropall(void **pbase)
 static void destroy(void **pbase)
 {
 	void *base;
+	flat_t flat;
 
 	base = *pbase;
 	*pbase = NULL;
+	flatof(&flat, base);
+	index_release(&flat);
 	free(base);
 }
 
@@ -251,11 +500,14 @@ static void destroy(void **pbase)
 static int create(void **pbase)
 {
 	void *base;
+	flat_t flat;
 
 	*pbase = base = malloc(size(get_capacity(0)));
 	if (base == NULL)
 		return X_ENOMEM;
 	*(uint16_t*)base = 0;
+	flatofup(&flat, base, 0);
+	*index_slot(&flat) = NULL;
 	return 0;
 }
 
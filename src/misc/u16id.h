@@ -33,6 +33,18 @@ struct u16id2bool;
 /**        u16id2ptr                                                 **/
 /**********************************************************************/
 
+/*
+ * Iteration order of u16id2ptr_at and u16id2ptr_forall:
+ *
+ * Items are kept in a flat array in the order of their addition,
+ * except that dropping an item moves the last item to its place.
+ * u16id2ptr_at iterates that array from first to last and
+ * u16id2ptr_forall from last to first.
+ *
+ * When the count of ids grows large, an index is added for searching
+ * ids in constant time. It doesn't change that order.
+ */
+
 extern int u16id2ptr_create(struct u16id2ptr **pi2p);
 extern void u16id2ptr_destroy(struct u16id2ptr **pi2p);
 extern void u16id2ptr_dropall(struct u16id2ptr **pi2p);
@@ -0,0 +1 @@
+../json/rp-jsonc-cache.h
\ No newline at end of file
@@ -0,0 +1 @@
+../json/rp-jsonc-cbor.h
\ No newline at end of file
@@ -0,0 +1 @@
+../json/rp-jsonc-query.h
\ No newline at end of file
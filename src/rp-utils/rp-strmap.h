@@ -0,0 +1 @@
+../misc/rp-strmap.h
\ No newline at end of file
@@ -34,8 +34,17 @@
 #define RP_VERBOSE_CONTEXT_DEPTH 8
 #endif
 
-static const char *contexts[RP_VERBOSE_CONTEXT_DEPTH];
-static unsigned short contexts_depth;
+#if !defined(THREAD_LOCAL)
+# if __ZEPHYR__
+#  define THREAD_LOCAL
+# else
+#  define THREAD_LOCAL __thread
+# endif
+#endif
+
+/* stack of contexts of the current thread */
+static THREAD_LOCAL const char *contexts[RP_VERBOSE_CONTEXT_DEPTH];
+static THREAD_LOCAL unsigned short contexts_depth;
 
 /**********************************************************************************
 * Log with SYSLOG or SYSTEMD
@@ -179,21 +188,25 @@ static x_mutex_t mutex = X_MUTEX_INITIALIZER;
 static int is_tty()
 {
 	static int tty;
+	int r = __atomic_load_n(&tty, __ATOMIC_RELAXED);
 
-	if (!tty)
-		tty = 1 + isatty(STDERR_FILENO);
-	return tty - 1;
+	if (!r) {
+		r = 1 + isatty(STDERR_FILENO);
+		__atomic_store_n(&tty, r, __ATOMIC_RELAXED);
+	}
+	return r - 1;
 }
 
 int rp_verbose_colorize(int value)
 {
 	static int colorized;
+	int r;
 
 	if (value >= 0)
-		colorized = 1 + (is_tty() && value);
-	else if (!colorized)
-		colorized = 1 + is_tty();
-	return colorized - 1;
+		__atomic_store_n(&colorized, r = 1 + (is_tty() && value), __ATOMIC_RELAXED);
+	else if (!(r = __atomic_load_n(&colorized, __ATOMIC_RELAXED)))
+		__atomic_store_n(&colorized, r = 1 + is_tty(), __ATOMIC_RELAXED);
+	return r - 1;
 }
 
 int rp_verbose_is_colorized()
@@ -201,13 +214,18 @@ int rp_verbose_is_colorized()
 	return rp_verbose_colorize(-1);
 }
 
-static void _vverbose_(int loglevel, const char *file, int line, const char *function, const char *fmt, va_list args, int saverr)
+#define TEXT_SIZE	4000
+#define LINO_SIZE	40	/* line number with more than 39 digits are difficult to find */
+#define IOV_COUNT	(20 + RP_VERBOSE_CONTEXT_DEPTH + RP_VERBOSE_CONTEXT_DEPTH)
+
+/*
+ * Fill 'iov' with the parts of the message of 'text' (NULL if none) and
+ * return the count of parts. 'lino' receives the text of the line number.
+ */
+static int make_iov(struct iovec *iov, char lino[LINO_SIZE], int loglevel, const char *file, int line, const char *function, const char * const *ctxs, unsigned nctx, const char *text, size_t length)
 {
-	char buffer[4000];
-	char lino[40]; /* line number with more than 39 digits are difficult to find */
-	int n, rc, addcolor;
+	int n, addcolor;
 	unsigned idx;
-	struct iovec iov[20 + RP_VERBOSE_CONTEXT_DEPTH + RP_VERBOSE_CONTEXT_DEPTH];
 	int tty;
 
 	/* check if tty (2) or not (1) */
@@ -226,26 +244,17 @@ static void _vverbose_(int loglevel, const char *file, int line, const char *fun
 	iov[1].iov_len = 2;
 
 	n = 2;
-	for (idx = 0 ; idx < contexts_depth && idx < RP_VERBOSE_CONTEXT_DEPTH ; idx++) {
-		iov[n].iov_base = (void*)contexts[idx];
-		iov[n++].iov_len = strlen(contexts[idx]);
+	for (idx = 0 ; idx < nctx && idx < RP_VERBOSE_CONTEXT_DEPTH ; idx++) {
+		iov[n].iov_base = (void*)ctxs[idx];
+		iov[n++].iov_len = strlen(ctxs[idx]);
 		iov[n].iov_base = (void*)CHARS_COMMA_SPACE;
 		iov[n++].iov_len = 0;
 	}
-	if (fmt) {
-		iov[n].iov_base = buffer;
-		errno = saverr;
-		rc = vsnprintf(buffer, sizeof buffer, fmt, args);
-		if (rc < 0)
-			rc = 0;
-		else if ((size_t)rc > sizeof buffer) {
-			/* if too long, ellipsis the end with ... */
-			rc = (int)sizeof buffer;
-			buffer[rc - 1] = buffer[rc - 2]  = buffer[rc - 3] = '.';
-		}
-		iov[n++].iov_len = (size_t)rc;
+	if (text) {
+		iov[n].iov_base = (void*)text;
+		iov[n++].iov_len = length;
 	}
-	if (file && (!fmt || !tty || loglevel <= rp_Log_Level_Warning)) {
+	if (file && (!text || !tty || loglevel <= rp_Log_Level_Warning)) {
 
 		if (addcolor)
 		{
@@ -253,9 +262,9 @@ static void _vverbose_(int loglevel, const char *file, int line, const char *fun
 			iov[n++].iov_len = strlen(RP_VERBOSE_COLOR_FILE);
 		}
 
-		/* "[" (!fmt) or " [" (fmt) */
-		iov[n].iov_base = (void*)(CHARS_SPACE_OBRACE + !fmt);
-		iov[n++].iov_len = 2 - !fmt;
+		/* "[" (!text) or " [" (text) */
+		iov[n].iov_base = (void*)(CHARS_SPACE_OBRACE + !text);
+		iov[n++].iov_len = 2 - !text;
 		/* file */
 		iov[n].iov_base = (void*)file;
 		iov[n++].iov_len = strlen(file);
@@ -265,7 +274,7 @@ static void _vverbose_(int loglevel, const char *file, int line, const char *fun
 		if (line) {
 			/* line number */
 			iov[n].iov_base = lino;
-			iov[n++].iov_len = (size_t)snprintf(lino, sizeof lino, "%d", line);
+			iov[n++].iov_len = (size_t)snprintf(lino, LINO_SIZE, "%d", line);
 		} else {
 			/* "?" */
 			iov[n].iov_base = (void*)CHAR_QUESTION;
@@ -300,8 +309,810 @@ static void _vverbose_(int loglevel, const char *file, int line, const char *fun
 	/* "\n" */
 	iov[n].iov_base = (void*)CHAR_EOL;
 	iov[n++].iov_len = 1;
+	return n;
+}
+
+/* format the message in 'buffer', ellipsing it with ... if too long */
+static size_t format_text(char buffer[TEXT_SIZE], const char *fmt, va_list args)
+{
+	int rc;
+
+	rc = vsnprintf(buffer, TEXT_SIZE, fmt, args);
+	if (rc < 0)
+		return 0;
+	if (rc < TEXT_SIZE)
+		return (size_t)rc;
+	buffer[TEXT_SIZE - 2] = buffer[TEXT_SIZE - 3] = buffer[TEXT_SIZE - 4] = '.';
+	return TEXT_SIZE - 1;
+}
+
+#if !defined(WITH_VERBOSE_ASYNC)
+# define WITH_VERBOSE_ASYNC 1
+#endif
+
+/**********************************************************************************
+* Asynchronous emission for STDERR
+*
+* Each logging thread copies its formatted messages in its own ring buffer.
+* Rings have a single producer (the owner thread) and a single consumer (the
+* flusher), so no lock is needed for pushing. The flusher thread drains the
+* rings and writes their records in batches using writev.
+* Records are never split: a record that doesn't fit before the end of the
+* ring is preceded by a wrap mark and written at its start.
+**********************************************************************************/
+#if WITH_VERBOSE_ASYNC
+
+#define VERBOSE_ASYNC 1
+
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#if !defined(RP_VERBOSE_ASYNC_RING_SIZE)
+# define RP_VERBOSE_ASYNC_RING_SIZE 65536
+#endif
+#define ASYNC_MIN_RING_SIZE	8192
+#define ASYNC_IOV_COUNT		128
+#define ASYNC_WRAP		UINT32_MAX
+#define ASYNC_DEFERRED		0x80000000u
+#define ASYNC_ARENA_COUNT	16
+#define ASYNC_ALIGN(x)		(((x) + 7) & ~(size_t)7)
+
+struct ring
+{
+	/* next ring, only the flusher unlinks rings */
+	struct ring *next;
+	/* set when the owner thread exited */
+	int orphan;
+	/* size of the data (power of 2) */
+	size_t size;
+	/* free running offsets, head written by the owner, tail by the flusher */
+	size_t head;
+	size_t tail;
+	/* records: 8 bytes header (length) followed by the text */
+	char data[] __attribute__((aligned(8)));
+};
+
+static int async_running;
+static int async_deferring;
+static unsigned async_ring_size = RP_VERBOSE_ASYNC_RING_SIZE;
+static unsigned long async_dropped;
+static unsigned long async_reported;
+static struct ring *async_rings;
+static __thread struct ring *async_ring;
+static pthread_key_t async_key;
+static pthread_once_t async_once = PTHREAD_ONCE_INIT;
+static pthread_t async_flusher;
+static int async_draining;
+static int async_sleeping;
+static pthread_mutex_t async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_cond = PTHREAD_COND_INITIALIZER;
+
+/* called at exit of the threads owning a ring */
+static void async_release(void *arg)
+{
+	struct ring *ring = arg;
+
+	async_ring = NULL;
+	__atomic_store_n(&ring->orphan, 1, __ATOMIC_RELEASE);
+}
+
+static void async_init()
+{
+	pthread_key_create(&async_key, async_release);
+	atexit(rp_verbose_async_flush);
+}
+
+/* get the ring of the current thread, creating it if needed */
+static struct ring *async_get_ring()
+{
+	struct ring *ring = async_ring;
+	size_t size;
+
+	if (ring == NULL) {
+		size = __atomic_load_n(&async_ring_size, __ATOMIC_RELAXED);
+		ring = malloc(sizeof *ring + size);
+		if (ring != NULL) {
+			ring->orphan = 0;
+			ring->size = size;
+			ring->head = ring->tail = 0;
+			ring->next = __atomic_load_n(&async_rings, __ATOMIC_RELAXED);
+			while (!__atomic_compare_exchange_n(&async_rings, &ring->next, ring,
+						1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+			pthread_setspecific(async_key, ring);
+			async_ring = ring;
+		}
+	}
+	return ring;
+}
+
+/* wake up the flusher if it sleeps */
+static void async_wakeup()
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&async_sleeping, __ATOMIC_RELAXED)
+	 && __atomic_exchange_n(&async_sleeping, 0, __ATOMIC_RELAXED)) {
+		pthread_mutex_lock(&async_mutex);
+		pthread_cond_signal(&async_cond);
+		pthread_mutex_unlock(&async_mutex);
+	}
+}
+
+/*
+ * Push the record of 'iov' of 'kind' in the ring of the current thread.
+ * Returns 0 when pushed or dropped and -1 when there is no ring.
+ */
+static int async_push(const struct iovec *iov, int n, uint32_t kind)
+{
+	struct ring *ring;
+	size_t len, total, head, free, off, end;
+	char *ptr;
+	int i;
+
+	ring = async_get_ring();
+	if (ring == NULL)
+		return -1;
+
+	/* compute the room needed */
+	for (len = 0, i = 0 ; i < n ; i++)
+		len += iov[i].iov_len;
+	total = ASYNC_ALIGN(8 + len);
+	head = ring->head;
+	free = ring->size - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+	off = head & (ring->size - 1);
+	end = ring->size - off;
+	if (end < total) {
+		/* wrap needed */
+		if (free < end + total) {
+			__atomic_add_fetch(&async_dropped, 1, __ATOMIC_RELAXED);
+			return 0;
+		}
+		*(uint32_t*)&ring->data[off] = ASYNC_WRAP;
+		head += end;
+		off = 0;
+	}
+	else if (free < total) {
+		__atomic_add_fetch(&async_dropped, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	/* copy the record */
+	ptr = &ring->data[off];
+	*(uint32_t*)ptr = (uint32_t)len | kind;
+	ptr += 8;
+	for (i = 0 ; i < n ; i++) {
+		memcpy(ptr, iov[i].iov_base, iov[i].iov_len);
+		ptr += iov[i].iov_len;
+	}
+	__atomic_store_n(&ring->head, head + total, __ATOMIC_RELEASE);
+	async_wakeup();
+	return 0;
+}
+
+/**********************************************************************************
+* Deferred formatting
+*
+* Instead of formatting the message, the logging thread records the raw values
+* of the arguments as read by va_arg. The strings of the message (arguments,
+* format, file, function and contexts) are copied because the caller can
+* release them as soon as it returns. The flusher then formats the record,
+* conversion by conversion. Formats using unsupported conversions (%n,
+* positional or wide strings) are formatted immediately.
+**********************************************************************************/
+
+/*
+ * head of deferred records, followed by the arguments and then by the
+ * strings: format, file (if any), function (if any) and contexts
+ */
+struct deferred
+{
+	int loglevel;
+	int line;
+	int saverr;
+	unsigned argslen;
+	unsigned char hasfile;
+	unsigned char hasfunction;
+	unsigned char nctx;
+};
+
+/* conversion specification of printf */
+struct spec
+{
+	/* end of the specification */
+	const char *end;
+	/* count of * for width and precision */
+	int stars;
+	/* precision, -1 if none, -2 if given by argument */
+	int precision;
+	/* 0 (int), 'l' (long), 'q' (long long or long double), 'j', 'z' or 't' */
+	char length;
+	/* the conversion */
+	char conv;
+};
+
+/* scan the specification at 'p' (after %), returns 0 if supported or else -1 */
+static int scan_spec(const char *p, struct spec *spec)
+{
+	spec->stars = 0;
+	spec->precision = -1;
+	spec->length = 0;
+	while (*p && strchr("-+ #0'I", *p))
+		p++;
+	if (*p == '*') {
+		spec->stars++;
+		p++;
+	}
+	else
+		while (*p >= '0' && *p <= '9')
+			p++;
+	if (*p == '.') {
+		if (*++p == '*') {
+			spec->stars++;
+			spec->precision = -2;
+			p++;
+		}
+		else
+			for (spec->precision = 0 ; *p >= '0' && *p <= '9' ; p++)
+				if (spec->precision < TEXT_SIZE)
+					spec->precision = spec->precision * 10 + *p - '0';
+	}
+	switch (*p) {
+	case 'h':
+		p += 1 + (p[1] == 'h');
+		break;
+	case 'l':
+		spec->length = p[1] == 'l' ? 'q' : 'l';
+		p += 1 + (p[1] == 'l');
+		break;
+	case 'q':
+	case 'L':
+		spec->length = 'q';
+		p++;
+		break;
+	case 'j':
+	case 'z':
+	case 't':
+		spec->length = *p++;
+		break;
+	}
+	spec->conv = *p;
+	spec->end = p + (*p != 0);
+	switch (spec->conv) {
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+	case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+	case 'p': case 'm': case '%':
+		return 0;
+	case 's':
+		return spec->length ? -1 : 0;
+	default:
+		return -1;
+	}
+}
+
+#define PUT(value)	do{ if (pos + sizeof(value) > size) return -1; \
+			    memcpy(&buffer[pos], &(value), sizeof(value)); \
+			    pos += sizeof(value); }while(0)
+#define GET(value)	do{ memcpy(&(value), args, sizeof(value)); args += sizeof(value); }while(0)
+
+/* record in 'buffer' of 'size' the arguments of 'fmt', returns the length used or -1 */
+static int defer_args(char *buffer, size_t size, const char *fmt, va_list args)
+{
+	struct spec spec;
+	long long ival = 0;
+	long double lval;
+	double dval;
+	const char *str;
+	void *ptr;
+	uint32_t len;
+	size_t pos = 0;
+	int i;
+
+	for (fmt = strchr(fmt, '%') ; fmt != NULL ; fmt = strchr(spec.end, '%')) {
+		if (scan_spec(fmt + 1, &spec) < 0)
+			return -1;
+		for (i = 0 ; i < spec.stars ; i++) {
+			ival = va_arg(args, int);
+			PUT(ival);
+		}
+		switch (spec.conv) {
+		case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+			switch (spec.length) {
+			case 'l': ival = va_arg(args, long); break;
+			case 'q': ival = va_arg(args, long long); break;
+			case 'j': ival = (long long)va_arg(args, intmax_t); break;
+			case 'z': ival = (long long)va_arg(args, size_t); break;
+			case 't': ival = (long long)va_arg(args, ptrdiff_t); break;
+			default: ival = va_arg(args, int); break;
+			}
+			PUT(ival);
+			break;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			if (spec.length == 'q') {
+				lval = va_arg(args, long double);
+				PUT(lval);
+			}
+			else {
+				dval = va_arg(args, double);
+				PUT(dval);
+			}
+			break;
+		case 'p':
+			ptr = va_arg(args, void*);
+			PUT(ptr);
+			break;
+		case 's':
+			str = va_arg(args, const char*);
+			if (spec.precision == -2)
+				spec.precision = ival < 0 ? -1 : ival < TEXT_SIZE ? (int)ival : TEXT_SIZE;
+			len = str == NULL ? UINT32_MAX : (uint32_t)strnlen(str,
+				spec.precision < 0 ? TEXT_SIZE : (size_t)spec.precision);
+			PUT(len);
+			if (str != NULL) {
+				if (pos + len + 1 > size)
+					return -1;
+				memcpy(&buffer[pos], str, len);
+				pos += len;
+				buffer[pos++] = 0;
+			}
+			break;
+		}
+	}
+	return (int)pos;
+}
+
+/* format in 'buffer' the message of 'fmt' for the recorded 'args' */
+static size_t defer_format(char buffer[TEXT_SIZE], const char *fmt, const char *args, int saverr)
+{
+	char sub[64];
+	struct spec spec;
+	long long ival;
+	long double lval;
+	double dval;
+	void *ptr;
+	uint32_t len;
+	size_t pos, rem, n, k;
+	const char *p;
+	int rc, stars, truncated;
+
+	pos = 0;
+	truncated = 0;
+	while (pos < TEXT_SIZE - 1) {
+		/* copy the text until % */
+		rem = TEXT_SIZE - 1 - pos;
+		p = strchr(fmt, '%');
+		n = p == NULL ? strlen(fmt) : (size_t)(p - fmt);
+		if (n > rem) {
+			n = rem;
+			p = NULL;
+			truncated = 1;
+		}
+		memcpy(&buffer[pos], fmt, n);
+		pos += n;
+		if (p == NULL)
+			break;
+
+		/* make the specification, replacing the stars with their values */
+		scan_spec(p + 1, &spec);
+		fmt = spec.end;
+		for (k = 0, stars = spec.stars ; p != spec.end && k < sizeof sub - 13 ; p++) {
+			if (*p != '*')
+				sub[k++] = *p;
+			else if (stars-- > 0) {
+				GET(ival);
+				if (sub[k - 1] == '.') {
+					/* a negative precision is taken as if omitted */
+					if (ival < 0)
+						k--;
+					else
+						k += (size_t)snprintf(&sub[k], 12, "%d", (int)ival);
+				}
+				else {
+					/* a negative width is a - flag followed by a positive width */
+					if (ival < 0) {
+						sub[k++] = '-';
+						ival = -ival;
+					}
+					k += (size_t)snprintf(&sub[k], 12, "%lld", ival);
+				}
+			}
+		}
+		sub[k] = 0;
+
+		/* format the conversion */
+		rem = TEXT_SIZE - pos;
+		switch (spec.conv) {
+		case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+			GET(ival);
+			switch (spec.length) {
+			case 'l': rc = snprintf(&buffer[pos], rem, sub, (long)ival); break;
+			case 'q': rc = snprintf(&buffer[pos], rem, sub, ival); break;
+			case 'j': rc = snprintf(&buffer[pos], rem, sub, (intmax_t)ival); break;
+			case 'z': rc = snprintf(&buffer[pos], rem, sub, (size_t)ival); break;
+			case 't': rc = snprintf(&buffer[pos], rem, sub, (ptrdiff_t)ival); break;
+			default: rc = snprintf(&buffer[pos], rem, sub, (int)ival); break;
+			}
+			break;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			if (spec.length == 'q') {
+				GET(lval);
+				rc = snprintf(&buffer[pos], rem, sub, lval);
+			}
+			else {
+				GET(dval);
+				rc = snprintf(&buffer[pos], rem, sub, dval);
+			}
+			break;
+		case 'p':
+			GET(ptr);
+			rc = snprintf(&buffer[pos], rem, sub, ptr);
+			break;
+		case 's':
+			GET(len);
+			if (len == UINT32_MAX)
+				rc = snprintf(&buffer[pos], rem, sub, (const char*)NULL);
+			else {
+				rc = snprintf(&buffer[pos], rem, sub, args);
+				args += len + 1;
+			}
+			break;
+		default:
+			errno = saverr;
+			rc = snprintf(&buffer[pos], rem, sub, 0);
+			break;
+		}
+		if (rc > 0) {
+			if ((size_t)rc < rem)
+				pos += (size_t)rc;
+			else {
+				pos += rem - 1;
+				truncated = 1;
+			}
+		}
+	}
+	buffer[pos] = 0;
+	if (truncated || (pos == TEXT_SIZE - 1 && *fmt))
+		buffer[pos - 1] = buffer[pos - 2] = buffer[pos - 3] = '.';
+	return pos;
+}
+
+#undef PUT
+#undef GET
+
+/*
+ * Record the message in the ring of the current thread for being formatted
+ * later. Returns 0 when recorded or dropped and -1 when it can not be deferred.
+ */
+/* copy the string 'str' in 'record' at 'pos', returns 0 or -1 if it doesn't fit */
+static int defer_string(char *record, size_t *pos, size_t size, const char *str)
+{
+	size_t len = strlen(str) + 1;
+
+	if (len > size - *pos)
+		return -1;
+	memcpy(&record[*pos], str, len);
+	*pos += len;
+	return 0;
+}
+
+static int async_defer(int loglevel, const char *file, int line, const char *function, const char *fmt, va_list args, int saverr)
+{
+	char record[sizeof(struct deferred) + 2 * TEXT_SIZE] __attribute__((aligned(8)));
+	struct deferred *deferred = (struct deferred*)record;
+	struct iovec iov;
+	size_t pos;
+	unsigned idx;
+	int len;
+
+	if (!__atomic_load_n(&async_deferring, __ATOMIC_RELAXED))
+		return -1;
+	len = defer_args(&record[sizeof *deferred], TEXT_SIZE, fmt, args);
+	if (len < 0)
+		return -1;
+	deferred->loglevel = loglevel;
+	deferred->line = line;
+	deferred->saverr = saverr;
+	deferred->argslen = (unsigned)len;
+	deferred->hasfile = file != NULL;
+	deferred->hasfunction = function != NULL;
+	deferred->nctx = contexts_depth < RP_VERBOSE_CONTEXT_DEPTH ? contexts_depth : RP_VERBOSE_CONTEXT_DEPTH;
+	pos = sizeof *deferred + (size_t)len;
+	if (defer_string(record, &pos, sizeof record, fmt)
+	 || (file && defer_string(record, &pos, sizeof record, file))
+	 || (function && defer_string(record, &pos, sizeof record, function)))
+		return -1;
+	for (idx = 0 ; idx < deferred->nctx ; idx++)
+		if (defer_string(record, &pos, sizeof record, contexts[idx]))
+			return -1;
+	iov.iov_base = record;
+	iov.iov_len = pos;
+	return async_push(&iov, 1, ASYNC_DEFERRED);
+}
+
+/* call the observer with the variable arguments */
+static void defer_observe(rp_verbose_observer_cb observer, int loglevel, const char *file, int line, const char *function, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	observer(loglevel, file, line, function, fmt, ap);
+	va_end(ap);
+}
+
+/*
+ * Format the deferred record 'data' in 'arena' and fill 'iov' with its parts.
+ * Returns the count of parts.
+ */
+static int defer_make_iov(struct iovec *iov, char arena[TEXT_SIZE + LINO_SIZE], const char *data)
+{
+	struct deferred deferred;
+	rp_verbose_observer_cb observer;
+	const char *ctxs[RP_VERBOSE_CONTEXT_DEPTH];
+	const char *args, *fmt, *file, *function, *str;
+	size_t length;
+	unsigned idx;
+	int n;
+
+	/* locate the strings */
+	memcpy(&deferred, data, sizeof deferred);
+	args = data + sizeof deferred;
+	str = fmt = args + deferred.argslen;
+	str += strlen(str) + 1;
+	file = function = NULL;
+	if (deferred.hasfile) {
+		file = str;
+		str += strlen(str) + 1;
+	}
+	if (deferred.hasfunction) {
+		function = str;
+		str += strlen(str) + 1;
+	}
+	for (idx = 0 ; idx < deferred.nctx ; idx++) {
+		ctxs[idx] = str;
+		str += strlen(str) + 1;
+	}
+
+	/* format */
+	length = defer_format(arena, fmt, args, deferred.saverr);
+	n = make_iov(iov, &arena[TEXT_SIZE], deferred.loglevel, file, deferred.line,
+			function, ctxs, deferred.nctx, arena, length);
+	observer = rp_verbose_observer;
+	if (observer)
+		defer_observe(observer, deferred.loglevel, file, deferred.line,
+				function, "%s", arena);
+	return n;
+}
+
+/* write all the 'n' buffers of 'iov' even if interrupted */
+static void async_write(struct iovec *iov, int n)
+{
+	ssize_t rc;
+
+	x_mutex_lock(&mutex);
+	while (n > 0) {
+		rc = writev(STDERR_FILENO, iov, n);
+		if (rc < 0) {
+			if (errno != EINTR && errno != EAGAIN)
+				break;
+			continue;
+		}
+		while (n > 0 && (size_t)rc >= iov->iov_len) {
+			rc -= (ssize_t)iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n > 0) {
+			iov->iov_base = (char*)iov->iov_base + rc;
+			iov->iov_len -= (size_t)rc;
+		}
+	}
+	x_mutex_unlock(&mutex);
+}
+
+/* write the records of 'ring', returns the count of records written */
+static int async_drain_ring(struct ring *ring)
+{
+	static char arena[ASYNC_ARENA_COUNT][TEXT_SIZE + LINO_SIZE];
+	struct iovec iov[ASYNC_IOV_COUNT];
+	size_t head, tail, off;
+	uint32_t len;
+	int n, used, count = 0;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	tail = ring->tail;
+	while (tail != head) {
+		n = used = 0;
+		while (tail != head && n + IOV_COUNT <= ASYNC_IOV_COUNT) {
+			off = tail & (ring->size - 1);
+			len = *(uint32_t*)&ring->data[off];
+			if (len == ASYNC_WRAP) {
+				tail += ring->size - off;
+				continue;
+			}
+			if (!(len & ASYNC_DEFERRED)) {
+				iov[n].iov_base = &ring->data[off + 8];
+				iov[n++].iov_len = len;
+			}
+			else if (used < ASYNC_ARENA_COUNT) {
+				len &= ~ASYNC_DEFERRED;
+				n += defer_make_iov(&iov[n], arena[used++], &ring->data[off + 8]);
+			}
+			else
+				break;
+			tail += ASYNC_ALIGN(8 + (size_t)len);
+			count++;
+		}
+		async_write(iov, n);
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+	return count;
+}
+
+/* report the count of dropped messages */
+static void async_report()
+{
+	char buffer[100];
+	struct iovec iov;
+	unsigned long dropped;
+
+	dropped = __atomic_load_n(&async_dropped, __ATOMIC_RELAXED);
+	if (dropped != async_reported) {
+		iov.iov_base = buffer;
+		iov.iov_len = (size_t)snprintf(buffer, sizeof buffer,
+				"%s: %lu log messages dropped\n",
+				prefixes[rp_Log_Level_Warning] + (is_tty() ? 4 : 0),
+				dropped - async_reported);
+		async_write(&iov, 1);
+		async_reported = dropped;
+	}
+}
+
+/*
+ * Write the records of all the rings. When 'reclaim' isn't zero, release
+ * the rings of exited threads: only the flusher thread does it because it
+ * walks the rings in async_pending without draining.
+ * When 'trials' isn't zero, it bounds the waiting for a concurrent drain.
+ * Returns the count of records written.
+ */
+static int async_drain(int trials, int reclaim)
+{
+	struct ring *ring, **prv;
+	int count = 0;
+
+	while (__atomic_exchange_n(&async_draining, 1, __ATOMIC_ACQUIRE)) {
+		if (trials && !--trials)
+			return 0;
+		sched_yield();
+	}
+	prv = &async_rings;
+	ring = __atomic_load_n(prv, __ATOMIC_ACQUIRE);
+	while (ring != NULL) {
+		count += async_drain_ring(ring);
+		if (reclaim
+		 && prv != &async_rings
+		 && __atomic_load_n(&ring->orphan, __ATOMIC_ACQUIRE)
+		 && ring->tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+			/* unlink and free the ring of an exited thread */
+			*prv = ring->next;
+			free(ring);
+		}
+		else
+			prv = &ring->next;
+		ring = *prv;
+	}
+	async_report();
+	__atomic_store_n(&async_draining, 0, __ATOMIC_RELEASE);
+	return count;
+}
+
+/* check if some records are pending, only called by the flusher */
+static int async_pending()
+{
+	struct ring *ring;
+
+	for (ring = __atomic_load_n(&async_rings, __ATOMIC_ACQUIRE) ; ring != NULL ; ring = ring->next)
+		if (__atomic_load_n(&ring->tail, __ATOMIC_RELAXED) != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+			return 1;
+	return 0;
+}
+
+static void *async_flusher_main(void *arg)
+{
+	struct timespec ts;
+
+	(void)arg;
+	while (__atomic_load_n(&async_running, __ATOMIC_ACQUIRE)) {
+		if (async_drain(0, 1) == 0) {
+			pthread_mutex_lock(&async_mutex);
+			__atomic_store_n(&async_sleeping, 1, __ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			if (!async_pending() && __atomic_load_n(&async_running, __ATOMIC_ACQUIRE)) {
+				clock_gettime(CLOCK_REALTIME, &ts);
+				ts.tv_sec++;
+				pthread_cond_timedwait(&async_cond, &async_mutex, &ts);
+			}
+			__atomic_store_n(&async_sleeping, 0, __ATOMIC_RELAXED);
+			pthread_mutex_unlock(&async_mutex);
+		}
+	}
+	async_drain(0, 1);
+	return NULL;
+}
+
+int rp_verbose_async_start(unsigned ringsize)
+{
+	unsigned size;
+	int rc;
+
+	if (ringsize == 0)
+		ringsize = RP_VERBOSE_ASYNC_RING_SIZE;
+	for (size = ASYNC_MIN_RING_SIZE ; size < ringsize && size < 0x40000000 ; size <<= 1);
+	pthread_once(&async_once, async_init);
+	if (__atomic_load_n(&async_running, __ATOMIC_ACQUIRE))
+		return -EBUSY;
+	__atomic_store_n(&async_ring_size, size, __ATOMIC_RELAXED);
+	__atomic_store_n(&async_running, 1, __ATOMIC_RELEASE);
+	rc = pthread_create(&async_flusher, NULL, async_flusher_main, NULL);
+	if (rc != 0) {
+		__atomic_store_n(&async_running, 0, __ATOMIC_RELEASE);
+		return -rc;
+	}
+	return 0;
+}
+
+void rp_verbose_async_stop()
+{
+	if (__atomic_exchange_n(&async_running, 0, __ATOMIC_ACQ_REL)) {
+		pthread_mutex_lock(&async_mutex);
+		pthread_cond_signal(&async_cond);
+		pthread_mutex_unlock(&async_mutex);
+		pthread_join(async_flusher, NULL);
+	}
+}
+
+void rp_verbose_async_flush()
+{
+	async_drain(1000, 0);
+}
+
+unsigned long rp_verbose_async_dropped()
+{
+	return __atomic_load_n(&async_dropped, __ATOMIC_RELAXED);
+}
+
+int rp_verbose_async_defer(int value)
+{
+	if (value >= 0)
+		__atomic_store_n(&async_deferring, !!value, __ATOMIC_RELAXED);
+	return __atomic_load_n(&async_deferring, __ATOMIC_RELAXED);
+}
+
+#endif
+
+static void _vverbose_(int loglevel, const char *file, int line, const char *function, const char *fmt, va_list args, int saverr)
+{
+	char buffer[TEXT_SIZE];
+	char lino[LINO_SIZE];
+	struct iovec iov[IOV_COUNT];
+	size_t length = 0;
+	int n;
+
+	if (fmt) {
+		errno = saverr;
+		length = format_text(buffer, fmt, args);
+	}
+	n = make_iov(iov, lino, loglevel, file, line, function,
+			contexts, contexts_depth, fmt ? buffer : NULL, length);
 
 	/* emit the message */
+#if WITH_VERBOSE_ASYNC
+	if (__atomic_load_n(&async_running, __ATOMIC_ACQUIRE)) {
+		if (loglevel > rp_Log_Level_Critical && async_push(iov, n, 0) == 0)
+			return;
+		rp_verbose_async_flush();
+	}
+#endif
 	x_mutex_lock(&mutex);
 	writev(STDERR_FILENO, iov, n);
 	x_mutex_unlock(&mutex);
@@ -360,12 +1171,147 @@ extern rp_verbose_observer_cb rp_verbose_observer;
 
 void (*rp_verbose_observer)(int loglevel, const char *file, int line, const char *function, const char *fmt, va_list args);
 
-void rp_vverbose(int loglevel, const char *file, int line, const char *function, const char *fmt, va_list args)
+/**********************************************************************************
+* Rate limitation
+*
+* Each call site, identified by its file (or format) and line, has a token bucket
+* of 'rate_burst' tokens refilled at 'rate_per_second'. Sites are recorded in a
+* fixed table without lock, sites not fitting in the table are not limited.
+* The state of the bucket is packed in 64 bits (time in ms and count of tokens
+* in thousandth) for being updated atomically.
+**********************************************************************************/
+#if !defined(WITH_VERBOSE_RATE_LIMIT)
+# define WITH_VERBOSE_RATE_LIMIT !__ZEPHYR__
+#endif
+
+#if WITH_VERBOSE_RATE_LIMIT
+
+#include <stdint.h>
+#include <time.h>
+
+#define RATE_SITE_COUNT		1024
+#define RATE_SITE_PROBES	8
+
+struct rate_site
+{
+	/* identifier of the site, 0 if free */
+	uint64_t id;
+	/* stamp in ms (high 32 bits) and thousandth of tokens (low 32 bits) */
+	uint64_t state;
+	/* count of suppressed messages */
+	unsigned suppressed;
+};
+
+static unsigned rate_burst;
+static unsigned rate_per_second;
+static struct rate_site rate_sites[RATE_SITE_COUNT];
+
+static uint32_t rate_now()
+{
+	struct timespec ts;
+
+#if defined(CLOCK_MONOTONIC_COARSE)
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+	return (uint32_t)ts.tv_sec * 1000 + (uint32_t)(ts.tv_nsec / 1000000);
+}
+
+/* get the site of 'key' and 'line', NULL if the table is full */
+static struct rate_site *rate_site(const void *key, int line)
+{
+	struct rate_site *site;
+	uint64_t id, cur;
+	unsigned idx, probe;
+
+	id = ((uint64_t)(uintptr_t)key << 16) ^ (uint64_t)(unsigned)line;
+	id += !id;
+	idx = (unsigned)((id * 0x9e3779b97f4a7c15ULL) >> 40);
+	for (probe = 0 ; probe < RATE_SITE_PROBES ; probe++) {
+		site = &rate_sites[(idx + probe) & (RATE_SITE_COUNT - 1)];
+		cur = __atomic_load_n(&site->id, __ATOMIC_ACQUIRE);
+		if (cur == 0) {
+			if (__atomic_compare_exchange_n(&site->id, &cur, id, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+				return site;
+		}
+		if (cur == id)
+			return site;
+	}
+	return NULL;
+}
+
+/*
+ * Check if the message of the site 'key' and 'line' can be emitted.
+ * Returns -1 if it is suppressed or else the count of messages
+ * suppressed since the last emitted one.
+ */
+static int rate_check(const void *key, int line)
+{
+	struct rate_site *site;
+	uint64_t state, next;
+	uint32_t now, stamp, tokens, max, rate;
+
+	max = __atomic_load_n(&rate_burst, __ATOMIC_RELAXED) * 1000;
+	rate = __atomic_load_n(&rate_per_second, __ATOMIC_RELAXED);
+	if (max == 0 || (site = rate_site(key, line)) == NULL)
+		return 0;
+	now = rate_now();
+	state = __atomic_load_n(&site->state, __ATOMIC_RELAXED);
+	do {
+		if (state == 0)
+			tokens = max;
+		else {
+			stamp = (uint32_t)(state >> 32);
+			tokens = (uint32_t)state;
+			if (tokens >= max || (uint64_t)(now - stamp) * rate >= max - tokens)
+				tokens = max;
+			else
+				tokens += (now - stamp) * rate;
+		}
+		if (tokens < 1000) {
+			__atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+			return -1;
+		}
+		next = ((uint64_t)now << 32) | (tokens - 1000);
+		next += !next;
+	}
+	while (!__atomic_compare_exchange_n(&site->state, &state, next, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	return (int)__atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+}
+
+void rp_verbose_rate_limit(unsigned burst, unsigned persecond)
+{
+	__atomic_store_n(&rate_per_second, persecond, __ATOMIC_RELAXED);
+	__atomic_store_n(&rate_burst, burst, __ATOMIC_RELAXED);
+}
+
+#else
+
+void rp_verbose_rate_limit(unsigned burst, unsigned persecond)
+{
+	(void)burst;
+	(void)persecond;
+}
+
+#endif
+
+static void vverbose_emit(int loglevel, const char *file, int line, const char *function, const char *fmt, va_list args, int saverr)
 {
-	int saverr = errno;
 	void (*observer)(int loglevel, const char *file, int line, const char *function, const char *fmt, va_list args) = rp_verbose_observer;
 
-	loglevel = CROP_LOGLEVEL(loglevel);
+#if defined(VERBOSE_ASYNC)
+	if (fmt != NULL && loglevel > rp_Log_Level_Critical
+	 && __atomic_load_n(&async_running, __ATOMIC_ACQUIRE)) {
+		va_list ap;
+		int rc;
+		va_copy(ap, args);
+		rc = async_defer(loglevel, file, line, function, fmt, ap, saverr);
+		va_end(ap);
+		if (rc == 0)
+			return;
+	}
+#endif
 	if (!observer)
 		_vverbose_(loglevel, file, line, function, fmt, args, saverr);
 	else {
@@ -376,6 +1322,37 @@ void rp_vverbose(int loglevel, const char *file, int line, const char *function,
 		observer(loglevel, file, line, function, fmt, ap);
 		va_end(ap);
 	}
+}
+
+#if WITH_VERBOSE_RATE_LIMIT
+static void verbose_emit(int loglevel, const char *file, int line, const char *function, int saverr, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vverbose_emit(loglevel, file, line, function, fmt, ap, saverr);
+	va_end(ap);
+}
+#endif
+
+void rp_vverbose(int loglevel, const char *file, int line, const char *function, const char *fmt, va_list args)
+{
+	int saverr = errno;
+
+	loglevel = CROP_LOGLEVEL(loglevel);
+#if WITH_VERBOSE_RATE_LIMIT
+	if (loglevel > rp_Log_Level_Critical && __atomic_load_n(&rate_burst, __ATOMIC_RELAXED)) {
+		int suppressed = rate_check(file ? (const void*)file : (const void*)fmt, line);
+		if (suppressed < 0) {
+			errno = saverr;
+			return;
+		}
+		if (suppressed > 0)
+			verbose_emit(loglevel, file, line, function, saverr,
+					"%d similar messages suppressed", suppressed);
+	}
+#endif
+	vverbose_emit(loglevel, file, line, function, fmt, args, saverr);
 
 	/* restore errno */
 	errno = saverr;
@@ -390,6 +1367,33 @@ void rp_verbose(int loglevel, const char *file, int line, const char *function,
 	va_end(ap);
 }
 
+#if !defined(VERBOSE_ASYNC)
+int rp_verbose_async_start(unsigned ringsize)
+{
+	(void)ringsize;
+	return -ENOTSUP;
+}
+
+void rp_verbose_async_stop()
+{
+}
+
+void rp_verbose_async_flush()
+{
+}
+
+unsigned long rp_verbose_async_dropped()
+{
+	return 0;
+}
+
+int rp_verbose_async_defer(int value)
+{
+	(void)value;
+	return 0;
+}
+#endif
+
 void rp_set_logmask(int logmask)
 {
 	rp_logmask = (logmask | MINIMAL_LOGMASK) & MAXIMAL_LOGMASK;
@@ -131,9 +131,50 @@ extern int rp_verbose_is_colorized();
 extern int rp_verbose_level_of_name(const char *name);
 extern const char *rp_verbose_name_of_level(int level);
 
+/*
+ * Contexts are pushed and popped for the current thread only.
+ * A pushed context must remain valid until it is popped.
+ */
 extern void rp_verbose_push(const char *context);
 extern void rp_verbose_pop();
 
+/*
+ * Limit the rate of messages of each call site (identified by file and line)
+ * to bursts of 'burst' messages refilled at 'persecond' messages per second.
+ * A 'burst' of 0 removes the limitation. Messages of level critical or lower
+ * are never limited. When a site emits again, the count of its suppressed
+ * messages is reported.
+ */
+extern void rp_verbose_rate_limit(unsigned burst, unsigned persecond);
+
+/*
+ * Asynchronous emission of messages (only for the default stderr output).
+ * When started, messages are copied in a ring buffer of 'ringsize' bytes
+ * (0 for default) per logging thread, and written later by a background
+ * thread. When a ring is full, messages are dropped and counted.
+ * Messages of level critical or lower flush pending messages and are
+ * written immediately. rp_verbose_async_flush writes pending messages,
+ * it is automatically called at exit. It is not async-signal-safe and
+ * must not be called from signal handlers.
+ *
+ * When deferring is set by rp_verbose_async_defer (and the asynchronous
+ * emission is started), the logging threads only record the format and
+ * the values of the arguments, and formatting is done by the background
+ * thread. The observer is then called by the background thread with the
+ * formatted text. Formats using %n, positional arguments or wide strings
+ * are formatted immediately. The strings of the message (format, string
+ * arguments, file, function and pushed contexts) are copied when recorded,
+ * so, as for immediate formatting, they only have to remain valid until
+ * the logging function returns. Other pointers (%p) are only printed.
+ * rp_verbose_async_defer returns the current setting, it only queries it
+ * when 'value' is negative.
+ */
+extern int rp_verbose_async_start(unsigned ringsize);
+extern void rp_verbose_async_stop();
+extern void rp_verbose_async_flush();
+extern unsigned long rp_verbose_async_dropped();
+extern int rp_verbose_async_defer(int value);
+
 
 typedef void (*rp_verbose_observer_cb)(
 	int loglevel,
@@ -25,6 +25,9 @@
 #include "rp-yaml.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
 #include <errno.h>
 #include <limits.h>
 
@@ -80,12 +83,9 @@ static
 int
 y2jt_init(y2j_t *y2jt, const char *name)
 {
-	y2jt->aliases = json_object_new_object();
-	if (y2jt->aliases == NULL
-	|| !yaml_parser_initialize(&y2jt->parser)) {
-		json_object_put(y2jt->aliases);
+	y2jt->aliases = NULL;
+	if (!yaml_parser_initialize(&y2jt->parser))
 		return -ENOMEM;
-	}
 	yaml_parser_set_input(&y2jt->parser, y2jt_read, y2jt);
 	memset(&y2jt->event, 0, sizeof y2jt->event);
 	return 0;
@@ -151,6 +151,8 @@ y2j_rec_anchor(y2j_t *y2jt, json_object *node, const char *anchor)
 	int rc;
 	if (anchor == NULL)
 		rc = 0;
+	else if (y2jt->aliases == NULL && (y2jt->aliases = json_object_new_object()) == NULL)
+		rc = -1;
 	else if (json_object_object_get_ex(y2jt->aliases, anchor, NULL))
 		rc = -1;
 	else {
@@ -168,13 +170,47 @@ y2j_rec_line(y2j_t *y2jt, json_object *node, size_t line)
 {
 }
 
+/**
+ * compute the type of the scalar of the current event
+ */
+static rp_yaml_event_type_t
+y2j_scalar(y2j_t *y2jt, int64_t *integer, double *number)
+{
+	const char *text = (const char*)y2jt->event.data.scalar.value;
+	char *pend;
+
+	switch (y2jt->event.data.scalar.style) {
+	case YAML_ANY_SCALAR_STYLE:
+	case YAML_PLAIN_SCALAR_STYLE:
+		if (strcmp(text, "null") == 0)
+			return rp_yaml_event_null;
+		if (strcmp(text, "true") == 0) {
+			*integer = 1;
+			return rp_yaml_event_boolean;
+		}
+		if (strcmp(text, "false") == 0) {
+			*integer = 0;
+			return rp_yaml_event_boolean;
+		}
+		*integer = strtol(text, &pend, 0);
+		if (*pend == '\0')
+			return rp_yaml_event_integer;
+		*number = strtod(text, &pend);
+		if (*pend == '\0')
+			return rp_yaml_event_number;
+		/*@fallthrough@*/
+	default:
+		return rp_yaml_event_string;
+	}
+}
+
 static int
 y2j_node(y2j_t *y2jt, json_object **node)
 {
 	int rc;
-	char *text, *pend;
+	char *text;
 	json_object *value, *item;
-	long lv;
+	int64_t lv;
 	double ld;
 
 	*node = NULL;
@@ -190,32 +226,19 @@ y2j_node(y2j_t *y2jt, json_object **node)
 
 	case YAML_SCALAR_EVENT:
 		text = (char*)y2jt->event.data.scalar.value;
-		switch (y2jt->event.data.scalar.style) {
-		case YAML_ANY_SCALAR_STYLE:
-		case YAML_PLAIN_SCALAR_STYLE:
-			if (strcmp(text, "null") == 0) {
-				value = NULL;
-				break;
-			}
-			if (strcmp(text, "true") == 0) {
-				value = json_object_new_boolean(1);
-				break;
-			}
-			if (strcmp(text, "false") == 0) {
-				value = json_object_new_boolean(0);
-				break;
-			}
-			lv = strtol(text, &pend, 0);
-			if (*pend == '\0') {
-				value = json_object_new_int64(lv);
-				break;
-			}
-			ld = strtod(text, &pend);
-			if (*pend == '\0') {
-				value = json_object_new_double_s(ld, text);
-				break;
-			}
-			/*@fallthrough@*/
+		switch (y2j_scalar(y2jt, &lv, &ld)) {
+		case rp_yaml_event_null:
+			value = NULL;
+			break;
+		case rp_yaml_event_boolean:
+			value = json_object_new_boolean((json_bool)lv);
+			break;
+		case rp_yaml_event_integer:
+			value = json_object_new_int64(lv);
+			break;
+		case rp_yaml_event_number:
+			value = json_object_new_double_s(ld, text);
+			break;
 		default:
 			value = json_object_new_string(text);
 			break;
@@ -349,3 +372,537 @@ rp_yaml_path_to_json_c(json_object **root, const char *path, const char *name)
 	}
 	return rc;
 }
+
+/******************************************************************************/
+/*** STREAMING                                                              ***/
+/******************************************************************************/
+
+typedef struct y2e_rec_s y2e_rec_t;
+typedef struct y2e_anchor_s y2e_anchor_t;
+typedef struct y2e_s y2e_t;
+
+/**
+ * recorded event, data holds the copies of key and text
+ */
+struct y2e_rec_s
+{
+	rp_yaml_event_t   event;
+	char             *data;
+};
+
+/**
+ * recording of the events of an anchored node
+ */
+struct y2e_anchor_s
+{
+	y2e_anchor_t     *next;
+	char             *name;
+	y2e_rec_t        *events;
+	size_t            count;
+	size_t            alloc;
+	int               depth;
+	int               active;
+};
+
+/**
+ * state of the streaming parser
+ */
+struct y2e_s
+{
+	y2j_t              y2jt;
+	unsigned           flags;
+	rp_yaml_event_cb_t callback;
+	void              *closure;
+	char              *key;
+	size_t             keysize;
+	int                haskey;
+	unsigned char     *stack;
+	size_t             depth;
+	size_t             alloc;
+	y2e_anchor_t      *anchors;
+	size_t             aliasevts;
+};
+
+/**
+ * release memory of the streaming parser
+ */
+static
+void
+y2e_deinit(y2e_t *y2e)
+{
+	y2e_anchor_t *anchor;
+
+	while ((anchor = y2e->anchors) != NULL) {
+		y2e->anchors = anchor->next;
+		while (anchor->count)
+			free(anchor->events[--anchor->count].data);
+		free(anchor->events);
+		free(anchor->name);
+		free(anchor);
+	}
+	free(y2e->stack);
+	free(y2e->key);
+	y2jt_deinit(&y2e->y2jt);
+}
+
+/**
+ * record the event in the anchor
+ */
+static
+int
+y2e_record(y2e_anchor_t *anchor, const rp_yaml_event_t *event)
+{
+	y2e_rec_t *events, *rec;
+	size_t keylen, textlen, alloc;
+	char *data;
+
+	if (anchor->count == anchor->alloc) {
+		alloc = anchor->alloc ? anchor->alloc << 1 : 8;
+		events = realloc(anchor->events, alloc * sizeof *events);
+		if (events == NULL)
+			return -ENOMEM;
+		anchor->events = events;
+		anchor->alloc = alloc;
+	}
+
+	/* copy key and text in one block */
+	keylen = event->key ? strlen(event->key) : 0;
+	textlen = event->text ? event->length : 0;
+	data = malloc(keylen + textlen + 2);
+	if (data == NULL)
+		return -ENOMEM;
+	rec = &anchor->events[anchor->count++];
+	rec->event = *event;
+	rec->data = data;
+	if (event->key) {
+		memcpy(data, event->key, keylen + 1);
+		rec->event.key = data;
+	}
+	if (event->text) {
+		memcpy(&data[keylen + 1], event->text, textlen);
+		data[keylen + 1 + textlen] = 0;
+		rec->event.text = &data[keylen + 1];
+	}
+
+	/* track the end of the anchored node */
+	switch (event->type) {
+	case rp_yaml_event_object_start:
+	case rp_yaml_event_array_start:
+		anchor->depth++;
+		break;
+	case rp_yaml_event_object_end:
+	case rp_yaml_event_array_end:
+		anchor->depth--;
+		break;
+	default:
+		break;
+	}
+	anchor->active = anchor->depth != 0;
+	return 0;
+}
+
+/**
+ * emit the event to the callback and to the active anchors
+ */
+static
+int
+y2e_emit(y2e_t *y2e, const rp_yaml_event_t *event)
+{
+	y2e_anchor_t *anchor;
+	int rc = 0;
+
+	for (anchor = y2e->anchors ; rc == 0 && anchor != NULL ; anchor = anchor->next)
+		if (anchor->active)
+			rc = ++y2e->aliasevts > RP_YAML_MAX_ALIAS_EVENTS ? -E2BIG : y2e_record(anchor, event);
+	return rc ? rc : y2e->callback(y2e->closure, event);
+}
+
+/**
+ * start recording an anchor
+ */
+static
+int
+y2e_anchor(y2e_t *y2e, const char *name)
+{
+	y2e_anchor_t *anchor;
+
+	if (name == NULL)
+		return 0;
+	anchor = calloc(1, sizeof *anchor);
+	if (anchor == NULL)
+		return -ENOMEM;
+	anchor->name = strdup(name);
+	if (anchor->name == NULL) {
+		free(anchor);
+		return -ENOMEM;
+	}
+	anchor->active = 1;
+	anchor->next = y2e->anchors;
+	y2e->anchors = anchor;
+	return 0;
+}
+
+/**
+ * replay the events of an anchor for an alias
+ */
+static
+int
+y2e_alias(y2e_t *y2e, const char *name, rp_yaml_event_t *event)
+{
+	y2e_anchor_t *anchor;
+	rp_yaml_event_t replay;
+	size_t idx;
+	int rc;
+
+	for (anchor = y2e->anchors ; anchor != NULL ; anchor = anchor->next)
+		if (strcmp(anchor->name, name) == 0)
+			break;
+	if (anchor == NULL || anchor->active)
+		return -1;
+	if (anchor->count > RP_YAML_MAX_ALIAS_EVENTS - y2e->aliasevts)
+		return -E2BIG;
+	y2e->aliasevts += anchor->count;
+	for (idx = 0, rc = 0 ; rc == 0 && idx < anchor->count ; idx++) {
+		replay = anchor->events[idx].event;
+		if (idx == 0)
+			replay.key = event->key;
+		if (event->line)
+			replay.line = event->line;
+		rc = y2e_emit(y2e, &replay);
+	}
+	return rc;
+}
+
+/**
+ * push a container
+ */
+static
+int
+y2e_push(y2e_t *y2e, unsigned char mapping)
+{
+	unsigned char *stack;
+	size_t alloc;
+
+	if (y2e->depth == y2e->alloc) {
+		alloc = y2e->alloc ? y2e->alloc << 1 : 16;
+		stack = realloc(y2e->stack, alloc);
+		if (stack == NULL)
+			return -ENOMEM;
+		y2e->stack = stack;
+		y2e->alloc = alloc;
+	}
+	y2e->stack[y2e->depth++] = mapping;
+	return 0;
+}
+
+/**
+ * record the key of the next value
+ */
+static
+int
+y2e_key(y2e_t *y2e, const char *key, size_t length)
+{
+	char *copy;
+
+	if (length >= y2e->keysize) {
+		copy = realloc(y2e->key, length + 1);
+		if (copy == NULL)
+			return -ENOMEM;
+		y2e->key = copy;
+		y2e->keysize = length + 1;
+	}
+	memcpy(y2e->key, key, length + 1);
+	y2e->haskey = 1;
+	return 0;
+}
+
+/**
+ * process the events of the document
+ */
+static
+int
+y2e_root(y2e_t *y2e)
+{
+	y2j_t *y2jt = &y2e->y2jt;
+	rp_yaml_event_t event;
+	int rc, mapping;
+
+	/* stream and document start */
+	rc = y2jt_parse(y2jt);
+	if (rc == 0 && y2jt->event.type != YAML_STREAM_START_EVENT)
+		rc = -1;
+	if (rc == 0)
+		rc = y2jt_parse(y2jt);
+	if (rc == 0 && y2jt->event.type != YAML_DOCUMENT_START_EVENT)
+		rc = -1;
+
+	/* process the nodes */
+	memset(&event, 0, sizeof event);
+	while (rc == 0) {
+		rc = y2jt_parse(y2jt);
+		if (rc < 0)
+			break;
+		mapping = y2e->depth && y2e->stack[y2e->depth - 1];
+		event.key = y2e->haskey ? y2e->key : NULL;
+		event.text = NULL;
+		event.length = 0;
+		event.line = y2e->flags & RP_YAML_LINES ? y2jt->event.start_mark.line + 1 : 0;
+		switch (y2jt->event.type) {
+		case YAML_SCALAR_EVENT:
+			event.text = (const char*)y2jt->event.data.scalar.value;
+			event.length = y2jt->event.data.scalar.length;
+			if (mapping && !y2e->haskey) {
+				rc = y2e_key(y2e, event.text, event.length);
+				continue;
+			}
+			event.type = y2j_scalar(y2jt, &event.integer, &event.number);
+			rc = y2e_anchor(y2e, (const char*)y2jt->event.data.scalar.anchor);
+			if (rc == 0)
+				rc = y2e_emit(y2e, &event);
+			break;
+		case YAML_ALIAS_EVENT:
+			if (mapping && !y2e->haskey)
+				rc = -1;
+			else
+				rc = y2e_alias(y2e, (const char*)y2jt->event.data.alias.anchor, &event);
+			break;
+		case YAML_SEQUENCE_START_EVENT:
+		case YAML_MAPPING_START_EVENT:
+			if (mapping && !y2e->haskey) {
+				rc = -1;
+				break;
+			}
+			if (y2jt->event.type == YAML_SEQUENCE_START_EVENT) {
+				event.type = rp_yaml_event_array_start;
+				rc = y2e_anchor(y2e, (const char*)y2jt->event.data.sequence_start.anchor);
+			}
+			else {
+				event.type = rp_yaml_event_object_start;
+				rc = y2e_anchor(y2e, (const char*)y2jt->event.data.mapping_start.anchor);
+			}
+			if (rc == 0)
+				rc = y2e_emit(y2e, &event);
+			if (rc == 0)
+				rc = y2e_push(y2e, y2jt->event.type == YAML_MAPPING_START_EVENT);
+			y2e->haskey = 0;
+			continue;
+		case YAML_SEQUENCE_END_EVENT:
+		case YAML_MAPPING_END_EVENT:
+			if (y2e->depth == 0 || y2e->haskey
+			 || mapping != (y2jt->event.type == YAML_MAPPING_END_EVENT)) {
+				rc = -1;
+				break;
+			}
+			y2e->depth--;
+			event.key = NULL;
+			event.type = mapping ? rp_yaml_event_object_end : rp_yaml_event_array_end;
+			rc = y2e_emit(y2e, &event);
+			break;
+		default:
+			rc = -1;
+			break;
+		}
+		/* a value was processed */
+		y2e->haskey = 0;
+		if (rc == 0 && y2e->depth == 0)
+			break;
+	}
+	return rc;
+}
+
+/**
+ * initialize the streaming parser
+ */
+static
+void
+y2e_init(y2e_t *y2e, unsigned flags, rp_yaml_event_cb_t callback, void *closure)
+{
+	memset(y2e, 0, sizeof *y2e);
+	y2e->flags = flags;
+	y2e->callback = callback;
+	y2e->closure = closure;
+}
+
+int
+rp_yaml_buffer_to_events(const char *buffer, size_t size, unsigned flags, rp_yaml_event_cb_t callback, void *closure)
+{
+	y2e_t y2e;
+	int rc;
+
+	y2e_init(&y2e, flags, callback, closure);
+	rc = y2jt_init_buffer(&y2e.y2jt, NULL, buffer, size);
+	if (rc == 0) {
+		rc = y2e_root(&y2e);
+		y2e_deinit(&y2e);
+	}
+	return rc;
+}
+
+int
+rp_yaml_file_to_events(FILE *file, unsigned flags, rp_yaml_event_cb_t callback, void *closure)
+{
+	y2e_t y2e;
+	int rc;
+
+	y2e_init(&y2e, flags, callback, closure);
+	rc = y2jt_init_file(&y2e.y2jt, NULL, file);
+	if (rc == 0) {
+		rc = y2e_root(&y2e);
+		y2e_deinit(&y2e);
+	}
+	return rc;
+}
+
+int
+rp_yaml_path_to_events(const char *path, unsigned flags, rp_yaml_event_cb_t callback, void *closure)
+{
+	int rc;
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+		rc = -errno;
+	else {
+		rc = rp_yaml_file_to_events(file, flags, callback, closure);
+		fclose(file);
+	}
+	return rc;
+}
+
+/******************************************************************************/
+/*** JSON TEXT                                                              ***/
+/******************************************************************************/
+
+/**
+ * state of the JSON text writer
+ */
+typedef struct
+{
+	FILE *output;
+	int   first;
+}
+	e2t_t;
+
+/**
+ * write the string as a JSON string
+ */
+static
+void
+e2t_string(FILE *output, const char *string, size_t length)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char *end = &string[length];
+	unsigned char c;
+
+	putc('"', output);
+	while (string != end) {
+		c = (unsigned char)*string++;
+		switch (c) {
+		case '"':  fputs("\\\"", output); break;
+		case '\\': fputs("\\\\", output); break;
+		case '\b': fputs("\\b", output); break;
+		case '\f': fputs("\\f", output); break;
+		case '\n': fputs("\\n", output); break;
+		case '\r': fputs("\\r", output); break;
+		case '\t': fputs("\\t", output); break;
+		default:
+			if (c >= ' ')
+				putc(c, output);
+			else {
+				fputs("\\u00", output);
+				putc(hex[c >> 4], output);
+				putc(hex[c & 15], output);
+			}
+			break;
+		}
+	}
+	putc('"', output);
+}
+
+/**
+ * write the number in its shortest exact representation
+ */
+static
+void
+e2t_number(FILE *output, double number)
+{
+	char buffer[32];
+
+	if (number != number || number - number != 0)
+		fputs("null", output);
+	else {
+		snprintf(buffer, sizeof buffer, "%.15g", number);
+		if (strtod(buffer, NULL) != number)
+			snprintf(buffer, sizeof buffer, "%.17g", number);
+		fputs(buffer, output);
+	}
+}
+
+/**
+ * callback of events writing JSON text
+ */
+static
+int
+e2t_event(void *closure, const rp_yaml_event_t *event)
+{
+	e2t_t *e2t = closure;
+	FILE *output = e2t->output;
+
+	if (event->type == rp_yaml_event_object_end || event->type == rp_yaml_event_array_end) {
+		putc(event->type == rp_yaml_event_object_end ? '}' : ']', output);
+		e2t->first = 0;
+		return ferror(output) ? -EIO : 0;
+	}
+	if (!e2t->first)
+		putc(',', output);
+	if (event->key != NULL) {
+		e2t_string(output, event->key, strlen(event->key));
+		putc(':', output);
+	}
+	e2t->first = 0;
+	switch (event->type) {
+	case rp_yaml_event_object_start:
+		putc('{', output);
+		e2t->first = 1;
+		break;
+	case rp_yaml_event_array_start:
+		putc('[', output);
+		e2t->first = 1;
+		break;
+	case rp_yaml_event_null:
+		fputs("null", output);
+		break;
+	case rp_yaml_event_boolean:
+		fputs(event->integer ? "true" : "false", output);
+		break;
+	case rp_yaml_event_integer:
+		fprintf(output, "%" PRId64, event->integer);
+		break;
+	case rp_yaml_event_number:
+		e2t_number(output, event->number);
+		break;
+	default:
+		e2t_string(output, event->text, event->length);
+		break;
+	}
+	return ferror(output) ? -EIO : 0;
+}
+
+int
+rp_yaml_buffer_to_json_text(FILE *output, const char *buffer, size_t size)
+{
+	e2t_t e2t = { output, 1 };
+	return rp_yaml_buffer_to_events(buffer, size, 0, e2t_event, &e2t);
+}
+
+int
+rp_yaml_file_to_json_text(FILE *output, FILE *file)
+{
+	e2t_t e2t = { output, 1 };
+	return rp_yaml_file_to_events(file, 0, e2t_event, &e2t);
+}
+
+int
+rp_yaml_path_to_json_text(FILE *output, const char *path)
+{
+	e2t_t e2t = { output, 1 };
+	return rp_yaml_path_to_events(path, 0, e2t_event, &e2t);
+}
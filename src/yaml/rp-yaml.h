@@ -29,6 +29,7 @@ extern "C" {
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <json-c/json.h>
 
@@ -72,6 +73,170 @@ extern
 int
 rp_yaml_path_to_json_c(json_object **root, const char *path, const char *name);
 
+/**
+ * Flag for requiring line numbers in events
+ */
+#define RP_YAML_LINES	1
+
+/**
+ * Maximum count of events that the streaming parsers record for anchors
+ * plus the count of events they replay for aliases. It protects against
+ * documents expanding exponentially through nested aliases
+ * ("billion laughs"). When exceeded, parsing fails with -E2BIG.
+ */
+#if !defined(RP_YAML_MAX_ALIAS_EVENTS)
+#define RP_YAML_MAX_ALIAS_EVENTS	1000000
+#endif
+
+/**
+ * Types of the events received by streaming parsers
+ */
+typedef enum rp_yaml_event_type
+{
+	/** start of an object (mapping) */
+	rp_yaml_event_object_start,
+	/** end of an object (mapping) */
+	rp_yaml_event_object_end,
+	/** start of an array (sequence) */
+	rp_yaml_event_array_start,
+	/** end of an array (sequence) */
+	rp_yaml_event_array_end,
+	/** the null value */
+	rp_yaml_event_null,
+	/** a boolean value */
+	rp_yaml_event_boolean,
+	/** an integer value */
+	rp_yaml_event_integer,
+	/** a floating number value */
+	rp_yaml_event_number,
+	/** a string value */
+	rp_yaml_event_string
+}
+	rp_yaml_event_type_t;
+
+/**
+ * Events received by streaming parsers
+ */
+typedef struct rp_yaml_event
+{
+	/** type of the event */
+	rp_yaml_event_type_t type;
+
+	/** key of the value if in an object or NULL otherwise (not for end events) */
+	const char *key;
+
+	/** text of scalar values or NULL */
+	const char *text;
+
+	/** length of the text */
+	size_t length;
+
+	/** value of integers and booleans */
+	int64_t integer;
+
+	/** value of floating numbers */
+	double number;
+
+	/** line of the event (starting at 1) if RP_YAML_LINES is set or 0 */
+	size_t line;
+}
+	rp_yaml_event_t;
+
+/**
+ * Callback receiving the events of streaming parsers
+ *
+ * @param closure the closure given to the parser
+ * @param event   the event, only valid during the call
+ *
+ * @return 0 to continue or a negative value to stop the parsing
+ */
+typedef int (*rp_yaml_event_cb_t)(void *closure, const rp_yaml_event_t *event);
+
+/**
+ * @brief parse a YAML buffer and call the callback for each event
+ * without building a json-c structure. The memory used is bounded by
+ * the depth of nesting and the size of the anchored nodes. The events
+ * recorded and replayed for anchors and aliases are limited to
+ * RP_YAML_MAX_ALIAS_EVENTS.
+ *
+ * @param buffer the buffer (UTF8)
+ * @param size the size of the buffer
+ * @param flags 0 or RP_YAML_LINES
+ * @param callback the callback receiving events
+ * @param closure the closure of the callback
+ * @return 0 on success or a negative error code
+ */
+extern
+int
+rp_yaml_buffer_to_events(const char *buffer, size_t size, unsigned flags, rp_yaml_event_cb_t callback, void *closure);
+
+/**
+ * @brief parse a YAML stream and call the callback for each event
+ * without building a json-c structure. The memory used is bounded by
+ * the depth of nesting and the size of the anchored nodes.
+ *
+ * @param file the file to parse (will not be closed)
+ * @param flags 0 or RP_YAML_LINES
+ * @param callback the callback receiving events
+ * @param closure the closure of the callback
+ * @return 0 on success or a negative error code
+ */
+extern
+int
+rp_yaml_file_to_events(FILE *file, unsigned flags, rp_yaml_event_cb_t callback, void *closure);
+
+/**
+ * @brief parse a YAML file and call the callback for each event
+ * without building a json-c structure. The memory used is bounded by
+ * the depth of nesting and the size of the anchored nodes.
+ *
+ * @param path path of the file to parse
+ * @param flags 0 or RP_YAML_LINES
+ * @param callback the callback receiving events
+ * @param closure the closure of the callback
+ * @return 0 on success or a negative error code
+ */
+extern
+int
+rp_yaml_path_to_events(const char *path, unsigned flags, rp_yaml_event_cb_t callback, void *closure);
+
+/**
+ * @brief write to output the JSON text of the YAML buffer
+ * without building a json-c structure
+ *
+ * @param output the output stream
+ * @param buffer the buffer (UTF8)
+ * @param size the size of the buffer
+ * @return 0 on success or a negative error code
+ */
+extern
+int
+rp_yaml_buffer_to_json_text(FILE *output, const char *buffer, size_t size);
+
+/**
+ * @brief write to output the JSON text of the YAML stream
+ * without building a json-c structure
+ *
+ * @param output the output stream
+ * @param file the file to parse (will not be closed)
+ * @return 0 on success or a negative error code
+ */
+extern
+int
+rp_yaml_file_to_json_text(FILE *output, FILE *file);
+
+/**
+ * @brief write to output the JSON text of the YAML file
+ * without building a json-c structure
+ *
+ * @param output the output stream
+ * @param path path of the file to parse
+ * @return 0 on success or a negative error code
+ */
+extern
+int
+rp_yaml_path_to_json_text(FILE *output, const char *path);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <rp-utils/rp-enum-map.h>
+
+/* count of searches of the benchmark */
+#define NSEARCH 1000000
+
+static int nerr;
+
+static void error(const char *what, unsigned size, const char *label, int value)
+{
+	fprintf(stderr, "error %s for map of size %u: %s %d\n", what, size, label, value);
+	nerr++;
+}
+
+/* makes a map of count items, with some duplicates, sparse if spread */
+static rp_enum_map_t *make_map(unsigned count, int spread, char ***plabels)
+{
+	rp_enum_map_t *map = malloc((count + 1) * sizeof *map);
+	char **labels = malloc((count + 1) * sizeof *labels);
+	char buffer[40];
+	unsigned i;
+	int value;
+
+	for (i = 0 ; i < count ; i++) {
+		if (i && rand() % 16 == 0)
+			/* duplicate label with other case */
+			strcpy(buffer, labels[rand() % i]);
+		else
+			sprintf(buffer, "label-%u-%x", i, rand());
+		if (rand() & 1)
+			buffer[0] = 'L';
+		labels[i] = strdup(buffer);
+		value = spread ? rand() - RAND_MAX / 2 : (int)(rand() % (count + 10)) - 5;
+		memcpy(&map[i], &(rp_enum_map_t){ labels[i], value }, sizeof *map);
+	}
+	labels[i] = NULL;
+	memcpy(&map[i], &(rp_enum_map_t){ NULL, 0 }, sizeof *map);
+	*plabels = labels;
+	return map;
+}
+
+/* checks that indexed searches give the results of linear searches */
+static void check(unsigned count, int spread)
+{
+	char **labels, buffer[40];
+	rp_enum_map_t *map = make_map(count, spread, &labels);
+	rp_enum_index_t *index;
+	const char *l1, *l2;
+	unsigned i;
+	int rc, v1, v2, value;
+
+	rc = rp_enum_index_create(map, &index);
+	if (rc < 0) {
+		error("creation", count, "", rc);
+		return;
+	}
+	for (i = 0 ; i <= count + 100 ; i++) {
+		if (i < count)
+			strcpy(buffer, labels[i]);
+		else
+			sprintf(buffer, "label-%u-%x", i, rand());
+		buffer[0] ^= 'l' ^ 'L';
+		v1 = rp_enum_map_value_def(map, buffer, -12345);
+		v2 = rp_enum_index_value_def(index, buffer, -12345);
+		if (v1 != v2)
+			error("value", count, buffer, v2);
+
+		value = i < count ? map[i].value : rand() - RAND_MAX / 2;
+		l1 = rp_enum_map_label_def(map, value, NULL);
+		l2 = rp_enum_index_label_def(index, value, NULL);
+		if (l1 != l2)
+			error("label", count, "", value);
+	}
+	rp_enum_index_destroy(index);
+	for (i = 0 ; i < count ; i++)
+		free(labels[i]);
+	free(labels);
+	free(map);
+}
+
+/* compares speed of linear and indexed search */
+static void bench(unsigned count)
+{
+	char **labels;
+	rp_enum_map_t *map = make_map(count, 0, &labels);
+	const rp_enum_index_t *index;
+	clock_t t0, t1, t2;
+	unsigned i;
+	long sum1 = 0, sum2 = 0;
+
+	if (rp_enum_map_index(map, &index) < 0) {
+		error("lazy creation", count, "", 0);
+		return;
+	}
+	t0 = clock();
+	for (i = 0 ; i < NSEARCH ; i++)
+		sum1 += rp_enum_map_value_def(map, labels[i % count], 0);
+	t1 = clock();
+	for (i = 0 ; i < NSEARCH ; i++)
+		sum2 += rp_enum_index_value_def(index, labels[i % count], 0);
+	t2 = clock();
+	if (sum1 != sum2)
+		error("sums", count, "", 0);
+	printf("%5u items: linear %7.1f ns, indexed %5.1f ns\n", count,
+		(double)(t1 - t0) * 1e9 / CLOCKS_PER_SEC / NSEARCH,
+		(double)(t2 - t1) * 1e9 / CLOCKS_PER_SEC / NSEARCH);
+	rp_enum_map_unindex(map);
+	for (i = 0 ; i < count ; i++)
+		free(labels[i]);
+	free(labels);
+	free(map);
+}
+
+int main(int ac, char **av)
+{
+	unsigned count;
+
+	srand(1);
+	for (count = 0 ; count < 300 ; count++) {
+		check(count, 0);
+		check(count, 1);
+	}
+	check(5000, 0);
+	check(5000, 1);
+	for (count = 4 ; count <= 256 ; count <<= 2)
+		bench(count);
+	if (nerr)
+		fprintf(stderr, "%d errors\n", nerr);
+	return !!nerr;
+}
@@ -104,6 +104,110 @@ END_TEST
 
 /*********************************************************************/
 
+char minput[] = "{ \"a\": [ \"$valitem\", \"$valref\" ], \"b\": { \"c\": \"$toto\" }, \"d\": \"$valitem\", \"e\": 5 }";
+char moutput[] = "{ \"a\": [ \"HELLO\", \"toto\" ], \"b\": { \"c\": \"item\" }, \"d\": \"HELLO\", \"e\": 5 }";
+
+struct json_object *expstr_mt(void *closure, struct json_object* object, rp_jsonc_expand_path_t path)
+{
+	char *trf;
+
+	trf = rp_expand_vars_only(json_object_get_string(object), 0, closure);
+	if (trf) {
+		object = json_object_new_string(trf);
+		free(trf);
+	}
+	return object;
+}
+
+START_TEST (check_expand_mt)
+{
+	struct json_object *in = json_tokener_parse(minput);
+	struct json_object *out = json_tokener_parse(moutput);
+	struct json_object *res;
+
+	res = rp_jsonc_expand_mt(in, vars, NULL, expstr_mt, 3);
+	printf("got %s\n", json_object_get_string(res));
+	ck_assert_int_eq(0, rp_jsonc_cmp(res, out));
+
+	if (res != in)
+		json_object_put(res);
+	json_object_put(out);
+	json_object_put(in);
+}
+END_TEST
+
+/*********************************************************************/
+
+char *tvars[] = { "valref=toto", "valitem=HELLO", "toto=item", NULL };
+
+int getvar_track(void *closure, const char *name, size_t len, rp_expand_vars_result_t *result)
+{
+	rp_jsonc_expand_path_depends(closure, name, len);
+	result->value = rp_expand_vars_search(tvars, name, len);
+	return result->value != NULL;
+}
+
+struct json_object *expstr_track(void *closure, struct json_object* object, rp_jsonc_expand_path_t path)
+{
+	char *trf;
+
+	ck_assert_ptr_eq(closure, input);
+	trf = rp_expand_vars_function(json_object_get_string(object), 0, getvar_track, path);
+	if (trf) {
+		object = json_object_new_string(trf);
+		free(trf);
+	}
+	return object;
+}
+
+START_TEST (check_expand_track)
+{
+	struct json_object *in = json_tokener_parse(minput);
+	struct json_object *out = json_tokener_parse(moutput);
+	struct json_object *res;
+	rp_jsonc_expand_track_t track;
+	int rc;
+
+	res = rp_jsonc_expand_track(in, input, NULL, expstr_track, 1, &track);
+	ck_assert_ptr_nonnull(track);
+	ck_assert_int_eq(0, rp_jsonc_cmp(res, out));
+
+	/* change of valitem only updates 2 strings */
+	tvars[1] = "valitem=WORLD";
+	rc = rp_jsonc_expand_track_update(track, "valitem");
+	ck_assert_int_eq(rc, 2);
+	json_object_put(out);
+	out = json_tokener_parse("{ \"a\": [ \"WORLD\", \"toto\" ], \"b\": { \"c\": \"item\" }, \"d\": \"WORLD\", \"e\": 5 }");
+	printf("got %s\n", json_object_get_string(res));
+	ck_assert_int_eq(0, rp_jsonc_cmp(res, out));
+
+	/* change of unknown name does nothing */
+	rc = rp_jsonc_expand_track_update(track, "unknown");
+	ck_assert_int_eq(rc, 0);
+
+	/* change of toto updates 1 string */
+	tvars[2] = "toto=$valitem";
+	rc = rp_jsonc_expand_track_update(track, "toto");
+	ck_assert_int_eq(rc, 1);
+	json_object_put(out);
+	out = json_tokener_parse("{ \"a\": [ \"WORLD\", \"toto\" ], \"b\": { \"c\": \"WORLD\" }, \"d\": \"WORLD\", \"e\": 5 }");
+	printf("got %s\n", json_object_get_string(res));
+	ck_assert_int_eq(0, rp_jsonc_cmp(res, out));
+
+	/* the new dependency is recorded */
+	rc = rp_jsonc_expand_track_update(track, "valitem");
+	ck_assert_int_eq(rc, 3);
+
+	rp_jsonc_expand_track_destroy(track);
+	if (res != in)
+		json_object_put(res);
+	json_object_put(out);
+	json_object_put(in);
+}
+END_TEST
+
+/*********************************************************************/
+
 static Suite *suite;
 static TCase *tcase;
 
@@ -125,5 +229,7 @@ int main(int ac, char **av)
 	mksuite("expand-json");
 		addtcase("expand-json");
 			addtest(check_expand);
+			addtest(check_expand_mt);
+			addtest(check_expand_track);
 	return !!srun();
 }
@@ -119,6 +119,107 @@ END_TEST
 
 /*********************************************************************/
 
+void md(rp_expand_vars_dict_t *dict, const char *in, const char *out)
+{
+	char *r = rp_expand_vars_dict(in, 1, dict);
+	printf("md got %s\n", r);
+	ck_assert_ptr_nonnull(r);
+	ck_assert_str_eq(r, out);
+	free(r);
+}
+
+START_TEST (check_dict)
+{
+	char *x_before[] = { "X=before", "B=before", "B=twice", 0 };
+	char *x_after[] = { "X=after", "A=after", "Z=last", 0 };
+	rp_expand_vars_dict_t *dict, *snap;
+
+	putenv("X=env");
+	putenv("A=env");
+	putenv("B=env");
+	unsetenv("Z");
+	unsetenv("NEW");
+
+	ck_assert_int_eq(0, rp_expand_vars_dict_create_env(&dict, x_before, x_after, 0));
+	ck_assert_int_eq(0, rp_expand_vars_dict_create_env(&snap, x_before, x_after, RP_EXPAND_VARS_DICT_SNAPSHOT));
+	md(dict, "$A $B $X $Z", "env before before last");
+	md(snap, "$A $B $X $Z", "env before before last");
+	ck_assert_str_eq(rp_expand_vars_dict_search(dict, "Zorro", 1), "last");
+	ck_assert_ptr_null(rp_expand_vars_dict_search(dict, "NEW", 3));
+
+	// snapshot is kept until refresh
+	setenv("A", "changed", 1);
+	setenv("NEW", "new", 1);
+	md(snap, "$A$NEW", "env");
+	ck_assert_int_eq(0, rp_expand_vars_dict_refresh(dict));
+	ck_assert_int_eq(0, rp_expand_vars_dict_refresh(snap));
+	md(dict, "$A$NEW", "changednew");
+	md(snap, "$A$NEW", "changednew");
+
+	rp_expand_vars_dict_destroy(dict);
+	rp_expand_vars_dict_destroy(snap);
+}
+END_TEST
+
+/*********************************************************************/
+
+int calls[128];
+
+const char *lookup(void *closure, const char *name, size_t len)
+{
+	static const char *defs[] = {
+		"A=a", "D=$A$A", "E=x\\$A", "R=$(D)-${N:-$A}", 0
+	};
+	const char *value = rp_expand_vars_search((char**)defs, name, len);
+	calls[(unsigned char)name[0] & 127]++;
+	return value;
+}
+
+void mf(const char *in, const char *out)
+{
+	char *r;
+
+	memset(calls, 0, sizeof calls);
+	r = rp_expand_vars_callback(in, 1, lookup, NULL);
+	printf("mf got %s\n", r);
+	ck_assert_ptr_nonnull(r);
+	ck_assert_str_eq(r, out);
+	free(r);
+}
+
+START_TEST (check_function)
+{
+	// defaults with nested brackets
+	mf("${N:-${A}}", "a");
+	mf("${N:-x${A}y}/${A:-z}", "xay/a");
+	mf("${N:-${N:-${A}}}", "a");
+	mf("${N:-{}}", "{}");
+
+	// escaped dollars of values aren't expanded again
+	mf("$E", "x$A");
+	ck_assert_int_eq(calls['A'], 0);
+	mf("$E$E", "x$Ax$A");
+	ck_assert_int_eq(calls['A'], 0);
+	mf("\\$A", "\\$A");
+	ck_assert_int_eq(calls['A'], 0);
+
+	// the function is called once per name
+	mf("$A$A${A}$(A)", "aaaa");
+	ck_assert_int_eq(calls['A'], 1);
+	mf("$D$D$N$N${N:-$A}", "aaaaa");
+	ck_assert_int_eq(calls['A'], 1);
+	ck_assert_int_eq(calls['D'], 1);
+	ck_assert_int_eq(calls['N'], 1);
+	mf("$R:$R:$D", "aa-a:aa-a:aa");
+	ck_assert_int_eq(calls['A'], 1);
+	ck_assert_int_eq(calls['D'], 1);
+	ck_assert_int_eq(calls['N'], 1);
+	ck_assert_int_eq(calls['R'], 1);
+}
+END_TEST
+
+/*********************************************************************/
+
 static Suite *suite;
 static TCase *tcase;
 
@@ -141,5 +242,7 @@ int main(int ac, char **av)
 		addtcase("expand-vars");
 			addtest(check_expand);
 			addtest(check_order);
+			addtest(check_dict);
+			addtest(check_function);
 	return !!srun();
 }
@@ -0,0 +1,344 @@
+/*
+ Copyright (C) 2015-2026 IoT.bzh Company
+
+ Author: José Bollo <jose.bollo@iot.bzh>
+
+ $RP_BEGIN_LICENSE$
+ Commercial License Usage
+  Licensees holding valid commercial IoT.bzh licenses may use this file in
+  accordance with the commercial license agreement provided with the
+  Software or, alternatively, in accordance with the terms contained in
+  a written agreement between you and The IoT.bzh Company. For licensing terms
+  and conditions see https://www.iot.bzh/terms-conditions. For further
+  information use the contact form at https://www.iot.bzh/contact.
+
+ GNU General Public License Usage
+  Alternatively, this file may be used under the terms of the GNU General
+  Public license version 3. This license is as published by the Free Software
+  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+  of this file. Please review the following information to ensure the GNU
+  General Public License requirements will be met
+  https://www.gnu.org/licenses/gpl-3.0.html.
+ $RP_END_LICENSE$
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <check.h>
+
+#include <rp-utils/rp-file.h>
+
+/*********************************************************************/
+
+char dirname[32];
+int dfd;
+
+void setup()
+{
+	strcpy(dirname, "/tmp/test-file-XXXXXX");
+	ck_assert_ptr_ne(mkdtemp(dirname), NULL);
+	dfd = open(dirname, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	ck_assert_int_ge(dfd, 0);
+}
+
+/* removes the entries of the directory 'fd' and the directory itself */
+void removeall(int fd, const char *path)
+{
+	DIR *dir;
+	struct dirent *ent;
+	int sub;
+
+	dir = fdopendir(fd);
+	ck_assert_ptr_ne(dir, NULL);
+	rewinddir(dir);
+	while ((ent = readdir(dir)) != NULL) {
+		if (strcmp(ent->d_name, ".") && strcmp(ent->d_name, "..")) {
+			if (unlinkat(fd, ent->d_name, 0) < 0) {
+				sub = openat(fd, ent->d_name, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+				ck_assert_int_ge(sub, 0);
+				removeall(sub, NULL);
+				ck_assert_int_eq(0, unlinkat(fd, ent->d_name, AT_REMOVEDIR));
+			}
+		}
+	}
+	closedir(dir);
+	if (path != NULL)
+		ck_assert_int_eq(0, rmdir(path));
+}
+
+void teardown()
+{
+	removeall(dfd, dirname);
+}
+
+/* counts the temporary files of the directory */
+int count_tmp()
+{
+	DIR *dir;
+	struct dirent *ent;
+	size_t len;
+	int fd, count;
+
+	fd = dup(dfd);
+	ck_assert_int_ge(fd, 0);
+	dir = fdopendir(fd);
+	ck_assert_ptr_ne(dir, NULL);
+	rewinddir(dir);
+	count = 0;
+	while ((ent = readdir(dir)) != NULL) {
+		len = strlen(ent->d_name);
+		if (len > 4 && !strcmp(&ent->d_name[len - 4], ".tmp"))
+			count++;
+	}
+	closedir(dir);
+	return count;
+}
+
+/* checks that 'file' contains 'expected' */
+void check_content(const char *file, const char *expected)
+{
+	char *content;
+	size_t size;
+	int rc;
+
+	rc = rp_file_get_at(dfd, file, &content, &size);
+	ck_assert_int_eq(rc, 0);
+	printf("%s: %s\n", file, content);
+	ck_assert_uint_eq(size, strlen(expected));
+	ck_assert_str_eq(content, expected);
+	free(content);
+}
+
+/*********************************************************************/
+
+START_TEST (check_put)
+{
+	struct stat st;
+	unsigned flags;
+	int rc;
+
+	fprintf(stdout, "\n************************************ CHECK PUT\n\n");
+
+	setup();
+	for (flags = 0 ; flags <= (RP_FILE_PUT_ATOMIC|RP_FILE_PUT_SYNC) ; flags++) {
+		/* create */
+		rc = rp_file_put_flags_at(dfd, "file", "hello", (size_t)-1, flags);
+		ck_assert_int_eq(rc, 0);
+		check_content("file", "hello");
+
+		/* replace, keeping the mode */
+		ck_assert_int_eq(0, fchmodat(dfd, "file", 0604, 0));
+		rc = rp_file_put_flags_at(dfd, "file", "bye", 3, flags);
+		ck_assert_int_eq(rc, 0);
+		check_content("file", "bye");
+		ck_assert_int_eq(0, fstatat(dfd, "file", &st, 0));
+		ck_assert_int_eq(st.st_mode & 0777, 0604);
+		ck_assert_int_eq(0, unlinkat(dfd, "file", 0));
+		ck_assert_int_eq(0, count_tmp());
+	}
+
+	/* failing replacement leaves no temporary file */
+	ck_assert_int_eq(0, mkdirat(dfd, "dir", 0755));
+	ck_assert_int_eq(0, rp_file_put_at(dfd, "dir/file", "x", 1));
+	rc = rp_file_put_flags_at(dfd, "dir", "x", 1, RP_FILE_PUT_ATOMIC);
+	ck_assert_int_lt(rc, 0);
+	ck_assert_int_eq(0, count_tmp());
+	rc = rp_file_put_flags_at(dfd, "none/file", "x", 1, RP_FILE_PUT_ATOMIC);
+	ck_assert_int_eq(rc, -ENOENT);
+	ck_assert_int_eq(0, count_tmp());
+	teardown();
+}
+END_TEST
+
+START_TEST (check_batch)
+{
+	rp_file_batch_t *batch;
+	struct stat st;
+	int rc;
+
+	fprintf(stdout, "\n************************************ CHECK BATCH\n\n");
+
+	setup();
+	ck_assert_int_eq(0, rp_file_put_at(dfd, "a", "old", 3));
+	ck_assert_int_eq(0, fchmodat(dfd, "a", 0600, 0));
+
+	/* commit */
+	rc = rp_file_batch_create(&batch, dfd, NULL, RP_FILE_PUT_SYNC);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(-EINVAL, rp_file_batch_put(batch, "x/y", "", 0));
+	ck_assert_int_eq(0, rp_file_batch_put(batch, "a", "new a", (size_t)-1));
+	ck_assert_int_eq(0, rp_file_batch_put(batch, "b", "new b", (size_t)-1));
+	check_content("a", "old");
+	ck_assert_int_eq(-1, faccessat(dfd, "b", F_OK, 0));
+	ck_assert_int_eq(2, count_tmp());
+	rc = rp_file_batch_commit(batch);
+	ck_assert_int_eq(rc, 0);
+	rp_file_batch_destroy(batch);
+	check_content("a", "new a");
+	check_content("b", "new b");
+	ck_assert_int_eq(0, fstatat(dfd, "a", &st, 0));
+	ck_assert_int_eq(st.st_mode & 0777, 0600);
+	ck_assert_int_eq(0, count_tmp());
+
+	/* destroy without commit */
+	rc = rp_file_batch_create(&batch, dfd, NULL, 0);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(0, rp_file_batch_put(batch, "a", "lost", (size_t)-1));
+	ck_assert_int_eq(0, rp_file_batch_put(batch, "c", "lost", (size_t)-1));
+	rp_file_batch_destroy(batch);
+	check_content("a", "new a");
+	ck_assert_int_eq(-1, faccessat(dfd, "c", F_OK, 0));
+	ck_assert_int_eq(0, count_tmp());
+
+	/* failing commit leaves no temporary file */
+	ck_assert_int_eq(0, mkdirat(dfd, "d", 0755));
+	ck_assert_int_eq(0, rp_file_put_at(dfd, "d/file", "x", 1));
+	rc = rp_file_batch_create(&batch, dfd, NULL, 0);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(0, rp_file_batch_put(batch, "d", "x", 1));
+	ck_assert_int_eq(0, rp_file_batch_put(batch, "e", "x", 1));
+	rc = rp_file_batch_commit(batch);
+	ck_assert_int_lt(rc, 0);
+	rp_file_batch_destroy(batch);
+	ck_assert_int_eq(0, count_tmp());
+	teardown();
+}
+END_TEST
+
+/*********************************************************************/
+
+START_TEST (check_map)
+{
+	rp_file_map_t map;
+	int rc;
+
+	fprintf(stdout, "\n************************************ CHECK MAP\n\n");
+
+	setup();
+
+	/* empty file */
+	ck_assert_int_eq(0, rp_file_put_at(dfd, "empty", "", 0));
+	rc = rp_file_map_at(dfd, "empty", &map, RP_FILE_MAP_POPULATE);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_uint_eq(map.size, 0);
+	ck_assert_ptr_ne(map.data, NULL);
+	rp_file_map_release(&map);
+
+	/* regular file */
+	ck_assert_int_eq(0, rp_file_put_at(dfd, "file", "0123456789", (size_t)-1));
+	rc = rp_file_map_at(dfd, "file", &map, RP_FILE_MAP_SEQUENTIAL|RP_FILE_MAP_WILLNEED);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_uint_eq(map.size, 10);
+	ck_assert_int_eq(0, memcmp(map.data, "0123456789", 10));
+	rp_file_map_release(&map);
+	ck_assert_uint_eq(map.size, 0);
+
+	/* errors */
+	ck_assert_int_eq(-ENOENT, rp_file_map_at(dfd, "none", &map, 0));
+	ck_assert_int_eq(-EBADF, rp_file_map_at(dfd, ".", &map, 0));
+	teardown();
+}
+END_TEST
+
+struct blocks {
+	char data[100];
+	size_t size;
+	int count;
+	int stop;
+};
+
+int blockcb(void *closure, const char *data, size_t size)
+{
+	struct blocks *b = closure;
+
+	printf("block %d: %.*s\n", b->count, (int)size, data);
+	ck_assert_uint_le(b->size + size, sizeof b->data);
+	memcpy(&b->data[b->size], data, size);
+	b->size += size;
+	return ++b->count == b->stop ? 55 : 0;
+}
+
+START_TEST (check_blocks)
+{
+	struct blocks b;
+	int rc;
+
+	fprintf(stdout, "\n************************************ CHECK BLOCKS\n\n");
+
+	setup();
+	ck_assert_int_eq(0, rp_file_put_at(dfd, "file", "0123456789", (size_t)-1));
+
+	/* block size not dividing the size */
+	memset(&b, 0, sizeof b);
+	rc = rp_file_read_blocks_at(dfd, "file", 4, blockcb, &b);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(b.count, 3);
+	ck_assert_uint_eq(b.size, 10);
+	ck_assert_int_eq(0, memcmp(b.data, "0123456789", 10));
+
+	/* block size dividing the size */
+	memset(&b, 0, sizeof b);
+	rc = rp_file_read_blocks_at(dfd, "file", 5, blockcb, &b);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(b.count, 2);
+	ck_assert_uint_eq(b.size, 10);
+
+	/* default block size */
+	memset(&b, 0, sizeof b);
+	rc = rp_file_read_blocks_at(dfd, "file", 0, blockcb, &b);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(b.count, 1);
+	ck_assert_uint_eq(b.size, 10);
+
+	/* stopped by the callback */
+	memset(&b, 0, sizeof b);
+	b.stop = 2;
+	rc = rp_file_read_blocks_at(dfd, "file", 3, blockcb, &b);
+	ck_assert_int_eq(rc, 55);
+	ck_assert_uint_eq(b.size, 6);
+
+	/* empty file */
+	ck_assert_int_eq(0, rp_file_put_at(dfd, "empty", "", 0));
+	memset(&b, 0, sizeof b);
+	rc = rp_file_read_blocks_at(dfd, "empty", 4, blockcb, &b);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(b.count, 0);
+	teardown();
+}
+END_TEST
+
+/*********************************************************************/
+
+static Suite *suite;
+static TCase *tcase;
+
+void mksuite(const char *name) { suite = suite_create(name); }
+void addtcase(const char *name) { tcase = tcase_create(name); suite_add_tcase(suite, tcase); }
+#define addtest(test) tcase_add_test(tcase, test)
+int srun()
+{
+	int nerr;
+	SRunner *srunner = srunner_create(suite);
+	srunner_run_all(srunner, CK_NORMAL);
+	nerr = srunner_ntests_failed(srunner);
+	srunner_free(srunner);
+	return nerr;
+}
+
+int main(int ac, char **av)
+{
+	mksuite("file");
+		addtcase("file");
+			addtest(check_put);
+			addtest(check_batch);
+			addtest(check_map);
+			addtest(check_blocks);
+	return !!srun();
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "utils/globmatch.h"
+
+/* the previous recursive implementation of globmatch used as reference */
+#define TOLOWER(ch)        (tolower((int)(unsigned char)(ch)))
+#define EQ(flags,cha,chb)  ((flags & FNM_CASEFOLD) ? \
+				(TOLOWER(cha) == TOLOWER(chb)) : (cha == chb))
+
+static unsigned ref_match(const char *pat, const char *str, int flags)
+{
+	unsigned r, rs, rr;
+	char c, x;
+
+	r = 1;
+	while ((c = *pat++) != GLOB) {
+		x = *str++;
+		if (!EQ(flags,c,x))
+			return 0;
+		if (!c)
+			return r;
+		r++;
+	}
+	c = *pat++;
+	if (!c) {
+		if (flags & FNM_PATHNAME) {
+			while(*str)
+				if (*str++ == '/')
+					return 0;
+		}
+		return r;
+	}
+	rs = 0;
+	while (*str) {
+		x = *str++;
+		if (EQ(flags,c,x)) {
+			rr = ref_match(pat, str, flags);
+			if (rr > rs)
+				rs = rr;
+		} else if ((flags & FNM_PATHNAME) && x == '/')
+			return 0;
+	}
+	return rs ? rs + r : 0;
+}
+
+/* reference of fnmatch with FNM_PATHNAME, pat starts with a literal if lit */
+static int ref_path(const char *pat, const char *str, int flags, int lit)
+{
+	if (*pat == GLOB && !lit) {
+		for (;;) {
+			if (ref_path(pat + 1, str, flags, 1))
+				return 1;
+			if (!*str || *str == '/')
+				return 0;
+			str++;
+		}
+	}
+	if (!*pat)
+		return !*str;
+	return *str && EQ(flags, *pat, *str) && ref_path(pat + 1, str + 1, flags, 0);
+}
+
+/* makes a random string of the alphabet */
+static void randstr(char *buffer, int maxlen, const char *alphabet)
+{
+	int i, len = rand() % (maxlen + 1), n = (int)strlen(alphabet);
+	for (i = 0 ; i < len ; i++)
+		buffer[i] = alphabet[rand() % n];
+	buffer[len] = 0;
+}
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(int ac, char **av)
+{
+	char pat[20], str[20], big[200];
+	unsigned r, g, i, n;
+	int nerr = 0, flags;
+	double t0;
+
+	srand(ac > 1 ? (unsigned)atoi(av[1]) : 1);
+	for (n = 0 ; n < 1000000 ; n++) {
+		randstr(pat, 10, "ab*/Aa**");
+		randstr(str, 12, "ab/AB*");
+
+		r = ref_match(pat, str, 0);
+		g = globmatch(pat, str);
+		if (r != g) {
+			fprintf(stderr, "globmatch(%s, %s): %u expected %u\n", pat, str, g, r);
+			nerr++;
+		}
+
+		r = ref_match(pat, str, FNM_CASEFOLD);
+		g = globmatchi(pat, str);
+		if (r != g) {
+			fprintf(stderr, "globmatchi(%s, %s): %u expected %u\n", pat, str, g, r);
+			nerr++;
+		}
+
+#if !WITH_FNMATCH
+		for (flags = FNM_PATHNAME ; flags <= (FNM_PATHNAME|FNM_CASEFOLD) ; flags += FNM_CASEFOLD) {
+			r = !ref_path(pat, str, flags, 0);
+			g = (unsigned)fnmatch(pat, str, flags);
+			if (r != g) {
+				fprintf(stderr, "fnmatch(%s, %s, %d): %u expected %u\n", pat, str, flags, g, r);
+				nerr++;
+			}
+		}
+#endif
+		if (nerr > 20)
+			break;
+	}
+
+	/* pathological pattern, exponential with the reference */
+	memset(big, 'a', sizeof big - 1);
+	big[sizeof big - 1] = 0;
+	t0 = now();
+	for (i = 0 ; i < 100 ; i++)
+		if (globmatch("*a*a*a*a*a*a*a*a*a*a*b", big) || !globmatch("*a*a*a*a*a*a*a*a*a*a*", big))
+			nerr++;
+	printf("pathological: %.3f us/match\n", (now() - t0) * 1e6 / i);
+
+	printf("%u fuzzed, %d errors\n", n, nerr);
+	return !!nerr;
+}
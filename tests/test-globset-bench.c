@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "utils/globset.h"
+#include "utils/globmatch.h"
+
+/* count of texts matched per round */
+#define NTEXTS	2000
+
+/* count of texts checked against the scan */
+#define NCHECKS(count)	((count) <= 1000 ? NTEXTS : 100)
+
+static const char *words[] = {
+	"signal", "engine", "speed", "door", "front", "left", "right", "rear",
+	"hvac", "temp", "low-can", "gps", "position", "audio", "volume", "event"
+};
+#define NWORDS	(sizeof words / sizeof *words)
+
+/* makes the pattern or text of number n */
+static void make(char *buffer, unsigned long n, int glob)
+{
+	const char *w1 = words[n % NWORDS], *w2 = words[(n / NWORDS) % NWORDS];
+	unsigned long id = n / (NWORDS * NWORDS);
+
+	switch (glob ? n % 5 : 4) {
+	case 0: sprintf(buffer, "%s/%s/%lu/*", w1, w2, id); break;
+	case 1: sprintf(buffer, "*/%s/%lu/%s", w2, id, w1); break;
+	case 2: sprintf(buffer, "%s/*/%lu/*", w1, id); break;
+	case 3: sprintf(buffer, "%s*%lu", w2, id); break;
+	default: sprintf(buffer, "%s/%s/%lu/%s", w1, w2, id, w1); break;
+	}
+}
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* matches as globset did before compiling its automaton */
+static const char *scan(char **patterns, unsigned long count, const char *text)
+{
+	unsigned long i;
+	unsigned g, s = 0;
+	const char *r = NULL;
+
+	for (i = 0 ; i < count ; i++) {
+		g = globmatch(patterns[i], text);
+		if (g > s) {
+			s = g;
+			r = patterns[i];
+		}
+	}
+	return r;
+}
+
+/* counts the matches of match_all */
+static void count_cb(void *closure, const struct globset_handler *handler)
+{
+	(*(unsigned*)closure)++;
+}
+
+/* counts the matches of match_all_batch */
+static void count_batch_cb(void *closure, unsigned index, const struct globset_handler *handler)
+{
+	((unsigned*)closure)[index]++;
+}
+
+/* checks the multiple and batched matching */
+static int check_all(struct globset *set, char **patterns, unsigned long ng, char **texts)
+{
+	const struct globset_handler *results[NTEXTS];
+	unsigned counts[NTEXTS], n, ref;
+	unsigned long i, j;
+	int nerr = 0;
+
+	globset_match_batch(set, (const char * const *)texts, NTEXTS, results);
+	memset(counts, 0, sizeof counts);
+	globset_match_all_batch(set, (const char * const *)texts, NTEXTS, count_batch_cb, counts);
+	for (i = 0 ; i < NCHECKS(ng) ; i++) {
+		if (results[i] != globset_match(set, texts[i])) {
+			fprintf(stderr, "batch mismatch for %s\n", texts[i]);
+			nerr++;
+		}
+		n = 0;
+		globset_match_all(set, texts[i], count_cb, &n);
+		ref = globset_search(set, texts[i]) != NULL;
+		for (j = 0 ; j < ng ; j++)
+			ref += globmatch(patterns[j], texts[i]) != 0;
+		if (n != ref || counts[i] != ref) {
+			fprintf(stderr, "match all mismatch for %s: %u %u %u\n", texts[i], n, counts[i], ref);
+			nerr++;
+		}
+	}
+	return nerr;
+}
+
+static int bench(unsigned long count)
+{
+	struct globset *set;
+	const struct globset_handler *gh;
+	char buffer[100], **patterns, **texts;
+	const char *ref;
+	unsigned long i, ng;
+	const struct globset_handler *results[NTEXTS];
+	double t0, tset, tbatch, tscan;
+	int nerr = 0, rc;
+
+	/* create the set */
+	set = globset_create();
+	patterns = calloc(count, sizeof *patterns);
+	texts = calloc(NTEXTS, sizeof *texts);
+	for (i = ng = 0 ; i < count ; i++) {
+		make(buffer, i * 7919, 1);
+		rc = globset_add(set, buffer, NULL, NULL);
+		if (rc == 0 && strchr(buffer, GLOB))
+			patterns[ng++] = strdup(buffer);
+	}
+	for (i = 0 ; i < NTEXTS ; i++) {
+		make(buffer, (i * 104729) % (2 * count + 1), 0);
+		texts[i] = strdup(buffer);
+	}
+
+	/* check same results */
+	for (i = 0 ; i < NCHECKS(count) ; i++) {
+		gh = globset_match(set, texts[i]);
+		ref = scan(patterns, ng, texts[i]);
+		if (gh && !globset_search(set, texts[i]) && (!ref || strcmp(ref, gh->pattern))) {
+			fprintf(stderr, "mismatch for %s: %s vs %s\n", texts[i], gh->pattern, ref);
+			nerr++;
+		}
+		if (!gh && ref) {
+			fprintf(stderr, "mismatch for %s: none vs %s\n", texts[i], ref);
+			nerr++;
+		}
+	}
+
+	nerr += check_all(set, patterns, ng, texts);
+
+	/* measure */
+	t0 = now();
+	for (i = 0 ; i < NTEXTS ; i++)
+		globset_match(set, texts[i]);
+	tset = now() - t0;
+	t0 = now();
+	globset_match_batch(set, (const char * const *)texts, NTEXTS, results);
+	tbatch = now() - t0;
+	t0 = now();
+	for (i = 0 ; i < NCHECKS(count) ; i++)
+		scan(patterns, ng, texts[i]);
+	tscan = (now() - t0) / (double)i * NTEXTS;
+	printf("%8lu patterns: automaton %8.3f us/match, batch %8.3f us/match, scan %10.3f us/match\n",
+		count, tset * 1e6 / NTEXTS, tbatch * 1e6 / NTEXTS, tscan * 1e6 / NTEXTS);
+
+	/* delete half of the patterns and check again */
+	for (i = 0 ; i < count ; i += 2) {
+		make(buffer, i * 7919, 1);
+		globset_del(set, buffer, NULL);
+	}
+	while (ng)
+		free(patterns[--ng]);
+	for (i = 0 ; i < count ; i++) {
+		make(buffer, i * 7919, 1);
+		if ((i & 1) && strchr(buffer, GLOB))
+			patterns[ng++] = strdup(buffer);
+	}
+	for (i = 0 ; i < NCHECKS(count) ; i++) {
+		gh = globset_match(set, texts[i]);
+		ref = scan(patterns, ng, texts[i]);
+		if (gh ? !globset_search(set, texts[i]) && (!ref || strcmp(ref, gh->pattern)) : ref != NULL) {
+			fprintf(stderr, "mismatch after deletion for %s\n", texts[i]);
+			nerr++;
+		}
+	}
+
+	nerr += check_all(set, patterns, ng, texts);
+
+	globset_destroy(set);
+	while (ng)
+		free(patterns[--ng]);
+	for (i = 0 ; i < NTEXTS ; i++)
+		free(texts[i]);
+	free(patterns);
+	free(texts);
+	return nerr;
+}
+
+/* adds and deletes patterns while others are matching */
+static void *writer(void *arg)
+{
+	struct globset *set = arg;
+	char buffer[100];
+	unsigned long i;
+
+	for (i = 0 ; i < 20000 ; i++) {
+		make(buffer, i % 1000, 1);
+		if (globset_add(set, buffer, NULL, NULL))
+			globset_del(set, buffer, NULL);
+	}
+	return NULL;
+}
+
+/* checks that matching and modifying concurrently is safe */
+static int concurrent()
+{
+	struct globset *set;
+	pthread_t tid;
+	char buffer[100];
+	unsigned long i;
+	unsigned n;
+	int nerr = 0;
+
+	set = globset_create();
+	globset_add(set, "signal/*", NULL, NULL);
+	pthread_create(&tid, NULL, writer, set);
+	for (i = 0 ; i < 20000 ; i++) {
+		make(buffer, i % 1000, 0);
+		if (globset_match(set, "signal/x") == NULL)
+			nerr++;
+		n = 0;
+		globset_match_all(set, buffer, count_cb, &n);
+	}
+	pthread_join(tid, NULL);
+	globset_destroy(set);
+	if (nerr)
+		fprintf(stderr, "concurrent errors: %d\n", nerr);
+	return nerr;
+}
+
+int main(int ac, char **av)
+{
+	int nerr = 0;
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	nerr += bench(10);
+	nerr += bench(1000);
+	nerr += bench(100000);
+	nerr += concurrent();
+	return !!nerr;
+}
@@ -0,0 +1,239 @@
+/*
+ Copyright (C) 2015-2026 IoT.bzh Company
+
+ Author: José Bollo <jose.bollo@iot.bzh>
+
+ $RP_BEGIN_LICENSE$
+ Commercial License Usage
+  Licensees holding valid commercial IoT.bzh licenses may use this file in
+  accordance with the commercial license agreement provided with the
+  Software or, alternatively, in accordance with the terms contained in
+  a written agreement between you and The IoT.bzh Company. For licensing terms
+  and conditions see https://www.iot.bzh/terms-conditions. For further
+  information use the contact form at https://www.iot.bzh/contact.
+
+ GNU General Public License Usage
+  Alternatively, this file may be used under the terms of the GNU General
+  Public license version 3. This license is as published by the Free Software
+  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+  of this file. Please review the following information to ensure the GNU
+  General Public License requirements will be met
+  https://www.gnu.org/licenses/gpl-3.0.html.
+ $RP_END_LICENSE$
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <check.h>
+#if !defined(ck_assert_ptr_null)
+# define ck_assert_ptr_null(X)      ck_assert_ptr_eq(X, NULL)
+# define ck_assert_ptr_nonnull(X)   ck_assert_ptr_ne(X, NULL)
+#endif
+
+/*********************************************************************/
+
+#include <rp-utils/rp-jsonc-cache.h>
+#include <rp-utils/rp-jsonc.h>
+
+/*********************************************************************/
+
+char input[] =
+	"{"
+	  "\"name\": \"cache\","
+	  "\"list\": [ 1, -2, 3.5, true, false, null, \"x\", { \"in\": [ 7 ] } ],"
+	  "\"a/b\": { \"m~n\": 42 },"
+	  "\"nil\": null"
+	"}";
+
+char dirname[40];
+char path[100];
+char cachedir[100];
+int parsecount;
+
+void setup()
+{
+	struct timespec times[2];
+	FILE *f;
+
+	strcpy(dirname, "/tmp/test-jsonc-cache-XXXXXX");
+	ck_assert_ptr_nonnull(mkdtemp(dirname));
+	snprintf(path, sizeof path, "%s/input.json", dirname);
+	snprintf(cachedir, sizeof cachedir, "%s/cache", dirname);
+	ck_assert_int_eq(0, mkdir(cachedir, 0755));
+	f = fopen(path, "w");
+	ck_assert_ptr_nonnull(f);
+	fputs(input, f);
+	fclose(f);
+
+	/* avoid the delay of caching recently modified files */
+	times[0].tv_sec = times[1].tv_sec = time(NULL) - 3600;
+	times[0].tv_nsec = times[1].tv_nsec = 0;
+	ck_assert_int_eq(0, utimensat(AT_FDCWD, path, times, 0));
+}
+
+void teardown()
+{
+	DIR *dir;
+	struct dirent *ent;
+	char file[400];
+
+	dir = opendir(cachedir);
+	ck_assert_ptr_nonnull(dir);
+	while ((ent = readdir(dir)) != NULL) {
+		if (strcmp(ent->d_name, ".") && strcmp(ent->d_name, "..")) {
+			snprintf(file, sizeof file, "%s/%s", cachedir, ent->d_name);
+			ck_assert_int_eq(0, unlink(file));
+		}
+	}
+	closedir(dir);
+	ck_assert_int_eq(0, rmdir(cachedir));
+	ck_assert_int_eq(0, unlink(path));
+	ck_assert_int_eq(0, rmdir(dirname));
+}
+
+int parse(void *closure, const char *p, struct json_object **result)
+{
+	parsecount++;
+	*result = json_tokener_parse(input);
+	return 0;
+}
+
+void check_same(struct json_object *object, const char *text)
+{
+	struct json_object *ref = json_tokener_parse(text);
+	printf("got %s\n", json_object_to_json_string(object));
+	ck_assert_int_eq(1, json_object_equal(object, ref));
+	json_object_put(ref);
+}
+
+/*********************************************************************/
+
+START_TEST(check_load)
+{
+	struct json_object *object;
+	unsigned flags;
+	int rc;
+
+	setup();
+	for (flags = 0 ; flags <= RP_JSONC_CACHE_HASH ; flags++) {
+		/* first load parses, second load uses the cache */
+		parsecount = 0;
+		rc = rp_jsonc_cache_load(&object, path, cachedir, flags, parse, NULL);
+		ck_assert_int_eq(rc, 0);
+		check_same(object, input);
+		json_object_put(object);
+		ck_assert_int_eq(parsecount, 1);
+
+		rc = rp_jsonc_cache_load(&object, path, cachedir, flags, parse, NULL);
+		ck_assert_int_eq(rc, 0);
+		check_same(object, input);
+		json_object_put(object);
+		ck_assert_int_eq(parsecount, 1);
+	}
+
+	/* default parser */
+	rc = rp_jsonc_cache_load(&object, path, cachedir, 0, NULL, NULL);
+	ck_assert_int_eq(rc, 0);
+	check_same(object, input);
+	json_object_put(object);
+
+	/* modifying the file invalidates the cache */
+	ck_assert_int_eq(0, truncate(path, 0));
+	parsecount = 0;
+	rc = rp_jsonc_cache_load(&object, path, cachedir, 0, parse, NULL);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(parsecount, 1);
+	json_object_put(object);
+	rc = rp_jsonc_cache_load(&object, "/nonexistent", cachedir, 0, NULL, NULL);
+	ck_assert_int_eq(rc, -ENOENT);
+
+	/* unwritable cache directory is not an error */
+	rc = rp_jsonc_cache_load(&object, "/dev/null", "/nonexistent", 0, parse, NULL);
+	ck_assert_int_eq(rc, 0);
+	check_same(object, input);
+	json_object_put(object);
+	teardown();
+}
+END_TEST
+
+START_TEST(check_get)
+{
+	struct { const char *pointer; int rc; const char *result; } tests[] = {
+		{ "", 0, NULL },
+		{ "/name", 0, "\"cache\"" },
+		{ "/list", 0, "[ 1, -2, 3.5, true, false, null, \"x\", { \"in\": [ 7 ] } ]" },
+		{ "/list/0", 0, "1" },
+		{ "/list/1", 0, "-2" },
+		{ "/list/2", 0, "3.5" },
+		{ "/list/3", 0, "true" },
+		{ "/list/5", 0, "null" },
+		{ "/list/6", 0, "\"x\"" },
+		{ "/list/7/in/0", 0, "7" },
+		{ "/a~1b/m~0n", 0, "42" },
+		{ "/nil", 0, "null" },
+		{ "/list/8", -ENOENT, NULL },
+		{ "/list/01", -ENOENT, NULL },
+		{ "/list/-", -ENOENT, NULL },
+		{ "/name/x", -ENOENT, NULL },
+		{ "/none", -ENOENT, NULL },
+		{ "name", -EINVAL, NULL },
+		{ "/a~2b", -EINVAL, NULL }
+	};
+	rp_jsonc_cache_t *cache;
+	struct json_object *object;
+	unsigned i, pass;
+	int rc;
+
+	setup();
+	for (pass = 0 ; pass < 2 ; pass++) {
+		rc = rp_jsonc_cache_open(&cache, path, cachedir, 0, NULL, NULL);
+		ck_assert_int_eq(rc, 0);
+		for (i = 0 ; i < sizeof tests / sizeof *tests ; i++) {
+			printf("get %s\n", tests[i].pointer);
+			rc = rp_jsonc_cache_get(cache, tests[i].pointer, &object);
+			ck_assert_int_eq(rc, tests[i].rc);
+			if (rc == 0)
+				check_same(object, tests[i].result != NULL ? tests[i].result : input);
+			json_object_put(object);
+		}
+		rp_jsonc_cache_close(cache);
+	}
+	teardown();
+}
+END_TEST
+
+/*********************************************************************/
+
+static Suite *suite;
+static TCase *tcase;
+
+void mksuite(const char *name) { suite = suite_create(name); }
+void addtcase(const char *name) { tcase = tcase_create(name); suite_add_tcase(suite, tcase); }
+#define addtest(test) tcase_add_test(tcase, test)
+int srun()
+{
+	int nerr;
+	SRunner *srunner = srunner_create(suite);
+	srunner_run_all(srunner, CK_NORMAL);
+	nerr = srunner_ntests_failed(srunner);
+	srunner_free(srunner);
+	return nerr;
+}
+
+int main(int ac, char **av)
+{
+	mksuite("jsonc-cache");
+		addtcase("jsonc-cache");
+			addtest(check_load);
+			addtest(check_get);
+	return !!srun();
+}
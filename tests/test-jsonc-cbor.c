@@ -0,0 +1,342 @@
+/*
+ Copyright (C) 2015-2026 IoT.bzh Company
+
+ Author: José Bollo <jose.bollo@iot.bzh>
+
+ $RP_BEGIN_LICENSE$
+ Commercial License Usage
+  Licensees holding valid commercial IoT.bzh licenses may use this file in
+  accordance with the commercial license agreement provided with the
+  Software or, alternatively, in accordance with the terms contained in
+  a written agreement between you and The IoT.bzh Company. For licensing terms
+  and conditions see https://www.iot.bzh/terms-conditions. For further
+  information use the contact form at https://www.iot.bzh/contact.
+
+ GNU General Public License Usage
+  Alternatively, this file may be used under the terms of the GNU General
+  Public license version 3. This license is as published by the Free Software
+  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+  of this file. Please review the following information to ensure the GNU
+  General Public License requirements will be met
+  https://www.gnu.org/licenses/gpl-3.0.html.
+ $RP_END_LICENSE$
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <check.h>
+#if !defined(ck_assert_ptr_null)
+# define ck_assert_ptr_null(X)      ck_assert_ptr_eq(X, NULL)
+# define ck_assert_ptr_nonnull(X)   ck_assert_ptr_ne(X, NULL)
+#endif
+
+/*********************************************************************/
+
+#include <rp-utils/rp-jsonc-cbor.h>
+#include <rp-utils/rp-jsonc.h>
+
+/*********************************************************************/
+
+/* vectors of RFC 8949, appendix A, that are valid JSON */
+struct { const char *json; const char *cbor; } vectors[] = {
+	{ "0", "00" },
+	{ "23", "17" },
+	{ "24", "1818" },
+	{ "1000", "1903e8" },
+	{ "1000000", "1a000f4240" },
+	{ "1000000000000", "1b000000e8d4a51000" },
+	{ "-1", "20" },
+	{ "-1000", "3903e7" },
+	{ "1.1", "fb3ff199999999999a" },
+	{ "100000.0", "fa47c35000" },
+	{ "-4.1", "fbc010666666666666" },
+	{ "false", "f4" },
+	{ "true", "f5" },
+	{ "null", "f6" },
+	{ "\"\"", "60" },
+	{ "\"IETF\"", "6449455446" },
+	{ "\"\\u00fc\"", "62c3bc" },
+	{ "[]", "80" },
+	{ "[1,[2,3],[4,5]]", "8301820203820405" },
+	{ "{}", "a0" },
+	{ "{\"a\":1,\"b\":[2,3]}", "a26161016162820203" },
+	{ "[\"a\",{\"b\":\"c\"}]", "826161a161626163" }
+};
+
+/* vectors of RFC 8949 only decodable */
+struct { const char *cbor; const char *json; } decodes[] = {
+	{ "f93c00", "1.0" },
+	{ "f9c400", "-4.0" },
+	{ "f90001", "5.960464477539063e-8" },
+	{ "f97bff", "65504.0" },
+	{ "c11a514b67b0", "1363896240" },
+	{ "4401020304", "\"AQIDBA\"" },
+	{ "5f42010243030405ff", "\"AQIDBAU\"" },
+	{ "7f657374726561646d696e67ff", "\"streaming\"" },
+	{ "9fff", "[]" },
+	{ "9f018202039f0405ffff", "[1,[2,3],[4,5]]" },
+	{ "83019f0203ff820405", "[1,[2,3],[4,5]]" },
+	{ "bf61610161629f0203ffff", "{\"a\":1,\"b\":[2,3]}" },
+	{ "bf6346756ef563416d7421ff", "{\"Fun\":true,\"Amt\":-2}" },
+	{ "f7", "null" }
+};
+
+/* invalid inputs */
+const char *invalids[] = {
+	"",
+	"18",
+	"1f",
+	"62c3",
+	"8201",
+	"a16161",
+	"a10101",
+	"9f01",
+	"ff",
+	"5f6161ff",
+	"0000"
+};
+
+size_t unhex(const char *hex, unsigned char *bin)
+{
+	size_t n;
+	unsigned x;
+	for (n = 0 ; hex[2 * n] ; n++) {
+		sscanf(&hex[2 * n], "%2x", &x);
+		bin[n] = (unsigned char)x;
+	}
+	return n;
+}
+
+void tohex(const void *bin, size_t length, char *hex)
+{
+	const unsigned char *b = bin;
+	while (length--)
+		hex += sprintf(hex, "%02x", *b++);
+	*hex = 0;
+}
+
+/*********************************************************************/
+
+START_TEST(check_vectors)
+{
+	struct json_object *object, *decoded;
+	unsigned i;
+	unsigned char bin[100];
+	char hex[200];
+	void *data;
+	size_t length;
+	int rc;
+
+	for (i = 0 ; i < sizeof vectors / sizeof *vectors ; i++) {
+		object = json_tokener_parse(vectors[i].json);
+		rc = rp_jsonc_cbor_encode(object, &data, &length);
+		ck_assert_int_eq(rc, 0);
+		tohex(data, length, hex);
+		printf("encode %s -> %s\n", vectors[i].json, hex);
+		ck_assert_str_eq(hex, vectors[i].cbor);
+
+		rc = rp_jsonc_cbor_decode(data, length, &decoded, NULL);
+		ck_assert_int_eq(rc, 0);
+		ck_assert_int_eq(1, json_object_equal(object, decoded));
+		json_object_put(decoded);
+		json_object_put(object);
+		free(data);
+	}
+
+	for (i = 0 ; i < sizeof decodes / sizeof *decodes ; i++) {
+		length = unhex(decodes[i].cbor, bin);
+		rc = rp_jsonc_cbor_decode(bin, length, &decoded, NULL);
+		printf("decode %s -> %s\n", decodes[i].cbor, json_object_to_json_string(decoded));
+		ck_assert_int_eq(rc, 0);
+		object = json_tokener_parse(decodes[i].json);
+		ck_assert_int_eq(1, json_object_equal(object, decoded));
+		json_object_put(decoded);
+		json_object_put(object);
+	}
+
+	for (i = 0 ; i < sizeof invalids / sizeof *invalids ; i++) {
+		length = unhex(invalids[i], bin);
+		rc = rp_jsonc_cbor_decode(bin, length, &decoded, NULL);
+		printf("invalid %s -> %d\n", invalids[i], rc);
+		ck_assert_int_eq(rc, -EBADMSG);
+		ck_assert_ptr_null(decoded);
+	}
+
+	/* sequences */
+	length = unhex("0102", bin);
+	rc = rp_jsonc_cbor_decode(bin, length, &decoded, &length);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(length, 1);
+	ck_assert_int_eq(json_object_get_int(decoded), 1);
+	json_object_put(decoded);
+}
+END_TEST
+
+START_TEST(check_iovec)
+{
+	struct json_object *object, *decoded;
+	rp_jsonc_cbor_encoder_t *encoder;
+	const struct iovec *iov;
+	char buffer[1000], *p;
+	size_t length, total, used;
+	int pass, i, count, rc;
+
+	object = json_tokener_parse(
+		"{\"short\":\"text\",\"long\":\"0123456789012345678901234567890123456789"
+		"0123456789012345678901234567890123456789\",\"n\":[1,2.5,null]}");
+	rc = rp_jsonc_cbor_encoder_create(&encoder);
+	ck_assert_int_eq(rc, 0);
+	for (pass = 0 ; pass < 2 ; pass++) {
+		rp_jsonc_cbor_encoder_reset(encoder);
+		rc = rp_jsonc_cbor_encoder_add(encoder, object);
+		ck_assert_int_eq(rc, 0);
+		rc = rp_jsonc_cbor_encoder_add(encoder, object);
+		ck_assert_int_eq(rc, 0);
+		count = rp_jsonc_cbor_encoder_iovec(encoder, &iov, &length);
+		ck_assert_int_eq(count, 5);
+
+		/* the long string is referenced */
+		ck_assert_ptr_eq(iov[1].iov_base,
+			json_object_get_string(json_object_object_get(object, "long")));
+
+		for (p = buffer, total = 0, i = 0 ; i < count ; i++) {
+			memcpy(p, iov[i].iov_base, iov[i].iov_len);
+			p += iov[i].iov_len;
+			total += iov[i].iov_len;
+		}
+		ck_assert_int_eq(total, length);
+
+		/* decode the sequence of two */
+		for (p = buffer ; total ; p += used, total -= used) {
+			rc = rp_jsonc_cbor_decode(p, total, &decoded, &used);
+			ck_assert_int_eq(rc, 0);
+			ck_assert_int_eq(1, json_object_equal(object, decoded));
+			json_object_put(decoded);
+		}
+	}
+	rp_jsonc_cbor_encoder_destroy(encoder);
+	json_object_put(object);
+}
+END_TEST
+
+/*********************************************************************/
+
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+struct json_object *mkmessage()
+{
+	struct json_object *msg, *items, *item;
+	int i;
+
+	msg = json_object_new_object();
+	json_object_object_add(msg, "api", json_object_new_string("signal-composer"));
+	json_object_object_add(msg, "verb", json_object_new_string("subscribe"));
+	json_object_object_add(msg, "request-id", json_object_new_int64(123456789));
+	items = json_object_new_array();
+	for (i = 0 ; i < 50 ; i++) {
+		item = json_object_new_object();
+		json_object_object_add(item, "uid", json_object_new_int(i));
+		json_object_object_add(item, "name", json_object_new_string("engine.speed"));
+		json_object_object_add(item, "value", json_object_new_double(1234.5 + i * 0.1));
+		json_object_object_add(item, "valid", json_object_new_boolean(i & 1));
+		json_object_object_add(item, "unit", NULL);
+		json_object_array_add(items, item);
+	}
+	json_object_object_add(msg, "items", items);
+	return msg;
+}
+
+START_TEST(check_bench)
+{
+	struct json_object *msg, *decoded;
+	rp_jsonc_cbor_encoder_t *encoder;
+	const struct iovec *iov;
+	const char *text;
+	void *data;
+	size_t textlen, cborlen;
+	double t0, tenc, tdec, ttext, tparse;
+	int i, n = 2000;
+
+	msg = mkmessage();
+
+	/* round trip */
+	ck_assert_int_eq(0, rp_jsonc_cbor_encode(msg, &data, &cborlen));
+	ck_assert_int_eq(0, rp_jsonc_cbor_decode(data, cborlen, &decoded, NULL));
+	ck_assert_int_eq(1, json_object_equal(msg, decoded));
+	json_object_put(decoded);
+	text = json_object_to_json_string_length(msg, JSON_C_TO_STRING_PLAIN, &textlen);
+
+	/* text */
+	t0 = now();
+	for (i = 0 ; i < n ; i++)
+		json_object_to_json_string_length(msg, JSON_C_TO_STRING_PLAIN, &textlen);
+	ttext = now() - t0;
+	t0 = now();
+	for (i = 0 ; i < n ; i++)
+		json_object_put(json_tokener_parse(text));
+	tparse = now() - t0;
+
+	/* cbor */
+	ck_assert_int_eq(0, rp_jsonc_cbor_encoder_create(&encoder));
+	t0 = now();
+	for (i = 0 ; i < n ; i++) {
+		rp_jsonc_cbor_encoder_reset(encoder);
+		rp_jsonc_cbor_encoder_add(encoder, msg);
+		rp_jsonc_cbor_encoder_iovec(encoder, &iov, &cborlen);
+	}
+	tenc = now() - t0;
+	rp_jsonc_cbor_encoder_destroy(encoder);
+	t0 = now();
+	for (i = 0 ; i < n ; i++) {
+		rp_jsonc_cbor_decode(data, cborlen, &decoded, NULL);
+		json_object_put(decoded);
+	}
+	tdec = now() - t0;
+
+	printf("size: json %zu bytes, cbor %zu bytes\n", textlen, cborlen);
+	printf("encode: json %.1f us, cbor %.1f us\n", ttext * 1e6 / n, tenc * 1e6 / n);
+	printf("decode: json %.1f us, cbor %.1f us\n", tparse * 1e6 / n, tdec * 1e6 / n);
+	ck_assert_int_lt(cborlen, textlen);
+
+	free(data);
+	json_object_put(msg);
+}
+END_TEST
+
+/*********************************************************************/
+
+static Suite *suite;
+static TCase *tcase;
+
+void mksuite(const char *name) { suite = suite_create(name); }
+void addtcase(const char *name) { tcase = tcase_create(name); suite_add_tcase(suite, tcase); }
+#define addtest(test) tcase_add_test(tcase, test)
+int srun()
+{
+	int nerr;
+	SRunner *srunner = srunner_create(suite);
+	srunner_run_all(srunner, CK_NORMAL);
+	nerr = srunner_ntests_failed(srunner);
+	srunner_free(srunner);
+	return nerr;
+}
+
+int main(int ac, char **av)
+{
+	mksuite("jsonc-cbor");
+		addtcase("jsonc-cbor");
+			addtest(check_vectors);
+			addtest(check_iovec);
+			addtest(check_bench);
+	return !!srun();
+}
@@ -0,0 +1,250 @@
+/*
+ Copyright (C) 2015-2026 IoT.bzh Company
+
+ Author: José Bollo <jose.bollo@iot.bzh>
+
+ $RP_BEGIN_LICENSE$
+ Commercial License Usage
+  Licensees holding valid commercial IoT.bzh licenses may use this file in
+  accordance with the commercial license agreement provided with the
+  Software or, alternatively, in accordance with the terms contained in
+  a written agreement between you and The IoT.bzh Company. For licensing terms
+  and conditions see https://www.iot.bzh/terms-conditions. For further
+  information use the contact form at https://www.iot.bzh/contact.
+
+ GNU General Public License Usage
+  Alternatively, this file may be used under the terms of the GNU General
+  Public license version 3. This license is as published by the Free Software
+  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+  of this file. Please review the following information to ensure the GNU
+  General Public License requirements will be met
+  https://www.gnu.org/licenses/gpl-3.0.html.
+ $RP_END_LICENSE$
+*/
+
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <check.h>
+#if !defined(ck_assert_ptr_null)
+# define ck_assert_ptr_null(X)      ck_assert_ptr_eq(X, NULL)
+# define ck_assert_ptr_nonnull(X)   ck_assert_ptr_ne(X, NULL)
+#endif
+
+/*********************************************************************/
+
+#include <rp-utils/rp-jsonc-query.h>
+#include <rp-utils/rp-jsonc.h>
+
+/*********************************************************************/
+
+char input[] =
+	"{"
+	  "\"store\": {"
+	    "\"book\": ["
+	      "{ \"category\": \"reference\", \"author\": \"Nigel Rees\", \"price\": 8.95 },"
+	      "{ \"category\": \"fiction\", \"author\": \"Evelyn Waugh\", \"price\": 12.99 },"
+	      "{ \"category\": \"fiction\", \"author\": \"Herman Melville\", \"isbn\": \"0-553-21311-3\", \"price\": 8.99 },"
+	      "{ \"category\": \"fiction\", \"author\": \"J. R. R. Tolkien\", \"isbn\": \"0-395-19395-8\", \"price\": 22.99 }"
+	    "],"
+	    "\"bicycle\": { \"color\": \"red\", \"price\": 19.95 }"
+	  "},"
+	  "\"a/b\": 1, \"m~n\": 2, \"\": 3, \"nil\": null"
+	"}";
+
+struct json_object *root;
+
+struct collect {
+	int count;
+	char text[4096];
+};
+
+void collectcb(void *closure, struct json_object *object)
+{
+	struct collect *c = closure;
+	size_t len = strlen(c->text);
+	snprintf(&c->text[len], sizeof c->text - len, "%s%s",
+			len ? "|" : "", json_object_to_json_string(object));
+	c->count++;
+}
+
+void check(int pointer, const char *query, int count, const char *expected)
+{
+	rp_jsonc_query_t *q;
+	struct collect c = { 0, "" };
+	int rc;
+
+	rc = pointer ? rp_jsonc_query_pointer(&q, query) : rp_jsonc_query_path(&q, query);
+	printf("query %s -> %d\n", query, rc);
+	ck_assert_int_eq(rc, 0);
+	rp_jsonc_query_for_all(q, root, collectcb, &c);
+	printf("   got %d: %s\n", c.count, c.text);
+	ck_assert_int_eq(c.count, count);
+	if (expected)
+		ck_assert_str_eq(c.text, expected);
+	rp_jsonc_query_destroy(q);
+}
+
+void invalid(int pointer, const char *query)
+{
+	rp_jsonc_query_t *q;
+	int rc;
+
+	rc = pointer ? rp_jsonc_query_pointer(&q, query) : rp_jsonc_query_path(&q, query);
+	printf("invalid query %s -> %d\n", query, rc);
+	ck_assert_int_lt(rc, 0);
+	ck_assert_ptr_null(q);
+}
+
+START_TEST (check_pointer)
+{
+	root = json_tokener_parse(input);
+
+	check(1, "", 1, NULL);
+	check(1, "/store/bicycle/color", 1, "\"red\"");
+	check(1, "/store/book/1/author", 1, "\"Evelyn Waugh\"");
+	check(1, "/store/book/4", 0, "");
+	check(1, "/store/book/-", 0, "");
+	check(1, "/store/book/01", 0, "");
+	check(1, "/a~1b", 1, "1");
+	check(1, "/m~0n", 1, "2");
+	check(1, "/", 1, "3");
+	check(1, "/nil", 1, "null");
+	invalid(1, "store");
+	invalid(1, "/a~2b");
+
+	json_object_put(root);
+}
+END_TEST
+
+START_TEST (check_path)
+{
+	struct json_object *obj;
+	rp_jsonc_query_t *q;
+
+	root = json_tokener_parse(input);
+
+	check(0, "$", 1, NULL);
+	check(0, "$.store.bicycle.color", 1, "\"red\"");
+	check(0, "$['store'][\"bicycle\"]['color']", 1, "\"red\"");
+	check(0, "$.store.book[-1].author", 1, "\"J. R. R. Tolkien\"");
+	check(0, "$.store.book.0.author", 1, "\"Nigel Rees\"");
+	check(0, "$.store.book[*].author", 4, "\"Nigel Rees\"|\"Evelyn Waugh\"|\"Herman Melville\"|\"J. R. R. Tolkien\"");
+	check(0, "$..author", 4, "\"Nigel Rees\"|\"Evelyn Waugh\"|\"Herman Melville\"|\"J. R. R. Tolkien\"");
+	check(0, "$.store.*", 2, NULL);
+	check(0, "$..price", 5, NULL);
+	check(0, "$..book[2].isbn", 1, "\"0-553-21311-3\"");
+	check(0, "$..book[?(@.isbn)].price", 2, "8.99|22.99");
+	check(0, "$..book[?(@.price < 10)].author", 2, "\"Nigel Rees\"|\"Herman Melville\"");
+	check(0, "$..book[?(@.price >= 12.99)].author", 2, "\"Evelyn Waugh\"|\"J. R. R. Tolkien\"");
+	check(0, "$.store.book[?(@.category == 'reference')].author", 1, "\"Nigel Rees\"");
+	check(0, "$.store.book[?(@.category != 'reference')].author", 3, NULL);
+	check(0, "$.store.book[?(@['isbn'] == \"0-395-19395-8\")].price", 1, "22.99");
+	check(0, "$[?(@ == null)]", 1, "null");
+	check(0, "$.nothing", 0, "");
+	invalid(0, "store");
+	invalid(0, "$.store[");
+	invalid(0, "$.store[?(@.x = 1)]");
+	invalid(0, "$..");
+
+	rp_jsonc_query_path(&q, "$..book[?(@.price > 20)].author");
+	ck_assert_int_eq(1, rp_jsonc_query_get(q, root, &obj));
+	ck_assert_str_eq(json_object_get_string(obj), "J. R. R. Tolkien");
+	rp_jsonc_query_destroy(q);
+
+	json_object_put(root);
+}
+END_TEST
+
+/*********************************************************************/
+
+const char *batchqueries[] = {
+	"$.store.bicycle.color",
+	"$.store.book[0].author",
+	"$.store.book[-1].author",
+	"$.store.book[1].price",
+	"$..author",
+	"$..book[?(@.price < 10)].author",
+	"$.store.*",
+	"$.store.bicycle.price",
+	"$..price",
+	"$.store.book[0].author",
+	"$.unknown"
+};
+#define NBQ (sizeof batchqueries / sizeof *batchqueries)
+
+struct collect batchres[NBQ];
+
+int batchcb(void *closure, unsigned index, struct json_object *object)
+{
+	ck_assert_ptr_eq(closure, batchres);
+	collectcb(&batchres[index], object);
+	return 0;
+}
+
+START_TEST (check_batch)
+{
+	rp_jsonc_query_t *queries[NBQ];
+	rp_jsonc_query_batch_t *batch;
+	struct collect c;
+	unsigned i;
+	int rc;
+
+	root = json_tokener_parse(input);
+	for (i = 0 ; i < NBQ ; i++) {
+		rc = rp_jsonc_query_path(&queries[i], batchqueries[i]);
+		ck_assert_int_eq(rc, 0);
+	}
+	rc = rp_jsonc_query_batch_create(&batch, (const rp_jsonc_query_t * const *)queries, NBQ);
+	ck_assert_int_eq(rc, 0);
+
+	/* evaluate twice to check reuse of the batch */
+	for (rc = 0 ; rc < 2 ; rc++) {
+		memset(batchres, 0, sizeof batchres);
+		ck_assert_int_eq(0, rp_jsonc_query_batch_until(batch, root, batchcb, batchres));
+		for (i = 0 ; i < NBQ ; i++) {
+			memset(&c, 0, sizeof c);
+			rp_jsonc_query_for_all(queries[i], root, collectcb, &c);
+			printf("batch %s: %s\n", batchqueries[i], batchres[i].text);
+			ck_assert_int_eq(c.count, batchres[i].count);
+		}
+	}
+
+	rp_jsonc_query_batch_destroy(batch);
+	for (i = 0 ; i < NBQ ; i++)
+		rp_jsonc_query_destroy(queries[i]);
+	json_object_put(root);
+}
+END_TEST
+
+/*********************************************************************/
+
+static Suite *suite;
+static TCase *tcase;
+
+void mksuite(const char *name) { suite = suite_create(name); }
+void addtcase(const char *name) { tcase = tcase_create(name); suite_add_tcase(suite, tcase); }
+#define addtest(test) tcase_add_test(tcase, test)
+int srun()
+{
+	int nerr;
+	SRunner *srunner = srunner_create(suite);
+	srunner_run_all(srunner, CK_NORMAL);
+	nerr = srunner_ntests_failed(srunner);
+	srunner_free(srunner);
+	return nerr;
+}
+
+int main(int ac, char **av)
+{
+	mksuite("jsonc-query");
+		addtcase("jsonc-query");
+			addtest(check_pointer);
+			addtest(check_path);
+			addtest(check_batch);
+	return !!srun();
+}
@@ -0,0 +1,307 @@
+/*
+ Copyright (C) 2015-2026 IoT.bzh Company
+
+ Author: José Bollo <jose.bollo@iot.bzh>
+
+ $RP_BEGIN_LICENSE$
+ Commercial License Usage
+  Licensees holding valid commercial IoT.bzh licenses may use this file in
+  accordance with the commercial license agreement provided with the
+  Software or, alternatively, in accordance with the terms contained in
+  a written agreement between you and The IoT.bzh Company. For licensing terms
+  and conditions see https://www.iot.bzh/terms-conditions. For further
+  information use the contact form at https://www.iot.bzh/contact.
+
+ GNU General Public License Usage
+  Alternatively, this file may be used under the terms of the GNU General
+  Public license version 3. This license is as published by the Free Software
+  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+  of this file. Please review the following information to ensure the GNU
+  General Public License requirements will be met
+  https://www.gnu.org/licenses/gpl-3.0.html.
+ $RP_END_LICENSE$
+*/
+
+#define _GNU_SOURCE /* for pipe2 and F_SETPIPE_SZ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include <check.h>
+
+#include <rp-utils/locale-root.h>
+#include <rp-utils/locale-file.h>
+
+/*********************************************************************/
+
+#define SMALL   100
+#define BIG     200000
+
+char dirname[64];
+char path[100];
+struct locale_root *root;
+char big[BIG];
+
+/* creates the file 'name' of 'size' bytes of 'data' */
+void put(const char *name, const char *data, size_t size)
+{
+	FILE *file;
+
+	snprintf(path, sizeof path, "%s/%s", dirname, name);
+	file = fopen(path, "w");
+	ck_assert_ptr_ne(file, NULL);
+	ck_assert_int_eq(size, fwrite(data, 1, size, file));
+	fclose(file);
+}
+
+/* sets the modification time of 'name' to 'sec' seconds ago */
+void age(const char *name, int sec)
+{
+	struct timespec times[2];
+
+	snprintf(path, sizeof path, "%s/%s", dirname, name);
+	times[0].tv_sec = times[1].tv_sec = time(NULL) - sec;
+	times[0].tv_nsec = times[1].tv_nsec = 0;
+	ck_assert_int_eq(0, utimensat(AT_FDCWD, path, times, 0));
+}
+
+void setup()
+{
+	int i;
+
+	strcpy(dirname, "/tmp/test-locale-file-XXXXXX");
+	ck_assert_ptr_ne(mkdtemp(dirname), NULL);
+	for (i = 0 ; i < BIG ; i++)
+		big[i] = (char)('a' + i % 23);
+	put("small", big, SMALL);
+	put("big", big, BIG);
+	root = locale_root_create_path(dirname);
+	ck_assert_ptr_ne(root, NULL);
+}
+
+void teardown()
+{
+	locale_root_unref(root);
+	snprintf(path, sizeof path, "%s/small", dirname);
+	unlink(path);
+	snprintf(path, sizeof path, "%s/big", dirname);
+	unlink(path);
+	snprintf(path, sizeof path, "%s/out", dirname);
+	unlink(path);
+	ck_assert_int_eq(0, rmdir(dirname));
+}
+
+/*********************************************************************/
+
+START_TEST (check_open)
+{
+	struct locale_file_cache *cache;
+	struct locale_file f1, f2, f3;
+	char etag[56];
+
+	fprintf(stdout, "\n************************************ CHECK OPEN\n\n");
+
+	setup();
+	ck_assert_int_eq(0, locale_file_cache_create(&cache, 8, 1024));
+
+	/* small files are mapped and shared */
+	ck_assert_int_eq(0, locale_file_open(&f1, root, "small", NULL, cache));
+	ck_assert_int_eq(f1.fd, -1);
+	ck_assert_ptr_ne(f1.data, NULL);
+	ck_assert_int_eq(f1.size, SMALL);
+	ck_assert_int_eq(0, memcmp(f1.data, big, SMALL));
+	ck_assert_int_eq(0, locale_file_open(&f2, root, "small", NULL, cache));
+	ck_assert_ptr_eq(f2.data, f1.data);
+	ck_assert_str_eq(f2.etag, f1.etag);
+	locale_file_close(&f2);
+
+	/* the entity tag doesn't depend on the cache */
+	ck_assert_int_eq(0, locale_file_open(&f2, root, "small", NULL, NULL));
+	ck_assert_int_ge(f2.fd, 0);
+	ck_assert_ptr_eq(f2.data, NULL);
+	ck_assert_str_eq(f2.etag, f1.etag);
+	locale_file_close(&f2);
+	ck_assert_int_eq(f2.fd, -1);
+
+	/* big files are not mapped */
+	ck_assert_int_eq(0, locale_file_open(&f2, root, "big", NULL, cache));
+	ck_assert_int_ge(f2.fd, 0);
+	ck_assert_ptr_eq(f2.data, NULL);
+	ck_assert_int_eq(f2.size, BIG);
+	ck_assert_str_ne(f2.etag, f1.etag);
+	locale_file_close(&f2);
+
+	/* a modification time change revalidates the mapping */
+	strcpy(etag, f1.etag);
+	age("small", 100);
+	ck_assert_int_eq(0, locale_file_open(&f2, root, "small", NULL, cache));
+	ck_assert_ptr_ne(f2.data, f1.data);
+	ck_assert_str_ne(f2.etag, etag);
+	strcpy(etag, f2.etag);
+	ck_assert_int_eq(0, locale_file_open(&f3, root, "small", NULL, cache));
+	ck_assert_ptr_eq(f3.data, f2.data);
+	ck_assert_str_eq(f3.etag, etag);
+	locale_file_close(&f3);
+	locale_file_close(&f2);
+
+	/* a size change too */
+	put("small", "changed", 7);
+	age("small", 100);
+	ck_assert_int_eq(0, locale_file_open(&f2, root, "small", NULL, cache));
+	ck_assert_int_eq(f2.size, 7);
+	ck_assert_int_eq(0, memcmp(f2.data, "changed", 7));
+	ck_assert_str_ne(f2.etag, etag);
+	locale_file_close(&f2);
+
+	/* files opened remain valid after the destruction of the cache */
+	locale_file_cache_destroy(cache);
+	ck_assert_ptr_ne(f1.data, NULL);
+	locale_file_close(&f1);
+
+	/* errors */
+	ck_assert_int_eq(-ENOENT, locale_file_open(&f2, root, "none", NULL, NULL));
+	ck_assert_int_eq(-EINVAL, locale_file_open(&f2, root, ".", NULL, NULL));
+	ck_assert_int_eq(-EINVAL, locale_file_cache_create(&cache, 0, 1024));
+	teardown();
+}
+END_TEST
+
+/*********************************************************************/
+
+/* sends 'file' from 'offset' to the non blocking pipe of capacity 4096 and checks the content */
+void send_pipe(struct locale_file *file, off_t offset)
+{
+	char buffer[8192];
+	int fds[2], partial;
+	off_t expected, prev;
+	ssize_t rc, sz;
+
+	ck_assert_int_eq(0, pipe2(fds, O_NONBLOCK|O_CLOEXEC));
+	fcntl(fds[1], F_SETPIPE_SZ, 4096);
+	expected = offset;
+	partial = 0;
+	for (;;) {
+		prev = offset;
+		rc = locale_file_send(file, fds[1], &offset, sizeof buffer);
+		if (rc == 0)
+			break;
+		if (rc != -EAGAIN) {
+			ck_assert_int_gt(rc, 0);
+			ck_assert_int_eq(offset, prev + rc);
+			partial += rc < (ssize_t)sizeof buffer && offset < (off_t)file->size;
+		}
+		while ((sz = read(fds[0], buffer, sizeof buffer)) > 0) {
+			ck_assert_int_le(expected + sz, file->size);
+			ck_assert_int_eq(0, memcmp(buffer, &big[expected], (size_t)sz));
+			expected += sz;
+		}
+	}
+	ck_assert_int_eq(offset, (off_t)file->size);
+	ck_assert_int_eq(expected, (off_t)file->size);
+	if (file->size > sizeof buffer)
+		ck_assert_int_gt(partial, 0);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+/* sends 'file' from 'offset' to the file 'out' opened in append mode */
+void send_append(struct locale_file *file, off_t offset)
+{
+	struct stat st;
+	off_t start = offset;
+	ssize_t rc;
+	char *content;
+	int fd;
+
+	snprintf(path, sizeof path, "%s/out", dirname);
+	fd = open(path, O_WRONLY|O_CREAT|O_TRUNC|O_APPEND|O_CLOEXEC, 0600);
+	ck_assert_int_ge(fd, 0);
+	while ((rc = locale_file_send(file, fd, &offset, 1000000)) > 0);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(offset, (off_t)file->size);
+	ck_assert_int_eq(0, fstat(fd, &st));
+	ck_assert_int_eq(st.st_size, (off_t)file->size - start);
+	content = malloc((size_t)st.st_size);
+	ck_assert_ptr_ne(content, NULL);
+	close(fd);
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	ck_assert_int_ge(fd, 0);
+	ck_assert_int_eq(st.st_size, read(fd, content, (size_t)st.st_size));
+	ck_assert_int_eq(0, memcmp(content, &big[start], (size_t)st.st_size));
+	free(content);
+	close(fd);
+}
+
+START_TEST (check_send)
+{
+	struct locale_file_cache *cache;
+	struct locale_file file;
+	off_t offset;
+
+	fprintf(stdout, "\n************************************ CHECK SEND\n\n");
+
+	setup();
+	ck_assert_int_eq(0, locale_file_cache_create(&cache, 8, 1024));
+
+	/* from memory */
+	ck_assert_int_eq(0, locale_file_open(&file, root, "small", NULL, cache));
+	ck_assert_ptr_ne(file.data, NULL);
+	send_pipe(&file, 0);
+	send_pipe(&file, 33);
+	send_append(&file, 0);
+	locale_file_close(&file);
+
+	/* using sendfile with partial writes */
+	ck_assert_int_eq(0, locale_file_open(&file, root, "big", NULL, cache));
+	ck_assert_ptr_eq(file.data, NULL);
+	send_pipe(&file, 0);
+	send_pipe(&file, 12345);
+
+	/* using the copy, as sendfile refuses files in append mode */
+	send_append(&file, 0);
+	send_append(&file, 54321);
+
+	/* bounds */
+	offset = BIG;
+	ck_assert_int_eq(0, locale_file_send(&file, 1, &offset, 10));
+	offset = -1;
+	ck_assert_int_eq(-EINVAL, locale_file_send(&file, 1, &offset, 10));
+	locale_file_close(&file);
+
+	locale_file_cache_destroy(cache);
+	teardown();
+}
+END_TEST
+
+/*********************************************************************/
+
+static Suite *suite;
+static TCase *tcase;
+
+void mksuite(const char *name) { suite = suite_create(name); }
+void addtcase(const char *name) { tcase = tcase_create(name); suite_add_tcase(suite, tcase); tcase_set_timeout(tcase, 120); }
+#define addtest(test) tcase_add_test(tcase, test)
+int srun()
+{
+	int nerr;
+	SRunner *srunner = srunner_create(suite);
+	srunner_run_all(srunner, CK_NORMAL);
+	nerr = srunner_ntests_failed(srunner);
+	srunner_free(srunner);
+	return nerr;
+}
+
+int main(int ac, char **av)
+{
+	mksuite("locale-file");
+		addtcase("locale-file");
+			addtest(check_open);
+			addtest(check_send);
+	return !!srun();
+}
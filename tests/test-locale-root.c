@@ -0,0 +1,264 @@
+/*
+ Copyright (C) 2015-2026 IoT.bzh Company
+
+ Author: José Bollo <jose.bollo@iot.bzh>
+
+ $RP_BEGIN_LICENSE$
+ Commercial License Usage
+  Licensees holding valid commercial IoT.bzh licenses may use this file in
+  accordance with the commercial license agreement provided with the
+  Software or, alternatively, in accordance with the terms contained in
+  a written agreement between you and The IoT.bzh Company. For licensing terms
+  and conditions see https://www.iot.bzh/terms-conditions. For further
+  information use the contact form at https://www.iot.bzh/contact.
+
+ GNU General Public License Usage
+  Alternatively, this file may be used under the terms of the GNU General
+  Public license version 3. This license is as published by the Free Software
+  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+  of this file. Please review the following information to ensure the GNU
+  General Public License requirements will be met
+  https://www.gnu.org/licenses/gpl-3.0.html.
+ $RP_END_LICENSE$
+*/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include <check.h>
+
+#include <rp-utils/locale-root.h>
+
+/*********************************************************************/
+
+char dirname[64];
+
+void setup()
+{
+	strcpy(dirname, "/tmp/test-locale-root-XXXXXX");
+	ck_assert_ptr_ne(mkdtemp(dirname), NULL);
+}
+
+/* returns the full path of 'name' in the test directory */
+const char *at(const char *name)
+{
+	static char path[PATH_MAX];
+
+	snprintf(path, sizeof path, "%s/%s", dirname, name);
+	return path;
+}
+
+/* creates the file 'name' of content 'text' */
+void put(const char *name, const char *text)
+{
+	FILE *file = fopen(at(name), "w");
+
+	ck_assert_ptr_ne(file, NULL);
+	fputs(text, file);
+	fclose(file);
+}
+
+/* checks that 'root' resolves 'name' for 'locale' to the file 'expected' or to nothing */
+void resolves(struct locale_root *root, const char *name, const char *locale, const char *expected)
+{
+	char *path = locale_root_resolve(root, name, locale);
+	size_t len;
+
+	if (expected == NULL)
+		ck_assert_ptr_eq(path, NULL);
+	else {
+		ck_assert_ptr_ne(path, NULL);
+		len = strlen(path) - strlen(expected);
+		ck_assert(strlen(path) >= strlen(expected));
+		ck_assert_str_eq(&path[len], expected);
+		free(path);
+	}
+}
+
+/* checks that 'root' opens 'name' for 'locale' to a file of content 'expected' */
+void opens(struct locale_root *root, const char *name, const char *locale, const char *expected)
+{
+	char buffer[100];
+	ssize_t sz;
+	int fd;
+
+	fd = locale_root_open(root, name, O_RDONLY, locale);
+	ck_assert_int_ge(fd, 0);
+	sz = read(fd, buffer, sizeof buffer - 1);
+	close(fd);
+	ck_assert_int_ge((int)sz, 0);
+	buffer[sz] = 0;
+	ck_assert_str_eq(buffer, expected);
+}
+
+void cleanup()
+{
+	unlink(at("locales/fr/a.txt"));
+	unlink(at("locales/fr/b.txt"));
+	unlink(at("a.txt"));
+	unlink(at("b.txt"));
+	rmdir(at("locales/fr"));
+	rmdir(at("locales"));
+	ck_assert_int_eq(0, rmdir(dirname));
+}
+
+/*********************************************************************/
+
+START_TEST (check_invalidate)
+{
+	struct locale_root *root;
+
+	fprintf(stdout, "\n************************************ CHECK INVALIDATE\n\n");
+
+	setup();
+	root = locale_root_create_path(dirname);
+	ck_assert_ptr_ne(root, NULL);
+	ck_assert_int_eq(0, locale_root_set_cache(root, 16, 0));
+
+	/* the absence is cached */
+	resolves(root, "a.txt", NULL, NULL);
+	put("a.txt", "default");
+	resolves(root, "a.txt", NULL, NULL);
+	ck_assert_int_lt(locale_root_open(root, "a.txt", O_RDONLY, NULL), 0);
+	ck_assert_int_eq(ENOENT, errno);
+
+	/* until the cache is invalidated */
+	locale_root_invalidate(root);
+	resolves(root, "a.txt", NULL, "/a.txt");
+	opens(root, "a.txt", NULL, "default");
+
+	/* the presence is cached too */
+	ck_assert_int_eq(0, mkdir(at("locales"), 0755));
+	ck_assert_int_eq(0, mkdir(at("locales/fr"), 0755));
+	put("locales/fr/a.txt", "fr");
+	resolves(root, "a.txt", "fr", "/a.txt");
+	resolves(root, "a.txt", NULL, "/a.txt");
+	locale_root_invalidate(root);
+	resolves(root, "a.txt", "fr", "/locales/fr/a.txt");
+	opens(root, "a.txt", "fr", "fr");
+
+	locale_root_unref(root);
+	cleanup();
+}
+END_TEST
+
+/*********************************************************************/
+
+START_TEST (check_notify)
+{
+	struct locale_root *root;
+	int rc;
+
+	fprintf(stdout, "\n************************************ CHECK NOTIFY\n\n");
+
+	setup();
+	root = locale_root_create_path(dirname);
+	ck_assert_ptr_ne(root, NULL);
+	rc = locale_root_set_cache(root, 16, LOCALE_ROOT_CACHE_NOTIFY);
+	if (rc == -ENOTSUP) {
+		locale_root_unref(root);
+		cleanup();
+		return;
+	}
+	ck_assert_int_eq(0, rc);
+	ck_assert_int_ge(locale_root_cache_notify_fd(root), 0);
+
+	/* nothing changed */
+	resolves(root, "b.txt", "fr", NULL);
+	locale_root_cache_notify_process(root);
+	resolves(root, "b.txt", "fr", NULL);
+
+	/* creation of the file of the last candidate */
+	put("b.txt", "default");
+	locale_root_cache_notify_process(root);
+	resolves(root, "b.txt", "fr", "/b.txt");
+
+	/* creation of the missing directories of the first candidate */
+	ck_assert_int_eq(0, mkdir(at("locales"), 0755));
+	locale_root_cache_notify_process(root);
+	resolves(root, "b.txt", "fr", "/b.txt");
+	ck_assert_int_eq(0, mkdir(at("locales/fr"), 0755));
+	locale_root_cache_notify_process(root);
+	resolves(root, "b.txt", "fr", "/b.txt");
+	put("locales/fr/b.txt", "fr");
+	locale_root_cache_notify_process(root);
+	resolves(root, "b.txt", "fr", "/locales/fr/b.txt");
+	opens(root, "b.txt", "fr", "fr");
+
+	/* deletion */
+	ck_assert_int_eq(0, unlink(at("locales/fr/b.txt")));
+	locale_root_cache_notify_process(root);
+	resolves(root, "b.txt", "fr", "/b.txt");
+
+	locale_root_unref(root);
+	cleanup();
+}
+END_TEST
+
+/*********************************************************************/
+
+START_TEST (check_stale)
+{
+	struct locale_root *root;
+
+	fprintf(stdout, "\n************************************ CHECK STALE\n\n");
+
+	setup();
+	ck_assert_int_eq(0, mkdir(at("locales"), 0755));
+	ck_assert_int_eq(0, mkdir(at("locales/fr"), 0755));
+	put("locales/fr/a.txt", "fr");
+	put("a.txt", "default");
+	root = locale_root_create_path(dirname);
+	ck_assert_ptr_ne(root, NULL);
+	ck_assert_int_eq(0, locale_root_set_cache(root, 16, 0));
+	opens(root, "a.txt", "fr", "fr");
+
+	/* opening a deleted entry searches again */
+	ck_assert_int_eq(0, unlink(at("locales/fr/a.txt")));
+	opens(root, "a.txt", "fr", "default");
+	resolves(root, "a.txt", "fr", "/a.txt");
+
+	/* and fails if nothing is found */
+	ck_assert_int_eq(0, unlink(at("a.txt")));
+	ck_assert_int_lt(locale_root_open(root, "a.txt", O_RDONLY, "fr"), 0);
+	ck_assert_int_eq(ENOENT, errno);
+
+	locale_root_unref(root);
+	cleanup();
+}
+END_TEST
+
+/*********************************************************************/
+
+static Suite *suite;
+static TCase *tcase;
+
+void mksuite(const char *name) { suite = suite_create(name); }
+void addtcase(const char *name) { tcase = tcase_create(name); suite_add_tcase(suite, tcase); tcase_set_timeout(tcase, 120); }
+#define addtest(test) tcase_add_test(tcase, test)
+int srun()
+{
+	int nerr;
+	SRunner *srunner = srunner_create(suite);
+	srunner_run_all(srunner, CK_NORMAL);
+	nerr = srunner_ntests_failed(srunner);
+	srunner_free(srunner);
+	return nerr;
+}
+
+int main(int ac, char **av)
+{
+	mksuite("locale-root");
+		addtcase("locale-root");
+			addtest(check_invalidate);
+			addtest(check_notify);
+			addtest(check_stale);
+	return !!srun();
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "utils/lockany.h"
+
+/* count of lock/unlock per thread and round */
+#define NOPS	200000
+
+/* count of items locked by each thread when not shared */
+#define NPRIVATE	16
+
+/* count of items shared by all threads */
+#define NSHARED	4
+
+/* maximum count of threads */
+#define NTHREADS	64
+
+/* an item protected by lockany, a and b must always be equal */
+struct item {
+	unsigned long a, b;
+};
+
+static struct item shared[NSHARED];
+static struct item private[NTHREADS][NPRIVATE];
+
+struct worker {
+	pthread_t tid;
+	struct item *items;
+	unsigned nitems;
+	unsigned seed;
+	unsigned long writes;
+	int nerr;
+};
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* locks items: one write for 8 reads */
+static void *work(void *arg)
+{
+	struct worker *w = arg;
+	struct item *item;
+	unsigned long i;
+
+	for (i = 0 ; i < NOPS ; i++) {
+		w->seed = w->seed * 1103515245 + 12345;
+		item = &w->items[(w->seed >> 16) % w->nitems];
+		if ((w->seed >> 8) % 9 == 0) {
+			lockany_lock_write(item);
+			item->a++;
+			item->b++;
+			w->writes++;
+			lockany_unlock(item);
+		}
+		else {
+			lockany_lock_read(item);
+			if (item->a != item->b)
+				w->nerr++;
+			lockany_unlock(item);
+		}
+	}
+	return NULL;
+}
+
+/* runs nthreads on private or shared items */
+static int bench(unsigned nthreads, int share)
+{
+	static struct worker workers[NTHREADS];
+	unsigned long writes = 0, total = 0;
+	unsigned i, j;
+	int nerr = 0;
+	double t;
+
+	for (i = 0 ; i < NSHARED ; i++)
+		shared[i].a = shared[i].b = 0;
+	for (i = 0 ; i < nthreads ; i++) {
+		for (j = 0 ; j < NPRIVATE ; j++)
+			private[i][j].a = private[i][j].b = 0;
+		workers[i].items = share ? shared : private[i];
+		workers[i].nitems = share ? NSHARED : NPRIVATE;
+		workers[i].seed = i + 1;
+		workers[i].writes = 0;
+		workers[i].nerr = 0;
+	}
+
+	t = now();
+	for (i = 0 ; i < nthreads ; i++)
+		pthread_create(&workers[i].tid, NULL, work, &workers[i]);
+	for (i = 0 ; i < nthreads ; i++)
+		pthread_join(workers[i].tid, NULL);
+	t = now() - t;
+
+	for (i = 0 ; i < nthreads ; i++) {
+		writes += workers[i].writes;
+		nerr += workers[i].nerr;
+	}
+	if (share)
+		for (i = 0 ; i < NSHARED ; i++)
+			total += shared[i].a;
+	else
+		for (i = 0 ; i < nthreads ; i++)
+			for (j = 0 ; j < NPRIVATE ; j++)
+				total += private[i][j].a;
+	if (total != writes) {
+		fprintf(stderr, "lost writes: %lu instead of %lu\n", total, writes);
+		nerr++;
+	}
+	if (nerr)
+		fprintf(stderr, "%u threads, %s items: %d errors\n",
+			nthreads, share ? "shared" : "private", nerr);
+
+	printf("%2u threads %-7s items: %8.3f Mops/s\n",
+		nthreads, share ? "shared" : "private",
+		(double)nthreads * NOPS / t * 1e-6);
+	return nerr;
+}
+
+int main(int ac, char **av)
+{
+	unsigned n;
+	int nerr = 0, prefer;
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	for (prefer = 0 ; prefer < 2 ; prefer++) {
+		printf("writer preference %s\n", prefer ? "on" : "off");
+		lockany_prefer_writers(prefer);
+		for (n = 1 ; n <= NTHREADS ; n <<= 1) {
+			nerr += bench(n, 0);
+			nerr += bench(n, 1);
+		}
+	}
+	if (lockany_try_lock_write(shared) || !lockany_try_lock_read(shared)
+	 || lockany_unlock(shared) || lockany_try_lock_read(shared)
+	 || lockany_try_lock_read(shared) || !lockany_try_lock_write(shared)
+	 || !lockany_unlock(shared) || lockany_unlock(shared)) {
+		fprintf(stderr, "try lock errors\n");
+		nerr++;
+	}
+	return !!nerr;
+}
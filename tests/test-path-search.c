@@ -31,6 +31,11 @@
 #include <string.h>
 #include <stdint.h>
 #include <libgen.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include <check.h>
 
@@ -164,6 +169,237 @@ END_TEST
 
 /*********************************************************************/
 
+START_TEST (check_index)
+{
+#if WITH_DIRENT
+	int rc, check;
+	rp_path_search_t *search;
+	rp_path_search_index_t *index;
+	const char *ipath;
+	char *path;
+
+	fprintf(stdout, "\n************************************ CHECK INDEX\n\n");
+
+	rc = rp_path_search_add_dirs(&search, base, 0, 0);
+	ck_assert_int_ge(rc, 0);
+
+	rc = get_path(search, &path, "test-path-search", 0);
+	ck_assert_int_eq(rc, 0);
+
+	for (check = RP_PATH_SEARCH_INDEX_MANUAL ; check <= RP_PATH_SEARCH_INDEX_NOTIFY ; check++) {
+		rc = rp_path_search_index_create(&index, search, RP_PATH_SEARCH_RECURSIVE, check);
+		ck_assert_int_eq(rc, 0);
+
+		rc = rp_path_search_index_get_path(index, &ipath, "test-path-search", 0);
+		ck_assert_int_eq(rc, 0);
+		ck_assert_str_eq(path, ipath);
+
+		rc = rp_path_search_index_get_path(index, &ipath, "t-e-s-t-path-search", 0);
+		ck_assert_int_eq(rc, X_ENOENT);
+		ck_assert_ptr_eq(ipath, NULL);
+
+		/* a directory modified recently is racy and always rescanned */
+		rc = rp_path_search_index_refresh(index, 0);
+		if (check != RP_PATH_SEARCH_INDEX_NOTIFY)
+			ck_assert(rc == 0 || rc == 1);
+		else
+			ck_assert_int_eq(rc, 0);
+		rc = rp_path_search_index_refresh(index, 1);
+		ck_assert_int_eq(rc, 1);
+
+		rp_path_search_index_destroy(index);
+	}
+
+	free(path);
+	rp_path_search_unref(search);
+#endif
+}
+END_TEST
+
+/*********************************************************************/
+
+/* set an old modification time to 'path' */
+void oldtime(const char *path)
+{
+	struct timespec times[2];
+
+	times[0].tv_sec = times[1].tv_sec = time(NULL) - 3600;
+	times[0].tv_nsec = times[1].tv_nsec = 0;
+	ck_assert_int_eq(0, utimensat(AT_FDCWD, path, times, 0));
+}
+
+START_TEST (check_index_changes)
+{
+#if WITH_DIRENT
+	int rc, check;
+	rp_path_search_t *search;
+	rp_path_search_index_t *index;
+	const char *ipath;
+	char dir[64], sub[80], file[100];
+	FILE *f;
+
+	fprintf(stdout, "\n************************************ CHECK INDEX CHANGES\n\n");
+
+	for (check = RP_PATH_SEARCH_INDEX_MANUAL ; check <= RP_PATH_SEARCH_INDEX_NOTIFY ; check++) {
+		strcpy(dir, "/tmp/test-path-search-XXXXXX");
+		ck_assert_ptr_ne(mkdtemp(dir), NULL);
+		snprintf(sub, sizeof sub, "%s/sub", dir);
+		snprintf(file, sizeof file, "%s/new-file", sub);
+		ck_assert_int_eq(0, mkdir(sub, 0755));
+		oldtime(sub);
+		oldtime(dir);
+
+		rc = rp_path_search_add_dirs(&search, dir, 0, 0);
+		ck_assert_int_ge(rc, 0);
+		rc = rp_path_search_index_create(&index, search, RP_PATH_SEARCH_RECURSIVE, check);
+		ck_assert_int_eq(rc, 0);
+		rc = rp_path_search_index_get_path(index, &ipath, "new-file", 0);
+		ck_assert_int_eq(rc, X_ENOENT);
+		rc = rp_path_search_index_refresh(index, 0);
+		ck_assert_int_eq(rc, 0);
+
+		/* creation */
+		f = fopen(file, "w");
+		ck_assert_ptr_ne(f, NULL);
+		fclose(f);
+		rc = rp_path_search_index_get_path(index, &ipath, "new-file", 0);
+		if (check == RP_PATH_SEARCH_INDEX_MANUAL) {
+			ck_assert_int_eq(rc, X_ENOENT);
+			rc = rp_path_search_index_refresh(index, 0);
+			ck_assert_int_eq(rc, 1);
+			rc = rp_path_search_index_get_path(index, &ipath, "new-file", 0);
+		}
+		ck_assert_int_eq(rc, 0);
+		ck_assert_str_eq(ipath, file);
+
+		/* deletion */
+		ck_assert_int_eq(0, unlink(file));
+		rc = rp_path_search_index_get_path(index, &ipath, "new-file", 0);
+		if (check == RP_PATH_SEARCH_INDEX_MANUAL) {
+			ck_assert_int_eq(rc, 0);
+			rc = rp_path_search_index_refresh(index, 1);
+			ck_assert_int_eq(rc, 1);
+			rc = rp_path_search_index_get_path(index, &ipath, "new-file", 0);
+		}
+		ck_assert_int_eq(rc, X_ENOENT);
+
+		rp_path_search_index_destroy(index);
+		rp_path_search_unref(search);
+		ck_assert_int_eq(0, rmdir(sub));
+		ck_assert_int_eq(0, rmdir(dir));
+	}
+#endif
+}
+END_TEST
+
+/*********************************************************************/
+
+/* record of the events of a search */
+struct events {
+	char *text;
+	size_t size;
+	int count;
+	int calls;
+	int stop;
+};
+
+/* record the event 'tag' of 'entry' */
+void record(struct events *ev, int tag, const rp_path_search_entry_t *entry)
+{
+	char line[PATH_MAX + 16];
+	int len;
+
+	len = snprintf(line, sizeof line, "%c%d%d %.*s\n", tag, (int)entry->action,
+			(int)entry->isDir, (int)entry->pathlen, entry->path);
+	ev->text = realloc(ev->text, ev->size + (size_t)len + 1);
+	ck_assert_ptr_ne(ev->text, NULL);
+	memcpy(&ev->text[ev->size], line, (size_t)len + 1);
+	ev->size += (size_t)len;
+	ev->count++;
+}
+
+int recordcb(void *closure, const rp_path_search_entry_t *entry)
+{
+	struct events *ev = closure;
+	record(ev, 'C', entry);
+	return ++ev->calls == ev->stop ? 77 : 0;
+}
+
+int recordfilter(void *closure, const rp_path_search_entry_t *entry)
+{
+	record(closure, 'F', entry);
+	return entry->namelen != 4 || memcmp(entry->name, "skip", 4) != 0;
+}
+
+/* make the directory 'name' of 'dir' with 'nfiles' files */
+void mktree(const char *dir, const char *name, int nfiles)
+{
+	char path[PATH_MAX];
+	FILE *f;
+	int i;
+
+	snprintf(path, sizeof path, "%s/%s", dir, name);
+	ck_assert_int_eq(0, mkdir(path, 0755));
+	for (i = 0 ; i < nfiles ; i++) {
+		snprintf(path, sizeof path, "%s/%s/f%d", dir, name, i);
+		f = fopen(path, "w");
+		ck_assert_ptr_ne(f, NULL);
+		fclose(f);
+	}
+}
+
+START_TEST (check_filter_mt)
+{
+#if WITH_DIRENT
+	static const char *dirs[] = {
+		"a", "a/b", "a/b/c", "a/b/c/d", "a/e", "skip", "skip/x",
+		"f", "f/g", "f/h", "f/i", "empty", NULL
+	};
+	static const int nthreads[] = { 1, 2, 3, 8 };
+	struct events ref, ev;
+	rp_path_search_t *search;
+	char dir[64], cmd[100];
+	int rc, refrc, i, n, flags, stop;
+
+	fprintf(stdout, "\n************************************ CHECK FILTER MT\n\n");
+
+	strcpy(dir, "/tmp/test-path-search-XXXXXX");
+	ck_assert_ptr_ne(mkdtemp(dir), NULL);
+	for (i = 0 ; dirs[i] != NULL ; i++)
+		mktree(dir, dirs[i], i * 3 % 7);
+	rc = rp_path_search_add_dirs(&search, dir, 0, 0);
+	ck_assert_int_ge(rc, 0);
+	flags = RP_PATH_SEARCH_FILE | RP_PATH_SEARCH_DIRECTORY | RP_PATH_SEARCH_RECURSIVE;
+
+	/* stop = 0 means no stop, otherwise stop at that callback */
+	for (stop = 0 ; stop <= 40 ; stop += 13) {
+		memset(&ref, 0, sizeof ref);
+		ref.stop = stop;
+		refrc = rp_path_search_filter(search, flags, recordcb, &ref, recordfilter, &ref);
+		ck_assert_ptr_ne(ref.text, NULL);
+		ck_assert_int_eq(refrc, stop ? 77 : 0);
+		for (n = 0 ; n < (int)(sizeof nthreads / sizeof *nthreads) ; n++) {
+			memset(&ev, 0, sizeof ev);
+			ev.stop = stop;
+			rc = rp_path_search_filter_mt(search, flags, recordcb, &ev, recordfilter, &ev, nthreads[n]);
+			printf("stop %d threads %d: %d events\n", stop, nthreads[n], ev.count);
+			ck_assert_int_eq(rc, refrc);
+			ck_assert_ptr_ne(ev.text, NULL);
+			ck_assert_str_eq(ev.text, ref.text);
+			free(ev.text);
+		}
+		free(ref.text);
+	}
+
+	rp_path_search_unref(search);
+	snprintf(cmd, sizeof cmd, "rm -rf %s", dir);
+	ck_assert_int_eq(0, system(cmd));
+#endif
+}
+END_TEST
+
+/*********************************************************************/
+
 static Suite *suite;
 static TCase *tcase;
 
@@ -188,5 +424,8 @@ int main(int ac, char **av)
 		addtcase("path-search");
 			addtest(check_addins);
 			addtest(check_search);
+			addtest(check_index);
+			addtest(check_index_changes);
+			addtest(check_filter_mt);
 	return !!srun();
 }
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <rp-utils/rp-pearson.h>
+#include <rp-utils/rp-strmap.h>
+
+/* count of keys */
+#define NKEYS	100000
+
+/* bytes hashed per measure of throughput */
+#define NBYTES	(64 * 1024 * 1024)
+
+static char **keys;
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void make_keys()
+{
+	static const char *words[] = { "signal", "engine", "speed", "door", "hvac", "gps" };
+	char buffer[100];
+	unsigned i;
+
+	keys = malloc(NKEYS * sizeof *keys);
+	for (i = 0 ; i < NKEYS ; i++) {
+		sprintf(buffer, "%s/%s/%u", words[i % 6], words[(i / 6) % 6], i / 36);
+		keys[i] = strdup(buffer);
+	}
+}
+
+/* chi-square of the distribution of keys in 2^bits buckets, divided by the buckets */
+static double quality(const char *name, unsigned bits, uint64_t (*hash)(const char*))
+{
+	unsigned *counts, i, nb = 1u << bits;
+	double expected = (double)NKEYS / nb, chi = 0, d;
+
+	counts = calloc(nb, sizeof *counts);
+	for (i = 0 ; i < NKEYS ; i++)
+		counts[hash(keys[i]) & (nb - 1)]++;
+	for (i = 0 ; i < nb ; i++) {
+		d = counts[i] - expected;
+		chi += d * d / expected;
+	}
+	free(counts);
+	chi /= nb;
+	printf("%-10s %2u bits: chi2/buckets %6.3f (ideal 1)\n", name, bits, chi);
+	return chi;
+}
+
+static uint64_t h8(const char *text) { return rp_pearson8(text); }
+static uint64_t h16(const char *text) { return rp_pearson16(text); }
+static uint64_t h32(const char *text) { return rp_pearson32(text); }
+static uint64_t h64(const char *text) { return rp_pearson64(text); }
+
+/* count of 32 bits collisions */
+static int cmp32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return x < y ? -1 : x > y;
+}
+static unsigned collisions32()
+{
+	uint32_t *hashes = malloc(NKEYS * sizeof *hashes);
+	unsigned i, n = 0;
+
+	for (i = 0 ; i < NKEYS ; i++)
+		hashes[i] = rp_pearson32(keys[i]);
+	qsort(hashes, NKEYS, sizeof *hashes, cmp32);
+	for (i = 1 ; i < NKEYS ; i++)
+		n += hashes[i] == hashes[i - 1];
+	free(hashes);
+	return n;
+}
+
+/* throughput of hashing texts of length */
+static void throughput(size_t length)
+{
+	char *text = malloc(length);
+	size_t i, n = NBYTES / length;
+	uint64_t sum = 0;
+	double t0, t1, t2;
+
+	for (i = 0 ; i < length ; i++)
+		text[i] = (char)('a' + i % 26);
+	t0 = now();
+	for (i = 0 ; i < n ; i++) {
+		text[0] = (char)i;
+		sum += rp_pearson8_len(text, length);
+	}
+	t1 = now();
+	for (i = 0 ; i < n ; i++) {
+		text[0] = (char)i;
+		sum += rp_pearson64_len(text, length);
+	}
+	t2 = now();
+	printf("length %4u: pearson8 %7.1f MB/s, pearson64 %7.1f MB/s (%u)\n",
+		(unsigned)length, NBYTES / (t1 - t0) * 1e-6, NBYTES / (t2 - t1) * 1e-6,
+		(unsigned)(sum & 1));
+	free(text);
+}
+
+/* check and measure the map */
+static int map()
+{
+	rp_strmap_t *map;
+	unsigned i;
+	void *value;
+	int nerr = 0;
+	double t0, t1, t2, t3;
+
+	if (rp_strmap_create(&map, 0, RP_STRMAP_COPY_KEYS) < 0)
+		return 1;
+	t0 = now();
+	for (i = 0 ; i < NKEYS ; i++)
+		nerr += rp_strmap_add(map, keys[i], keys[i]) != 0;
+	t1 = now();
+	for (i = 0 ; i < NKEYS ; i++)
+		nerr += rp_strmap_get(map, keys[i], &value) != 0 || value != keys[i];
+	t2 = now();
+	for (i = 0 ; i < NKEYS ; i += 2)
+		nerr += rp_strmap_drop(map, keys[i], &value) != 0 || value != keys[i];
+	t3 = now();
+	for (i = 0 ; i < NKEYS ; i++) {
+		nerr += (rp_strmap_get(map, keys[i], NULL) == 0) != (i & 1);
+		nerr += (rp_strmap_get_len(map, keys[i], strlen(keys[i]), NULL) == 0) != (i & 1);
+		nerr += (rp_strmap_get_len(map, keys[i], 5, NULL) == 0);
+	}
+	nerr += rp_strmap_add(map, keys[1], NULL) == 0;
+	nerr += rp_strmap_set(map, keys[1], NULL) != 0;
+	nerr += rp_strmap_get(map, keys[1], &value) != 0 || value != NULL;
+	nerr += rp_strmap_count(map) != NKEYS / 2;
+	rp_strmap_clear(map);
+	nerr += rp_strmap_count(map) != 0 || rp_strmap_get(map, keys[1], NULL) == 0;
+	rp_strmap_destroy(map);
+
+	printf("strmap: add %5.1f ns, get %5.1f ns, drop %5.1f ns\n",
+		(t1 - t0) * 1e9 / NKEYS, (t2 - t1) * 1e9 / NKEYS, (t3 - t2) * 2e9 / NKEYS);
+	if (nerr)
+		fprintf(stderr, "strmap: %d errors\n", nerr);
+	return nerr;
+}
+
+int main(int ac, char **av)
+{
+	unsigned n, i;
+	int nerr = 0;
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	make_keys();
+
+	quality("pearson8", 8, h8);
+	nerr += quality("pearson16", 16, h16) > 1.2;
+	nerr += quality("pearson32", 16, h32) > 1.2;
+	nerr += quality("pearson64", 16, h64) > 1.2;
+	nerr += quality("pearson64", 12, h64) > 1.2;
+	n = collisions32();
+	printf("pearson32 collisions: %u (expected about 1.2)\n", n);
+	nerr += n > 10;
+
+	throughput(8);
+	throughput(32);
+	throughput(256);
+
+	nerr += map();
+
+	for (i = 0 ; i < NKEYS ; i++)
+		free(keys[i]);
+	free(keys);
+	return !!nerr;
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2015-2026 IoT.bzh Company
+ * Author: José Bollo <jose.bollo@iot.bzh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Micro-benchmark of the search of ids in u16id2ptr maps.
+ *
+ * Above U16ID_INDEX_THRESHOLD ids the maps use their index. Compile
+ * u16id.c with -DU16ID_INDEX_THRESHOLD=65535 for measuring the linear
+ * search at all sizes.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "utils/u16id.h"
+
+/* count of searches per size */
+#define NSEARCH	2000000
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* benchmark a map of count ids, half of searches are misses */
+static int bench(unsigned count)
+{
+	struct u16id2ptr *i2p = NULL;
+	uint16_t *keys;
+	unsigned i, n, found = 0, expected = 0;
+	void *ptr;
+	double t;
+	int nerr = 0;
+
+	keys = malloc(2 * count * sizeof *keys);
+	u16id2ptr_create(&i2p);
+	srand(count);
+
+	/* even keys are in the map, odd keys are not */
+	for (i = 0 ; i < 2 * count ; i++) {
+		do {
+			keys[i] = (uint16_t)(rand() & 0xfffe);
+		} while ((i & 1) == 0 && u16id2ptr_has(i2p, keys[i]));
+		if (i & 1)
+			keys[i] |= 1;
+		else
+			u16id2ptr_add(&i2p, keys[i], &keys[i]);
+	}
+	if (u16id2ptr_count(i2p) != (int)count) {
+		fprintf(stderr, "bad count %d for %u\n", u16id2ptr_count(i2p), count);
+		nerr++;
+	}
+
+	t = now();
+	for (i = n = 0 ; i < NSEARCH ; i++) {
+		if (u16id2ptr_get(i2p, keys[n], &ptr) == 0)
+			found += ptr == &keys[n];
+		if (++n == 2 * count)
+			n = 0;
+	}
+	t = now() - t;
+	for (i = n = 0 ; i < NSEARCH ; i++) {
+		expected += (n & 1) == 0;
+		if (++n == 2 * count)
+			n = 0;
+	}
+	if (found != expected) {
+		fprintf(stderr, "found %u instead of %u for %u\n", found, expected, count);
+		nerr++;
+	}
+	printf("%5u ids: %7.2f ns/search\n", count, t * 1e9 / NSEARCH);
+
+	u16id2ptr_destroy(&i2p);
+	free(keys);
+	return nerr;
+}
+
+int main(int ac, char **av)
+{
+	unsigned count;
+	int nerr = 0;
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	for (count = 4 ; count <= 1024 ; count <<= 1)
+		nerr += bench(count);
+	return !!nerr;
+}
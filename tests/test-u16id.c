@@ -0,0 +1,293 @@
+/*
+ Copyright (C) 2015-2026 IoT.bzh Company
+
+ Author: José Bollo <jose.bollo@iot.bzh>
+
+ $RP_BEGIN_LICENSE$
+ Commercial License Usage
+  Licensees holding valid commercial IoT.bzh licenses may use this file in
+  accordance with the commercial license agreement provided with the
+  Software or, alternatively, in accordance with the terms contained in
+  a written agreement between you and The IoT.bzh Company. For licensing terms
+  and conditions see https://www.iot.bzh/terms-conditions. For further
+  information use the contact form at https://www.iot.bzh/contact.
+
+ GNU General Public License Usage
+  Alternatively, this file may be used under the terms of the GNU General
+  Public license version 3. This license is as published by the Free Software
+  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+  of this file. Please review the following information to ensure the GNU
+  General Public License requirements will be met
+  https://www.gnu.org/licenses/gpl-3.0.html.
+ $RP_END_LICENSE$
+*/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "sys/x-errno.h"
+
+#include <rp-utils/u16id.h>
+
+/*********************************************************************/
+
+/*
+ * Model of a u16id2ptr: the ids in the documented order, that is
+ * the order of addition except that a dropped item is replaced
+ * by the last one
+ */
+struct model {
+	uint16_t ids[65536];
+	int count;
+};
+
+/* the pointer associated to id */
+void *ptrof(uint16_t id)
+{
+	return (void*)(intptr_t)(id * 3 + 1);
+}
+
+/* add id to the model */
+void model_add(struct model *m, uint16_t id)
+{
+	m->ids[m->count++] = id;
+}
+
+/* drop the item at position idx of the model */
+void model_drop(struct model *m, int idx)
+{
+	m->ids[idx] = m->ids[--m->count];
+}
+
+struct forall {
+	struct model *m;
+	int next;
+};
+
+void forallcb(void *closure, uint16_t id, void *ptr)
+{
+	struct forall *f = closure;
+
+	ck_assert_int_gt(f->next, 0);
+	f->next--;
+	ck_assert_int_eq(id, f->m->ids[f->next]);
+	ck_assert_ptr_eq(ptr, ptrof(id));
+}
+
+/* check that i2p matches the model m */
+void check_model(struct u16id2ptr *i2p, struct model *m)
+{
+	struct forall f;
+	uint16_t id;
+	void *ptr;
+	int i;
+
+	ck_assert_int_eq(u16id2ptr_count(i2p), m->count);
+	for (i = 0 ; i < m->count ; i++) {
+		ck_assert_int_eq(0, u16id2ptr_at(i2p, i, &id, &ptr));
+		ck_assert_int_eq(id, m->ids[i]);
+		ck_assert_ptr_eq(ptr, ptrof(id));
+		ck_assert_int_eq(1, u16id2ptr_has(i2p, id));
+		ck_assert_int_eq(0, u16id2ptr_get(i2p, id, &ptr));
+		ck_assert_ptr_eq(ptr, ptrof(id));
+	}
+	ck_assert_int_eq(X_EINVAL, u16id2ptr_at(i2p, m->count, &id, &ptr));
+	ck_assert_int_eq(X_EINVAL, u16id2ptr_at(i2p, -1, &id, &ptr));
+	f.m = m;
+	f.next = m->count;
+	u16id2ptr_forall(i2p, forallcb, &f);
+	ck_assert_int_eq(f.next, 0);
+}
+
+/* a random id not in the model */
+uint16_t newid(struct u16id2ptr *i2p)
+{
+	uint16_t id;
+
+	do {
+		id = (uint16_t)rand();
+	} while (u16id2ptr_has(i2p, id));
+	return id;
+}
+
+/*********************************************************************/
+
+START_TEST (check_order)
+{
+	static struct model m;
+	struct u16id2ptr *i2p;
+	uint16_t id;
+	int i;
+
+	fprintf(stdout, "\n************************************ CHECK ORDER\n\n");
+
+	srand(36);
+	m.count = 0;
+	ck_assert_int_eq(0, u16id2ptr_create(&i2p));
+	check_model(i2p, &m);
+
+	/* grow far above the threshold of the index */
+	for (i = 0 ; i < 300 ; i++) {
+		id = newid(i2p);
+		ck_assert_int_eq(0, u16id2ptr_add(&i2p, id, ptrof(id)));
+		model_add(&m, id);
+		if (i % 7 == 0)
+			check_model(i2p, &m);
+	}
+	check_model(i2p, &m);
+	ck_assert_int_eq(X_EEXIST, u16id2ptr_add(&i2p, m.ids[0], NULL));
+
+	/* drop in the middle, at end, at start */
+	ck_assert_int_eq(0, u16id2ptr_drop(&i2p, m.ids[150], NULL));
+	model_drop(&m, 150);
+	ck_assert_int_eq(0, u16id2ptr_drop(&i2p, m.ids[m.count - 1], NULL));
+	model_drop(&m, m.count - 1);
+	ck_assert_int_eq(0, u16id2ptr_drop(&i2p, m.ids[0], NULL));
+	model_drop(&m, 0);
+	check_model(i2p, &m);
+
+	/* set and put don't change the order */
+	ck_assert_int_eq(0, u16id2ptr_set(&i2p, m.ids[10], ptrof(m.ids[10])));
+	ck_assert_int_eq(0, u16id2ptr_put(i2p, m.ids[20], ptrof(m.ids[20])));
+	check_model(i2p, &m);
+
+	u16id2ptr_dropall(&i2p);
+	m.count = 0;
+	check_model(i2p, &m);
+	u16id2ptr_destroy(&i2p);
+	ck_assert_ptr_eq(i2p, NULL);
+}
+END_TEST
+
+/*********************************************************************/
+
+START_TEST (check_drop)
+{
+	static struct model m;
+	struct u16id2ptr *i2p;
+	uint16_t id;
+	void *ptr;
+	int i, round, idx, high;
+
+	fprintf(stdout, "\n************************************ CHECK DROP\n\n");
+
+	srand(37);
+	m.count = 0;
+	ck_assert_int_eq(0, u16id2ptr_create(&i2p));
+
+	/* oscillate around the thresholds of creation and release of the index */
+	for (round = 0 ; round < 8 ; round++) {
+		high = 40 + round * 20;
+		while (m.count < high) {
+			id = newid(i2p);
+			ck_assert_int_eq(0, u16id2ptr_add(&i2p, id, ptrof(id)));
+			model_add(&m, id);
+		}
+		check_model(i2p, &m);
+		for (i = m.count / 2 + round ; i > 0 && m.count ; i--) {
+			idx = rand() % m.count;
+			ptr = NULL;
+			ck_assert_int_eq(0, u16id2ptr_drop(&i2p, m.ids[idx], &ptr));
+			ck_assert_ptr_eq(ptr, ptrof(m.ids[idx]));
+			id = m.ids[idx];
+			model_drop(&m, idx);
+			ck_assert_int_eq(0, u16id2ptr_has(i2p, id));
+			ck_assert_int_eq(X_ENOENT, u16id2ptr_get(i2p, id, &ptr));
+			ck_assert_int_eq(X_ENOENT, u16id2ptr_drop(&i2p, id, &ptr));
+			ck_assert_int_eq(X_ENOENT, u16id2ptr_put(i2p, id, ptr));
+		}
+		check_model(i2p, &m);
+	}
+
+	/* drop all one by one, shrinking the map */
+	while (m.count) {
+		ck_assert_int_eq(0, u16id2ptr_drop(&i2p, m.ids[0], NULL));
+		model_drop(&m, 0);
+		if (m.count % 5 == 0)
+			check_model(i2p, &m);
+	}
+	check_model(i2p, &m);
+
+	/* still usable after being emptied */
+	ck_assert_int_eq(0, u16id2ptr_add(&i2p, 1234, ptrof(1234)));
+	model_add(&m, 1234);
+	check_model(i2p, &m);
+	u16id2ptr_destroy(&i2p);
+}
+END_TEST
+
+/*********************************************************************/
+
+START_TEST (check_bool)
+{
+	static unsigned char ref[65536];
+	struct u16id2bool *i2b;
+	int i, id, value;
+
+	fprintf(stdout, "\n************************************ CHECK BOOL\n\n");
+
+	srand(38);
+	memset(ref, 0, sizeof ref);
+	ck_assert_int_eq(0, u16id2bool_create(&i2b));
+
+	/* set values spread over many more words than the threshold of the index */
+	for (i = 0 ; i < 20000 ; i++) {
+		id = rand() & 0xffff;
+		value = (rand() & 3) != 0;
+		ck_assert_int_eq(ref[id], u16id2bool_set(&i2b, (uint16_t)id, value));
+		ref[id] = (unsigned char)value;
+	}
+	for (id = 0 ; id < 65536 ; id++)
+		ck_assert_int_eq(ref[id], u16id2bool_get(i2b, (uint16_t)id));
+
+	/* clear most of them, releasing the index */
+	for (id = 0 ; id < 65536 ; id++)
+		if (ref[id] && (id & 0xfff) != 0) {
+			ck_assert_int_eq(1, u16id2bool_set(&i2b, (uint16_t)id, 0));
+			ref[id] = 0;
+		}
+	for (id = 0 ; id < 65536 ; id++)
+		ck_assert_int_eq(ref[id], u16id2bool_get(i2b, (uint16_t)id));
+
+	/* clear all */
+	u16id2bool_clearall(&i2b);
+	for (id = 0 ; id < 65536 ; id++)
+		ck_assert_int_eq(0, u16id2bool_get(i2b, (uint16_t)id));
+	ck_assert_int_eq(0, u16id2bool_set(&i2b, 77, 1));
+	ck_assert_int_eq(1, u16id2bool_get(i2b, 77));
+	u16id2bool_destroy(&i2b);
+}
+END_TEST
+
+/*********************************************************************/
+
+static Suite *suite;
+static TCase *tcase;
+
+void mksuite(const char *name) { suite = suite_create(name); }
+void addtcase(const char *name) { tcase = tcase_create(name); suite_add_tcase(suite, tcase); tcase_set_timeout(tcase, 120); }
+#define addtest(test) tcase_add_test(tcase, test)
+int srun()
+{
+	int nerr;
+	SRunner *srunner = srunner_create(suite);
+	srunner_run_all(srunner, CK_NORMAL);
+	nerr = srunner_ntests_failed(srunner);
+	srunner_free(srunner);
+	return nerr;
+}
+
+int main(int ac, char **av)
+{
+	mksuite("u16id");
+		addtcase("u16id");
+			addtest(check_order);
+			addtest(check_drop);
+			addtest(check_bool);
+	return !!srun();
+}
@@ -0,0 +1,377 @@
+/*
+ Copyright (C) 2015-2026 IoT.bzh Company
+
+ Author: José Bollo <jose.bollo@iot.bzh>
+
+ $RP_BEGIN_LICENSE$
+ Commercial License Usage
+  Licensees holding valid commercial IoT.bzh licenses may use this file in
+  accordance with the commercial license agreement provided with the
+  Software or, alternatively, in accordance with the terms contained in
+  a written agreement between you and The IoT.bzh Company. For licensing terms
+  and conditions see https://www.iot.bzh/terms-conditions. For further
+  information use the contact form at https://www.iot.bzh/contact.
+
+ GNU General Public License Usage
+  Alternatively, this file may be used under the terms of the GNU General
+  Public license version 3. This license is as published by the Free Software
+  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+  of this file. Please review the following information to ensure the GNU
+  General Public License requirements will be met
+  https://www.gnu.org/licenses/gpl-3.0.html.
+ $RP_END_LICENSE$
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include <check.h>
+
+#include <rp-utils/rp-verbose.h>
+
+/*********************************************************************/
+
+#define NTHREADS  8
+#define NMSGS     500
+
+int savedfd = -1;
+
+/* redirect the standard error to the file descriptor 'fd' */
+void redirect(int fd)
+{
+	if (savedfd < 0)
+		savedfd = dup(STDERR_FILENO);
+	ck_assert_int_ge(savedfd, 0);
+	ck_assert_int_eq(STDERR_FILENO, dup2(fd, STDERR_FILENO));
+}
+
+/* restore the standard error */
+void restore()
+{
+	ck_assert_int_eq(STDERR_FILENO, dup2(savedfd, STDERR_FILENO));
+}
+
+/* redirect the standard error to a temporary file */
+FILE *capture()
+{
+	FILE *file = tmpfile();
+
+	ck_assert_ptr_ne(file, NULL);
+	redirect(fileno(file));
+	return file;
+}
+
+/* restore the standard error and return the content of the captured 'file' */
+char *captured(FILE *file)
+{
+	char *content;
+	long size;
+
+	restore();
+	ck_assert_int_eq(0, fseek(file, 0, SEEK_END));
+	size = ftell(file);
+	ck_assert_int_ge(size, 0);
+	content = malloc((size_t)size + 1);
+	ck_assert_ptr_ne(content, NULL);
+	rewind(file);
+	ck_assert_int_eq((size_t)size, fread(content, 1, (size_t)size, file));
+	content[size] = 0;
+	fclose(file);
+	return content;
+}
+
+/* sum the counts of dropped messages reported in 'text' */
+unsigned long reported_drops(const char *text)
+{
+	const char *iter;
+	unsigned long sum = 0;
+
+	for (iter = text ; (iter = strstr(iter, "WARNING: ")) != NULL ; ) {
+		iter += 9;
+		if (strstr(iter, " log messages dropped\n") == strchr(iter, ' '))
+			sum += strtoul(iter, NULL, 10);
+	}
+	return sum;
+}
+
+/*********************************************************************/
+
+void *writer(void *arg)
+{
+	int i, id = (int)(intptr_t)arg;
+
+	for (i = 0 ; i < NMSGS ; i++)
+		rp_verbose(rp_Log_Level_Notice, NULL, 0, NULL, "T%d %d", id, i);
+	return NULL;
+}
+
+START_TEST (check_async)
+{
+	pthread_t tids[NTHREADS];
+	int next[NTHREADS];
+	char *content, *line;
+	int i, id, num, count, crit;
+	FILE *file;
+
+	fprintf(stdout, "\n************************************ CHECK ASYNC\n\n");
+
+	rp_set_logmask(rp_Log_Mask_Notice);
+	file = capture();
+	ck_assert_int_eq(0, rp_verbose_async_start(1 << 20));
+	ck_assert_int_eq(-EBUSY, rp_verbose_async_start(0));
+	for (i = 0 ; i < NTHREADS ; i++)
+		ck_assert_int_eq(0, pthread_create(&tids[i], NULL, writer, (void*)(intptr_t)i));
+	for (i = 0 ; i < NTHREADS ; i++)
+		pthread_join(tids[i], NULL);
+
+	/* critical messages are written immediately */
+	rp_verbose(rp_Log_Level_Critical, NULL, 0, NULL, "last");
+	rp_verbose_async_stop();
+	content = captured(file);
+	ck_assert_int_eq(0, (int)rp_verbose_async_dropped());
+
+	/* messages of each thread are complete and in order */
+	memset(next, 0, sizeof next);
+	count = crit = 0;
+	for (line = strtok(content, "\n") ; line != NULL ; line = strtok(NULL, "\n")) {
+		if (sscanf(line, "<5> NOTICE: T%d %d", &id, &num) == 2) {
+			ck_assert_int_ge(id, 0);
+			ck_assert_int_lt(id, NTHREADS);
+			ck_assert_int_eq(num, next[id]);
+			next[id]++;
+			count++;
+		}
+		else {
+			ck_assert_str_eq(line, "<2> CRITICAL: last");
+			crit++;
+		}
+	}
+	ck_assert_int_eq(count, NTHREADS * NMSGS);
+	ck_assert_int_eq(crit, 1);
+	free(content);
+}
+END_TEST
+
+/*********************************************************************/
+
+struct reader {
+	int fd;
+	char *content;
+	size_t size;
+};
+
+void *reader(void *arg)
+{
+	struct reader *r = arg;
+	char buffer[4096];
+	ssize_t sz;
+
+	while ((sz = read(r->fd, buffer, sizeof buffer)) > 0) {
+		r->content = realloc(r->content, r->size + (size_t)sz + 1);
+		ck_assert_ptr_ne(r->content, NULL);
+		memcpy(&r->content[r->size], buffer, (size_t)sz);
+		r->size += (size_t)sz;
+		r->content[r->size] = 0;
+	}
+	return NULL;
+}
+
+START_TEST (check_drop)
+{
+	struct reader r;
+	pthread_t tid;
+	char text[200];
+	unsigned long dropped;
+	int fds[2], i, count;
+	char *iter;
+
+	fprintf(stdout, "\n************************************ CHECK DROP\n\n");
+
+	/* nobody reads the pipe, so the flusher blocks and the ring overflows */
+	rp_set_logmask(rp_Log_Mask_Notice);
+	ck_assert_int_eq(0, pipe(fds));
+	redirect(fds[1]);
+	close(fds[1]);
+	ck_assert_int_eq(0, rp_verbose_async_start(8192));
+	memset(text, 'x', sizeof text - 1);
+	text[sizeof text - 1] = 0;
+	for (i = 0 ; i < 2000 ; i++)
+		rp_verbose(rp_Log_Level_Notice, NULL, 0, NULL, "M %s", text);
+	dropped = rp_verbose_async_dropped();
+	ck_assert_int_gt((int)dropped, 0);
+
+	/* read everything */
+	memset(&r, 0, sizeof r);
+	r.fd = fds[0];
+	ck_assert_int_eq(0, pthread_create(&tid, NULL, reader, &r));
+	rp_verbose_async_stop();
+	restore();
+	pthread_join(tid, NULL);
+	close(fds[0]);
+
+	/* written and dropped messages are all counted */
+	ck_assert_ptr_ne(r.content, NULL);
+	for (count = 0, iter = r.content ; (iter = strstr(iter, "<5> NOTICE: M ")) != NULL ; iter++)
+		count++;
+	printf("written %d dropped %lu\n", count, dropped);
+	ck_assert_int_eq((unsigned long)count + dropped, 2000);
+	ck_assert_int_eq(dropped, reported_drops(r.content));
+	free(r.content);
+}
+END_TEST
+
+/*********************************************************************/
+
+void *churner(void *arg)
+{
+	/* critical messages flush while the flusher reclaims rings */
+	rp_verbose(rp_Log_Level_Notice, NULL, 0, NULL, "C%d", (int)(intptr_t)arg);
+	rp_verbose(rp_Log_Level_Critical, NULL, 0, NULL, "X%d", (int)(intptr_t)arg);
+	return NULL;
+}
+
+void *spawner(void *arg)
+{
+	pthread_t tid;
+	int i, base = 16 * (int)(intptr_t)arg;
+
+	for (i = 0 ; i < 16 ; i++) {
+		ck_assert_int_eq(0, pthread_create(&tid, NULL, churner, (void*)(intptr_t)(base + i)));
+		pthread_join(tid, NULL);
+	}
+	return NULL;
+}
+
+START_TEST (check_reclaim)
+{
+	pthread_t tids[4];
+	char *content, name[40];
+	int i;
+	FILE *file;
+#if defined(__GLIBC__)
+	struct mallinfo2 before, after;
+
+	/* all the threads allocate in the main arena */
+	mallopt(M_ARENA_MAX, 1);
+	before = mallinfo2();
+#endif
+
+	fprintf(stdout, "\n************************************ CHECK RECLAIM\n\n");
+
+	/* each thread gets a ring of 1M and exits, the rings must be released */
+	rp_set_logmask(rp_Log_Mask_Notice);
+	file = capture();
+	ck_assert_int_eq(0, rp_verbose_async_start(1 << 20));
+	for (i = 0 ; i < 4 ; i++)
+		ck_assert_int_eq(0, pthread_create(&tids[i], NULL, spawner, (void*)(intptr_t)i));
+	for (i = 0 ; i < 4 ; i++)
+		pthread_join(tids[i], NULL);
+	rp_verbose_async_stop();
+	content = captured(file);
+
+#if defined(__GLIBC__)
+	/* the rings of the exited threads were released */
+	after = mallinfo2();
+	printf("allocated before %zu after %zu\n",
+		before.uordblks + before.hblkhd, after.uordblks + after.hblkhd);
+	ck_assert_int_lt(after.uordblks + after.hblkhd, before.uordblks + before.hblkhd + (8 << 20));
+#endif
+
+	/* no message was lost */
+	for (i = 0 ; i < 64 ; i++) {
+		snprintf(name, sizeof name, "<5> NOTICE: C%d\n", i);
+		ck_assert_ptr_ne(strstr(content, name), NULL);
+		snprintf(name, sizeof name, "<2> CRITICAL: X%d\n", i);
+		ck_assert_ptr_ne(strstr(content, name), NULL);
+	}
+	free(content);
+}
+END_TEST
+
+/*********************************************************************/
+
+void messages()
+{
+	static char big[5000];
+
+	memset(big, 'y', sizeof big - 1);
+	rp_verbose(rp_Log_Level_Notice, NULL, 0, NULL, "%*d|%-*d|%0*d|", 5, 1, 5, 2, 5, 3);
+	rp_verbose(rp_Log_Level_Notice, NULL, 0, NULL, "%*d|%0*d|%*s|", -5, 4, -5, 5, -8, "neg");
+	rp_verbose(rp_Log_Level_Notice, NULL, 0, NULL, "%.*s|%.*s|%.*s|", 3, "precision", 0, "zero", -1, "negprec");
+	rp_verbose(rp_Log_Level_Notice, NULL, 0, NULL, "%*.*f|%-*.*e|%.*f|", 10, 3, 3.14159, -12, 2, 2.5, -1, 1.5);
+	rp_verbose(rp_Log_Level_Notice, NULL, 0, NULL, "%ld|%lld|%zu|%hhx|%c|%p|", -6L, 7LL, (size_t)8, 0x1ff, 'z', NULL);
+	rp_verbose(rp_Log_Level_Notice, NULL, 0, NULL, "100%%|%s|%5s|%.3s|", (char*)NULL, (char*)NULL, (char*)NULL);
+	errno = EACCES;
+	rp_verbose(rp_Log_Level_Notice, NULL, 0, NULL, "%m|%d|", 9);
+	rp_verbose(rp_Log_Level_Notice, NULL, 0, NULL, "%s|%s|", big, "after");
+	rp_verbose(rp_Log_Level_Notice, NULL, 0, NULL, "%.*s|%s|", 4500, big, "after");
+	rp_verbose(rp_Log_Level_Notice, NULL, 0, NULL, "%4000d|%s|", 10, "after");
+	rp_verbose(rp_Log_Level_Notice, NULL, 0, NULL, "end");
+}
+
+START_TEST (check_deferred)
+{
+	char *sync, *deferred;
+	FILE *file;
+
+	fprintf(stdout, "\n************************************ CHECK DEFERRED\n\n");
+
+	rp_set_logmask(rp_Log_Mask_Notice);
+
+	/* formatted at call */
+	file = capture();
+	messages();
+	sync = captured(file);
+	ck_assert_ptr_ne(strstr(sync, "<5> NOTICE:     1|2    |00003|\n"), NULL);
+	ck_assert_ptr_ne(strstr(sync, "<5> NOTICE: pre||negprec|\n"), NULL);
+	ck_assert_ptr_ne(strstr(sync, "<5> NOTICE: end\n"), NULL);
+
+	/* formatted by the flusher */
+	file = capture();
+	ck_assert_int_eq(0, rp_verbose_async_start(1 << 20));
+	messages();
+	rp_verbose_async_stop();
+	deferred = captured(file);
+
+	ck_assert_str_eq(sync, deferred);
+	free(sync);
+	free(deferred);
+}
+END_TEST
+
+/*********************************************************************/
+
+static Suite *suite;
+static TCase *tcase;
+
+void mksuite(const char *name) { suite = suite_create(name); }
+void addtcase(const char *name) { tcase = tcase_create(name); suite_add_tcase(suite, tcase); tcase_set_timeout(tcase, 120); }
+#define addtest(test) tcase_add_test(tcase, test)
+int srun()
+{
+	int nerr;
+	SRunner *srunner = srunner_create(suite);
+	srunner_run_all(srunner, CK_NORMAL);
+	nerr = srunner_ntests_failed(srunner);
+	srunner_free(srunner);
+	return nerr;
+}
+
+int main(int ac, char **av)
+{
+	mksuite("verbose");
+		addtcase("verbose");
+			addtest(check_async);
+			addtest(check_deferred);
+			addtest(check_drop);
+			addtest(check_reclaim);
+	return !!srun();
+}
@@ -0,0 +1,187 @@
+/*
+ Copyright (C) 2015-2026 IoT.bzh Company
+
+ Author: José Bollo <jose.bollo@iot.bzh>
+
+ $RP_BEGIN_LICENSE$
+ Commercial License Usage
+  Licensees holding valid commercial IoT.bzh licenses may use this file in
+  accordance with the commercial license agreement provided with the
+  Software or, alternatively, in accordance with the terms contained in
+  a written agreement between you and The IoT.bzh Company. For licensing terms
+  and conditions see https://www.iot.bzh/terms-conditions. For further
+  information use the contact form at https://www.iot.bzh/contact.
+
+ GNU General Public License Usage
+  Alternatively, this file may be used under the terms of the GNU General
+  Public license version 3. This license is as published by the Free Software
+  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+  of this file. Please review the following information to ensure the GNU
+  General Public License requirements will be met
+  https://www.gnu.org/licenses/gpl-3.0.html.
+ $RP_END_LICENSE$
+*/
+
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+
+#include <check.h>
+#if !defined(ck_assert_ptr_null)
+# define ck_assert_ptr_null(X)      ck_assert_ptr_eq(X, NULL)
+# define ck_assert_ptr_nonnull(X)   ck_assert_ptr_ne(X, NULL)
+#endif
+
+/*********************************************************************/
+
+#include <rp-utils/rp-yaml.h>
+#include <rp-utils/rp-jsonc.h>
+
+/*********************************************************************/
+
+const char yaml[] =
+	"name: test\n"
+	"version: 1.5\n"
+	"count: 42\n"
+	"enabled: true\n"
+	"nothing: null\n"
+	"quoted: \"with \\\"quotes\\\" and \\ttab\"\n"
+	"base: &base\n"
+	"  host: localhost\n"
+	"  ports: [ 80, 443 ]\n"
+	"copy: *base\n"
+	"list:\n"
+	"  - &item one\n"
+	"  - two\n"
+	"  - *item\n"
+	"  - { a: 1, b: [ x, y ] }\n"
+	"  - []\n"
+	"  - {}\n";
+
+START_TEST (check_text)
+{
+	struct json_object *tree, *text;
+	char *buffer;
+	size_t size;
+	FILE *output;
+	int rc;
+
+	output = open_memstream(&buffer, &size);
+	ck_assert_ptr_nonnull(output);
+	rc = rp_yaml_buffer_to_json_text(output, yaml, sizeof yaml - 1);
+	fclose(output);
+	ck_assert_int_eq(rc, 0);
+	printf("text: %s\n", buffer);
+	text = json_tokener_parse(buffer);
+	ck_assert_ptr_nonnull(text);
+
+	rc = rp_yaml_buffer_to_json_c(&tree, yaml, sizeof yaml - 1, NULL);
+	ck_assert_int_eq(rc, 0);
+	printf("tree: %s\n", json_object_to_json_string(tree));
+	ck_assert_int_eq(0, rp_jsonc_cmp(tree, text));
+
+	json_object_put(tree);
+	json_object_put(text);
+	free(buffer);
+}
+END_TEST
+
+/*********************************************************************/
+
+struct counts {
+	int events;
+	int starts;
+	int ends;
+	size_t lastline;
+};
+
+int countcb(void *closure, const rp_yaml_event_t *event)
+{
+	struct counts *c = closure;
+
+	c->events++;
+	if (event->type == rp_yaml_event_object_start || event->type == rp_yaml_event_array_start)
+		c->starts++;
+	if (event->type == rp_yaml_event_object_end || event->type == rp_yaml_event_array_end)
+		c->ends++;
+	if (event->type == rp_yaml_event_string && event->key && !strcmp(event->key, "name"))
+		ck_assert_str_eq(event->text, "test");
+	ck_assert_int_ge(event->line, c->lastline);
+	c->lastline = event->line;
+	return c->events == 1000 ? -1000 : 0;
+}
+
+int nullcb(void *closure, const rp_yaml_event_t *event)
+{
+	return 0;
+}
+
+const char laughs[] =
+	"a: &a [ lol, lol, lol, lol, lol, lol, lol, lol, lol ]\n"
+	"b: &b [ *a, *a, *a, *a, *a, *a, *a, *a, *a ]\n"
+	"c: &c [ *b, *b, *b, *b, *b, *b, *b, *b, *b ]\n"
+	"d: &d [ *c, *c, *c, *c, *c, *c, *c, *c, *c ]\n"
+	"e: &e [ *d, *d, *d, *d, *d, *d, *d, *d, *d ]\n"
+	"f: &f [ *e, *e, *e, *e, *e, *e, *e, *e, *e ]\n"
+	"g: &g [ *f, *f, *f, *f, *f, *f, *f, *f, *f ]\n"
+	"h: &h [ *g, *g, *g, *g, *g, *g, *g, *g, *g ]\n"
+	"i: &i [ *h, *h, *h, *h, *h, *h, *h, *h, *h ]\n";
+
+START_TEST (check_events)
+{
+	struct counts c;
+	int rc;
+
+	memset(&c, 0, sizeof c);
+	rc = rp_yaml_buffer_to_events(yaml, sizeof yaml - 1, 0, countcb, &c);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(c.starts, c.ends);
+	ck_assert_int_eq(c.starts, 10);
+	ck_assert_int_eq(c.lastline, 0);
+
+	memset(&c, 0, sizeof c);
+	rc = rp_yaml_buffer_to_events(yaml, sizeof yaml - 1, RP_YAML_LINES, countcb, &c);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(c.lastline, 18);
+
+	/* errors */
+	memset(&c, 0, sizeof c);
+	rc = rp_yaml_buffer_to_events("a: *unknown\n", 12, 0, countcb, &c);
+	ck_assert_int_lt(rc, 0);
+	rc = rp_yaml_buffer_to_events("a: [ b\n", 7, 0, countcb, &c);
+	ck_assert_int_lt(rc, 0);
+	rc = rp_yaml_buffer_to_events(laughs, sizeof laughs - 1, 0, nullcb, NULL);
+	ck_assert_int_eq(rc, -E2BIG);
+}
+END_TEST
+
+/*********************************************************************/
+
+static Suite *suite;
+static TCase *tcase;
+
+void mksuite(const char *name) { suite = suite_create(name); }
+void addtcase(const char *name) { tcase = tcase_create(name); suite_add_tcase(suite, tcase); }
+#define addtest(test) tcase_add_test(tcase, test)
+int srun()
+{
+	int nerr;
+	SRunner *srunner = srunner_create(suite);
+	srunner_run_all(srunner, CK_NORMAL);
+	nerr = srunner_ntests_failed(srunner);
+	srunner_free(srunner);
+	return nerr;
+}
+
+int main(int ac, char **av)
+{
+	mksuite("yaml-events");
+		addtcase("yaml-events");
+			addtest(check_text);
+			addtest(check_events);
+	return !!srun();
+}